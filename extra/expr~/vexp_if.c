@@ -896,11 +896,11 @@ max_ex_tab(struct expr *expr, fts_symbol_t s, struct ex_ex *arg,
 {
 #ifdef PD
         t_garray *garray;
-        int size, indx;
-        t_word *wvec;
+        int size, indx, stride;
+        t_float *vec;
 
         if (!s || !(garray = (t_garray *)pd_findbyclass(s, garray_class)) ||
-            !garray_getfloatwords(garray, &size, &wvec))
+            !garray_getfloatvec(garray, &size, &vec, &stride))
         {
                 optr->ex_type = ET_FLT;
                 optr->ex_flt = 0;
@@ -924,7 +924,7 @@ max_ex_tab(struct expr *expr, fts_symbol_t s, struct ex_ex *arg,
         }
         if (indx < 0) indx = 0;
         else if (indx >= size) indx = size - 1;
-        optr->ex_flt = wvec[indx].w_float;
+        optr->ex_flt = vec[indx * stride];
 #else /* MSP */
         /*
          * table lookup not done for MSP yet
@@ -952,9 +952,9 @@ max_ex_var(struct expr *expr, fts_symbol_t var, struct ex_ex *optr)
 #ifdef PD /* this goes to the end of this file as the following functions
            * should be defined in the expr object in MSP
            */
-#define ISTABLE(sym, garray, size, vec)                               \
+#define ISTABLE(sym, garray, size, vec, stride)                       \
 if (!sym || !(garray = (t_garray *)pd_findbyclass(sym, garray_class)) || \
-                !garray_getfloatwords(garray, &size, &vec))  {          \
+                !garray_getfloatvec(garray, &size, &vec, &stride))  {   \
         optr->ex_type = ET_FLT;                                         \
         optr->ex_int = 0;                                               \
         error("no such table '%s'", sym?(sym->s_name):"(null)");                       \
@@ -969,8 +969,8 @@ ex_size(t_expr *e, long int argc, struct ex_ex *argv, struct ex_ex *optr)
 {
         t_symbol *s;
         t_garray *garray;
-        int size;
-        t_word *wvec;
+        int size, stride;
+        t_float *vec;
 
         if (argv->ex_type != ET_SYM)
         {
@@ -982,7 +982,7 @@ ex_size(t_expr *e, long int argc, struct ex_ex *argv, struct ex_ex *optr)
 
         s = (fts_symbol_t ) argv->ex_ptr;
 
-        ISTABLE(s, garray, size, wvec);
+        ISTABLE(s, garray, size, vec, stride);
 
         optr->ex_type = ET_INT;
         optr->ex_int = size;
@@ -997,8 +997,8 @@ ex_sum(t_expr *e, long int argc, struct ex_ex *argv, struct ex_ex *optr)
 {
         t_symbol *s;
         t_garray *garray;
-        int size;
-        t_word *wvec;
+        int size, stride;
+        t_float *vec;
         t_float sum;
         int indx;
 
@@ -1012,10 +1012,10 @@ ex_sum(t_expr *e, long int argc, struct ex_ex *argv, struct ex_ex *optr)
 
         s = (fts_symbol_t ) argv->ex_ptr;
 
-        ISTABLE(s, garray, size, wvec);
+        ISTABLE(s, garray, size, vec, stride);
 
         for (indx = 0, sum = 0; indx < size; indx++)
-                sum += wvec[indx].w_float;
+                sum += vec[indx * stride];
 
         optr->ex_type = ET_FLT;
         optr->ex_flt = sum;
@@ -1031,8 +1031,8 @@ ex_Sum(t_expr *e, long int argc, struct ex_ex *argv, struct ex_ex *optr)
 {
         t_symbol *s;
         t_garray *garray;
-        int size;
-        t_word *wvec;
+        int size, stride;
+        t_float *vec;
         t_float sum;
         int indx, n1, n2;
 
@@ -1046,7 +1046,7 @@ ex_Sum(t_expr *e, long int argc, struct ex_ex *argv, struct ex_ex *optr)
 
         s = (fts_symbol_t ) argv->ex_ptr;
 
-        ISTABLE(s, garray, size, wvec);
+        ISTABLE(s, garray, size, vec, stride);
 
         if (argv->ex_type != ET_INT || argv[1].ex_type != ET_INT)
         {
@@ -1060,7 +1060,7 @@ ex_Sum(t_expr *e, long int argc, struct ex_ex *argv, struct ex_ex *optr)
 
         for (indx = n1, sum = 0; indx < n2; indx++)
                 if (indx >= 0 && indx < size)
-                        sum += wvec[indx].w_float;
+                        sum += vec[indx * stride];
 
         optr->ex_type = ET_FLT;
         optr->ex_flt = sum;
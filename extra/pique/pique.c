@@ -182,17 +182,21 @@ static void pique_list(t_pique *x, t_symbol *s, int argc, t_atom *argv)
     t_symbol *symreal = atom_getsymbolarg(1, argc, argv);
     t_symbol *symimag = atom_getsymbolarg(2, argc, argv);
     int npeak = atom_getintarg(3, argc, argv);
-    int n;
+    int n, realstride, imagstride;
     t_garray *a;
-    t_word *fpreal, *fpimag;
-    if (npts < 8 || npeak < 1) error("pique: bad npoints or npeak");
+    t_float *vecreal, *vecimag;
+    if (npts < 8 || npeak < 1)
+    {
+        error("pique: bad npoints or npeak");
+        return;
+    }
     if (npeak > x->x_n) npeak = x->x_n;
     if (!(a = (t_garray *)pd_findbyclass(symreal, garray_class)) ||
-        !garray_getfloatwords(a, &n, &fpreal) ||
+        !garray_getfloatvec(a, &n, &vecreal, &realstride) ||
             n < npts)
                 error("%s: missing or bad array", symreal->s_name);
     else if (!(a = (t_garray *)pd_findbyclass(symimag, garray_class)) ||
-        !garray_getfloatwords(a, &n, &fpimag) ||
+        !garray_getfloatvec(a, &n, &vecimag, &imagstride) ||
             n < npts)
                 error("%s: missing or bad array", symimag->s_name);
     else
@@ -202,8 +206,18 @@ static void pique_list(t_pique *x, t_symbol *s, int argc, t_atom *argv)
         t_float *fpamp = x->x_amp;
         t_float *fpampre = x->x_ampre;
         t_float *fpampim = x->x_ampim;
+            /* the arrays may be packed or mapped (see garray_getfloatvec());
+            copy them out so the analysis can step through words. */
+        t_word *fpreal = (t_word *)t_getbytes(2 * npts * sizeof(t_word));
+        t_word *fpimag = fpreal + npts;
+        for (i = 0; i < npts; i++)
+        {
+            fpreal[i].w_float = vecreal[i * realstride];
+            fpimag[i].w_float = vecimag[i * imagstride];
+        }
         pique_doit(npts, fpreal, fpimag, npeak,
             &nfound, fpfreq, fpamp, fpampre, fpampim, x->x_errthresh);
+        t_freebytes(fpreal, 2 * npts * sizeof(t_word));
         for (i = 0; i < nfound; i++, fpamp++, fpfreq++, fpampre++, fpampim++)
         {
             t_atom at[5];
@@ -9,6 +9,369 @@ to reset the value.
 */
 
 #include "m_pd.h"
+#include "s_stuff.h"
+#include "s_simd.h"
+
+/* ------------------------- vector kernels ------------------------- */
+
+/* The perform routines for each object below are plain C, unrolled by 8
+when the block size allows.  Where the CPU has vector instructions we use
+these kernels instead, chosen at DSP time from what sys_getcpufeatures()
+reports: AVX2 first, then SSE2 and NEON.  The AVX-512 kernels are only
+used if asked for with "-avx512", since on many CPUs 512-bit instructions
+lower the clock speed for everything else running on the core.  They
+take any block size, finishing leftover samples one at a time.  Other
+files get at them through sys_getveckernel() to copy, zero, and sum into
+catch~; they get a null pointer back where there's no vector code, and
+fall back to their own C. */
+
+    /* out = in op g, for signal-by-scalar objects */
+typedef void (*t_vecscalarkernel)(t_sample *in, t_sample g, t_sample *out,
+    int n);
+
+typedef struct _veckernels
+{
+    const char *v_name;
+    t_veckernel v_vec[VEC_NKERNELS];
+    t_vecscalarkernel v_scalar[VEC_MIN + 1];
+} t_veckernels;
+
+    /* one-at-a-time versions for the leftovers */
+#define VEC_BINOP_C(name, expr) \
+static void name##_c(t_sample *in1, t_sample *in2, t_sample *out, int n) \
+{ \
+    int i; \
+    for (i = 0; i < n; i++) \
+    { \
+        t_sample f = in1[i], g = in2[i]; \
+        out[i] = (expr); \
+    } \
+} \
+static void scalar##name##_c(t_sample *in, t_sample g, t_sample *out, int n) \
+{ \
+    int i; \
+    for (i = 0; i < n; i++) \
+    { \
+        t_sample f = in[i]; \
+        out[i] = (expr); \
+    } \
+}
+
+VEC_BINOP_C(plus, f + g)
+VEC_BINOP_C(minus, f - g)
+VEC_BINOP_C(times, f * g)
+VEC_BINOP_C(max, (f > g ? f : g))
+VEC_BINOP_C(min, (f < g ? f : g))
+
+static void over_c(t_sample *in1, t_sample *in2, t_sample *out, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        out[i] = (in2[i] ? in1[i] / in2[i] : 0);
+}
+
+static void copy_c(t_sample *in1, t_sample *in2, t_sample *out, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        out[i] = in1[i];
+}
+
+static void zero_c(t_sample *in1, t_sample *in2, t_sample *out, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        out[i] = 0;
+}
+
+static void catch_c(t_sample *in1, t_sample *in2, t_sample *out, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        out[i] = in1[i], in1[i] = 0;
+}
+
+static void throw_c(t_sample *in1, t_sample *in2, t_sample *out, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        out[i] = in2[i] + (PD_BIGORSMALL(in1[i]) ? 0 : in1[i]);
+}
+
+    /* The kernels for one instruction set, given its function attributes
+    FN, vector type T holding W samples, unaligned LOAD and STORE, SET1 to
+    fill a vector, and DONE to finish (AVX needs to clear the upper halves
+    of its registers before plain SSE code runs, and the compiler doesn't
+    always remember to before the tail call.)  The arithmetic operations
+    are passed in by name; THROW(f, g) adds f to g unless f is
+    PD_BIGORSMALL, and OVERKERNEL is a /~ kernel made separately with
+    VEC_BINOP, as one instruction set may borrow another's. */
+#define VEC_BINOP(isa, FN, T, W, LOAD, STORE, DONE, name, op) \
+FN static void name##_##isa(t_sample *in1, t_sample *in2, t_sample *out, \
+    int n) \
+{ \
+    int i; \
+    for (i = 0; i + 2*W <= n; i += 2*W) \
+    { \
+        T a0 = LOAD(in1 + i), a1 = LOAD(in1 + i + W); \
+        T b0 = LOAD(in2 + i), b1 = LOAD(in2 + i + W); \
+        STORE(out + i, op(a0, b0)); \
+        STORE(out + i + W, op(a1, b1)); \
+    } \
+    if (i + W <= n) \
+        STORE(out + i, op(LOAD(in1 + i), LOAD(in2 + i))), i += W; \
+    DONE; \
+    name##_c(in1 + i, in2 + i, out + i, n - i); \
+}
+
+#define VEC_SCALAROP(isa, FN, T, W, LOAD, STORE, SET1, DONE, name, op) \
+FN static void scalar##name##_##isa(t_sample *in, t_sample g, \
+    t_sample *out, int n) \
+{ \
+    int i; \
+    T vg = SET1(g); \
+    for (i = 0; i + 2*W <= n; i += 2*W) \
+    { \
+        T a0 = LOAD(in + i), a1 = LOAD(in + i + W); \
+        STORE(out + i, op(a0, vg)); \
+        STORE(out + i + W, op(a1, vg)); \
+    } \
+    if (i + W <= n) \
+        STORE(out + i, op(LOAD(in + i), vg)), i += W; \
+    DONE; \
+    scalar##name##_c(in + i, g, out + i, n - i); \
+}
+
+#define VEC_KERNELS(isa, FN, T, W, LOAD, STORE, SET1, DONE, \
+    ADD, SUB, MUL, OVERKERNEL, MAX, MIN, THROW) \
+VEC_BINOP(isa, FN, T, W, LOAD, STORE, DONE, plus, ADD) \
+VEC_BINOP(isa, FN, T, W, LOAD, STORE, DONE, minus, SUB) \
+VEC_BINOP(isa, FN, T, W, LOAD, STORE, DONE, times, MUL) \
+VEC_BINOP(isa, FN, T, W, LOAD, STORE, DONE, max, MAX) \
+VEC_BINOP(isa, FN, T, W, LOAD, STORE, DONE, min, MIN) \
+VEC_BINOP(isa, FN, T, W, LOAD, STORE, DONE, throw, THROW) \
+VEC_SCALAROP(isa, FN, T, W, LOAD, STORE, SET1, DONE, plus, ADD) \
+VEC_SCALAROP(isa, FN, T, W, LOAD, STORE, SET1, DONE, minus, SUB) \
+VEC_SCALAROP(isa, FN, T, W, LOAD, STORE, SET1, DONE, times, MUL) \
+VEC_SCALAROP(isa, FN, T, W, LOAD, STORE, SET1, DONE, max, MAX) \
+VEC_SCALAROP(isa, FN, T, W, LOAD, STORE, SET1, DONE, min, MIN) \
+FN static void copy_##isa(t_sample *in1, t_sample *in2, t_sample *out, \
+    int n) \
+{ \
+    int i; \
+    for (i = 0; i + 2*W <= n; i += 2*W) \
+    { \
+        T a0 = LOAD(in1 + i), a1 = LOAD(in1 + i + W); \
+        STORE(out + i, a0); \
+        STORE(out + i + W, a1); \
+    } \
+    DONE; \
+    copy_c(in1 + i, in2, out + i, n - i); \
+} \
+FN static void zero_##isa(t_sample *in1, t_sample *in2, t_sample *out, \
+    int n) \
+{ \
+    int i; \
+    T z = SET1(0); \
+    for (i = 0; i + 2*W <= n; i += 2*W) \
+        STORE(out + i, z), STORE(out + i + W, z); \
+    DONE; \
+    zero_c(in1, in2, out + i, n - i); \
+} \
+FN static void catch_##isa(t_sample *in1, t_sample *in2, t_sample *out, \
+    int n) \
+{ \
+    int i; \
+    T z = SET1(0); \
+    for (i = 0; i + 2*W <= n; i += 2*W) \
+    { \
+        T a0 = LOAD(in1 + i), a1 = LOAD(in1 + i + W); \
+        STORE(out + i, a0); \
+        STORE(out + i + W, a1); \
+        STORE(in1 + i, z); \
+        STORE(in1 + i + W, z); \
+    } \
+    DONE; \
+    catch_c(in1 + i, in2, out + i, n - i); \
+} \
+static const t_veckernels vec_##isa = \
+{ \
+    #isa, \
+    {plus_##isa, minus_##isa, times_##isa, OVERKERNEL, max_##isa, \
+        min_##isa, copy_##isa, zero_##isa, catch_##isa, throw_##isa}, \
+        /* scalar division is done by multiplying by the reciprocal */ \
+    {scalarplus_##isa, scalarminus_##isa, scalartimes_##isa, \
+        scalartimes_##isa, scalarmax_##isa, scalarmin_##isa} \
+};
+
+    /* PD_BIGORSMALL is true when exponent bits 29 and 30 are equal; adding
+    1 at bit 29 makes bit 30 set exactly when they aren't */
+#define VEC_BIGORSMALLBIT 0x20000000
+
+#ifdef PD_SIMD_SSE2
+static __m128 vec_over_sse2(__m128 f, __m128 g)
+{
+    return (_mm_and_ps(_mm_div_ps(f, g),
+        _mm_cmpneq_ps(g, _mm_setzero_ps())));
+}
+
+static __m128 vec_throw_sse2(__m128 f, __m128 g)
+{
+    __m128i b = _mm_add_epi32(_mm_castps_si128(f),
+        _mm_set1_epi32(VEC_BIGORSMALLBIT));
+    return (_mm_add_ps(g, _mm_and_ps(f, _mm_castsi128_ps(
+        _mm_srai_epi32(_mm_slli_epi32(b, 1), 31)))));
+}
+
+VEC_BINOP(sse2, , __m128, 4, _mm_loadu_ps, _mm_storeu_ps, (void)0,
+    over, vec_over_sse2)
+VEC_KERNELS(sse2, , __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps,
+    (void)0, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, over_sse2,
+    _mm_max_ps, _mm_min_ps, vec_throw_sse2)
+#endif /* PD_SIMD_SSE2 */
+
+#ifdef PD_SIMD_AVX2
+PD_SIMD_AVX2FN static __m256 vec_over_avx2(__m256 f, __m256 g)
+{
+    return (_mm256_and_ps(_mm256_div_ps(f, g),
+        _mm256_cmp_ps(g, _mm256_setzero_ps(), _CMP_NEQ_UQ)));
+}
+
+PD_SIMD_AVX2FN static __m256 vec_throw_avx2(__m256 f, __m256 g)
+{
+    __m256i b = _mm256_add_epi32(_mm256_castps_si256(f),
+        _mm256_set1_epi32(VEC_BIGORSMALLBIT));
+    return (_mm256_add_ps(g, _mm256_and_ps(f, _mm256_castsi256_ps(
+        _mm256_srai_epi32(_mm256_slli_epi32(b, 1), 31)))));
+}
+
+VEC_BINOP(avx2, PD_SIMD_AVX2FN, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps,
+    _mm256_zeroupper(), over, vec_over_avx2)
+VEC_KERNELS(avx2, PD_SIMD_AVX2FN, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps,
+    _mm256_set1_ps, _mm256_zeroupper(), _mm256_add_ps, _mm256_sub_ps,
+    _mm256_mul_ps, over_avx2, _mm256_max_ps, _mm256_min_ps, vec_throw_avx2)
+#endif /* PD_SIMD_AVX2 */
+
+    /* 512-bit division measured slower than two 256-bit ones, so /~ uses
+    the AVX2 kernel (every AVX-512 CPU has AVX2.) */
+#ifdef PD_SIMD_AVX512
+PD_SIMD_AVX512FN static __m512 vec_throw_avx512(__m512 f, __m512 g)
+{
+    __m512i b = _mm512_add_epi32(_mm512_castps_si512(f),
+        _mm512_set1_epi32(VEC_BIGORSMALLBIT));
+    return (_mm512_add_ps(g, _mm512_castsi512_ps(_mm512_and_si512(
+        _mm512_castps_si512(f), _mm512_srai_epi32(_mm512_slli_epi32(b, 1),
+            31)))));
+}
+
+VEC_KERNELS(avx512, PD_SIMD_AVX512FN, __m512, 16, _mm512_loadu_ps,
+    _mm512_storeu_ps, _mm512_set1_ps, _mm256_zeroupper(), _mm512_add_ps,
+    _mm512_sub_ps, _mm512_mul_ps, over_avx2, _mm512_max_ps,
+    _mm512_min_ps, vec_throw_avx512)
+#endif /* PD_SIMD_AVX512 */
+
+#ifdef PD_SIMD_NEON
+static float32x4_t vec_over_neon(float32x4_t f, float32x4_t g)
+{
+    return (vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(
+        vdivq_f32(f, g)), vceqq_f32(g, vdupq_n_f32(0)))));
+}
+
+static float32x4_t vec_throw_neon(float32x4_t f, float32x4_t g)
+{
+    int32x4_t b = vaddq_s32(vreinterpretq_s32_f32(f),
+        vdupq_n_s32(VEC_BIGORSMALLBIT));
+    return (vaddq_f32(g, vreinterpretq_f32_s32(vandq_s32(
+        vreinterpretq_s32_f32(f), vshrq_n_s32(vshlq_n_s32(b, 1), 31)))));
+}
+
+VEC_BINOP(neon, , float32x4_t, 4, vld1q_f32, vst1q_f32, (void)0,
+    over, vec_over_neon)
+VEC_KERNELS(neon, , float32x4_t, 4, vld1q_f32, vst1q_f32, vdupq_n_f32,
+    (void)0, vaddq_f32, vsubq_f32, vmulq_f32, over_neon, vmaxq_f32,
+    vminq_f32, vec_throw_neon)
+#endif /* PD_SIMD_NEON */
+
+    /* choose a set of kernels for the CPU; null if it has none */
+static const t_veckernels *vec_getkernels(void)
+{
+    int cpu = sys_getcpufeatures();
+#ifdef PD_SIMD_AVX512
+    if ((cpu & CPU_AVX512) && sys_avx512)
+        return (&vec_avx512);
+#endif
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+        return (&vec_avx2);
+#endif
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+        return (&vec_sse2);
+#endif
+#ifdef PD_SIMD_NEON
+    if (cpu & CPU_NEON)
+        return (&vec_neon);
+#endif
+    return (0);
+}
+
+t_veckernel sys_getveckernel(int which)
+{
+    const t_veckernels *k = vec_getkernels();
+    return (k ? k->v_vec[which] : 0);
+}
+
+    /* arguments: kernel, in1, in2, out, n */
+t_int *vec_perform(t_int *w)
+{
+    t_veckernel kernel = (t_veckernel)(w[1]);
+    (*kernel)((t_sample *)(w[2]), (t_sample *)(w[3]), (t_sample *)(w[4]),
+        (int)(w[5]));
+    return (w+6);
+}
+
+    /* the scalar is read through a pointer, as it may change */
+static t_int *vec_perform_scalar(t_int *w)
+{
+    t_vecscalarkernel kernel = (t_vecscalarkernel)(w[1]);
+    (*kernel)((t_sample *)(w[2]), *(t_float *)(w[3]), (t_sample *)(w[4]),
+        (int)(w[5]));
+    return (w+6);
+}
+
+static t_int *vec_perform_scalarover(t_int *w)
+{
+    t_vecscalarkernel kernel = (t_vecscalarkernel)(w[1]);
+    t_float g = *(t_float *)(w[3]);
+    (*kernel)((t_sample *)(w[2]), (g ? 1.f / g : 0), (t_sample *)(w[4]),
+        (int)(w[5]));
+    return (w+6);
+}
+
+    /* add a vector perform routine for signal-by-signal operation "op", or
+    return 0 if there's no vector code for this CPU */
+static int vec_dsp(int op, t_sample *in1, t_sample *in2, t_sample *out,
+    int n)
+{
+    const t_veckernels *k = vec_getkernels();
+    if (!k)
+        return (0);
+    dsp_add(vec_perform, 5, k->v_vec[op], in1, in2, out, n);
+    return (1);
+}
+
+    /* same for signal-by-scalar, with the scalar at "g" */
+static int vec_dsp_scalar(int op, t_sample *in, t_float *g, t_sample *out,
+    int n)
+{
+    const t_veckernels *k = vec_getkernels();
+    if (!k)
+        return (0);
+    dsp_add((op == VEC_OVER ? vec_perform_scalarover : vec_perform_scalar),
+        5, k->v_scalar[op], in, g, out, n);
+    return (1);
+}
+
 
 /* ----------------------------- plus ----------------------------- */
 static t_class *plus_class, *scalarplus_class;
@@ -107,6 +470,8 @@ t_int *scalarplus_perf8(t_int *w)
 
 void dsp_add_plus(t_sample *in1, t_sample *in2, t_sample *out, int n)
 {
+    if (vec_dsp(VEC_PLUS, in1, in2, out, n))
+        return;
     if (n&7)
         dsp_add(plus_perform, 4, in1, in2, out, n);
     else        
@@ -120,6 +485,9 @@ static void plus_dsp(t_plus *x, t_signal **sp)
 
 static void scalarplus_dsp(t_scalarplus *x, t_signal **sp)
 {
+    if (vec_dsp_scalar(VEC_PLUS, sp[0]->s_vec, &x->x_g, sp[1]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(scalarplus_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, sp[0]->s_n);
@@ -240,6 +608,9 @@ t_int *scalarminus_perf8(t_int *w)
 
 static void minus_dsp(t_minus *x, t_signal **sp)
 {
+    if (vec_dsp(VEC_MINUS, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(minus_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
@@ -250,6 +621,9 @@ static void minus_dsp(t_minus *x, t_signal **sp)
 
 static void scalarminus_dsp(t_scalarminus *x, t_signal **sp)
 {
+    if (vec_dsp_scalar(VEC_MINUS, sp[0]->s_vec, &x->x_g, sp[1]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(scalarminus_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, sp[0]->s_n);
@@ -371,6 +745,9 @@ t_int *scalartimes_perf8(t_int *w)
 
 static void times_dsp(t_times *x, t_signal **sp)
 {
+    if (vec_dsp(VEC_TIMES, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(times_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
@@ -381,6 +758,9 @@ static void times_dsp(t_times *x, t_signal **sp)
 
 static void scalartimes_dsp(t_scalartimes *x, t_signal **sp)
 {
+    if (vec_dsp_scalar(VEC_TIMES, sp[0]->s_vec, &x->x_g, sp[1]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(scalartimes_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, sp[0]->s_n);
@@ -513,6 +893,9 @@ t_int *scalarover_perf8(t_int *w)
 
 static void over_dsp(t_over *x, t_signal **sp)
 {
+    if (vec_dsp(VEC_OVER, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(over_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
@@ -523,6 +906,9 @@ static void over_dsp(t_over *x, t_signal **sp)
 
 static void scalarover_dsp(t_scalarover *x, t_signal **sp)
 {
+    if (vec_dsp_scalar(VEC_OVER, sp[0]->s_vec, &x->x_g, sp[1]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(scalarover_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, sp[0]->s_n);
@@ -655,6 +1041,9 @@ t_int *scalarmax_perf8(t_int *w)
 
 static void max_dsp(t_max *x, t_signal **sp)
 {
+    if (vec_dsp(VEC_MAX, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(max_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
@@ -665,6 +1054,9 @@ static void max_dsp(t_max *x, t_signal **sp)
 
 static void scalarmax_dsp(t_scalarmax *x, t_signal **sp)
 {
+    if (vec_dsp_scalar(VEC_MAX, sp[0]->s_vec, &x->x_g, sp[1]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(scalarmax_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, sp[0]->s_n);
@@ -797,6 +1189,9 @@ t_int *scalarmin_perf8(t_int *w)
 
 static void min_dsp(t_min *x, t_signal **sp)
 {
+    if (vec_dsp(VEC_MIN, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(min_perform, 4,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
@@ -807,6 +1202,9 @@ static void min_dsp(t_min *x, t_signal **sp)
 
 static void scalarmin_dsp(t_scalarmin *x, t_signal **sp)
 {
+    if (vec_dsp_scalar(VEC_MIN, sp[0]->s_vec, &x->x_g, sp[1]->s_vec,
+        sp[0]->s_n))
+        return;
     if (sp[0]->s_n&7)
         dsp_add(scalarmin_perform, 4, sp[0]->s_vec, &x->x_g,
             sp[1]->s_vec, sp[0]->s_n);
@@ -830,6 +1228,139 @@ static void min_setup(void)
     class_sethelpsymbol(scalarmin_class, gensym("sigbinops"));
 }
 
+/* ------------------------ "pd cpu-features" ------------------------ */
+
+    /* report which vector kernels we're using and time each against the C
+    perform routine it replaces, on a block of 64.  This holds up the
+    scheduler for a fraction of a second. */
+
+#define BENCH_N 64
+#define BENCH_REPEAT 20000
+
+typedef struct _vecbench
+{
+    const char *b_name;
+    int b_op;
+    int b_args;     /* BENCH_BINOP etc. below */
+    t_perfroutine b_ref;
+} t_vecbench;
+
+#define BENCH_BINOP 0   /* in1, in2, out, n */
+#define BENCH_SCALAR 1  /* in, &g, out, n */
+#define BENCH_COPY 2    /* in, out, n */
+#define BENCH_ZERO 3    /* out, n */
+#define BENCH_GLOBAL 4  /* catch~ or throw~ from d_global.c */
+
+static const t_vecbench vec_bench[] =
+{
+    {"+~", VEC_PLUS, BENCH_BINOP, plus_perf8},
+    {"-~", VEC_MINUS, BENCH_BINOP, minus_perf8},
+    {"*~", VEC_TIMES, BENCH_BINOP, times_perf8},
+    {"/~", VEC_OVER, BENCH_BINOP, over_perf8},
+    {"max~", VEC_MAX, BENCH_BINOP, max_perf8},
+    {"min~", VEC_MIN, BENCH_BINOP, min_perf8},
+    {"+~ scalar", VEC_PLUS, BENCH_SCALAR, scalarplus_perf8},
+    {"-~ scalar", VEC_MINUS, BENCH_SCALAR, scalarminus_perf8},
+    {"*~ scalar", VEC_TIMES, BENCH_SCALAR, scalartimes_perf8},
+    {"/~ scalar", VEC_OVER, BENCH_SCALAR, scalarover_perf8},
+    {"max~ scalar", VEC_MAX, BENCH_SCALAR, scalarmax_perf8},
+    {"min~ scalar", VEC_MIN, BENCH_SCALAR, scalarmin_perf8},
+    {"copy", VEC_COPY, BENCH_COPY, copy_perform},
+    {"zero", VEC_ZERO, BENCH_ZERO, zero_perform},
+    {"catch~", VEC_CATCH, BENCH_GLOBAL, 0},
+    {"throw~", VEC_THROW, BENCH_GLOBAL, 0},
+};
+
+#define NBENCH (sizeof(vec_bench)/sizeof(*vec_bench))
+
+    /* nanoseconds per block for a perform routine */
+static double vec_time(t_perfroutine fn, t_int *w)
+{
+    int i;
+    double t = sys_getrealtime();
+    for (i = 0; i < BENCH_REPEAT; i++)
+        (*fn)(w);
+    return ((sys_getrealtime() - t) * (1e9 / BENCH_REPEAT));
+}
+
+void glob_cpufeatures(void *dummy)
+{
+    const t_veckernels *k = vec_getkernels();
+    t_sample *buf;
+    t_float g = 0.75;
+    int i, cpu;
+    if (sys_nosimd)
+    {
+        post("vector instructions disabled (-nosimd)");
+        return;
+    }
+    cpu = sys_getcpufeatures();
+    post("CPU features:%s%s%s%s%s",
+        (cpu & CPU_SSE2 ? " SSE2" : ""), (cpu & CPU_AVX2 ? " AVX2" : ""),
+        (cpu & CPU_AVX512 ? " AVX-512F" : ""), (cpu & CPU_NEON ? " NEON" : ""),
+        (cpu ? "" : " (none known)"));
+    if (!k)
+    {
+        post("no vector kernels for this CPU; using C perform routines");
+        return;
+    }
+    if ((cpu & CPU_AVX512) && !sys_avx512)
+        post("(AVX-512 isn't used unless Pd is started with -avx512)");
+    post("arithmetic kernels: %s; ns per %d-sample block:", k->v_name,
+        BENCH_N);
+    buf = (t_sample *)getbytes(3 * BENCH_N * sizeof(t_sample));
+    for (i = 0; i < (int)NBENCH; i++)
+    {
+        const t_vecbench *b = &vec_bench[i];
+        t_sample *in1 = buf, *in2 = buf + BENCH_N, *out = buf + 2 * BENCH_N;
+        t_int ref[6], vec[6];
+        t_perfroutine reffn = b->b_ref;
+        double tref, tvec;
+        int j;
+            /* refill, as catch~ zeroes its input */
+        for (j = 0; j < 2 * BENCH_N; j++)
+            buf[j] = 0.5 + (j % 13) * 0.1;
+        switch (b->b_args)
+        {
+        case BENCH_BINOP:
+            ref[1] = (t_int)in1, ref[2] = (t_int)in2, ref[3] = (t_int)out,
+                ref[4] = BENCH_N;
+            break;
+        case BENCH_SCALAR:
+            ref[1] = (t_int)in1, ref[2] = (t_int)&g, ref[3] = (t_int)out,
+                ref[4] = BENCH_N;
+            break;
+        case BENCH_COPY:
+            ref[1] = (t_int)in1, ref[2] = (t_int)out, ref[3] = BENCH_N;
+            break;
+        case BENCH_ZERO:
+            ref[1] = (t_int)out, ref[2] = BENCH_N;
+            break;
+        default:
+            reffn = sys_getcatchthrowperform(b->b_op, in1, out, BENCH_N, ref);
+            break;
+        }
+        vec[2] = (t_int)in1, vec[4] = (t_int)out, vec[5] = BENCH_N;
+        if (b->b_args == BENCH_SCALAR)
+        {
+            vec[1] = (t_int)k->v_scalar[b->b_op];
+            vec[3] = (t_int)&g;
+            tvec = vec_time((b->b_op == VEC_OVER ?
+                vec_perform_scalarover : vec_perform_scalar), vec);
+        }
+        else
+        {
+            vec[1] = (t_int)k->v_vec[b->b_op];
+            vec[3] = (t_int)in2;
+            tvec = vec_time(vec_perform, vec);
+        }
+        tref = vec_time(reffn, ref);
+        post("  %-12s C %7.1f  %s %7.1f  (%.1fx)", b->b_name, tref,
+            k->v_name, tvec, (tvec > 0 ? tref / tvec : 0));
+    }
+    freebytes(buf, 3 * BENCH_N * sizeof(t_sample));
+}
+
 /* ----------------------- global setup routine ---------------- */
 void d_arithmetic_setup(void)
 {
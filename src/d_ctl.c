@@ -7,7 +7,9 @@
 */
 
 #include "m_pd.h"
+#include "s_simd.h"
 #include "math.h"
+#include <string.h>
 
 /* -------------------------- sig~ ------------------------------ */
 static t_class *sig_tilde_class;
@@ -565,9 +567,39 @@ static void vsnapshot_tilde_setup(void)
 
 /* ---------------- env~ - simple envelope follower. ----------------- */
 
+/* By default env~ reports power in a Hann window, as a weighted sum that is
+recomputed for every overlapping window.  That costs more the more windows
+overlap.  With "-rms" or "-peak" we instead keep the sum of squares, or the
+peak, of each DSP block in a ring covering the window, and slide the window
+a block at a time: a running sum for RMS and a queue of falling maxima for
+the peak, so the cost per sample stays the same whatever the window and
+period.  The window is rounded up to a whole number of blocks.  Output is in
+dB as before, with 100 for an RMS (or peak) of one.  "-n N" meters N inputs
+at once and outputs their levels as a list. */
+
 #define MAXOVERLAP 32
 #define INITVSTAKEN 64
 
+#define ENV_HANN 0      /* Hann-weighted power, the original */
+#define ENV_RMS 1       /* mean square over a sliding window */
+#define ENV_PEAK 2      /* squared peak over a sliding window */
+
+    /* sum of squares and largest magnitude in a block */
+typedef void (*t_envstats)(t_sample *in, int n, double *sumsq,
+    t_sample *peak);
+
+typedef struct _envchan
+{
+    t_sample *c_in;                 /* input vector */
+    t_sample c_sumbuf[MAXOVERLAP];  /* summing buffer */
+    double *c_ring;                 /* sum of squares or peak, per block */
+    double c_sum;                   /* "-rms": sum of the ring */
+    int *c_queue;                   /* "-peak": ring slots of falling maxima */
+    int c_head;                     /* "-peak": oldest slot in the queue */
+    int c_count;                    /* "-peak": length of the queue */
+    t_float c_result;               /* result to output */
+} t_envchan;
+
 typedef struct sigenv
 {
     t_object x_obj;                 /* header */
@@ -578,123 +610,440 @@ typedef struct sigenv
     int x_period;                   /* requested period of output */
     int x_realperiod;               /* period rounded up to vecsize multiple */
     int x_npoints;                  /* analysis window size in samples */
-    t_float x_result;                 /* result to output */
-    t_sample x_sumbuf[MAXOVERLAP];     /* summing buffer */
     t_float x_f;
     int x_allocforvs;               /* extra buffer for DSP vector size */
+    int x_mode;                     /* ENV_HANN, ENV_RMS or ENV_PEAK */
+    int x_nchans;                   /* number of inputs */
+    t_envchan *x_chans;             /* state for each input */
+    t_atom *x_list;                 /* output list for more than one input */
+    int x_nblocks;                  /* ring size in DSP blocks */
+    int x_ringpos;                  /* ring slot for the next block */
+    t_envstats x_stats;             /* block statistics for this CPU */
 } t_sigenv;
 
 t_class *env_tilde_class;
 static void env_tilde_tick(t_sigenv *x);
 
-static void *env_tilde_new(t_floatarg fnpoints, t_floatarg fperiod)
+static void *env_tilde_new(t_symbol *s, int argc, t_atom *argv)
 {
-    int npoints = fnpoints;
-    int period = fperiod;
+    int npoints, period, mode = ENV_HANN, nchans = 1;
     t_sigenv *x;
-    t_sample *buf;
+    t_sample *buf = 0;
     int i;
 
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-rms"))
+            mode = ENV_RMS;
+        else if (!strcmp(argv->a_w.w_symbol->s_name, "-peak"))
+            mode = ENV_PEAK;
+        else if (!strcmp(argv->a_w.w_symbol->s_name, "-n") &&
+            argc >= 2 && argv[1].a_type == A_FLOAT)
+        {
+            if ((nchans = atom_getfloatarg(1, argc, argv)) < 1)
+                nchans = 1;
+            argc--; argv++;
+        }
+        else
+        {
+            error("env~: unknown flag ...");
+            postatom(argc, argv); endpost();
+        }
+        argc--; argv++;
+    }
+    npoints = atom_getfloatarg(0, argc, argv);
+    period = atom_getfloatarg(1, argc, argv);
     if (npoints < 1) npoints = 1024;
     if (period < 1) period = npoints/2;
-    if (period < npoints / MAXOVERLAP + 1)
-        period = npoints / MAXOVERLAP + 1;
-    if (!(buf = getbytes(sizeof(t_sample) * (npoints + INITVSTAKEN))))
+    if (period < 1) period = 1;
+    if (mode == ENV_HANN)
     {
-        error("env: couldn't allocate buffer");
-        return (0);
+        if (period < npoints / MAXOVERLAP + 1)
+            period = npoints / MAXOVERLAP + 1;
+        if (!(buf = getbytes(sizeof(t_sample) * (npoints + INITVSTAKEN))))
+        {
+            error("env: couldn't allocate buffer");
+            return (0);
+        }
     }
     x = (t_sigenv *)pd_new(env_tilde_class);
     x->x_buf = buf;
     x->x_npoints = npoints;
     x->x_phase = 0;
     x->x_period = period;
-    for (i = 0; i < MAXOVERLAP; i++) x->x_sumbuf[i] = 0;
-    for (i = 0; i < npoints; i++)
-        buf[i] = (1. - cos((2 * 3.14159 * i) / npoints))/npoints;
-    for (; i < npoints+INITVSTAKEN; i++) buf[i] = 0;
+    x->x_mode = mode;
+    x->x_nchans = nchans;
+    x->x_chans = (t_envchan *)getbytes(nchans * sizeof(t_envchan));
+    for (i = 1; i < nchans; i++)
+        inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+    if (buf)
+    {
+        for (i = 0; i < npoints; i++)
+            buf[i] = (1. - cos((2 * 3.14159 * i) / npoints))/npoints;
+        for (; i < npoints+INITVSTAKEN; i++) buf[i] = 0;
+    }
     x->x_clock = clock_new(x, (t_method)env_tilde_tick);
-    x->x_outlet = outlet_new(&x->x_obj, gensym("float"));
+    if (nchans > 1)
+    {
+        x->x_outlet = outlet_new(&x->x_obj, &s_list);
+        x->x_list = (t_atom *)getbytes(nchans * sizeof(t_atom));
+    }
+    else
+    {
+        x->x_outlet = outlet_new(&x->x_obj, gensym("float"));
+        x->x_list = 0;
+    }
     x->x_f = 0;
     x->x_allocforvs = INITVSTAKEN;
+    x->x_nblocks = 0;
+    x->x_ringpos = 0;
+    x->x_stats = 0;
     return (x);
 }
 
 static t_int *env_tilde_perform(t_int *w)
 {
     t_sigenv *x = (t_sigenv *)(w[1]);
-    t_sample *in = (t_sample *)(w[2]);
-    int n = (int)(w[3]);
-    int count;
+    int n = (int)(w[2]);
+    int count, c;
     t_sample *sump; 
-    in += n;
-    for (count = x->x_phase, sump = x->x_sumbuf;
-        count < x->x_npoints; count += x->x_realperiod, sump++)
-    {
-        t_sample *hp = x->x_buf + count;
-        t_sample *fp = in;
-        t_sample sum = *sump;
-        int i;
-        
-        for (i = 0; i < n; i++)
+    for (c = 0; c < x->x_nchans; c++)
+    {
+        t_sample *in = x->x_chans[c].c_in + n;
+        for (count = x->x_phase, sump = x->x_chans[c].c_sumbuf;
+            count < x->x_npoints; count += x->x_realperiod, sump++)
         {
-            fp--;
-            sum += *hp++ * (*fp * *fp);
+            t_sample *hp = x->x_buf + count;
+            t_sample *fp = in;
+            t_sample sum = *sump;
+            int i;
+            
+            for (i = 0; i < n; i++)
+            {
+                fp--;
+                sum += *hp++ * (*fp * *fp);
+            }
+            *sump = sum;
         }
-        *sump = sum;
+        sump[0] = 0;
     }
-    sump[0] = 0;
     x->x_phase -= n;
     if (x->x_phase < 0)
     {
-        x->x_result = x->x_sumbuf[0];
-        for (count = x->x_realperiod, sump = x->x_sumbuf;
-            count < x->x_npoints; count += x->x_realperiod, sump++)
-                sump[0] = sump[1];
-        sump[0] = 0;
+        for (c = 0; c < x->x_nchans; c++)
+        {
+            t_envchan *ch = &x->x_chans[c];
+            ch->c_result = ch->c_sumbuf[0];
+            for (count = x->x_realperiod, sump = ch->c_sumbuf;
+                count < x->x_npoints; count += x->x_realperiod, sump++)
+                    sump[0] = sump[1];
+            sump[0] = 0;
+        }
         x->x_phase = x->x_realperiod - n;
         clock_delay(x->x_clock, 0L);
     }
-    return (w+4);
+    return (w+3);
+}
+
+    /* enter a block's peak into ring slot "pos", keeping the queue of slots
+    whose peaks aren't exceeded by any later one.  Its head is the window's
+    maximum. */
+static void env_tilde_pushpeak(t_envchan *ch, int nblocks, int pos,
+    double peak)
+{
+    int *queue = ch->c_queue;
+        /* the block we overwrite is the oldest, so it can only be the head */
+    if (ch->c_count && queue[ch->c_head] == pos)
+    {
+        if (++ch->c_head == nblocks)
+            ch->c_head = 0;
+        ch->c_count--;
+    }
+    while (ch->c_count &&
+        ch->c_ring[queue[(ch->c_head + ch->c_count - 1) % nblocks]] <= peak)
+            ch->c_count--;
+    ch->c_ring[pos] = peak;
+    queue[(ch->c_head + ch->c_count) % nblocks] = pos;
+    ch->c_count++;
+}
+
+static t_int *env_tilde_perform_sliding(t_int *w)
+{
+    t_sigenv *x = (t_sigenv *)(w[1]);
+    int n = (int)(w[2]);
+    int pos = x->x_ringpos, nblocks = x->x_nblocks, c, i;
+    for (c = 0; c < x->x_nchans; c++)
+    {
+        t_envchan *ch = &x->x_chans[c];
+        double sumsq;
+        t_sample peak;
+        (*x->x_stats)(ch->c_in, n, &sumsq, &peak);
+        if (x->x_mode == ENV_RMS)
+        {
+            ch->c_sum += sumsq - ch->c_ring[pos];
+            ch->c_ring[pos] = sumsq;
+        }
+        else env_tilde_pushpeak(ch, nblocks, pos, peak);
+    }
+    if (++pos == nblocks)
+    {
+        pos = 0;
+            /* add the ring up afresh once per window so that rounding
+            error in the running sums can't build up */
+        if (x->x_mode == ENV_RMS)
+            for (c = 0; c < x->x_nchans; c++)
+        {
+            t_envchan *ch = &x->x_chans[c];
+            double sum = 0;
+            for (i = 0; i < nblocks; i++)
+                sum += ch->c_ring[i];
+            ch->c_sum = sum;
+        }
+    }
+    x->x_ringpos = pos;
+    x->x_phase -= n;
+    if (x->x_phase < 0)
+    {
+        for (c = 0; c < x->x_nchans; c++)
+        {
+            t_envchan *ch = &x->x_chans[c];
+            if (x->x_mode == ENV_RMS)
+                ch->c_result = (ch->c_sum > 0 ?
+                    ch->c_sum / ((double)nblocks * n) : 0);
+            else
+            {
+                double peak = ch->c_ring[ch->c_queue[ch->c_head]];
+                ch->c_result = peak * peak;
+            }
+        }
+        x->x_phase = x->x_realperiod - n;
+        clock_delay(x->x_clock, 0L);
+    }
+    return (w+3);
+}
+
+static void env_stats_c(t_sample *in, int n, double *sumsq, t_sample *peak)
+{
+    t_sample sum = 0, max = 0;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        t_sample f = in[i], a = (f < 0 ? -f : f);
+        sum += f * f;
+        if (a > max)
+            max = a;
+    }
+    *sumsq = sum;
+    *peak = max;
+}
+
+#ifdef PD_SIMD_SSE2
+static void env_stats_sse2(t_sample *in, int n, double *sumsq,
+    t_sample *peak)
+{
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(),
+        m0 = _mm_setzero_ps(), m1 = _mm_setzero_ps(),
+        mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    float s[4], m[4];
+    t_sample sum, max;
+    int i;
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m128 a = _mm_loadu_ps(in + i), b = _mm_loadu_ps(in + i + 4);
+        s0 = _mm_add_ps(s0, _mm_mul_ps(a, a));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(b, b));
+        m0 = _mm_max_ps(m0, _mm_and_ps(a, mask));
+        m1 = _mm_max_ps(m1, _mm_and_ps(b, mask));
+    }
+    _mm_storeu_ps(s, _mm_add_ps(s0, s1));
+    _mm_storeu_ps(m, _mm_max_ps(m0, m1));
+    sum = (s[0] + s[1]) + (s[2] + s[3]);
+    max = (m[0] > m[1] ? m[0] : m[1]);
+    if (m[2] > max) max = m[2];
+    if (m[3] > max) max = m[3];
+    for (; i < n; i++)
+    {
+        t_sample f = in[i], a = (f < 0 ? -f : f);
+        sum += f * f;
+        if (a > max)
+            max = a;
+    }
+    *sumsq = sum;
+    *peak = max;
+}
+#endif /* PD_SIMD_SSE2 */
+
+#ifdef PD_SIMD_AVX2
+PD_SIMD_AVX2FN static void env_stats_avx2(t_sample *in, int n, double *sumsq,
+    t_sample *peak)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(),
+        m0 = _mm256_setzero_ps(), m1 = _mm256_setzero_ps(),
+        mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m128 s4, m4;
+    float s[4], m[4];
+    t_sample sum, max;
+    int i;
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        __m256 a = _mm256_loadu_ps(in + i), b = _mm256_loadu_ps(in + i + 8);
+        s0 = _mm256_fmadd_ps(a, a, s0);
+        s1 = _mm256_fmadd_ps(b, b, s1);
+        m0 = _mm256_max_ps(m0, _mm256_and_ps(a, mask));
+        m1 = _mm256_max_ps(m1, _mm256_and_ps(b, mask));
+    }
+    s0 = _mm256_add_ps(s0, s1);
+    m0 = _mm256_max_ps(m0, m1);
+    s4 = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    m4 = _mm_max_ps(_mm256_castps256_ps128(m0), _mm256_extractf128_ps(m0, 1));
+    _mm_storeu_ps(s, s4);
+    _mm_storeu_ps(m, m4);
+    sum = (s[0] + s[1]) + (s[2] + s[3]);
+    max = (m[0] > m[1] ? m[0] : m[1]);
+    if (m[2] > max) max = m[2];
+    if (m[3] > max) max = m[3];
+    for (; i < n; i++)
+    {
+        t_sample f = in[i], a = (f < 0 ? -f : f);
+        sum += f * f;
+        if (a > max)
+            max = a;
+    }
+    *sumsq = sum;
+    *peak = max;
+}
+#endif /* PD_SIMD_AVX2 */
+
+#ifdef PD_SIMD_NEON
+static void env_stats_neon(t_sample *in, int n, double *sumsq,
+    t_sample *peak)
+{
+    float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0),
+        m0 = vdupq_n_f32(0), m1 = vdupq_n_f32(0);
+    t_sample sum, max;
+    int i;
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        float32x4_t a = vld1q_f32(in + i), b = vld1q_f32(in + i + 4);
+        s0 = vfmaq_f32(s0, a, a);
+        s1 = vfmaq_f32(s1, b, b);
+        m0 = vmaxq_f32(m0, vabsq_f32(a));
+        m1 = vmaxq_f32(m1, vabsq_f32(b));
+    }
+    sum = vaddvq_f32(vaddq_f32(s0, s1));
+    max = vmaxvq_f32(vmaxq_f32(m0, m1));
+    for (; i < n; i++)
+    {
+        t_sample f = in[i], a = (f < 0 ? -f : f);
+        sum += f * f;
+        if (a > max)
+            max = a;
+    }
+    *sumsq = sum;
+    *peak = max;
+}
+#endif /* PD_SIMD_NEON */
+
+    /* (re)allocate the rings for a new number of blocks per window, or
+    free them if zero */
+static void env_tilde_setrings(t_sigenv *x, int nblocks)
+{
+    int c;
+    if (nblocks == x->x_nblocks)
+        return;
+    for (c = 0; c < x->x_nchans; c++)
+    {
+        t_envchan *ch = &x->x_chans[c];
+        if (x->x_nblocks)
+        {
+            freebytes(ch->c_ring, x->x_nblocks * sizeof(double));
+            freebytes(ch->c_queue, x->x_nblocks * sizeof(int));
+        }
+        ch->c_ring = (nblocks ?
+            (double *)getbytes(nblocks * sizeof(double)) : 0);
+        ch->c_queue = (nblocks ? (int *)getbytes(nblocks * sizeof(int)) : 0);
+        ch->c_sum = 0;
+        ch->c_head = ch->c_count = 0;
+    }
+    x->x_nblocks = nblocks;
+    x->x_ringpos = 0;
 }
 
 static void env_tilde_dsp(t_sigenv *x, t_signal **sp)
 {
-    if (x->x_period % sp[0]->s_n) x->x_realperiod =
-        x->x_period + sp[0]->s_n - (x->x_period % sp[0]->s_n);
+    int n = sp[0]->s_n, c;
+    if (x->x_period % n) x->x_realperiod =
+        x->x_period + n - (x->x_period % n);
     else x->x_realperiod = x->x_period;
-    if (sp[0]->s_n > x->x_allocforvs)
+    for (c = 0; c < x->x_nchans; c++)
+        x->x_chans[c].c_in = sp[c]->s_vec;
+    if (x->x_mode != ENV_HANN)
+    {
+        int cpu = sys_getcpufeatures();
+        env_tilde_setrings(x, (x->x_npoints + n - 1) / n);
+        x->x_stats = env_stats_c;
+#ifdef PD_SIMD_SSE2
+        if (cpu & CPU_SSE2)
+            x->x_stats = env_stats_sse2;
+#endif
+#ifdef PD_SIMD_AVX2
+        if (cpu & CPU_AVX2)
+            x->x_stats = env_stats_avx2;
+#endif
+#ifdef PD_SIMD_NEON
+        if (cpu & CPU_NEON)
+            x->x_stats = env_stats_neon;
+#endif
+        dsp_add(env_tilde_perform_sliding, 2, x, n);
+        return;
+    }
+    if (n > x->x_allocforvs)
     {
         void *xx = resizebytes(x->x_buf,
             (x->x_npoints + x->x_allocforvs) * sizeof(t_sample),
-            (x->x_npoints + sp[0]->s_n) * sizeof(t_sample));
+            (x->x_npoints + n) * sizeof(t_sample));
         if (!xx)
         {
             error("env~: out of memory");
             return;
         }
         x->x_buf = (t_sample *)xx;
-        x->x_allocforvs = sp[0]->s_n;
+        x->x_allocforvs = n;
     }
-    dsp_add(env_tilde_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
+    dsp_add(env_tilde_perform, 2, x, n);
 }
 
 static void env_tilde_tick(t_sigenv *x) /* callback function for the clock */
 {
-    outlet_float(x->x_outlet, powtodb(x->x_result));
+    int c;
+    if (!x->x_list)
+        outlet_float(x->x_outlet, powtodb(x->x_chans[0].c_result));
+    else
+    {
+        for (c = 0; c < x->x_nchans; c++)
+            SETFLOAT(x->x_list + c, powtodb(x->x_chans[c].c_result));
+        outlet_list(x->x_outlet, &s_list, x->x_nchans, x->x_list);
+    }
 }
 
 static void env_tilde_ff(t_sigenv *x)           /* cleanup on free */
 {
     clock_free(x->x_clock);
-    freebytes(x->x_buf, (x->x_npoints + x->x_allocforvs) * sizeof(*x->x_buf));
+    if (x->x_buf)
+        freebytes(x->x_buf,
+            (x->x_npoints + x->x_allocforvs) * sizeof(*x->x_buf));
+    env_tilde_setrings(x, 0);
+    freebytes(x->x_chans, x->x_nchans * sizeof(t_envchan));
+    if (x->x_list)
+        freebytes(x->x_list, x->x_nchans * sizeof(t_atom));
 }
 
 
 void env_tilde_setup(void )
 {
     env_tilde_class = class_new(gensym("env~"), (t_newmethod)env_tilde_new,
-        (t_method)env_tilde_ff, sizeof(t_sigenv), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
+        (t_method)env_tilde_ff, sizeof(t_sigenv), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(env_tilde_class, t_sigenv, x_f);
     class_addmethod(env_tilde_class, (t_method)env_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -51,7 +51,7 @@ static void dac_dsp(t_dac *x, t_signal **sp)
         if ((*sp2)->s_n != DEFDACBLKSIZE)
             error("dac~: bad vector size");
         else if (ch >= 0 && ch < sys_get_outchannels())
-            dsp_add(plus_perform, 4, sys_soundout + DEFDACBLKSIZE*ch,
+            dsp_add_plus(sys_soundout + DEFDACBLKSIZE*ch,
                 (*sp2)->s_vec, sys_soundout + DEFDACBLKSIZE*ch, DEFDACBLKSIZE);
     }    
 }
@@ -150,7 +150,10 @@ static t_int *copy_perf8(t_int *w)
 
 void dsp_add_copy(t_sample *in, t_sample *out, int n)
 {
-    if (n&7)
+    t_veckernel kernel = sys_getveckernel(VEC_COPY);
+    if (kernel)
+        dsp_add(vec_perform, 5, kernel, in, 0, out, n);
+    else if (n&7)
         dsp_add(copy_perform, 3, in, out, n);
     else        
         dsp_add(copy_perf8, 3, in, out, n);
@@ -5,6 +5,8 @@
 /*  send~, delread~, throw~, catch~ */
 
 #include "m_pd.h"
+#include "s_stuff.h"
+#include <string.h>
 extern int ugen_getsortno(void);
 
 #define DEFDELVS 64             /* LATER get this from canvas at DSP time */
@@ -112,9 +114,46 @@ static t_int *sigdelwrite_perform(t_int *w)
     return (w+4);
 }
 
+    /* without the denormal test, when the CPU is flushing them anyway.
+    Infinities and NaNs would circulate forever in a feedback loop, so
+    a block containing any goes through the checking routine instead. */
+static t_int *sigdelwrite_perform_ftz(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_delwritectl *c = (t_delwritectl *)(w[2]);
+    int n = (int)(w[3]);
+    int phase = c->c_phase, nsamps = c->c_n;
+    t_sample *vp = c->c_vec, *bp = vp + phase, *ep = vp + (c->c_n + XTRASAMPS);
+    if (sys_infornan(in, n))
+        return (sigdelwrite_perform(w));
+    phase += n;
+
+    while (n)
+    {
+        int chunk = ep - bp;
+        if (chunk > n)
+            chunk = n;
+        memcpy(bp, in, chunk * sizeof(t_sample));
+        bp += chunk, in += chunk, n -= chunk;
+        if (bp == ep)
+        {
+            vp[0] = ep[-4];
+            vp[1] = ep[-3];
+            vp[2] = ep[-2];
+            vp[3] = ep[-1];
+            bp = vp + XTRASAMPS;
+            phase -= nsamps;
+        }
+    }
+    c->c_phase = phase; 
+    return (w+4);
+}
+
 static void sigdelwrite_dsp(t_sigdelwrite *x, t_signal **sp)
 {
-    dsp_add(sigdelwrite_perform, 3, sp[0]->s_vec, &x->x_cspace, sp[0]->s_n);
+    dsp_add((sys_denormalsflushed() ?
+        sigdelwrite_perform_ftz : sigdelwrite_perform), 3,
+            sp[0]->s_vec, &x->x_cspace, sp[0]->s_n);
     x->x_sortno = ugen_getsortno();
     sigdelwrite_checkvecsize(x, sp[0]->s_n);
     sigdelwrite_updatesr(x, sp[0]->s_sr);
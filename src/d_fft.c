@@ -3,6 +3,8 @@
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
 #include "m_pd.h"
+#include <string.h>
+#include <pthread.h>
 
 /* This file interfaces to one of the Mayer, Ooura, or fftw FFT packages
 to implement the "fft~", etc, Pd objects.  If using Mayer, also compile
@@ -137,6 +139,43 @@ static void sigfft_setup(void)
     class_sethelpsymbol(sigifft_class, gensym("fft~"));
 }
 
+    /* With a channel count, rfft~ and rifft~ transform that many channels
+    together with mayer_multirealfft() and mayer_multirealifft(), which take
+    channels in order.  A channel's outputs may be in the same place as an
+    input of a later channel, in which case we copy that input out of the
+    way first.  "vecs" holds "nin" inputs, "inperchan" per channel, followed
+    by "nout" outputs, "outperchan" per channel. */
+static void sigrfft_stage(t_sample **vecs, int nin, int inperchan,
+    int nout, int outperchan, int n, t_sample **stage, int *stagesize)
+{
+    int i, j, nstage = 0, size;
+    char *clobbered = (char *)getbytes(nin);
+    for (i = 0; i < nin; i++)
+    {
+        clobbered[i] = 0;
+        for (j = 0; j < nout; j++)
+            if (vecs[nin + j] == vecs[i] && j / outperchan < i / inperchan)
+                clobbered[i] = 1;
+        nstage += clobbered[i];
+    }
+    size = nstage * n * sizeof(t_sample);
+    if (size != *stagesize)
+    {
+        if (*stage)
+            freebytes(*stage, *stagesize);
+        *stage = (size ? (t_sample *)getbytes(size) : 0);
+        *stagesize = size;
+    }
+    for (i = 0, j = 0; i < nin; i++)
+        if (clobbered[i])
+    {
+        t_sample *copy = *stage + (j++) * n;
+        dsp_add(copy_perform, 3, vecs[i], copy, n);
+        vecs[i] = copy;
+    }
+    freebytes(clobbered, nin);
+}
+
 /* ----------------------- rfft~ -------------------------------- */
 
 static t_class *sigrfft_class;
@@ -145,17 +184,73 @@ typedef struct rfft
 {
     t_object x_obj;
     t_float x_f;
+    int x_nchans;           /* channels, if more than one */
+    t_sample **x_vecs;      /* ... inputs, then real and imaginary outputs */
+    t_sample *x_stage;      /* see sigrfft_stage() */
+    int x_stagesize;
 } t_sigrfft;
 
-static void *sigrfft_new(void)
+static void *sigrfft_new(t_floatarg fnchans)
 {
     t_sigrfft *x = (t_sigrfft *)pd_new(sigrfft_class);
-    outlet_new(&x->x_obj, gensym("signal"));
-    outlet_new(&x->x_obj, gensym("signal"));
+    int i, nchans = (fnchans > 1 ? fnchans : 1);
+    for (i = 1; i < nchans; i++)
+        inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+    for (i = 0; i < nchans; i++)
+    {
+        outlet_new(&x->x_obj, gensym("signal"));
+        outlet_new(&x->x_obj, gensym("signal"));
+    }
+    x->x_nchans = nchans;
+    x->x_vecs = (nchans > 1 ?
+        (t_sample **)getbytes(3 * nchans * sizeof(t_sample *)) : 0);
+    x->x_stage = 0;
+    x->x_stagesize = 0;
     x->x_f = 0;
     return (x);
 }
 
+static void sigrfft_free(t_sigrfft *x)
+{
+    if (x->x_vecs)
+        freebytes(x->x_vecs, 3 * x->x_nchans * sizeof(t_sample *));
+    if (x->x_stage)
+        freebytes(x->x_stage, x->x_stagesize);
+}
+
+static t_int *sigrfft_multiperform(t_int *w)
+{
+    t_sigrfft *x = (t_sigrfft *)(w[1]);
+    int n = (int)(w[2]), nchans = x->x_nchans;
+    mayer_multirealfft(n, nchans, x->x_vecs, x->x_vecs + nchans,
+        x->x_vecs + 2 * nchans);
+    return (w+3);
+}
+
+static void sigrfft_multidsp(t_sigrfft *x, t_signal **sp)
+{
+    int n = sp[0]->s_n, n2 = (n>>1), nchans = x->x_nchans, i;
+    t_sample **in = x->x_vecs, **re = in + nchans, **im = re + nchans;
+        /* staging wants the outputs in outlet order (real, imaginary,
+        real, ...), so use "re" and "im" for that first */
+    for (i = 0; i < 3 * nchans; i++)
+        x->x_vecs[i] = sp[i]->s_vec;
+    sigrfft_stage(x->x_vecs, nchans, 1, 2 * nchans, 2, n,
+        &x->x_stage, &x->x_stagesize);
+    for (i = 0; i < nchans; i++)
+    {
+        re[i] = sp[nchans + 2*i]->s_vec;
+        im[i] = sp[nchans + 2*i + 1]->s_vec;
+    }
+    dsp_add(sigrfft_multiperform, 2, x, n);
+    for (i = 0; i < nchans; i++)
+    {
+        dsp_add_zero(re[i] + (n2+1), ((n2-1)&(~7)));
+        dsp_add_zero(re[i] + (n2+1) + ((n2-1)&(~7)), ((n2-1)&7));
+        dsp_add_zero(im[i] + n2, n2);
+    }
+}
+
 static t_int *sigrfft_perform(t_int *w)
 {
     t_sample *in = (t_sample *)(w[1]);
@@ -175,6 +270,11 @@ static void sigrfft_dsp(t_sigrfft *x, t_signal **sp)
         error("fft: minimum 4 points");
         return;
     }
+    if (x->x_nchans > 1)
+    {
+        sigrfft_multidsp(x, sp);
+        return;
+    }
     if (in1 != out1)
         dsp_add(copy_perform, 3, in1, out1, n);
     dsp_add(sigrfft_perform, 2, out1, n);
@@ -187,8 +287,8 @@ static void sigrfft_dsp(t_sigrfft *x, t_signal **sp)
 
 static void sigrfft_setup(void)
 {
-    sigrfft_class = class_new(gensym("rfft~"), sigrfft_new, 0,
-        sizeof(t_sigrfft), 0, 0);
+    sigrfft_class = class_new(gensym("rfft~"), (t_newmethod)sigrfft_new,
+        (t_method)sigrfft_free, sizeof(t_sigrfft), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigrfft_class, t_sigrfft, x_f);
     class_addmethod(sigrfft_class, (t_method)sigrfft_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -203,17 +303,67 @@ typedef struct rifft
 {
     t_object x_obj;
     t_float x_f;
+    int x_nchans;           /* channels, if more than one */
+    t_sample **x_vecs;      /* ... real and imaginary inputs, then outputs */
+    t_sample *x_stage;      /* see sigrfft_stage() */
+    int x_stagesize;
 } t_sigrifft;
 
-static void *sigrifft_new(void)
+static void *sigrifft_new(t_floatarg fnchans)
 {
     t_sigrifft *x = (t_sigrifft *)pd_new(sigrifft_class);
-    inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
-    outlet_new(&x->x_obj, gensym("signal"));
+    int i, nchans = (fnchans > 1 ? fnchans : 1);
+    for (i = 1; i < 2 * nchans; i++)
+        inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+    for (i = 0; i < nchans; i++)
+        outlet_new(&x->x_obj, gensym("signal"));
+    x->x_nchans = nchans;
+    x->x_vecs = (nchans > 1 ?
+        (t_sample **)getbytes(3 * nchans * sizeof(t_sample *)) : 0);
+    x->x_stage = 0;
+    x->x_stagesize = 0;
     x->x_f = 0;
     return (x);
 }
 
+static void sigrifft_free(t_sigrifft *x)
+{
+    if (x->x_vecs)
+        freebytes(x->x_vecs, 3 * x->x_nchans * sizeof(t_sample *));
+    if (x->x_stage)
+        freebytes(x->x_stage, x->x_stagesize);
+}
+
+static t_int *sigrifft_multiperform(t_int *w)
+{
+    t_sigrifft *x = (t_sigrifft *)(w[1]);
+    int n = (int)(w[2]), nchans = x->x_nchans;
+    mayer_multirealifft(n, nchans, x->x_vecs, x->x_vecs + nchans,
+        x->x_vecs + 2 * nchans);
+    return (w+3);
+}
+
+static void sigrifft_multidsp(t_sigrifft *x, t_signal **sp)
+{
+    int n = sp[0]->s_n, nchans = x->x_nchans, i;
+    t_sample **ins = (t_sample **)getbytes(2 * nchans * sizeof(t_sample *));
+        /* staging wants the inputs in inlet order (real, imaginary,
+        real, ...), but the transform wants all real parts first */
+    for (i = 0; i < 3 * nchans; i++)
+        x->x_vecs[i] = sp[i]->s_vec;
+    sigrfft_stage(x->x_vecs, 2 * nchans, 2, nchans, 1, n,
+        &x->x_stage, &x->x_stagesize);
+    for (i = 0; i < 2 * nchans; i++)
+        ins[i] = x->x_vecs[i];
+    for (i = 0; i < nchans; i++)
+    {
+        x->x_vecs[i] = ins[2*i];
+        x->x_vecs[nchans + i] = ins[2*i + 1];
+    }
+    freebytes(ins, 2 * nchans * sizeof(t_sample *));
+    dsp_add(sigrifft_multiperform, 2, x, n);
+}
+
 static t_int *sigrifft_perform(t_int *w)
 {
     t_sample *in = (t_sample *)(w[1]);
@@ -233,6 +383,11 @@ static void sigrifft_dsp(t_sigrifft *x, t_signal **sp)
         error("fft: minimum 4 points");
         return;
     }
+    if (x->x_nchans > 1)
+    {
+        sigrifft_multidsp(x, sp);
+        return;
+    }
     if (in2 == out1)
     {
         dsp_add(sigrfft_flip, 3, out1+1, out1 + n, n2-1);
@@ -248,8 +403,8 @@ static void sigrifft_dsp(t_sigrifft *x, t_signal **sp)
 
 static void sigrifft_setup(void)
 {
-    sigrifft_class = class_new(gensym("rifft~"), sigrifft_new, 0,
-        sizeof(t_sigrifft), 0, 0);
+    sigrifft_class = class_new(gensym("rifft~"), (t_newmethod)sigrifft_new,
+        (t_method)sigrifft_free, sizeof(t_sigrifft), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigrifft_class, t_sigrifft, x_f);
     class_addmethod(sigrifft_class, (t_method)sigrifft_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -344,6 +499,441 @@ static void sigframp_setup(void)
         gensym("dsp"), A_CANT, 0);
 }
 
+/* ------------------------ conv~ ------------------------------------ */
+
+/* Convolve the input with an impulse response taken from an array, using
+overlap-save with a frequency-domain delay line.  The impulse response is
+split into segments.  Within a segment all partitions have the same size,
+and each segment's partitions are CONV_GROWTH times longer than the last
+segment's.  The first segment's partitions are one DSP block long.  It is
+computed in the perform routine, so the only latency is the block
+itself.  Each later segment has partitions of size L and starts 2L points
+into the impulse response.  Its blocks go to a worker thread, which has
+one full period of L samples to return the result before the DSP thread
+needs it.  If a worker is late, the DSP thread waits for it, so output
+(from "pd -batch" for instance) never depends on timing. */
+
+#define CONV_GROWTH 4           /* ratio of successive partition sizes */
+#define CONV_MAXPART 16384      /* largest partition if block is smaller */
+
+typedef struct _convseg
+{
+    int s_size;                 /* partition size L; FFT size is 2L */
+    int s_npart;                /* number of partitions */
+    int s_onset;                /* where the segment starts in the IR */
+    int s_pos;                  /* newest spectrum in the delay line */
+    t_sample *s_filter;         /* spectra of the IR partitions */
+    t_sample *s_fdl;            /* spectra of the last s_npart blocks */
+    t_sample *s_prev;           /* previous input block */
+    t_sample *s_fft;            /* FFT work space, 2L points */
+    t_sample *s_acc;            /* spectrum of the output block */
+        /* the rest is only used for segments run by a worker thread */
+    t_sample *s_in;             /* input being collected by DSP thread */
+    t_sample *s_jobin;          /* input being convolved by worker */
+    t_sample *s_out[2];         /* outputs of alternate jobs */
+    int s_fill;                 /* samples so far in s_in */
+    int s_readbuf;              /* which s_out the DSP thread reads */
+    int s_readpos;              /* ... and where */
+    int s_njob;                 /* number of jobs posted */
+    int s_busy;                 /* worker is computing a job */
+    int s_quit;                 /* worker should exit */
+    int s_late;                 /* times DSP thread had to wait for worker */
+    int s_threaded;             /* worker thread is running */
+    pthread_t s_thread;
+    pthread_mutex_t s_mutex;
+    pthread_cond_t s_cond;      /* signals both new jobs and finished ones */
+} t_convseg;
+
+static t_class *conv_tilde_class;
+
+typedef struct _conv_tilde
+{
+    t_object x_obj;
+    t_float x_f;
+    t_symbol *x_arrayname;
+    int x_blocksize;            /* block size segments were made for */
+    t_float *x_vec;             /* array contents they were made from */
+    int x_npoints;
+    int x_nseg;
+    t_convseg *x_seg;
+    t_sample *x_inbuf;          /* copy of input, which output may share */
+} t_conv_tilde;
+
+    /* spectra are stored as L+1 real parts followed by L+1 imaginary
+    parts, in the sign convention of mayer_realfft(), which, multiplied
+    together, give their product in the same convention. */
+static void convseg_mac(t_sample *acc, const t_sample *h, const t_sample *x,
+    int n)
+{
+    t_sample *are = acc, *aim = acc + n;
+    const t_sample *hre = h, *him = h + n, *xre = x, *xim = x + n;
+    int k;
+    for (k = 0; k < n; k++)
+    {
+        are[k] += hre[k] * xre[k] - him[k] * xim[k];
+        aim[k] += hre[k] * xim[k] + him[k] * xre[k];
+    }
+}
+
+    /* unpack a real transform of n points into n/2+1 complex bins */
+static void convseg_unpack(const t_sample *buf, t_sample *spec, int n)
+{
+    int k, l = n/2;
+    t_sample *re = spec, *im = spec + l + 1;
+    re[0] = buf[0], im[0] = 0;
+    for (k = 1; k < l; k++)
+        re[k] = buf[k], im[k] = buf[n-k];
+    re[l] = buf[l], im[l] = 0;
+}
+
+static void convseg_pack(const t_sample *spec, t_sample *buf, int n)
+{
+    int k, l = n/2;
+    const t_sample *re = spec, *im = spec + l + 1;
+    for (k = 0; k <= l; k++)
+        buf[k] = re[k];
+    for (k = 1; k < l; k++)
+        buf[n-k] = im[k];
+}
+
+    /* run one block of L new input samples through a segment, leaving
+    the segment's L output samples in "out" */
+static void convseg_run(t_convseg *s, const t_sample *in, t_sample *out)
+{
+    int l = s->s_size, n = 2 * l, slot = 2 * (l + 1), p;
+    t_sample *buf = s->s_fft;
+    memcpy(buf, s->s_prev, l * sizeof(t_sample));
+    memcpy(buf + l, in, l * sizeof(t_sample));
+    memcpy(s->s_prev, in, l * sizeof(t_sample));
+    mayer_realfft(n, buf);
+    if (++s->s_pos == s->s_npart)
+        s->s_pos = 0;
+    convseg_unpack(buf, s->s_fdl + s->s_pos * slot, n);
+    memset(s->s_acc, 0, slot * sizeof(t_sample));
+    for (p = 0; p < s->s_npart; p++)
+    {
+        int q = s->s_pos - p;
+        if (q < 0)
+            q += s->s_npart;
+        convseg_mac(s->s_acc, s->s_filter + p * slot, s->s_fdl + q * slot,
+            l + 1);
+    }
+    convseg_pack(s->s_acc, buf, n);
+    mayer_realifft(n, buf);
+    memcpy(out, buf + l, l * sizeof(t_sample));
+}
+
+static void *convseg_thread(void *z)
+{
+    t_convseg *s = (t_convseg *)z;
+    pthread_mutex_lock(&s->s_mutex);
+    while (1)
+    {
+        int which;
+        while (!s->s_busy && !s->s_quit)
+            pthread_cond_wait(&s->s_cond, &s->s_mutex);
+        if (s->s_quit)
+            break;
+        which = (s->s_njob - 1) & 1;
+        pthread_mutex_unlock(&s->s_mutex);
+        convseg_run(s, s->s_jobin, s->s_out[which]);
+        pthread_mutex_lock(&s->s_mutex);
+        s->s_busy = 0;
+        pthread_cond_broadcast(&s->s_cond);
+    }
+    pthread_mutex_unlock(&s->s_mutex);
+    return (0);
+}
+
+    /* called from the DSP thread when a worker segment has a full block of
+    input: collect the previous job's output and start the next job */
+static void convseg_post(t_convseg *s)
+{
+    t_sample *swap = s->s_in;
+    if (!s->s_threaded)
+    {
+            /* same schedule as the worker, just computed right away */
+        s->s_readbuf = (s->s_njob - 1) & 1;
+        s->s_readpos = s->s_fill = 0;
+        convseg_run(s, s->s_in, s->s_out[s->s_njob & 1]);
+        s->s_njob++;
+        return;
+    }
+    pthread_mutex_lock(&s->s_mutex);
+    if (s->s_busy)
+    {
+        s->s_late++;
+        while (s->s_busy)
+            pthread_cond_wait(&s->s_cond, &s->s_mutex);
+    }
+    s->s_readbuf = (s->s_njob - 1) & 1;
+    s->s_readpos = s->s_fill = 0;
+    s->s_in = s->s_jobin;
+    s->s_jobin = swap;
+    s->s_njob++;
+    s->s_busy = 1;
+    pthread_cond_broadcast(&s->s_cond);
+    pthread_mutex_unlock(&s->s_mutex);
+}
+
+    /* make a segment for "npoints" points of the IR starting at "onset",
+    in partitions of "size" */
+static int convseg_init(t_convseg *s, const t_float *vec, int stride,
+    int npoints, int onset, int size, int worker)
+{
+    int l = size, n = 2 * l, slot = 2 * (l + 1), p, i;
+    memset(s, 0, sizeof(*s));
+    s->s_size = l;
+    s->s_onset = onset;
+    s->s_npart = (npoints + l - 1) / l;
+    if (!(s->s_filter = (t_sample *)getbytes(s->s_npart * slot *
+            sizeof(t_sample))) ||
+        !(s->s_fdl = (t_sample *)getbytes(s->s_npart * slot *
+            sizeof(t_sample))) ||
+        !(s->s_prev = (t_sample *)getbytes(l * sizeof(t_sample))) ||
+        !(s->s_fft = (t_sample *)getbytes(n * sizeof(t_sample))) ||
+        !(s->s_acc = (t_sample *)getbytes(slot * sizeof(t_sample))))
+            return (0);
+    for (p = 0; p < s->s_npart; p++)
+    {
+        int m = (npoints - p * l < l ? npoints - p * l : l);
+        const t_float *fp = vec + (onset + p * l) * stride;
+            /* mayer_realifft() doesn't normalize, so we do it here */
+        for (i = 0; i < m; i++, fp += stride)
+            s->s_fft[i] = *fp * (1./n);
+        for (; i < n; i++)
+            s->s_fft[i] = 0;
+        mayer_realfft(n, s->s_fft);
+        convseg_unpack(s->s_fft, s->s_filter + p * slot, n);
+    }
+    if (!worker)
+        return (1);
+        /* run the inverse once so that the FFT package makes whatever
+        tables it needs here, and not in the worker thread */
+    mayer_realifft(n, s->s_fft);
+    if (!(s->s_in = (t_sample *)getbytes(l * sizeof(t_sample))) ||
+        !(s->s_jobin = (t_sample *)getbytes(l * sizeof(t_sample))) ||
+        !(s->s_out[0] = (t_sample *)getbytes(l * sizeof(t_sample))) ||
+        !(s->s_out[1] = (t_sample *)getbytes(l * sizeof(t_sample))))
+            return (0);
+    pthread_mutex_init(&s->s_mutex, 0);
+    pthread_cond_init(&s->s_cond, 0);
+    if (pthread_create(&s->s_thread, 0, convseg_thread, s))
+    {
+        pthread_cond_destroy(&s->s_cond);
+        pthread_mutex_destroy(&s->s_mutex);
+        error("conv~: couldn't start worker thread; running in DSP thread");
+    }
+    else s->s_threaded = 1;
+    return (1);
+}
+
+static void convseg_free(t_convseg *s)
+{
+    int l = s->s_size, slot = 2 * (l + 1);
+    if (s->s_threaded)
+    {
+        pthread_mutex_lock(&s->s_mutex);
+        s->s_quit = 1;
+        pthread_cond_broadcast(&s->s_cond);
+        pthread_mutex_unlock(&s->s_mutex);
+        pthread_join(s->s_thread, 0);
+        pthread_cond_destroy(&s->s_cond);
+        pthread_mutex_destroy(&s->s_mutex);
+    }
+    if (s->s_filter)
+        freebytes(s->s_filter, s->s_npart * slot * sizeof(t_sample));
+    if (s->s_fdl)
+        freebytes(s->s_fdl, s->s_npart * slot * sizeof(t_sample));
+    if (s->s_prev)
+        freebytes(s->s_prev, l * sizeof(t_sample));
+    if (s->s_fft)
+        freebytes(s->s_fft, 2 * l * sizeof(t_sample));
+    if (s->s_acc)
+        freebytes(s->s_acc, slot * sizeof(t_sample));
+    if (s->s_in)
+        freebytes(s->s_in, l * sizeof(t_sample));
+    if (s->s_jobin)
+        freebytes(s->s_jobin, l * sizeof(t_sample));
+    if (s->s_out[0])
+        freebytes(s->s_out[0], l * sizeof(t_sample));
+    if (s->s_out[1])
+        freebytes(s->s_out[1], l * sizeof(t_sample));
+}
+
+static void conv_tilde_clear(t_conv_tilde *x)
+{
+    int i;
+    for (i = 0; i < x->x_nseg; i++)
+        convseg_free(&x->x_seg[i]);
+    if (x->x_seg)
+        freebytes(x->x_seg, x->x_nseg * sizeof(t_convseg));
+    if (x->x_inbuf)
+        freebytes(x->x_inbuf, x->x_blocksize * sizeof(t_sample));
+    x->x_seg = 0;
+    x->x_inbuf = 0;
+    x->x_nseg = 0;
+}
+
+    /* size of the next segment's partitions, or 0 if this is the last */
+static int conv_tilde_nextsize(int size)
+{
+    return (size * CONV_GROWTH <= CONV_MAXPART ? size * CONV_GROWTH : 0);
+}
+
+    /* split the impulse response into segments for the given block size */
+static void conv_tilde_build(t_conv_tilde *x, int blocksize)
+{
+    t_float *vec;
+    int npoints, stride, nseg, onset, size, next, i;
+    t_garray *a;
+    conv_tilde_clear(x);
+    x->x_blocksize = blocksize;
+    x->x_vec = 0;
+    x->x_npoints = 0;
+    if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
+    {
+        if (*x->x_arrayname->s_name)
+            pd_error(x, "conv~: %s: no such array", x->x_arrayname->s_name);
+        return;
+    }
+    if (!garray_getfloatvec(a, &npoints, &vec, &stride))
+    {
+        pd_error(x, "%s: bad template for conv~", x->x_arrayname->s_name);
+        return;
+    }
+    garray_usedindsp(a);
+    x->x_vec = vec;
+    x->x_npoints = npoints;
+    if (!npoints || blocksize < 1)
+        return;
+    for (nseg = 0, onset = 0, size = blocksize; onset < npoints; nseg++)
+    {
+        if (!(next = conv_tilde_nextsize(size)))
+        {
+            nseg++;
+            break;
+        }
+        onset = 2 * next;
+        size = next;
+    }
+    if (!(x->x_seg = (t_convseg *)getbytes(nseg * sizeof(t_convseg))))
+        goto nomem;
+    x->x_nseg = nseg;
+    if (!(x->x_inbuf = (t_sample *)getbytes(blocksize * sizeof(t_sample))))
+        goto nomem;
+    for (i = 0, onset = 0, size = blocksize; i < nseg; i++)
+    {
+        int end = ((next = conv_tilde_nextsize(size)) ?
+            2 * next : npoints);
+        if (end > npoints)
+            end = npoints;
+        if (!convseg_init(&x->x_seg[i], vec, stride, end - onset,
+            onset, size, (i > 0)))
+                goto nomem;
+        onset = end;
+        size = next;
+    }
+    return;
+nomem:
+    pd_error(x, "conv~: out of memory");
+    conv_tilde_clear(x);
+}
+
+static void conv_tilde_set(t_conv_tilde *x, t_symbol *s)
+{
+    x->x_arrayname = s;
+    if (x->x_blocksize)
+        conv_tilde_build(x, x->x_blocksize);
+}
+
+static void conv_tilde_print(t_conv_tilde *x)
+{
+    int i;
+    post("conv~ %s: %d points, block size %d", x->x_arrayname->s_name,
+        x->x_npoints, x->x_blocksize);
+    for (i = 0; i < x->x_nseg; i++)
+    {
+        t_convseg *s = &x->x_seg[i];
+        post("  onset %d: %d partitions of %d (%s)", s->s_onset,
+            s->s_npart, s->s_size, (s->s_threaded ? "worker thread" :
+                "DSP thread"));
+        if (s->s_late)
+            post("    DSP thread waited for worker %d times", s->s_late);
+    }
+}
+
+static t_int *conv_tilde_perform(t_int *w)
+{
+    t_conv_tilde *x = (t_conv_tilde *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]), i, j;
+    if (!x->x_nseg)
+    {
+        while (n--)
+            *out++ = 0;
+        return (w+5);
+    }
+    memcpy(x->x_inbuf, in, n * sizeof(t_sample));
+    convseg_run(&x->x_seg[0], x->x_inbuf, out);
+    for (i = 1; i < x->x_nseg; i++)
+    {
+        t_convseg *s = &x->x_seg[i];
+        t_sample *op = s->s_out[s->s_readbuf] + s->s_readpos;
+        for (j = 0; j < n; j++)
+            out[j] += op[j];
+        s->s_readpos += n;
+        memcpy(s->s_in + s->s_fill, x->x_inbuf, n * sizeof(t_sample));
+        if ((s->s_fill += n) == s->s_size)
+            convseg_post(s);
+    }
+    return (w+5);
+}
+
+static void conv_tilde_dsp(t_conv_tilde *x, t_signal **sp)
+{
+    int n = sp[0]->s_n, npoints, stride;
+    t_float *vec;
+    t_garray *a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class);
+        /* only redo the (possibly long) partitioning if something
+        changed; "set" reads the array again after editing it */
+    if (n != x->x_blocksize || !a ||
+        !garray_getfloatvec(a, &npoints, &vec, &stride) ||
+        vec != x->x_vec || npoints != x->x_npoints)
+            conv_tilde_build(x, n);
+    else garray_usedindsp(a);
+    dsp_add(conv_tilde_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, n);
+}
+
+static void *conv_tilde_new(t_symbol *s)
+{
+    t_conv_tilde *x = (t_conv_tilde *)pd_new(conv_tilde_class);
+    x->x_arrayname = s;
+    x->x_f = 0;
+    outlet_new(&x->x_obj, gensym("signal"));
+    return (x);
+}
+
+static void conv_tilde_free(t_conv_tilde *x)
+{
+    conv_tilde_clear(x);
+}
+
+static void conv_tilde_setup(void)
+{
+    conv_tilde_class = class_new(gensym("conv~"),
+        (t_newmethod)conv_tilde_new, (t_method)conv_tilde_free,
+        sizeof(t_conv_tilde), 0, A_DEFSYM, 0);
+    CLASS_MAINSIGNALIN(conv_tilde_class, t_conv_tilde, x_f);
+    class_addmethod(conv_tilde_class, (t_method)conv_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(conv_tilde_class, (t_method)conv_tilde_set,
+        gensym("set"), A_SYMBOL, 0);
+    class_addmethod(conv_tilde_class, (t_method)conv_tilde_print,
+        gensym("print"), 0);
+}
+
 /* ------------------------ global setup routine ------------------------- */
 
 void d_fft_setup(void)
@@ -352,4 +942,5 @@ void d_fft_setup(void)
     sigrfft_setup();
     sigrifft_setup();
     sigframp_setup();
+    conv_tilde_setup();
 }
@@ -20,6 +20,10 @@ for another, more permissive-sounding copyright notice.  -MSP
 
 /* ---------- Pd interface to OOURA FFT; imitate Mayer API ---------- */
 #include "m_pd.h"
+#include "s_stuff.h"
+#include "s_simd.h"
+#include <math.h>
+#include <pthread.h>
 
 #ifdef HAVE_ALLOCA_H        /* ifdef nonsense to find include for alloca() */
 # include <alloca.h>        /* linux, mac, mingw, cygwin */
@@ -35,74 +39,622 @@ void rdft(int, int, FFTFLT *, int *, FFTFLT *);
 
 int ilog2(int n);
 
-static int ooura_maxn;
-static int *ooura_bitrev;
-static int ooura_bitrevsize;
-static FFTFLT *ooura_costab;
+/* The Mayer-style entry points no longer call Ooura's transforms, which
+work in double precision on an interleaved copy of the data.  Instead each
+power-of-two size gets a "plan" holding its bit-reversal table and
+twiddle factors in t_sample precision, made on first use and then kept.
+The complex transforms run in place on Pd's separate real and imaginary
+vectors; the real ones run a half-size complex transform on a scratch
+copy, read straight out of (and written straight back into) Pd's packed
+layout.  The butterflies are done two stages per pass (radix 4) and
+have SSE2, AVX2 and NEON versions chosen by sys_getcpufeatures().
+Plans are never changed once made, so all this is reentrant.
+
+mayer_multirealfft() and mayer_multirealifft() do real transforms of
+several channels at once.  Groups of 4 or 8 channels (as the CPU allows)
+have their samples interleaved, so that each SIMD register holds the same
+point in each channel and every butterfly, even in the first stages, is
+done on full vectors with a single twiddle factor.
+
+Ooura's code below is kept intact for anyone calling cdft() or rdft()
+directly. */
 
-static int ooura_init( int n)
+#define FFT_MAXLOG 30
+#define FFT_MAXSCRATCH 32768  /* complex points of stack per channel group */
+
+typedef void (*t_fftpass)(t_sample *re, t_sample *im, int n, int h,
+    const t_sample *twre, const t_sample *twim);
+typedef void (*t_fftmpass)(t_sample *re, t_sample *im, int n, int h, int v,
+    const t_sample *twre, const t_sample *twim);
+
+typedef struct _fftplan
 {
-    n = (1 << ilog2(n));
-    if (n < 64)
-        return (0);
-    if (n > ooura_maxn)
+    int p_n;                /* number of complex points */
+    int *p_bitrev;          /* bit-reversal permutation */
+    t_sample *p_twre;       /* exp(-2 pi i k / 2h) for the stage of span */
+    t_sample *p_twim;       /* ... h, at [h - 1 + k] for k < h */
+    t_sample *p_rtwre;      /* exp(-2 pi i k / 2n) for 0 <= k <= n, for */
+    t_sample *p_rtwim;      /* ... real transforms of 2n points */
+    t_fftpass p_pass;       /* best radix-4 pass for this CPU */
+    t_fftmpass p_mpass;     /* ... and for several channels at once */
+    int p_nlanes;           /* how many channels p_mpass does */
+} t_fftplan;
+
+static t_fftplan *fft_plans[FFT_MAXLOG + 1];
+static pthread_mutex_t fft_planmutex = PTHREAD_MUTEX_INITIALIZER;
+
+#if defined(__GNUC__)
+#define FFT_LOADPLAN(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define FFT_STOREPLAN(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#else
+#define FFT_LOADPLAN(p) (*(t_fftplan * volatile *)&(p))
+#define FFT_STOREPLAN(p, v) (*(t_fftplan * volatile *)&(p) = (v))
+#endif
+
+    /* one radix-2 stage of span h; only used for the first stage when
+    the number of stages is odd, where all twiddles are one */
+static void fft_pass2(t_sample *re, t_sample *im, int n)
+{
+    int g;
+    for (g = 0; g < n; g += 2)
     {
-        if (ooura_maxn)
+        t_sample ar = re[g], ai = im[g], br = re[g+1], bi = im[g+1];
+        re[g] = ar + br; im[g] = ai + bi;
+        re[g+1] = ar - br; im[g+1] = ai - bi;
+    }
+}
+
+    /* two stages, of spans h and 2h, at once.  Within each group of 4h
+    points, with w1 the first stage's twiddle and w2 the second's:
+        b *= w1, d *= w1;  (a, b) = (a + b, a - b);  (c, d) = (c + d, c - d)
+        c *= w2, d *= -i w2;  (a, c) = (a + c, a - c);  (b, d) = (b + d, b - d)
+    */
+static void fft_pass4_c(t_sample *re, t_sample *im, int n, int h,
+    const t_sample *twre, const t_sample *twim)
+{
+    const t_sample *w1r = twre + (h - 1), *w1i = twim + (h - 1),
+        *w2r = twre + (2*h - 1), *w2i = twim + (2*h - 1);
+    int g, k;
+    for (g = 0; g < n; g += 4*h)
+    {
+        t_sample *r0 = re + g, *r1 = r0 + h, *r2 = r1 + h, *r3 = r2 + h;
+        t_sample *i0 = im + g, *i1 = i0 + h, *i2 = i1 + h, *i3 = i2 + h;
+        for (k = 0; k < h; k++)
         {
-            t_freebytes(ooura_bitrev, ooura_bitrevsize);
-            t_freebytes(ooura_costab, ooura_maxn * sizeof(FFTFLT) / 2);
+            t_sample br = r1[k] * w1r[k] - i1[k] * w1i[k],
+                bi = r1[k] * w1i[k] + i1[k] * w1r[k],
+                dr = r3[k] * w1r[k] - i3[k] * w1i[k],
+                di = r3[k] * w1i[k] + i3[k] * w1r[k];
+            t_sample ar = r0[k] + br, ai = i0[k] + bi,
+                b2r = r0[k] - br, b2i = i0[k] - bi,
+                cr = r2[k] + dr, ci = i2[k] + di,
+                d2r = r2[k] - dr, d2i = i2[k] - di, tr, ti;
+            tr = cr * w2r[k] - ci * w2i[k];
+            ti = cr * w2i[k] + ci * w2r[k];
+            r0[k] = ar + tr; i0[k] = ai + ti;
+            r2[k] = ar - tr; i2[k] = ai - ti;
+                /* -i w2 d = (w2 d).imag - i (w2 d).real */
+            tr = d2r * w2i[k] + d2i * w2r[k];
+            ti = -(d2r * w2r[k] - d2i * w2i[k]);
+            r1[k] = b2r + tr; i1[k] = b2i + ti;
+            r3[k] = b2r - tr; i3[k] = b2i - ti;
         }
-        ooura_bitrevsize = sizeof(int) * (2 + (1 << (ilog2(n)/2)));
-        ooura_bitrev = (int *)t_getbytes(ooura_bitrevsize);
-        ooura_bitrev[0] = 0;
-        if (!ooura_bitrev)
+    }
+}
+
+#ifdef PD_SIMD_SSE2
+static void fft_pass4_sse2(t_sample *re, t_sample *im, int n, int h,
+    const t_sample *twre, const t_sample *twim)
+{
+    const t_sample *w1r = twre + (h - 1), *w1i = twim + (h - 1),
+        *w2r = twre + (2*h - 1), *w2i = twim + (2*h - 1);
+    int g, k;
+    if (h & 3)
+    {
+        fft_pass4_c(re, im, n, h, twre, twim);
+        return;
+    }
+    for (g = 0; g < n; g += 4*h)
+    {
+        t_sample *r0 = re + g, *r1 = r0 + h, *r2 = r1 + h, *r3 = r2 + h;
+        t_sample *i0 = im + g, *i1 = i0 + h, *i2 = i1 + h, *i3 = i2 + h;
+        for (k = 0; k < h; k += 4)
         {
-            error("out of memory allocating FFT buffer");
-            ooura_maxn = 0;
-            return (0);
+            __m128 ar, ai, br, bi, cr, ci, dr, di, tr, ti, wr, wi;
+            wr = _mm_loadu_ps(w1r + k); wi = _mm_loadu_ps(w1i + k);
+            ar = _mm_loadu_ps(r1 + k); ai = _mm_loadu_ps(i1 + k);
+            br = _mm_sub_ps(_mm_mul_ps(ar, wr), _mm_mul_ps(ai, wi));
+            bi = _mm_add_ps(_mm_mul_ps(ar, wi), _mm_mul_ps(ai, wr));
+            ar = _mm_loadu_ps(r3 + k); ai = _mm_loadu_ps(i3 + k);
+            dr = _mm_sub_ps(_mm_mul_ps(ar, wr), _mm_mul_ps(ai, wi));
+            di = _mm_add_ps(_mm_mul_ps(ar, wi), _mm_mul_ps(ai, wr));
+            ar = _mm_loadu_ps(r0 + k); ai = _mm_loadu_ps(i0 + k);
+            cr = _mm_loadu_ps(r2 + k); ci = _mm_loadu_ps(i2 + k);
+            tr = _mm_sub_ps(ar, br); ti = _mm_sub_ps(ai, bi);
+            ar = _mm_add_ps(ar, br); ai = _mm_add_ps(ai, bi);
+            br = tr; bi = ti;
+            tr = _mm_sub_ps(cr, dr); ti = _mm_sub_ps(ci, di);
+            cr = _mm_add_ps(cr, dr); ci = _mm_add_ps(ci, di);
+            dr = tr; di = ti;
+            wr = _mm_loadu_ps(w2r + k); wi = _mm_loadu_ps(w2i + k);
+            tr = _mm_sub_ps(_mm_mul_ps(cr, wr), _mm_mul_ps(ci, wi));
+            ti = _mm_add_ps(_mm_mul_ps(cr, wi), _mm_mul_ps(ci, wr));
+            _mm_storeu_ps(r0 + k, _mm_add_ps(ar, tr));
+            _mm_storeu_ps(i0 + k, _mm_add_ps(ai, ti));
+            _mm_storeu_ps(r2 + k, _mm_sub_ps(ar, tr));
+            _mm_storeu_ps(i2 + k, _mm_sub_ps(ai, ti));
+            tr = _mm_add_ps(_mm_mul_ps(dr, wi), _mm_mul_ps(di, wr));
+            ti = _mm_sub_ps(_mm_mul_ps(di, wi), _mm_mul_ps(dr, wr));
+            _mm_storeu_ps(r1 + k, _mm_add_ps(br, tr));
+            _mm_storeu_ps(i1 + k, _mm_add_ps(bi, ti));
+            _mm_storeu_ps(r3 + k, _mm_sub_ps(br, tr));
+            _mm_storeu_ps(i3 + k, _mm_sub_ps(bi, ti));
         }
-        ooura_costab = (FFTFLT *)t_getbytes(n * sizeof(FFTFLT)/2);
-        if (!ooura_costab)
+    }
+}
+#endif /* PD_SIMD_SSE2 */
+
+#ifdef PD_SIMD_AVX2
+PD_SIMD_AVX2FN static void fft_pass4_avx2(t_sample *re, t_sample *im, int n,
+    int h, const t_sample *twre, const t_sample *twim)
+{
+    const t_sample *w1r = twre + (h - 1), *w1i = twim + (h - 1),
+        *w2r = twre + (2*h - 1), *w2i = twim + (2*h - 1);
+    int g, k;
+    if (h & 7)
+    {
+        fft_pass4_sse2(re, im, n, h, twre, twim);
+        return;
+    }
+    for (g = 0; g < n; g += 4*h)
+    {
+        t_sample *r0 = re + g, *r1 = r0 + h, *r2 = r1 + h, *r3 = r2 + h;
+        t_sample *i0 = im + g, *i1 = i0 + h, *i2 = i1 + h, *i3 = i2 + h;
+        for (k = 0; k < h; k += 8)
         {
-            error("out of memory allocating FFT buffer");
-            t_freebytes(ooura_bitrev, ooura_bitrevsize);
-            ooura_maxn = 0;
-            return (0);
+            __m256 ar, ai, br, bi, cr, ci, dr, di, tr, ti, wr, wi;
+            wr = _mm256_loadu_ps(w1r + k); wi = _mm256_loadu_ps(w1i + k);
+            ar = _mm256_loadu_ps(r1 + k); ai = _mm256_loadu_ps(i1 + k);
+            br = _mm256_fmsub_ps(ar, wr, _mm256_mul_ps(ai, wi));
+            bi = _mm256_fmadd_ps(ar, wi, _mm256_mul_ps(ai, wr));
+            ar = _mm256_loadu_ps(r3 + k); ai = _mm256_loadu_ps(i3 + k);
+            dr = _mm256_fmsub_ps(ar, wr, _mm256_mul_ps(ai, wi));
+            di = _mm256_fmadd_ps(ar, wi, _mm256_mul_ps(ai, wr));
+            ar = _mm256_loadu_ps(r0 + k); ai = _mm256_loadu_ps(i0 + k);
+            cr = _mm256_loadu_ps(r2 + k); ci = _mm256_loadu_ps(i2 + k);
+            tr = _mm256_sub_ps(ar, br); ti = _mm256_sub_ps(ai, bi);
+            ar = _mm256_add_ps(ar, br); ai = _mm256_add_ps(ai, bi);
+            br = tr; bi = ti;
+            tr = _mm256_sub_ps(cr, dr); ti = _mm256_sub_ps(ci, di);
+            cr = _mm256_add_ps(cr, dr); ci = _mm256_add_ps(ci, di);
+            dr = tr; di = ti;
+            wr = _mm256_loadu_ps(w2r + k); wi = _mm256_loadu_ps(w2i + k);
+            tr = _mm256_fmsub_ps(cr, wr, _mm256_mul_ps(ci, wi));
+            ti = _mm256_fmadd_ps(cr, wi, _mm256_mul_ps(ci, wr));
+            _mm256_storeu_ps(r0 + k, _mm256_add_ps(ar, tr));
+            _mm256_storeu_ps(i0 + k, _mm256_add_ps(ai, ti));
+            _mm256_storeu_ps(r2 + k, _mm256_sub_ps(ar, tr));
+            _mm256_storeu_ps(i2 + k, _mm256_sub_ps(ai, ti));
+            tr = _mm256_fmadd_ps(dr, wi, _mm256_mul_ps(di, wr));
+            ti = _mm256_fmsub_ps(di, wi, _mm256_mul_ps(dr, wr));
+            _mm256_storeu_ps(r1 + k, _mm256_add_ps(br, tr));
+            _mm256_storeu_ps(i1 + k, _mm256_add_ps(bi, ti));
+            _mm256_storeu_ps(r3 + k, _mm256_sub_ps(br, tr));
+            _mm256_storeu_ps(i3 + k, _mm256_sub_ps(bi, ti));
         }
-        ooura_maxn = n;
-        ooura_bitrev[0] = 0;
     }
-    return (1);
 }
+#endif /* PD_SIMD_AVX2 */
 
-EXTERN void mayer_fht(t_sample *fz, int n)
+#ifdef PD_SIMD_NEON
+static void fft_pass4_neon(t_sample *re, t_sample *im, int n, int h,
+    const t_sample *twre, const t_sample *twim)
 {
-    post("FHT: not yet implemented");
+    const t_sample *w1r = twre + (h - 1), *w1i = twim + (h - 1),
+        *w2r = twre + (2*h - 1), *w2i = twim + (2*h - 1);
+    int g, k;
+    if (h & 3)
+    {
+        fft_pass4_c(re, im, n, h, twre, twim);
+        return;
+    }
+    for (g = 0; g < n; g += 4*h)
+    {
+        t_sample *r0 = re + g, *r1 = r0 + h, *r2 = r1 + h, *r3 = r2 + h;
+        t_sample *i0 = im + g, *i1 = i0 + h, *i2 = i1 + h, *i3 = i2 + h;
+        for (k = 0; k < h; k += 4)
+        {
+            float32x4_t ar, ai, br, bi, cr, ci, dr, di, tr, ti, wr, wi;
+            wr = vld1q_f32(w1r + k); wi = vld1q_f32(w1i + k);
+            ar = vld1q_f32(r1 + k); ai = vld1q_f32(i1 + k);
+            br = vfmsq_f32(vmulq_f32(ar, wr), ai, wi);
+            bi = vfmaq_f32(vmulq_f32(ar, wi), ai, wr);
+            ar = vld1q_f32(r3 + k); ai = vld1q_f32(i3 + k);
+            dr = vfmsq_f32(vmulq_f32(ar, wr), ai, wi);
+            di = vfmaq_f32(vmulq_f32(ar, wi), ai, wr);
+            ar = vld1q_f32(r0 + k); ai = vld1q_f32(i0 + k);
+            cr = vld1q_f32(r2 + k); ci = vld1q_f32(i2 + k);
+            tr = vsubq_f32(ar, br); ti = vsubq_f32(ai, bi);
+            ar = vaddq_f32(ar, br); ai = vaddq_f32(ai, bi);
+            br = tr; bi = ti;
+            tr = vsubq_f32(cr, dr); ti = vsubq_f32(ci, di);
+            cr = vaddq_f32(cr, dr); ci = vaddq_f32(ci, di);
+            dr = tr; di = ti;
+            wr = vld1q_f32(w2r + k); wi = vld1q_f32(w2i + k);
+            tr = vfmsq_f32(vmulq_f32(cr, wr), ci, wi);
+            ti = vfmaq_f32(vmulq_f32(cr, wi), ci, wr);
+            vst1q_f32(r0 + k, vaddq_f32(ar, tr));
+            vst1q_f32(i0 + k, vaddq_f32(ai, ti));
+            vst1q_f32(r2 + k, vsubq_f32(ar, tr));
+            vst1q_f32(i2 + k, vsubq_f32(ai, ti));
+            tr = vfmaq_f32(vmulq_f32(dr, wi), di, wr);
+            ti = vfmsq_f32(vmulq_f32(di, wi), dr, wr);
+            vst1q_f32(r1 + k, vaddq_f32(br, tr));
+            vst1q_f32(i1 + k, vaddq_f32(bi, ti));
+            vst1q_f32(r3 + k, vsubq_f32(br, tr));
+            vst1q_f32(i3 + k, vsubq_f32(bi, ti));
+        }
+    }
 }
+#endif /* PD_SIMD_NEON */
 
-EXTERN void mayer_dofft(t_sample *fz1, t_sample *fz2, int n, int sgn)
+/* --------- the same passes on "v" channels interleaved ------------- */
+
+static void fft_mpass2(t_sample *re, t_sample *im, int n, int v)
 {
-    FFTFLT *buf, *fp3;
-    int i;
-    t_sample *fp1, *fp2;
-    buf = alloca(n * (2 * sizeof(FFTFLT)));
-    if (!ooura_init(2*n))
+    int g, c;
+    for (g = 0; g < n * v; g += 2 * v)
+    {
+        t_sample *r0 = re + g, *r1 = r0 + v, *i0 = im + g, *i1 = i0 + v;
+        for (c = 0; c < v; c++)
+        {
+            t_sample ar = r0[c], ai = i0[c], br = r1[c], bi = i1[c];
+            r0[c] = ar + br; i0[c] = ai + bi;
+            r1[c] = ar - br; i1[c] = ai - bi;
+        }
+    }
+}
+
+static void fft_mpass4_c(t_sample *re, t_sample *im, int n, int h, int v,
+    const t_sample *twre, const t_sample *twim)
+{
+    const t_sample *w1r = twre + (h - 1), *w1i = twim + (h - 1),
+        *w2r = twre + (2*h - 1), *w2i = twim + (2*h - 1);
+    int g, k, c, hv = h * v;
+    for (g = 0; g < n * v; g += 4 * hv)
+        for (k = 0; k < h; k++)
+    {
+        t_sample *r0 = re + g + k * v, *r1 = r0 + hv, *r2 = r1 + hv,
+            *r3 = r2 + hv;
+        t_sample *i0 = im + g + k * v, *i1 = i0 + hv, *i2 = i1 + hv,
+            *i3 = i2 + hv;
+        t_sample wr1 = w1r[k], wi1 = w1i[k], wr2 = w2r[k], wi2 = w2i[k];
+        for (c = 0; c < v; c++)
+        {
+            t_sample br = r1[c] * wr1 - i1[c] * wi1,
+                bi = r1[c] * wi1 + i1[c] * wr1,
+                dr = r3[c] * wr1 - i3[c] * wi1,
+                di = r3[c] * wi1 + i3[c] * wr1;
+            t_sample ar = r0[c] + br, ai = i0[c] + bi,
+                b2r = r0[c] - br, b2i = i0[c] - bi,
+                cr = r2[c] + dr, ci = i2[c] + di,
+                d2r = r2[c] - dr, d2i = i2[c] - di, tr, ti;
+            tr = cr * wr2 - ci * wi2;
+            ti = cr * wi2 + ci * wr2;
+            r0[c] = ar + tr; i0[c] = ai + ti;
+            r2[c] = ar - tr; i2[c] = ai - ti;
+            tr = d2r * wi2 + d2i * wr2;
+            ti = -(d2r * wr2 - d2i * wi2);
+            r1[c] = b2r + tr; i1[c] = b2i + ti;
+            r3[c] = b2r - tr; i3[c] = b2i - ti;
+        }
+    }
+}
+
+#ifdef PD_SIMD_SSE2
+static void fft_mpass4_sse2(t_sample *re, t_sample *im, int n, int h, int v,
+    const t_sample *twre, const t_sample *twim)
+{
+    const t_sample *w1r = twre + (h - 1), *w1i = twim + (h - 1),
+        *w2r = twre + (2*h - 1), *w2i = twim + (2*h - 1);
+    int g, k, hv = 4 * h;
+    for (g = 0; g < 4 * n; g += 4 * hv)
+        for (k = 0; k < h; k++)
+    {
+        t_sample *r0 = re + g + 4 * k, *r1 = r0 + hv, *r2 = r1 + hv,
+            *r3 = r2 + hv;
+        t_sample *i0 = im + g + 4 * k, *i1 = i0 + hv, *i2 = i1 + hv,
+            *i3 = i2 + hv;
+        __m128 wr = _mm_set1_ps(w1r[k]), wi = _mm_set1_ps(w1i[k]);
+        __m128 ar, ai, br, bi, cr, ci, dr, di, tr, ti;
+        ar = _mm_load_ps(r1); ai = _mm_load_ps(i1);
+        br = _mm_sub_ps(_mm_mul_ps(ar, wr), _mm_mul_ps(ai, wi));
+        bi = _mm_add_ps(_mm_mul_ps(ar, wi), _mm_mul_ps(ai, wr));
+        ar = _mm_load_ps(r3); ai = _mm_load_ps(i3);
+        dr = _mm_sub_ps(_mm_mul_ps(ar, wr), _mm_mul_ps(ai, wi));
+        di = _mm_add_ps(_mm_mul_ps(ar, wi), _mm_mul_ps(ai, wr));
+        ar = _mm_load_ps(r0); ai = _mm_load_ps(i0);
+        cr = _mm_load_ps(r2); ci = _mm_load_ps(i2);
+        tr = _mm_sub_ps(ar, br); ti = _mm_sub_ps(ai, bi);
+        ar = _mm_add_ps(ar, br); ai = _mm_add_ps(ai, bi);
+        br = tr; bi = ti;
+        tr = _mm_sub_ps(cr, dr); ti = _mm_sub_ps(ci, di);
+        cr = _mm_add_ps(cr, dr); ci = _mm_add_ps(ci, di);
+        dr = tr; di = ti;
+        wr = _mm_set1_ps(w2r[k]); wi = _mm_set1_ps(w2i[k]);
+        tr = _mm_sub_ps(_mm_mul_ps(cr, wr), _mm_mul_ps(ci, wi));
+        ti = _mm_add_ps(_mm_mul_ps(cr, wi), _mm_mul_ps(ci, wr));
+        _mm_store_ps(r0, _mm_add_ps(ar, tr));
+        _mm_store_ps(i0, _mm_add_ps(ai, ti));
+        _mm_store_ps(r2, _mm_sub_ps(ar, tr));
+        _mm_store_ps(i2, _mm_sub_ps(ai, ti));
+        tr = _mm_add_ps(_mm_mul_ps(dr, wi), _mm_mul_ps(di, wr));
+        ti = _mm_sub_ps(_mm_mul_ps(di, wi), _mm_mul_ps(dr, wr));
+        _mm_store_ps(r1, _mm_add_ps(br, tr));
+        _mm_store_ps(i1, _mm_add_ps(bi, ti));
+        _mm_store_ps(r3, _mm_sub_ps(br, tr));
+        _mm_store_ps(i3, _mm_sub_ps(bi, ti));
+    }
+}
+#endif /* PD_SIMD_SSE2 */
+
+#ifdef PD_SIMD_AVX2
+PD_SIMD_AVX2FN static void fft_mpass4_avx2(t_sample *re, t_sample *im, int n,
+    int h, int v, const t_sample *twre, const t_sample *twim)
+{
+    const t_sample *w1r = twre + (h - 1), *w1i = twim + (h - 1),
+        *w2r = twre + (2*h - 1), *w2i = twim + (2*h - 1);
+    int g, k, hv = 8 * h;
+    for (g = 0; g < 8 * n; g += 4 * hv)
+        for (k = 0; k < h; k++)
+    {
+        t_sample *r0 = re + g + 8 * k, *r1 = r0 + hv, *r2 = r1 + hv,
+            *r3 = r2 + hv;
+        t_sample *i0 = im + g + 8 * k, *i1 = i0 + hv, *i2 = i1 + hv,
+            *i3 = i2 + hv;
+        __m256 wr = _mm256_set1_ps(w1r[k]), wi = _mm256_set1_ps(w1i[k]);
+        __m256 ar, ai, br, bi, cr, ci, dr, di, tr, ti;
+        ar = _mm256_load_ps(r1); ai = _mm256_load_ps(i1);
+        br = _mm256_fmsub_ps(ar, wr, _mm256_mul_ps(ai, wi));
+        bi = _mm256_fmadd_ps(ar, wi, _mm256_mul_ps(ai, wr));
+        ar = _mm256_load_ps(r3); ai = _mm256_load_ps(i3);
+        dr = _mm256_fmsub_ps(ar, wr, _mm256_mul_ps(ai, wi));
+        di = _mm256_fmadd_ps(ar, wi, _mm256_mul_ps(ai, wr));
+        ar = _mm256_load_ps(r0); ai = _mm256_load_ps(i0);
+        cr = _mm256_load_ps(r2); ci = _mm256_load_ps(i2);
+        tr = _mm256_sub_ps(ar, br); ti = _mm256_sub_ps(ai, bi);
+        ar = _mm256_add_ps(ar, br); ai = _mm256_add_ps(ai, bi);
+        br = tr; bi = ti;
+        tr = _mm256_sub_ps(cr, dr); ti = _mm256_sub_ps(ci, di);
+        cr = _mm256_add_ps(cr, dr); ci = _mm256_add_ps(ci, di);
+        dr = tr; di = ti;
+        wr = _mm256_set1_ps(w2r[k]); wi = _mm256_set1_ps(w2i[k]);
+        tr = _mm256_fmsub_ps(cr, wr, _mm256_mul_ps(ci, wi));
+        ti = _mm256_fmadd_ps(cr, wi, _mm256_mul_ps(ci, wr));
+        _mm256_store_ps(r0, _mm256_add_ps(ar, tr));
+        _mm256_store_ps(i0, _mm256_add_ps(ai, ti));
+        _mm256_store_ps(r2, _mm256_sub_ps(ar, tr));
+        _mm256_store_ps(i2, _mm256_sub_ps(ai, ti));
+        tr = _mm256_fmadd_ps(dr, wi, _mm256_mul_ps(di, wr));
+        ti = _mm256_fmsub_ps(di, wi, _mm256_mul_ps(dr, wr));
+        _mm256_store_ps(r1, _mm256_add_ps(br, tr));
+        _mm256_store_ps(i1, _mm256_add_ps(bi, ti));
+        _mm256_store_ps(r3, _mm256_sub_ps(br, tr));
+        _mm256_store_ps(i3, _mm256_sub_ps(bi, ti));
+    }
+}
+#endif /* PD_SIMD_AVX2 */
+
+#ifdef PD_SIMD_NEON
+static void fft_mpass4_neon(t_sample *re, t_sample *im, int n, int h, int v,
+    const t_sample *twre, const t_sample *twim)
+{
+    const t_sample *w1r = twre + (h - 1), *w1i = twim + (h - 1),
+        *w2r = twre + (2*h - 1), *w2i = twim + (2*h - 1);
+    int g, k, hv = 4 * h;
+    for (g = 0; g < 4 * n; g += 4 * hv)
+        for (k = 0; k < h; k++)
+    {
+        t_sample *r0 = re + g + 4 * k, *r1 = r0 + hv, *r2 = r1 + hv,
+            *r3 = r2 + hv;
+        t_sample *i0 = im + g + 4 * k, *i1 = i0 + hv, *i2 = i1 + hv,
+            *i3 = i2 + hv;
+        float32x4_t wr = vdupq_n_f32(w1r[k]), wi = vdupq_n_f32(w1i[k]);
+        float32x4_t ar, ai, br, bi, cr, ci, dr, di, tr, ti;
+        ar = vld1q_f32(r1); ai = vld1q_f32(i1);
+        br = vfmsq_f32(vmulq_f32(ar, wr), ai, wi);
+        bi = vfmaq_f32(vmulq_f32(ar, wi), ai, wr);
+        ar = vld1q_f32(r3); ai = vld1q_f32(i3);
+        dr = vfmsq_f32(vmulq_f32(ar, wr), ai, wi);
+        di = vfmaq_f32(vmulq_f32(ar, wi), ai, wr);
+        ar = vld1q_f32(r0); ai = vld1q_f32(i0);
+        cr = vld1q_f32(r2); ci = vld1q_f32(i2);
+        tr = vsubq_f32(ar, br); ti = vsubq_f32(ai, bi);
+        ar = vaddq_f32(ar, br); ai = vaddq_f32(ai, bi);
+        br = tr; bi = ti;
+        tr = vsubq_f32(cr, dr); ti = vsubq_f32(ci, di);
+        cr = vaddq_f32(cr, dr); ci = vaddq_f32(ci, di);
+        dr = tr; di = ti;
+        wr = vdupq_n_f32(w2r[k]); wi = vdupq_n_f32(w2i[k]);
+        tr = vfmsq_f32(vmulq_f32(cr, wr), ci, wi);
+        ti = vfmaq_f32(vmulq_f32(cr, wi), ci, wr);
+        vst1q_f32(r0, vaddq_f32(ar, tr));
+        vst1q_f32(i0, vaddq_f32(ai, ti));
+        vst1q_f32(r2, vsubq_f32(ar, tr));
+        vst1q_f32(i2, vsubq_f32(ai, ti));
+        tr = vfmaq_f32(vmulq_f32(dr, wi), di, wr);
+        ti = vfmsq_f32(vmulq_f32(di, wi), dr, wr);
+        vst1q_f32(r1, vaddq_f32(br, tr));
+        vst1q_f32(i1, vaddq_f32(bi, ti));
+        vst1q_f32(r3, vsubq_f32(br, tr));
+        vst1q_f32(i3, vsubq_f32(bi, ti));
+    }
+}
+#endif /* PD_SIMD_NEON */
+
+static void fft_freeplan(t_fftplan *p)
+{
+    int n = p->p_n;
+    if (p->p_bitrev)
+        t_freebytes(p->p_bitrev, n * sizeof(int));
+    if (p->p_twre)
+        t_freebytes(p->p_twre, n * sizeof(t_sample));
+    if (p->p_twim)
+        t_freebytes(p->p_twim, n * sizeof(t_sample));
+    if (p->p_rtwre)
+        t_freebytes(p->p_rtwre, (n + 1) * sizeof(t_sample));
+    if (p->p_rtwim)
+        t_freebytes(p->p_rtwim, (n + 1) * sizeof(t_sample));
+    t_freebytes(p, sizeof(*p));
+}
+
+static t_fftplan *fft_newplan(int n, int logn)
+{
+    t_fftplan *p = (t_fftplan *)t_getbytes(sizeof(*p));
+    int i, h, k, cpu = sys_getcpufeatures();
+    if (!p)
+        return (0);
+    p->p_n = n;
+    p->p_bitrev = (int *)t_getbytes(n * sizeof(int));
+    p->p_twre = (t_sample *)t_getbytes(n * sizeof(t_sample));
+    p->p_twim = (t_sample *)t_getbytes(n * sizeof(t_sample));
+    p->p_rtwre = (t_sample *)t_getbytes((n + 1) * sizeof(t_sample));
+    p->p_rtwim = (t_sample *)t_getbytes((n + 1) * sizeof(t_sample));
+    if (!p->p_bitrev || !p->p_twre || !p->p_twim || !p->p_rtwre ||
+        !p->p_rtwim)
+    {
+        error("out of memory allocating FFT plan");
+        fft_freeplan(p);
+        return (0);
+    }
+    for (i = 0; i < n; i++)
+    {
+        int j, r = 0;
+        for (j = 0; j < logn; j++)
+            r |= ((i >> j) & 1) << (logn - 1 - j);
+        p->p_bitrev[i] = r;
+    }
+    for (h = 1; h < n; h *= 2)
+        for (k = 0; k < h; k++)
+    {
+        p->p_twre[h - 1 + k] = cos(3.14159265358979323846 * k / h);
+        p->p_twim[h - 1 + k] = -sin(3.14159265358979323846 * k / h);
+    }
+    for (k = 0; k <= n; k++)
+    {
+        p->p_rtwre[k] = cos(3.14159265358979323846 * k / n);
+        p->p_rtwim[k] = -sin(3.14159265358979323846 * k / n);
+    }
+    p->p_pass = fft_pass4_c;
+    p->p_mpass = fft_mpass4_c;
+    p->p_nlanes = 1;
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+    {
+        p->p_pass = fft_pass4_sse2;
+        p->p_mpass = fft_mpass4_sse2;
+        p->p_nlanes = 4;
+    }
+#endif
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+    {
+        p->p_pass = fft_pass4_avx2;
+        p->p_mpass = fft_mpass4_avx2;
+        p->p_nlanes = 8;
+    }
+#endif
+#ifdef PD_SIMD_NEON
+    if (cpu & CPU_NEON)
+    {
+        p->p_pass = fft_pass4_neon;
+        p->p_mpass = fft_mpass4_neon;
+        p->p_nlanes = 4;
+    }
+#endif
+    return (p);
+}
+
+    /* find the plan for "n" complex points, making it if need be */
+static t_fftplan *fft_getplan(int n)
+{
+    int logn = ilog2(n);
+    t_fftplan *p;
+    if (n < 1 || n != (1 << logn) || logn > FFT_MAXLOG)
+        return (0);
+    if ((p = FFT_LOADPLAN(fft_plans[logn])))
+        return (p);
+    pthread_mutex_lock(&fft_planmutex);
+    if (!(p = fft_plans[logn]) && (p = fft_newplan(n, logn)))
+        FFT_STOREPLAN(fft_plans[logn], p);
+    pthread_mutex_unlock(&fft_planmutex);
+    return (p);
+}
+
+    /* forward complex transform of data already in bit-reversed order.
+    For the inverse, swap "re" and "im". */
+static void fft_run(const t_fftplan *p, t_sample *re, t_sample *im)
+{
+    int n = p->p_n, h = 1;
+    if (ilog2(n) & 1)
+    {
+        fft_pass2(re, im, n);
+        h = 2;
+    }
+    for (; h < n; h *= 4)
+        (*p->p_pass)(re, im, n, h, p->p_twre, p->p_twim);
+}
+
+    /* the same for "v" channels interleaved; v is 1 or p->p_nlanes */
+static void fft_mrun(const t_fftplan *p, t_sample *re, t_sample *im, int v)
+{
+    int n = p->p_n, h = 1;
+    if (v == 1)
+    {
+        fft_run(p, re, im);
         return;
-    for (i = 0, fp1 = fz1, fp2 = fz2, fp3 = buf; i < n; i++)
+    }
+    if (ilog2(n) & 1)
     {
-        fp3[0] = *fp1++;
-        fp3[1] = *fp2++;
-        fp3 += 2;
+        fft_mpass2(re, im, n, v);
+        h = 2;
     }
-    cdft(2*n, sgn, buf, ooura_bitrev, ooura_costab);
-    for (i = 0, fp1 = fz1, fp2 = fz2, fp3 = buf; i < n; i++)
+    for (; h < n; h *= 4)
+        (*p->p_mpass)(re, im, n, h, v, p->p_twre, p->p_twim);
+}
+
+    /* put complex data in bit-reversed order, in place */
+static void fft_bitreverse(const t_fftplan *p, t_sample *re, t_sample *im)
+{
+    int i, n = p->p_n;
+    for (i = 0; i < n; i++)
     {
-        *fp1++ = fp3[0];
-        *fp2++ = fp3[1];
-        fp3 += 2;
+        int j = p->p_bitrev[i];
+        if (i < j)
+        {
+            t_sample tr = re[i], ti = im[i];
+            re[i] = re[j]; im[i] = im[j];
+            re[j] = tr; im[j] = ti;
+        }
     }
 }
 
+EXTERN void mayer_fht(t_sample *fz, int n)
+{
+    post("FHT: not yet implemented");
+}
+
+EXTERN void mayer_dofft(t_sample *fz1, t_sample *fz2, int n, int sgn)
+{
+    t_fftplan *p = fft_getplan(n);
+    if (!p)
+        return;
+    fft_bitreverse(p, fz1, fz2);
+    if (sgn < 0)
+        fft_run(p, fz1, fz2);
+    else fft_run(p, fz2, fz1);
+}
+
 EXTERN void mayer_fft(int n, t_sample *fz1, t_sample *fz2)
 {
     mayer_dofft(fz1, fz2, n, -1);
@@ -113,56 +665,396 @@ EXTERN void mayer_ifft(int n, t_sample *fz1, t_sample *fz2)
     mayer_dofft(fz1, fz2, n, 1);
 }
 
+    /* Pd's packed layout for a real transform of n points: the real parts
+    of bins 0 through n/2 in fz[0] ... fz[n/2], and the imaginary parts of
+    bins 1 through n/2 - 1 backward from fz[n-1] to fz[n/2+1], the sign
+    being that of a transform with exp(+i...).  The n points are treated
+    as n/2 complex ones, z[j] = x[2j] + i x[2j+1], whose transform Z gives
+        X[k] = (Z[k] + Z*[m-k])/2 - i W^k (Z[k] - Z*[m-k])/2
+    with m = n/2 and W = exp(-2 pi i/n). */
 EXTERN void mayer_realfft(int n, t_sample *fz)
 {
-    FFTFLT *buf, *fp3;
-    int i, nover2 = n/2;
-    t_sample *fp1, *fp2;
-    buf = alloca(n * sizeof(FFTFLT));
-    if (!ooura_init(n))
+    int m = n/2, k;
+    t_fftplan *p = fft_getplan(m);
+    t_sample *zr, *zi;
+    if (!p)
         return;
-    for (i = 0, fp1 = fz, fp3 = buf; i < n; i++, fp1++, fp3++)
-        buf[i] = fz[i];
-    rdft(n, 1, buf, ooura_bitrev, ooura_costab);
-    fz[0] = buf[0];
-    fz[nover2] = buf[1];
-    for (i = 1, fp1 = fz+1, fp2 = fz+(n-1), fp3 = buf+2; i < nover2;
-        i++, fp1++, fp2--, fp3 += 2)
-            *fp1 = fp3[0], *fp2 = fp3[1];
+    zr = (t_sample *)alloca(n * sizeof(t_sample));
+    zi = zr + m;
+    for (k = 0; k < m; k++)
+    {
+        int j = p->p_bitrev[k];
+        zr[k] = fz[2*j];
+        zi[k] = fz[2*j+1];
+    }
+    fft_run(p, zr, zi);
+    fz[0] = zr[0] + zi[0];
+    fz[m] = zr[0] - zi[0];
+    for (k = 1; k < m; k++)
+    {
+        t_sample er = 0.5f * (zr[k] + zr[m-k]), ei = 0.5f * (zi[k] - zi[m-k]),
+            or = 0.5f * (zr[k] - zr[m-k]), oi = 0.5f * (zi[k] + zi[m-k]),
+            wr = p->p_rtwre[k], wi = p->p_rtwim[k];
+        fz[k] = er + wr * oi + wi * or;
+        fz[n-k] = wr * or - wi * oi - ei;
+    }
 }
 
 EXTERN void mayer_realifft(int n, t_sample *fz)
 {
-    FFTFLT *buf, *fp3;
-    int i, nover2 = n/2;
-    t_sample *fp1, *fp2;
-    buf = alloca(n * sizeof(FFTFLT));
-    if (!ooura_init(n))
+    int m = n/2, k;
+    t_fftplan *p = fft_getplan(m);
+    t_sample *zr, *zi;
+    if (!p)
         return;
-    buf[0] = fz[0];
-    buf[1] = fz[nover2];
-    for (i = 1, fp1 = fz+1, fp2 = fz+(n-1), fp3 = buf+2; i < nover2;
-        i++, fp1++, fp2--, fp3 += 2)
-            fp3[0] = *fp1, fp3[1] = *fp2;
-    rdft(n, -1, buf, ooura_bitrev, ooura_costab);
-    for (i = 0, fp1 = fz, fp3 = buf; i < n; i++, fp1++, fp3++)
-        fz[i] = 2*buf[i];
+    zr = (t_sample *)alloca(n * sizeof(t_sample));
+    zi = zr + m;
+        /* X[k] = fz[k] - i fz[n-k];  2Z[k] = (X[k] + X*[m-k]) +
+        i W^-k (X[k] - X*[m-k]) */
+    {
+        int j = p->p_bitrev[0];
+        zr[j] = fz[0] + fz[m];
+        zi[j] = fz[0] - fz[m];
+    }
+    for (k = 1; k < m; k++)
+    {
+        t_sample xr = fz[k], xi = -fz[n-k], yr = fz[m-k], yi = fz[n-m+k],
+            sr = xr + yr, si = xi + yi, dr = xr - yr, di = xi - yi,
+            wr = p->p_rtwre[k], wi = -p->p_rtwim[k];
+        int j = p->p_bitrev[k];
+            /* i W^-k d = i (wr dr - wi di) - (wr di + wi dr) */
+        zr[j] = sr - (wr * di + wi * dr);
+        zi[j] = si + (wr * dr - wi * di);
+    }
+    fft_run(p, zi, zr);
+    for (k = 0; k < m; k++)
+    {
+        fz[2*k] = zr[k];
+        fz[2*k+1] = zi[k];
+    }
 }
 
     /* ancient ISPW-like version, used in fiddle~ and perhaps other externs
     here and there. */
 void pd_fft(t_float *buf, int npoints, int inverse)
 {
-    FFTFLT *buf2 = (FFTFLT *)alloca(2 * npoints * sizeof(FFTFLT)), *bp2;
-    t_float *fp;
+    t_fftplan *p = fft_getplan(npoints);
+    t_sample *re, *im;
     int i;
-    if (!ooura_init(2*npoints))
+    if (!p)
+        return;
+    re = (t_sample *)alloca(2 * npoints * sizeof(t_sample));
+    im = re + npoints;
+    for (i = 0; i < npoints; i++)
+    {
+        int j = p->p_bitrev[i];
+        re[i] = buf[2*j];
+        im[i] = buf[2*j+1];
+    }
+    if (inverse)
+        fft_run(p, im, re);
+    else fft_run(p, re, im);
+    for (i = 0; i < npoints; i++)
+    {
+        buf[2*i] = re[i];
+        buf[2*i+1] = im[i];
+    }
+}
+
+    /* real transforms of "nchans" channels of n points each, from in[c]
+    to bins 0 through n/2 of re[c] and im[c], in the usual (exp(-i...))
+    sign convention.  The upper halves of re[c] and im[c] are left alone.
+    Channels are done in order, and all of a channel's input is read
+    before anything of the channel is written, so outputs may share
+    memory with inputs of the same or earlier channels (but not later
+    ones). */
+EXTERN void mayer_multirealfft(int n, int nchans, t_sample **in,
+    t_sample **re, t_sample **im)
+{
+    int m = n/2, v, c0, c, k;
+    t_fftplan *p = fft_getplan(m);
+    t_sample *buf, *zr, *zi;
+    if (!p)
         return;
-    for (i = 0, bp2 = buf2, fp = buf; i < 2 * npoints; i++, bp2++, fp++)
-        *bp2 = *fp;
-    cdft(2*npoints, (inverse ? 1 : -1), buf2, ooura_bitrev, ooura_costab);
-    for (i = 0, bp2 = buf2, fp = buf; i < 2 * npoints; i++, bp2++, fp++)
-        *fp = *bp2;
+    v = (m * p->p_nlanes <= FFT_MAXSCRATCH ? p->p_nlanes : 1);
+        /* aligned scratch for "v" channels; the SIMD passes need it */
+    buf = (t_sample *)alloca((n * v + 8) * sizeof(t_sample));
+    zr = (t_sample *)(((size_t)buf + 31) & ~(size_t)31);
+    zi = zr + m * v;
+    for (c0 = 0; c0 < nchans; c0 += v)
+    {
+        if (nchans - c0 < v)
+            v = 1;
+        for (k = 0; k < m; k++)
+        {
+            int j = 2 * p->p_bitrev[k];
+            for (c = 0; c < v; c++)
+            {
+                zr[k * v + c] = in[c0 + c][j];
+                zi[k * v + c] = in[c0 + c][j + 1];
+            }
+        }
+        fft_mrun(p, zr, zi, v);
+        for (c = 0; c < v; c++)
+        {
+            re[c0 + c][0] = zr[c] + zi[c];
+            re[c0 + c][m] = zr[c] - zi[c];
+            im[c0 + c][0] = im[c0 + c][m] = 0;
+        }
+        for (k = 1; k < m; k++)
+        {
+            t_sample wr = p->p_rtwre[k], wi = p->p_rtwim[k];
+            for (c = 0; c < v; c++)
+            {
+                t_sample ar = zr[k * v + c], ai = zi[k * v + c],
+                    br = zr[(m - k) * v + c], bi = zi[(m - k) * v + c],
+                    er = 0.5f * (ar + br), ei = 0.5f * (ai - bi),
+                    or = 0.5f * (ar - br), oi = 0.5f * (ai + bi);
+                re[c0 + c][k] = er + wr * oi + wi * or;
+                im[c0 + c][k] = ei + wi * oi - wr * or;
+            }
+        }
+    }
+}
+
+    /* the inverse: bins 0 through n/2 of re[c] and im[c] (whose imaginary
+    parts at 0 and n/2 are ignored) to n points of out[c], multiplied by n.
+    The same rules apply for sharing memory. */
+EXTERN void mayer_multirealifft(int n, int nchans, t_sample **re,
+    t_sample **im, t_sample **out)
+{
+    int m = n/2, v, c0, c, k;
+    t_fftplan *p = fft_getplan(m);
+    t_sample *buf, *zr, *zi;
+    if (!p)
+        return;
+    v = (m * p->p_nlanes <= FFT_MAXSCRATCH ? p->p_nlanes : 1);
+    buf = (t_sample *)alloca((n * v + 8) * sizeof(t_sample));
+    zr = (t_sample *)(((size_t)buf + 31) & ~(size_t)31);
+    zi = zr + m * v;
+    for (c0 = 0; c0 < nchans; c0 += v)
+    {
+        if (nchans - c0 < v)
+            v = 1;
+        for (c = 0; c < v; c++)
+        {
+            zr[c] = re[c0 + c][0] + re[c0 + c][m];
+            zi[c] = re[c0 + c][0] - re[c0 + c][m];
+        }
+        for (k = 1; k < m; k++)
+        {
+            t_sample wr = p->p_rtwre[k], wi = -p->p_rtwim[k];
+            int j = p->p_bitrev[k] * v;
+            for (c = 0; c < v; c++)
+            {
+                const t_sample *xr = re[c0 + c], *xi = im[c0 + c];
+                t_sample sr = xr[k] + xr[m-k], si = xi[k] - xi[m-k],
+                    dr = xr[k] - xr[m-k], di = xi[k] + xi[m-k];
+                zr[j + c] = sr - (wr * di + wi * dr);
+                zi[j + c] = si + (wr * dr - wi * di);
+            }
+        }
+        fft_mrun(p, zi, zr, v);
+        for (k = 0; k < m; k++)
+            for (c = 0; c < v; c++)
+        {
+            out[c0 + c][2*k] = zr[k * v + c];
+            out[c0 + c][2*k+1] = zi[k * v + c];
+        }
+    }
+}
+
+/* ------------------------- "pd fft-test" ---------------------------- */
+
+    /* check the transforms above against a DFT computed in double
+    precision, for every size from 2 to 8192 points, forward and inverse,
+    and time a forward and inverse pair next to the Ooura routines driven
+    the way this file used to drive them, copying to and from a double
+    buffer.  That only worked from 32 points (complex) or 64 (real) up.
+    Errors are relative to the largest output.  This holds up the
+    scheduler for a second or so. */
+
+#define FFTTEST_MAXLOG 13
+#define FFTTEST_TIME 0.01       /* seconds spent timing each case */
+
+    /* largest difference between "n" outputs and the reference, over the
+    largest reference value */
+static double ffttest_err(const t_sample *x, const double *ref, int n)
+{
+    double err = 0, big = 0;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        double diff = fabs(x[i] - ref[i]);
+        if (diff > err || diff != diff)
+            err = diff;
+        if (fabs(ref[i]) > big)
+            big = fabs(ref[i]);
+    }
+    return (big > 0 ? err / big : err);
+}
+
+    /* one forward and inverse pair, complex if "re" and "im" are both
+    given, else real; "old" for the Ooura routines */
+static void ffttest_pair(int n, t_sample *re, t_sample *im, int old,
+    FFTFLT *buf, int *ip, FFTFLT *w)
+{
+    int i, m = n/2;
+    if (!old)
+    {
+        if (im)
+            mayer_fft(n, re, im), mayer_ifft(n, re, im);
+        else mayer_realfft(n, re), mayer_realifft(n, re);
+    }
+    else if (im)
+    {
+        for (i = 0; i < n; i++)
+            buf[2*i] = re[i], buf[2*i+1] = im[i];
+        cdft(2*n, -1, buf, ip, w);
+        for (i = 0; i < n; i++)
+            re[i] = buf[2*i], im[i] = buf[2*i+1];
+        for (i = 0; i < n; i++)
+            buf[2*i] = re[i], buf[2*i+1] = im[i];
+        cdft(2*n, 1, buf, ip, w);
+        for (i = 0; i < n; i++)
+            re[i] = buf[2*i], im[i] = buf[2*i+1];
+    }
+    else
+    {
+        for (i = 0; i < n; i++)
+            buf[i] = re[i];
+        rdft(n, 1, buf, ip, w);
+        re[0] = buf[0], re[m] = buf[1];
+        for (i = 1; i < m; i++)
+            re[i] = buf[2*i], re[n-i] = buf[2*i+1];
+        buf[0] = re[0], buf[1] = re[m];
+        for (i = 1; i < m; i++)
+            buf[2*i] = re[i], buf[2*i+1] = re[n-i];
+        rdft(n, -1, buf, ip, w);
+        for (i = 0; i < n; i++)
+            re[i] = 2*buf[i];
+    }
+}
+
+    /* microseconds per pair, on zeros so the data can't grow */
+static double ffttest_time(int n, t_sample *re, t_sample *im, int old,
+    FFTFLT *buf, int *ip, FFTFLT *w)
+{
+    double start, elapsed;
+    int i, count = 0;
+    for (i = 0; i < n; i++)
+        re[i] = 0;
+    if (im)
+        for (i = 0; i < n; i++)
+            im[i] = 0;
+    if (old)    /* let Ooura make tables for this size outside the timing */
+        ip[0] = ip[1] = 0;
+    ffttest_pair(n, re, im, old, buf, ip, w);
+    start = sys_getrealtime();
+    do
+    {
+        ffttest_pair(n, re, im, old, buf, ip, w);
+        count++;
+    } while ((elapsed = sys_getrealtime() - start) < FFTTEST_TIME);
+    return (elapsed * 1e6 / count);
+}
+
+void glob_ffttest(void *dummy)
+{
+    int maxn = 1 << FFTTEST_MAXLOG, ipsize = 2 + (1 << (FFTTEST_MAXLOG+1)/2),
+        logn, i, j;
+    size_t nbytes = 2 * maxn * sizeof(t_sample) +
+        9 * maxn * sizeof(double) + ipsize * sizeof(int);
+    t_sample *re = (t_sample *)getbytes(nbytes), *im = re + maxn;
+    double *x = (double *)(im + maxn), *ref = x + 2 * maxn,
+        *ct = ref + 2 * maxn, *st = ct + maxn, *w = st + maxn,
+        *buf = w + maxn;    /* the last two for Ooura */
+    int *ip = (int *)(buf + 2 * maxn);
+    unsigned int seed = 1;
+    post("fft: max error relative to the largest output, forward and "
+        "inverse; us per forward and inverse pair, and the old way:");
+    for (logn = 1; logn <= FFTTEST_MAXLOG; logn++)
+    {
+        int n = 1 << logn, m = n/2, cplx;
+        for (i = 0; i < 2 * n; i++)
+        {
+            seed = seed * 435898247 + 382842987;
+            x[i] = ((seed & 0x7fffffff) * (1. / 0x40000000)) - 1;
+        }
+        for (i = 0; i < n; i++)
+            ct[i] = cos(i * (2 * 3.14159265358979 / n)),
+                st[i] = sin(i * (2 * 3.14159265358979 / n));
+        startpost("  %5d", n);
+        for (cplx = 1; cplx >= 0; cplx--)
+        {
+            double ferr, ierr, us, oldus;
+                /* the reference, in Pd's layout: re then im for complex,
+                packed for real */
+            for (i = 0; i < n; i++)
+            {
+                double sr = 0, si = 0;
+                for (j = 0; j < n; j++)
+                {
+                    int k = (i * j) & (n-1);
+                    if (cplx)
+                        sr += x[j] * ct[k] + x[n+j] * st[k],
+                            si += x[n+j] * ct[k] - x[j] * st[k];
+                    else sr += x[j] * ct[k], si += x[j] * st[k];
+                }
+                if (cplx)
+                    ref[i] = sr, ref[n+i] = si;
+                else if (i <= m)
+                {
+                    ref[i] = sr;
+                    if (i > 0 && i < m)
+                        ref[n-i] = si;
+                }
+            }
+            for (i = 0; i < n; i++)
+                re[i] = x[i], im[i] = x[n+i];
+            if (cplx)
+            {
+                mayer_fft(n, re, im);
+                ferr = ffttest_err(re, ref, n);
+                if ((ierr = ffttest_err(im, ref + n, n)) > ferr)
+                    ferr = ierr;
+            }
+            else
+            {
+                mayer_realfft(n, re);
+                ferr = ffttest_err(re, ref, n);
+            }
+                /* then back from the reference to n times the input */
+            for (i = 0; i < n; i++)
+            {
+                re[i] = ref[i], im[i] = ref[n+i];
+                ref[i] = n * x[i], ref[n+i] = n * x[n+i];
+            }
+            if (cplx)
+            {
+                mayer_ifft(n, re, im);
+                ierr = ffttest_err(re, ref, n);
+                if (ffttest_err(im, ref + n, n) > ierr)
+                    ierr = ffttest_err(im, ref + n, n);
+            }
+            else
+            {
+                mayer_realifft(n, re);
+                ierr = ffttest_err(re, ref, n);
+            }
+            us = ffttest_time(n, re, (cplx ? im : 0), 0, buf, ip, w);
+            startpost("  %s %.1e %.1e %.2f", (cplx ? "complex" : "real"),
+                ferr, ierr, us);
+            if (n >= (cplx ? 32 : 64))
+            {
+                oldus = ffttest_time(n, re, (cplx ? im : 0), 1, buf, ip, w);
+                startpost(" (%.2f)", oldus);
+            }
+            else startpost(" (-)");
+        }
+        endpost();
+    }
+    freebytes(re, nbytes);
 }
 
 /****************** end Pd-specific prologue ***********************/
@@ -8,6 +8,7 @@
 
 #include "m_pd.h"
 #include <fftw3.h>
+#include <pthread.h>
 
 int ilog2(int n);
 
@@ -66,9 +67,13 @@ static cfftw_info *cfftw_getplan(int n,int fwd)
 
 /* real stuff */
 
+    /* conv~ calls the real transforms from worker threads.  Its sizes
+    are planned beforehand in the main thread, but "in" and "out" are
+    shared by all callers, so each size has its own lock. */
 typedef struct {
     fftwf_plan plan;
     float *in,*out;
+    pthread_mutex_t mutex;
 } rfftw_info;
 
 static rfftw_info rfftw_fwd[MAXFFT+1 - MINFFT],rfftw_bwd[MAXFFT+1 - MINFFT];
@@ -85,6 +90,7 @@ static rfftw_info *rfftw_getplan(int n,int fwd)
         info->in = (float*) fftwf_malloc(sizeof(float) * n);
         info->out = (float*) fftwf_malloc(sizeof(float) * n);
         info->plan = fftwf_plan_r2r_1d(n, info->in, info->out, fwd?FFTW_R2HC:FFTW_HC2R, FFTW_MEASURE);
+        pthread_mutex_init(&info->mutex, 0);
     }
     return info;
 }
@@ -136,6 +142,7 @@ EXTERN void mayer_realfft(int n, float *fz)
     if (!p)
         return;
         
+    pthread_mutex_lock(&p->mutex);
     for (i = 0; i < n; i++)
         p->in[i] = fz[i];
     fftwf_execute(p->plan);
@@ -143,6 +150,7 @@ EXTERN void mayer_realfft(int n, float *fz)
         fz[i] = p->out[i];
     for (; i < n; i++)
         fz[i] = -p->out[i];
+    pthread_mutex_unlock(&p->mutex);
 }
 
 EXTERN void mayer_realifft(int n, float *fz)
@@ -152,6 +160,7 @@ EXTERN void mayer_realifft(int n, float *fz)
     if (!p)
         return;
         
+    pthread_mutex_lock(&p->mutex);
     for (i = 0; i < n/2+1; i++)
         p->in[i] = fz[i];
     for (; i < n; i++)
@@ -159,6 +168,52 @@ EXTERN void mayer_realifft(int n, float *fz)
     fftwf_execute(p->plan);
     for (i = 0; i < n; i++)
         fz[i] = p->out[i];
+    pthread_mutex_unlock(&p->mutex);
+}
+
+    /* several channels at once; see d_fft_fftsg.c for the layout.  FFTW
+    has its own SIMD code, so here we just do one channel after another. */
+EXTERN void mayer_multirealfft(int n, int nchans, float **in,
+    float **re, float **im)
+{
+    int c, i;
+    rfftw_info *p = rfftw_getplan(n, 1);
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->mutex);
+    for (c = 0; c < nchans; c++)
+    {
+        for (i = 0; i < n; i++)
+            p->in[i] = in[c][i];
+        fftwf_execute(p->plan);
+        for (i = 0; i < n/2+1; i++)
+            re[c][i] = p->out[i];
+        im[c][0] = im[c][n/2] = 0;
+        for (i = 1; i < n/2; i++)
+            im[c][i] = p->out[n-i];
+    }
+    pthread_mutex_unlock(&p->mutex);
+}
+
+EXTERN void mayer_multirealifft(int n, int nchans, float **re,
+    float **im, float **out)
+{
+    int c, i;
+    rfftw_info *p = rfftw_getplan(n, 0);
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->mutex);
+    for (c = 0; c < nchans; c++)
+    {
+        for (i = 0; i < n/2+1; i++)
+            p->in[i] = re[c][i];
+        for (i = 1; i < n/2; i++)
+            p->in[n-i] = im[c][i];
+        fftwf_execute(p->plan);
+        for (i = 0; i < n; i++)
+            out[c][i] = p->out[i];
+    }
+    pthread_mutex_unlock(&p->mutex);
 }
 
     /* ancient ISPW-like version, used in fiddle~ and perhaps other externs
@@ -175,3 +230,9 @@ void pd_fft(t_float *buf, int npoints, int inverse)
         buf[i] = *fz++;
 }
 
+
+    /* "pd fft-test" checks and times Pd's own FFT in d_fft_fftsg.c */
+void glob_ffttest(void *dummy)
+{
+    post("fft-test: this Pd uses FFTW; nothing to test");
+}
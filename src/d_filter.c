@@ -5,7 +5,10 @@
 /*  "filters", both linear and nonlinear. 
 */
 #include "m_pd.h"
+#include "s_stuff.h"
+#include "s_simd.h"
 #include <math.h>
+#include <string.h>
 
 /* ---------------- hip~ - 1-pole 1-zero hipass filter. ----------------- */
 
@@ -431,33 +434,70 @@ static t_int *sigbiquad_perform(t_int *w)
     return (w+5);
 }
 
-static void sigbiquad_list(t_sigbiquad *x, t_symbol *s, int argc, t_atom *argv)
+    /* the same for when the CPU is flushing denormals (see d_ugen.c), so
+    that the loop needn't test them; infinities and NaNs are still caught,
+    but only once per block. */
+static t_int *sigbiquad_perform_ftz(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    t_biquadctl *c = (t_biquadctl *)(w[3]);
+    int n = (t_int)(w[4]);
+    int i;
+    t_sample last = c->c_x1;
+    t_sample prev = c->c_x2;
+    t_sample fb1 = c->c_fb1;
+    t_sample fb2 = c->c_fb2;
+    t_sample ff1 = c->c_ff1;
+    t_sample ff2 = c->c_ff2;
+    t_sample ff3 = c->c_ff3;
+    for (i = 0; i < n; i++)
+    {
+        t_sample output =  *in++ + fb1 * last + fb2 * prev;
+        *out++ = ff1 * output + ff2 * last + ff3 * prev;
+        prev = last;
+        last = output;
+    }
+    if (PD_BIGORSMALL(last))
+        last = 0;
+    if (PD_BIGORSMALL(prev))
+        prev = 0;
+    c->c_x1 = last;
+    c->c_x2 = prev;
+    return (w+5);
+}
+
+    /* check the feedback coefficients of a biquad; also used by biquads~ */
+static int sigbiquad_stable(t_float fb1, t_float fb2)
 {
-    t_float fb1 = atom_getfloatarg(0, argc, argv);
-    t_float fb2 = atom_getfloatarg(1, argc, argv);
-    t_float ff1 = atom_getfloatarg(2, argc, argv);
-    t_float ff2 = atom_getfloatarg(3, argc, argv);
-    t_float ff3 = atom_getfloatarg(4, argc, argv);
     t_float discriminant = fb1 * fb1 + 4 * fb2;
-    t_biquadctl *c = x->x_ctl;
     if (discriminant < 0) /* imaginary roots -- resonant filter */
     {
             /* they're conjugates so we just check that the product
             is less than one */
-        if (fb2 >= -1.0f) goto stable;
+        return (fb2 >= -1.0f);
     }
     else    /* real roots */
     {
             /* check that the parabola 1 - fb1 x - fb2 x^2 has a
                 vertex between -1 and 1, and that it's nonnegative
                 at both ends, which implies both roots are in [1-,1]. */
-        if (fb1 <= 2.0f && fb1 >= -2.0f &&
-            1.0f - fb1 -fb2 >= 0 && 1.0f + fb1 - fb2 >= 0)
-                goto stable;
+        return (fb1 <= 2.0f && fb1 >= -2.0f &&
+            1.0f - fb1 -fb2 >= 0 && 1.0f + fb1 - fb2 >= 0);
     }
+}
+
+static void sigbiquad_list(t_sigbiquad *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_float fb1 = atom_getfloatarg(0, argc, argv);
+    t_float fb2 = atom_getfloatarg(1, argc, argv);
+    t_float ff1 = atom_getfloatarg(2, argc, argv);
+    t_float ff2 = atom_getfloatarg(3, argc, argv);
+    t_float ff3 = atom_getfloatarg(4, argc, argv);
+    t_biquadctl *c = x->x_ctl;
         /* if unstable, just bash to zero */
-    fb1 = fb2 = ff1 = ff2 = ff3 = 0;
-stable:
+    if (!sigbiquad_stable(fb1, fb2))
+        fb1 = fb2 = ff1 = ff2 = ff3 = 0;
     c->c_fb1 = fb1;
     c->c_fb2 = fb2;
     c->c_ff1 = ff1;
@@ -474,7 +514,8 @@ static void sigbiquad_set(t_sigbiquad *x, t_symbol *s, int argc, t_atom *argv)
 
 static void sigbiquad_dsp(t_sigbiquad *x, t_signal **sp)
 {
-    dsp_add(sigbiquad_perform, 4,
+    dsp_add((sys_denormalsflushed() ?
+        sigbiquad_perform_ftz : sigbiquad_perform), 4,
         sp[0]->s_vec, sp[1]->s_vec, 
             x->x_ctl, sp[0]->s_n);
 
@@ -494,6 +535,408 @@ void sigbiquad_setup(void)
         A_GIMME, 0);
 }
 
+/* ------- biquads~ - cascade of biquads on several channels ---------- */
+
+/* biquads~ runs "nsections" biquads in series on each of "nchans"
+channels.  Each block, the input channels are interleaved into a work
+buffer so that one SIMD register holds the same sample of 4 or 8
+channels, and every section is run on groups of channels at once in
+transposed direct form II:
+    y = ff1 x + s1,  s1 = ff2 x + fb1 y + s2,  s2 = ff3 x + fb2 y
+which is the same filter as biquad~ with the same coefficients.  New
+coefficients are reached by a linear ramp over one block.  As in rpole~,
+states that have decayed to denormals are zeroed at the end of the block
+rather than on every sample. */
+
+#define BQ_NCOEF 5          /* fb1, fb2, ff1, ff2, ff3 */
+#define BQ_PAD 8            /* channels are padded to a multiple of this */
+
+    /* run one section on BQ_PAD channels of the work buffer "buf", whose
+    samples are "stride" apart.  Coefficient k is at coef[k * stride], its
+    per-sample increment (if "ramp") at inc[k * stride]. */
+typedef void (*t_biquadskernel)(t_sample *buf, int n, int stride,
+    t_sample *coef, const t_sample *inc, t_sample *s1, t_sample *s2,
+    int ramp);
+
+static void biquads_kernel_c(t_sample *buf, int n, int stride,
+    t_sample *coef, const t_sample *inc, t_sample *s1, t_sample *s2,
+    int ramp)
+{
+    int i, c;
+    for (c = 0; c < BQ_PAD; c++)
+    {
+        t_sample fb1 = coef[c], fb2 = coef[stride + c],
+            ff1 = coef[2*stride + c], ff2 = coef[3*stride + c],
+            ff3 = coef[4*stride + c], z1 = s1[c], z2 = s2[c];
+        t_sample *bp = buf + c;
+        for (i = 0; i < n; i++, bp += stride)
+        {
+            t_sample x = *bp, y = ff1 * x + z1;
+            z1 = ff2 * x + fb1 * y + z2;
+            z2 = ff3 * x + fb2 * y;
+            *bp = y;
+            if (ramp)
+            {
+                fb1 += inc[c]; fb2 += inc[stride + c];
+                ff1 += inc[2*stride + c]; ff2 += inc[3*stride + c];
+                ff3 += inc[4*stride + c];
+            }
+        }
+        s1[c] = z1;
+        s2[c] = z2;
+    }
+}
+
+#ifdef PD_SIMD_SSE2
+static void biquads_kernel_sse2(t_sample *buf, int n, int stride,
+    t_sample *coef, const t_sample *inc, t_sample *s1, t_sample *s2,
+    int ramp)
+{
+    int i, c;
+    for (c = 0; c < BQ_PAD; c += 4)
+    {
+        __m128 fb1 = _mm_loadu_ps(coef + c),
+            fb2 = _mm_loadu_ps(coef + stride + c),
+            ff1 = _mm_loadu_ps(coef + 2*stride + c),
+            ff2 = _mm_loadu_ps(coef + 3*stride + c),
+            ff3 = _mm_loadu_ps(coef + 4*stride + c),
+            z1 = _mm_loadu_ps(s1 + c), z2 = _mm_loadu_ps(s2 + c);
+        t_sample *bp = buf + c;
+        if (ramp)
+        {
+            __m128 dfb1 = _mm_loadu_ps(inc + c),
+                dfb2 = _mm_loadu_ps(inc + stride + c),
+                dff1 = _mm_loadu_ps(inc + 2*stride + c),
+                dff2 = _mm_loadu_ps(inc + 3*stride + c),
+                dff3 = _mm_loadu_ps(inc + 4*stride + c);
+            for (i = 0; i < n; i++, bp += stride)
+            {
+                __m128 x = _mm_loadu_ps(bp),
+                    y = _mm_add_ps(_mm_mul_ps(ff1, x), z1);
+                z1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ff2, x),
+                    _mm_mul_ps(fb1, y)), z2);
+                z2 = _mm_add_ps(_mm_mul_ps(ff3, x), _mm_mul_ps(fb2, y));
+                _mm_storeu_ps(bp, y);
+                fb1 = _mm_add_ps(fb1, dfb1); fb2 = _mm_add_ps(fb2, dfb2);
+                ff1 = _mm_add_ps(ff1, dff1); ff2 = _mm_add_ps(ff2, dff2);
+                ff3 = _mm_add_ps(ff3, dff3);
+            }
+        }
+        else for (i = 0; i < n; i++, bp += stride)
+        {
+            __m128 x = _mm_loadu_ps(bp),
+                y = _mm_add_ps(_mm_mul_ps(ff1, x), z1);
+            z1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ff2, x),
+                _mm_mul_ps(fb1, y)), z2);
+            z2 = _mm_add_ps(_mm_mul_ps(ff3, x), _mm_mul_ps(fb2, y));
+            _mm_storeu_ps(bp, y);
+        }
+        _mm_storeu_ps(s1 + c, z1);
+        _mm_storeu_ps(s2 + c, z2);
+    }
+}
+#endif /* PD_SIMD_SSE2 */
+
+#ifdef PD_SIMD_AVX2
+PD_SIMD_AVX2FN static void biquads_kernel_avx2(t_sample *buf, int n,
+    int stride, t_sample *coef, const t_sample *inc, t_sample *s1,
+    t_sample *s2, int ramp)
+{
+    int i;
+    __m256 fb1 = _mm256_loadu_ps(coef), fb2 = _mm256_loadu_ps(coef + stride),
+        ff1 = _mm256_loadu_ps(coef + 2*stride),
+        ff2 = _mm256_loadu_ps(coef + 3*stride),
+        ff3 = _mm256_loadu_ps(coef + 4*stride),
+        z1 = _mm256_loadu_ps(s1), z2 = _mm256_loadu_ps(s2);
+    if (ramp)
+    {
+        __m256 dfb1 = _mm256_loadu_ps(inc),
+            dfb2 = _mm256_loadu_ps(inc + stride),
+            dff1 = _mm256_loadu_ps(inc + 2*stride),
+            dff2 = _mm256_loadu_ps(inc + 3*stride),
+            dff3 = _mm256_loadu_ps(inc + 4*stride);
+        for (i = 0; i < n; i++, buf += stride)
+        {
+            __m256 x = _mm256_loadu_ps(buf), y = _mm256_fmadd_ps(ff1, x, z1);
+            z1 = _mm256_fmadd_ps(ff2, x, _mm256_fmadd_ps(fb1, y, z2));
+            z2 = _mm256_fmadd_ps(ff3, x, _mm256_mul_ps(fb2, y));
+            _mm256_storeu_ps(buf, y);
+            fb1 = _mm256_add_ps(fb1, dfb1); fb2 = _mm256_add_ps(fb2, dfb2);
+            ff1 = _mm256_add_ps(ff1, dff1); ff2 = _mm256_add_ps(ff2, dff2);
+            ff3 = _mm256_add_ps(ff3, dff3);
+        }
+    }
+    else for (i = 0; i < n; i++, buf += stride)
+    {
+        __m256 x = _mm256_loadu_ps(buf), y = _mm256_fmadd_ps(ff1, x, z1);
+        z1 = _mm256_fmadd_ps(ff2, x, _mm256_fmadd_ps(fb1, y, z2));
+        z2 = _mm256_fmadd_ps(ff3, x, _mm256_mul_ps(fb2, y));
+        _mm256_storeu_ps(buf, y);
+    }
+    _mm256_storeu_ps(s1, z1);
+    _mm256_storeu_ps(s2, z2);
+}
+#endif /* PD_SIMD_AVX2 */
+
+#ifdef PD_SIMD_NEON
+static void biquads_kernel_neon(t_sample *buf, int n, int stride,
+    t_sample *coef, const t_sample *inc, t_sample *s1, t_sample *s2,
+    int ramp)
+{
+    int i, c;
+    for (c = 0; c < BQ_PAD; c += 4)
+    {
+        float32x4_t fb1 = vld1q_f32(coef + c),
+            fb2 = vld1q_f32(coef + stride + c),
+            ff1 = vld1q_f32(coef + 2*stride + c),
+            ff2 = vld1q_f32(coef + 3*stride + c),
+            ff3 = vld1q_f32(coef + 4*stride + c),
+            z1 = vld1q_f32(s1 + c), z2 = vld1q_f32(s2 + c);
+        t_sample *bp = buf + c;
+        if (ramp)
+        {
+            float32x4_t dfb1 = vld1q_f32(inc + c),
+                dfb2 = vld1q_f32(inc + stride + c),
+                dff1 = vld1q_f32(inc + 2*stride + c),
+                dff2 = vld1q_f32(inc + 3*stride + c),
+                dff3 = vld1q_f32(inc + 4*stride + c);
+            for (i = 0; i < n; i++, bp += stride)
+            {
+                float32x4_t x = vld1q_f32(bp), y = vfmaq_f32(z1, ff1, x);
+                z1 = vfmaq_f32(vfmaq_f32(z2, fb1, y), ff2, x);
+                z2 = vfmaq_f32(vmulq_f32(fb2, y), ff3, x);
+                vst1q_f32(bp, y);
+                fb1 = vaddq_f32(fb1, dfb1); fb2 = vaddq_f32(fb2, dfb2);
+                ff1 = vaddq_f32(ff1, dff1); ff2 = vaddq_f32(ff2, dff2);
+                ff3 = vaddq_f32(ff3, dff3);
+            }
+        }
+        else for (i = 0; i < n; i++, bp += stride)
+        {
+            float32x4_t x = vld1q_f32(bp), y = vfmaq_f32(z1, ff1, x);
+            z1 = vfmaq_f32(vfmaq_f32(z2, fb1, y), ff2, x);
+            z2 = vfmaq_f32(vmulq_f32(fb2, y), ff3, x);
+            vst1q_f32(bp, y);
+        }
+        vst1q_f32(s1 + c, z1);
+        vst1q_f32(s2 + c, z2);
+    }
+}
+#endif /* PD_SIMD_NEON */
+
+typedef struct sigbiquads
+{
+    t_object x_obj;
+    t_float x_f;
+    int x_nchans;
+    int x_nsections;
+    int x_npad;             /* x_nchans rounded up to BQ_PAD */
+    t_sample *x_coef;       /* coefficients now, [section][k][channel] */
+    t_sample *x_target;     /* ... where they're headed */
+    t_sample *x_inc;        /* ... per-sample increments while ramping */
+    char *x_moving;         /* per section: x_target differs from x_coef */
+    t_sample *x_s1;         /* filter states, [section][channel] */
+    t_sample *x_s2;
+    t_sample *x_buf;        /* work buffer, [sample][channel] */
+    int x_bufsize;          /* ... its size in samples */
+    t_sample **x_vecs;      /* signal inputs, then outputs */
+    t_biquadskernel x_kernel;
+} t_sigbiquads;
+
+t_class *sigbiquads_class;
+
+static int sigbiquads_ncoefs(t_sigbiquads *x)
+{
+    return (x->x_nsections * BQ_NCOEF * x->x_npad);
+}
+
+static void *sigbiquads_new(t_floatarg fnchans, t_floatarg fnsections)
+{
+    t_sigbiquads *x = (t_sigbiquads *)pd_new(sigbiquads_class);
+    int i, nchans = (fnchans >= 1 ? fnchans : 1),
+        nsections = (fnsections >= 1 ? fnsections : 1), ncoef;
+    for (i = 1; i < nchans; i++)
+        inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+    for (i = 0; i < nchans; i++)
+        outlet_new(&x->x_obj, &s_signal);
+    x->x_nchans = nchans;
+    x->x_nsections = nsections;
+    x->x_npad = (nchans + BQ_PAD - 1) / BQ_PAD * BQ_PAD;
+    ncoef = sigbiquads_ncoefs(x);
+    x->x_coef = (t_sample *)getbytes(ncoef * sizeof(t_sample));
+    x->x_target = (t_sample *)getbytes(ncoef * sizeof(t_sample));
+    x->x_inc = (t_sample *)getbytes(ncoef * sizeof(t_sample));
+    x->x_moving = (char *)getbytes(nsections);
+    x->x_s1 = (t_sample *)getbytes(nsections * x->x_npad * sizeof(t_sample));
+    x->x_s2 = (t_sample *)getbytes(nsections * x->x_npad * sizeof(t_sample));
+    x->x_vecs = (t_sample **)getbytes(2 * nchans * sizeof(t_sample *));
+    x->x_buf = 0;
+    x->x_bufsize = 0;
+        /* start out passing the signal through: ff1 = 1 */
+    for (i = 0; i < nsections; i++)
+    {
+        int c;
+        for (c = 0; c < x->x_npad; c++)
+            x->x_coef[(i * BQ_NCOEF + 2) * x->x_npad + c] =
+                x->x_target[(i * BQ_NCOEF + 2) * x->x_npad + c] = 1;
+    }
+    x->x_kernel = biquads_kernel_c;
+    x->x_f = 0;
+    return (x);
+}
+
+static void sigbiquads_free(t_sigbiquads *x)
+{
+    int ncoef = sigbiquads_ncoefs(x);
+    freebytes(x->x_coef, ncoef * sizeof(t_sample));
+    freebytes(x->x_target, ncoef * sizeof(t_sample));
+    freebytes(x->x_inc, ncoef * sizeof(t_sample));
+    freebytes(x->x_moving, x->x_nsections);
+    freebytes(x->x_s1, x->x_nsections * x->x_npad * sizeof(t_sample));
+    freebytes(x->x_s2, x->x_nsections * x->x_npad * sizeof(t_sample));
+    freebytes(x->x_vecs, 2 * x->x_nchans * sizeof(t_sample *));
+    if (x->x_buf)
+        freebytes(x->x_buf, x->x_bufsize * sizeof(t_sample));
+}
+
+static t_int *sigbiquads_perform(t_int *w)
+{
+    t_sigbiquads *x = (t_sigbiquads *)(w[1]);
+    int n = (int)(w[2]), nchans = x->x_nchans, npad = x->x_npad;
+    int i, c, s, g;
+    t_sample *buf = x->x_buf, **in = x->x_vecs, **out = in + nchans;
+        /* read all inputs before writing any output, since an output may
+        be in the same place as another channel's input */
+    for (c = 0; c < nchans; c++)
+        for (i = 0; i < n; i++)
+            buf[i * npad + c] = in[c][i];
+    for (s = 0; s < x->x_nsections; s++)
+    {
+        t_sample *coef = x->x_coef + s * BQ_NCOEF * npad,
+            *target = x->x_target + s * BQ_NCOEF * npad,
+            *inc = x->x_inc + s * BQ_NCOEF * npad;
+        int ramp = x->x_moving[s];
+        if (ramp)
+        {
+            t_sample oneovern = 1./n;
+            for (i = 0; i < BQ_NCOEF * npad; i++)
+                inc[i] = (target[i] - coef[i]) * oneovern;
+        }
+        for (g = 0; g < npad; g += BQ_PAD)
+            (*x->x_kernel)(buf + g, n, npad, coef + g, inc + g,
+                x->x_s1 + s * npad + g, x->x_s2 + s * npad + g, ramp);
+        if (ramp)
+        {
+            memcpy(coef, target, BQ_NCOEF * npad * sizeof(t_sample));
+            x->x_moving[s] = 0;
+        }
+    }
+    for (i = 0; i < x->x_nsections * npad; i++)
+    {
+        if (PD_BIGORSMALL(x->x_s1[i]))
+            x->x_s1[i] = 0;
+        if (PD_BIGORSMALL(x->x_s2[i]))
+            x->x_s2[i] = 0;
+    }
+    for (c = 0; c < nchans; c++)
+        for (i = 0; i < n; i++)
+            out[c][i] = buf[i * npad + c];
+    return (w+3);
+}
+
+    /* set the coefficients of one section, for one channel or all */
+static void sigbiquads_setcoefs(t_sigbiquads *x, int chan, int argc,
+    t_atom *argv)
+{
+    int section = atom_getfloatarg(0, argc, argv), c, k, npad = x->x_npad;
+    t_float coefs[BQ_NCOEF];
+    if (section < 0 || section >= x->x_nsections)
+    {
+        pd_error(x, "biquads~: section %d out of range", section);
+        return;
+    }
+    for (k = 0; k < BQ_NCOEF; k++)
+        coefs[k] = atom_getfloatarg(k + 1, argc, argv);
+    if (!sigbiquad_stable(coefs[0], coefs[1]))
+        for (k = 0; k < BQ_NCOEF; k++)
+            coefs[k] = 0;
+    for (c = (chan < 0 ? 0 : chan); c < (chan < 0 ? x->x_nchans : chan + 1);
+        c++)
+            for (k = 0; k < BQ_NCOEF; k++)
+                x->x_target[(section * BQ_NCOEF + k) * npad + c] = coefs[k];
+    x->x_moving[section] = 1;
+}
+
+    /* "section fb1 fb2 ff1 ff2 ff3": set a section on all channels */
+static void sigbiquads_list(t_sigbiquads *x, t_symbol *s, int argc,
+    t_atom *argv)
+{
+    sigbiquads_setcoefs(x, -1, argc, argv);
+}
+
+    /* "channel chan section fb1 fb2 ff1 ff2 ff3": one channel only */
+static void sigbiquads_channel(t_sigbiquads *x, t_symbol *s, int argc,
+    t_atom *argv)
+{
+    int chan = atom_getfloatarg(0, argc, argv);
+    if (chan < 0 || chan >= x->x_nchans || argc < 1)
+    {
+        pd_error(x, "biquads~: channel %d out of range", chan);
+        return;
+    }
+    sigbiquads_setcoefs(x, chan, argc - 1, argv + 1);
+}
+
+static void sigbiquads_clear(t_sigbiquads *x)
+{
+    memset(x->x_s1, 0, x->x_nsections * x->x_npad * sizeof(t_sample));
+    memset(x->x_s2, 0, x->x_nsections * x->x_npad * sizeof(t_sample));
+}
+
+static void sigbiquads_dsp(t_sigbiquads *x, t_signal **sp)
+{
+    int n = sp[0]->s_n, i, size = n * x->x_npad,
+        cpu = sys_getcpufeatures();
+    for (i = 0; i < 2 * x->x_nchans; i++)
+        x->x_vecs[i] = sp[i]->s_vec;
+    if (size != x->x_bufsize)
+    {
+        if (x->x_buf)
+            freebytes(x->x_buf, x->x_bufsize * sizeof(t_sample));
+        x->x_buf = (t_sample *)getbytes(size * sizeof(t_sample));
+        x->x_bufsize = size;
+    }
+    x->x_kernel = biquads_kernel_c;
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+        x->x_kernel = biquads_kernel_sse2;
+#endif
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+        x->x_kernel = biquads_kernel_avx2;
+#endif
+#ifdef PD_SIMD_NEON
+    if (cpu & CPU_NEON)
+        x->x_kernel = biquads_kernel_neon;
+#endif
+    dsp_add(sigbiquads_perform, 2, x, n);
+}
+
+void sigbiquads_setup(void)
+{
+    sigbiquads_class = class_new(gensym("biquads~"),
+        (t_newmethod)sigbiquads_new, (t_method)sigbiquads_free,
+        sizeof(t_sigbiquads), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
+    CLASS_MAINSIGNALIN(sigbiquads_class, t_sigbiquads, x_f);
+    class_addmethod(sigbiquads_class, (t_method)sigbiquads_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addlist(sigbiquads_class, sigbiquads_list);
+    class_addmethod(sigbiquads_class, (t_method)sigbiquads_channel,
+        gensym("channel"), A_GIMME, 0);
+    class_addmethod(sigbiquads_class, (t_method)sigbiquads_clear,
+        gensym("clear"), 0);
+}
+
 /* ---------------- samphold~ - sample and hold  ----------------- */
 
 typedef struct sigsamphold
@@ -1072,6 +1515,7 @@ void d_filter_setup(void)
     siglop_setup();
     sigbp_setup();
     sigbiquad_setup();
+    sigbiquads_setup();
     sigsamphold_setup();
     sigrpole_setup();
     sigrzero_setup();
@@ -5,6 +5,7 @@
 /*  send~, receive~, throw~, catch~ */
 
 #include "m_pd.h"
+#include "s_stuff.h"
 #include <string.h>
 
 #define DEFSENDVS 64    /* LATER get send to get this from canvas */
@@ -47,10 +48,25 @@ static t_int *sigsend_perform(t_int *w)
     return (w+4);
 }
 
+    /* if the CPU flushes denormals, only infinities and NaNs need zapping,
+    and a block without any is just copied. */
+static t_int *sigsend_perform_ftz(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+    if (sys_infornan(in, n))
+        return (sigsend_perform(w));
+    memcpy(out, in, n * sizeof(t_sample));
+    return (w+4);
+}
+
 static void sigsend_dsp(t_sigsend *x, t_signal **sp)
 {
     if (x->x_n == sp[0]->s_n)
-        dsp_add(sigsend_perform, 3, sp[0]->s_vec, x->x_vec, sp[0]->s_n);
+        dsp_add((sys_denormalsflushed() ?
+            sigsend_perform_ftz : sigsend_perform), 3,
+                sp[0]->s_vec, x->x_vec, sp[0]->s_n);
     else error("sigsend %s: unexpected vector size", x->x_sym->s_name);
 }
 
@@ -240,7 +256,11 @@ static void sigcatch_dsp(t_sigcatch *x, t_signal **sp)
 {
     if (x->x_n == sp[0]->s_n)
     {
-        if(sp[0]->s_n&7)
+        t_veckernel kernel = sys_getveckernel(VEC_CATCH);
+        if (kernel)
+            dsp_add(vec_perform, 5, kernel, x->x_vec, 0, sp[0]->s_vec,
+                sp[0]->s_n);
+        else if(sp[0]->s_n&7)
         dsp_add(sigcatch_perform, 3, x->x_vec, sp[0]->s_vec, sp[0]->s_n);
         else
         dsp_add(sigcatch_perf8, 3, x->x_vec, sp[0]->s_vec, sp[0]->s_n);
@@ -303,6 +323,58 @@ static t_int *sigthrow_perform(t_int *w)
     return (w+4);
 }
 
+    /* without the denormal test, when the CPU is flushing them anyway;
+    a block with infinities or NaNs in it still gets the full test. */
+static t_int *sigthrow_perform_ftz(t_int *w)
+{
+    t_sigthrow *x = (t_sigthrow *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+    t_sample *out = x->x_whereto;
+    if (out)
+    {
+        if (sys_infornan(in, n))
+            return (sigthrow_perform(w));
+        while (n--)
+            *out++ += *in++;
+    }
+    return (w+4);
+}
+
+    /* the same using a vector kernel, which sums into "whereto" in place */
+static t_int *sigthrow_perform_vec(t_int *w)
+{
+    t_sigthrow *x = (t_sigthrow *)(w[1]);
+    t_veckernel kernel = (t_veckernel)(w[2]);
+    t_sample *out = x->x_whereto;
+    if (out)
+        (*kernel)((t_sample *)(w[3]), out, out, (int)(w[4]));
+    return (w+5);
+}
+
+    /* ... and with a plain adding kernel when denormals are flushed */
+static t_int *sigthrow_perform_vecftz(t_int *w)
+{
+    t_sigthrow *x = (t_sigthrow *)(w[1]);
+    t_veckernel kernel = (t_veckernel)(w[2]);
+    t_sample *in = (t_sample *)(w[3]), *out = x->x_whereto;
+    int n = (int)(w[4]);
+    if (out)
+    {
+        if (sys_infornan(in, n))
+        {
+            while (n--)
+            {
+                *out += (PD_BIGORSMALL(*in) ? 0 : *in);
+                out++;
+                in++;
+            }
+        }
+        else (*kernel)(in, out, out, n);
+    }
+    return (w+5);
+}
+
 static void sigthrow_set(t_sigthrow *x, t_symbol *s)
 {
     t_sigcatch *catcher = (t_sigcatch *)pd_findbyclass((x->x_sym = s),
@@ -332,12 +404,36 @@ static void sigthrow_dsp(t_sigthrow *x, t_signal **sp)
     }
     else
     {
+        int flushed = sys_denormalsflushed();
+        t_veckernel kernel =
+            sys_getveckernel(flushed ? VEC_PLUS : VEC_THROW);
         sigthrow_set(x, x->x_sym);
-        dsp_add(sigthrow_perform, 3,
+        if (kernel)
+            dsp_add((flushed ? sigthrow_perform_vecftz : sigthrow_perform_vec),
+                4, x, kernel, sp[0]->s_vec, sp[0]->s_n);
+        else dsp_add((flushed ? sigthrow_perform_ftz : sigthrow_perform), 3,
             x, sp[0]->s_vec, sp[0]->s_n);
     }
 }
 
+    /* for "pd cpu-features": the C perform routine catch~ (VEC_CATCH) or
+throw~ (VEC_THROW) uses for a block of n, when n is a multiple of 8, with
+its arguments in w[1] onward.  catch~ moves "in" to "out"; throw~ adds "in"
+into "out" as if that were catch~'s vector. */
+t_perfroutine sys_getcatchthrowperform(int which, t_sample *in,
+    t_sample *out, int n, t_int *w)
+{
+    static t_sigthrow bench;
+    if (which == VEC_CATCH)
+    {
+        w[1] = (t_int)in, w[2] = (t_int)out, w[3] = n;
+        return (sigcatch_perf8);
+    }
+    bench.x_whereto = out;
+    w[1] = (t_int)&bench, w[2] = (t_int)in, w[3] = n;
+    return (sigthrow_perform);
+}
+
 static void sigthrow_setup(void)
 {
     sigthrow_class = class_new(gensym("throw~"), (t_newmethod)sigthrow_new, 0,
@@ -7,9 +7,573 @@
 */
 
 #include "m_pd.h"
+#include "s_stuff.h"
+#include "s_simd.h"
 #include <math.h>
 #define LOGTEN 2.302585092994
 
+/* ------------------- fast transcendental kernels -------------------- */
+
+/* The converters, pow~, exp~ and log~ below call the C library once per
+sample, and rsqrt~ and sqrt~ look up a pair of tables; all are serial.
+With "-fastmath" (or "pd fast-math 1") they use these kernels instead,
+which do a whole vector at once.  Exponentials are 2^k times a degree-5
+polynomial in the fractional part of the exponent, logarithms an atanh
+series in the mantissa, and square roots come from the CPU.  The
+polynomials are good to about 10^-7; exponentials of big arguments also
+inherit the rounding of the argument itself, so that exp~ is good to
+4 parts per million over its range and the others to 2.  Results that
+would overflow saturate at about 3.4e38 and ones that would underflow
+come out zero.  The library versions remain the default so that old
+patches compute exactly what they used to. */
+
+int sys_fastmath;
+
+#define MATH_LOG2E 1.44269504088896
+#define MATH_LN2 0.69314718055995
+#define MATH_SQRT2 1.41421356f
+#define MATH_TINY 1.17549435e-38f       /* smallest normal float */
+#define MATH_EXP2MAX 127.999985f        /* largest power of 2 we output */
+#define MATH_HUGE 3.40282347e38f         /* largest float */
+
+    /* minimax fit of 2^f for 0 <= f <= 1, relative error 7.5e-8 */
+#define MATH_E0 0.999999925f
+#define MATH_E1 0.693153073f
+#define MATH_E2 0.240153617f
+#define MATH_E3 0.0558263180f
+#define MATH_E4 0.00898934009f
+#define MATH_E5 0.00187757667f
+
+    /* log2(m) = s * (L1 + L3 s^2 + L5 s^4 ...) with s = (m-1)/(m+1); this
+    is the atanh series times log2(e), |s| < 0.172 for sqrt(1/2) <= m <
+    sqrt(2) */
+#define MATH_L1 2.88539008f
+#define MATH_L3 0.961796694f
+#define MATH_L5 0.577078016f
+#define MATH_L7 0.412198583f
+#define MATH_L9 0.320598898f
+
+    /* the kinds of thing the objects compute */
+#define MATH_EXP2 0     /* fill if x <= lo, else 2^(a * min(x, hi) + b) */
+#define MATH_LOG2 1     /* fill if x <= lo, else max(a * log2(x) + b, floor) */
+#define MATH_RSQRT 2    /* 0 if x < 0, else 1/sqrt(x) */
+#define MATH_SQRT 3     /* 0 if x < 0, else sqrt(x) */
+#define MATH_POW 4      /* 0 if x <= 0, else x^y */
+#define MATH_LOG 5      /* -1000 if x <= 0, else log of x to the base y */
+
+typedef struct _mathop
+{
+    int m_type;
+    t_sample m_lo;
+    t_sample m_hi;
+    t_sample m_a;
+    t_sample m_b;
+    t_sample m_fill;
+    t_sample m_floor;
+} t_mathop;
+
+    /* the same limits as the library versions of the objects below */
+static const t_mathop math_mtof = {MATH_EXP2, -1500, 1499,
+    .0577622650 * MATH_LOG2E, 3.03135971 /* log2(8.17579891564) */, 0, 0};
+static const t_mathop math_ftom = {MATH_LOG2, 0, 0,
+    17.3123405046 * MATH_LN2, -36.3763166 /* 17.31... * log(.1223...) */,
+    -1500, -MATH_HUGE};
+static const t_mathop math_dbtorms = {MATH_EXP2, 0, 485,
+    LOGTEN * 0.05 * MATH_LOG2E, LOGTEN * 0.05 * MATH_LOG2E * -100, 0, 0};
+static const t_mathop math_rmstodb = {MATH_LOG2, 0, 0,
+    20./LOGTEN * MATH_LN2, 100, 0, 0};
+static const t_mathop math_dbtopow = {MATH_EXP2, 0, 870,
+    LOGTEN * 0.1 * MATH_LOG2E, LOGTEN * 0.1 * MATH_LOG2E * -100, 0, 0};
+static const t_mathop math_powtodb = {MATH_LOG2, 0, 0,
+    10./LOGTEN * MATH_LN2, 100, 0, 0};
+static const t_mathop math_exp = {MATH_EXP2, -MATH_HUGE, MATH_HUGE,
+    MATH_LOG2E, 0, 0, 0};
+static const t_mathop math_rsqrt = {MATH_RSQRT, 0, 0, 0, 0, 0, 0};
+static const t_mathop math_sqrt = {MATH_SQRT, 0, 0, 0, 0, 0, 0};
+static const t_mathop math_pow = {MATH_POW, 0, 0, 0, 0, 0, 0};
+static const t_mathop math_log = {MATH_LOG, 0, 0, 0, 0, 0, 0};
+
+    /* "in2" is zero for objects with one signal input */
+typedef void (*t_mathkernel)(const t_mathop *op, const t_sample *in1,
+    const t_sample *in2, t_sample *out, int n);
+
+typedef union _mathbits
+{
+    float b_f;
+    int32_t b_i;
+} t_mathbits;
+
+    /* 2^t; zero below 2^-126 (and for NaN) and saturating at the top */
+static float math_exp2(float t)
+{
+    t_mathbits u;
+    float f;
+    int k;
+    if (!(t >= -126))
+        return (0);
+    if (t > MATH_EXP2MAX)
+        t = MATH_EXP2MAX;
+    k = (int)t;
+    if (k > t)
+        k--;
+    f = t - k;
+    u.b_i = (k + 127) << 23;
+    return (u.b_f * (MATH_E0 + f * (MATH_E1 + f * (MATH_E2 + f * (MATH_E3 +
+        f * (MATH_E4 + f * MATH_E5))))));
+}
+
+    /* log2(x) for x >= MATH_TINY */
+static float math_log2(float x)
+{
+    t_mathbits u;
+    float s, z;
+    int e;
+    u.b_f = x;
+    e = ((u.b_i >> 23) & 0xff) - 127;
+    u.b_i = (u.b_i & 0x7fffff) | 0x3f800000;
+    if (u.b_f > MATH_SQRT2)
+        u.b_f *= 0.5f, e++;
+    s = (u.b_f - 1) / (u.b_f + 1);
+    z = s * s;
+    return (e + s * (MATH_L1 + z * (MATH_L3 + z * (MATH_L5 + z * (MATH_L7 +
+        z * MATH_L9)))));
+}
+
+static t_sample math_scalar(const t_mathop *op, t_sample x, t_sample y)
+{
+    float g;
+    switch (op->m_type)
+    {
+    case MATH_EXP2:
+        return (x > op->m_lo ? math_exp2(op->m_a *
+            (x < op->m_hi ? x : op->m_hi) + op->m_b) : op->m_fill);
+    case MATH_LOG2:
+        if (!(x > op->m_lo))
+            return (op->m_fill);
+        g = op->m_a * math_log2(x < MATH_TINY ? MATH_TINY : x) + op->m_b;
+        return (g > op->m_floor ? g : op->m_floor);
+    case MATH_RSQRT:
+        return (x >= 0 ? 1 / sqrtf(x < MATH_TINY ? MATH_TINY :
+            (x > MATH_HUGE ? MATH_HUGE : x)) : 0);
+    case MATH_SQRT:
+        return (x >= 0 ? sqrtf(x) : 0);
+    case MATH_POW:
+        return (x > 0 ? math_exp2(y *
+            math_log2(x < MATH_TINY ? MATH_TINY : x)) : 0);
+    default:
+        if (!(x > 0))
+            return (-1000);
+        g = math_log2(x < MATH_TINY ? MATH_TINY : x);
+        return (y > 0 ? g / math_log2(y < MATH_TINY ? MATH_TINY : y) :
+            g * (float)MATH_LN2);
+    }
+}
+
+static void math_kernel_c(const t_mathop *op, const t_sample *in1,
+    const t_sample *in2, t_sample *out, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        out[i] = math_scalar(op, in1[i], (in2 ? in2[i] : 0));
+}
+
+#ifdef PD_SIMD_SSE2
+static __m128 math_select_sse2(__m128 mask, __m128 a, __m128 b)
+{
+    return (_mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)));
+}
+
+static __m128 math_exp2_sse2(__m128 t)
+{
+    __m128 valid = _mm_cmpge_ps(t, _mm_set1_ps(-126.f)), f, up, p;
+    __m128i k;
+    t = _mm_min_ps(_mm_max_ps(t, _mm_set1_ps(-126.f)),
+        _mm_set1_ps(MATH_EXP2MAX));
+    k = _mm_cvttps_epi32(t);
+    f = _mm_cvtepi32_ps(k);
+        /* truncation rounded negative t up; step down to the floor */
+    up = _mm_cmpgt_ps(f, t);
+    k = _mm_add_epi32(k, _mm_castps_si128(up));
+    f = _mm_sub_ps(t, _mm_sub_ps(f, _mm_and_ps(up, _mm_set1_ps(1.f))));
+    p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(MATH_E5), f),
+        _mm_set1_ps(MATH_E4));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(MATH_E3));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(MATH_E2));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(MATH_E1));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(MATH_E0));
+    p = _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_add_epi32(k, _mm_set1_epi32(127)), 23)));
+    return (_mm_and_ps(p, valid));
+}
+
+static __m128 math_log2_sse2(__m128 x)
+{
+    __m128i i = _mm_castps_si128(x), e;
+    __m128 m, big, s, z, p;
+    e = _mm_sub_epi32(_mm_srli_epi32(i, 23), _mm_set1_epi32(127));
+    m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(i,
+        _mm_set1_epi32(0x7fffff)), _mm_set1_epi32(0x3f800000)));
+    big = _mm_cmpgt_ps(m, _mm_set1_ps(MATH_SQRT2));
+    m = _mm_sub_ps(m, _mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))));
+    e = _mm_sub_epi32(e, _mm_castps_si128(big));
+    s = _mm_div_ps(_mm_sub_ps(m, _mm_set1_ps(1.f)),
+        _mm_add_ps(m, _mm_set1_ps(1.f)));
+    z = _mm_mul_ps(s, s);
+    p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(MATH_L9), z),
+        _mm_set1_ps(MATH_L7));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(MATH_L5));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(MATH_L3));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(MATH_L1));
+    return (_mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(p, s)));
+}
+
+static void math_kernel_sse2(const t_mathop *op, const t_sample *in1,
+    const t_sample *in2, t_sample *out, int n)
+{
+    int i = 0;
+    __m128 lo = _mm_set1_ps(op->m_lo), hi = _mm_set1_ps(op->m_hi),
+        a = _mm_set1_ps(op->m_a), b = _mm_set1_ps(op->m_b),
+        fill = _mm_set1_ps(op->m_fill), bot = _mm_set1_ps(op->m_floor),
+        tiny = _mm_set1_ps(MATH_TINY), zero = _mm_setzero_ps();
+    switch (op->m_type)
+    {
+    case MATH_EXP2:
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(in1 + i), g = math_exp2_sse2(_mm_add_ps(
+                _mm_mul_ps(a, _mm_min_ps(x, hi)), b));
+            _mm_storeu_ps(out + i,
+                math_select_sse2(_mm_cmpgt_ps(x, lo), g, fill));
+        }
+        break;
+    case MATH_LOG2:
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(in1 + i), g = _mm_add_ps(_mm_mul_ps(a,
+                math_log2_sse2(_mm_max_ps(x, tiny))), b);
+            _mm_storeu_ps(out + i, math_select_sse2(_mm_cmpgt_ps(x, lo),
+                _mm_max_ps(g, bot), fill));
+        }
+        break;
+    case MATH_RSQRT:
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(in1 + i), y = _mm_min_ps(
+                _mm_max_ps(x, tiny), _mm_set1_ps(MATH_HUGE)),
+                g = _mm_rsqrt_ps(y);
+                /* one Newton step takes the 12-bit estimate to 22 bits */
+            g = _mm_mul_ps(g, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(
+                _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), g), g)));
+            _mm_storeu_ps(out + i, _mm_and_ps(_mm_cmpge_ps(x, zero), g));
+        }
+        break;
+    case MATH_SQRT:
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(out + i,
+                _mm_sqrt_ps(_mm_max_ps(_mm_loadu_ps(in1 + i), zero)));
+        break;
+    case MATH_POW:
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(in1 + i), y = _mm_loadu_ps(in2 + i),
+                g = math_exp2_sse2(_mm_mul_ps(y,
+                    math_log2_sse2(_mm_max_ps(x, tiny))));
+            _mm_storeu_ps(out + i, _mm_and_ps(_mm_cmpgt_ps(x, zero), g));
+        }
+        break;
+    case MATH_LOG:
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(in1 + i), y = _mm_loadu_ps(in2 + i),
+                g = math_log2_sse2(_mm_max_ps(x, tiny));
+            g = math_select_sse2(_mm_cmpgt_ps(y, zero), _mm_div_ps(g,
+                math_log2_sse2(_mm_max_ps(y, tiny))),
+                    _mm_mul_ps(g, _mm_set1_ps(MATH_LN2)));
+            _mm_storeu_ps(out + i, math_select_sse2(_mm_cmpgt_ps(x, zero),
+                g, _mm_set1_ps(-1000.f)));
+        }
+        break;
+    }
+    math_kernel_c(op, in1 + i, (in2 ? in2 + i : 0), out + i, n - i);
+}
+#endif /* PD_SIMD_SSE2 */
+
+#ifdef PD_SIMD_AVX2
+PD_SIMD_AVX2FN static __m256 math_exp2_avx2(__m256 t)
+{
+    __m256 valid = _mm256_cmp_ps(t, _mm256_set1_ps(-126.f), _CMP_GE_OQ),
+        k, p;
+    t = _mm256_min_ps(_mm256_max_ps(t, _mm256_set1_ps(-126.f)),
+        _mm256_set1_ps(MATH_EXP2MAX));
+    k = _mm256_floor_ps(t);
+    t = _mm256_sub_ps(t, k);
+    p = _mm256_fmadd_ps(_mm256_set1_ps(MATH_E5), t, _mm256_set1_ps(MATH_E4));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(MATH_E3));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(MATH_E2));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(MATH_E1));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(MATH_E0));
+    p = _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(
+        _mm256_add_epi32(_mm256_cvtps_epi32(k), _mm256_set1_epi32(127)), 23)));
+    return (_mm256_and_ps(p, valid));
+}
+
+PD_SIMD_AVX2FN static __m256 math_log2_avx2(__m256 x)
+{
+    __m256i i = _mm256_castps_si256(x), e;
+    __m256 m, big, s, z, p;
+    e = _mm256_sub_epi32(_mm256_srli_epi32(i, 23), _mm256_set1_epi32(127));
+    m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(i,
+        _mm256_set1_epi32(0x7fffff)), _mm256_set1_epi32(0x3f800000)));
+    big = _mm256_cmp_ps(m, _mm256_set1_ps(MATH_SQRT2), _CMP_GT_OQ);
+    m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+    e = _mm256_sub_epi32(e, _mm256_castps_si256(big));
+    s = _mm256_div_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.f)),
+        _mm256_add_ps(m, _mm256_set1_ps(1.f)));
+    z = _mm256_mul_ps(s, s);
+    p = _mm256_fmadd_ps(_mm256_set1_ps(MATH_L9), z, _mm256_set1_ps(MATH_L7));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(MATH_L5));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(MATH_L3));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(MATH_L1));
+    return (_mm256_fmadd_ps(p, s, _mm256_cvtepi32_ps(e)));
+}
+
+PD_SIMD_AVX2FN static void math_kernel_avx2(const t_mathop *op,
+    const t_sample *in1, const t_sample *in2, t_sample *out, int n)
+{
+    int i = 0;
+    __m256 lo = _mm256_set1_ps(op->m_lo), hi = _mm256_set1_ps(op->m_hi),
+        a = _mm256_set1_ps(op->m_a), b = _mm256_set1_ps(op->m_b),
+        fill = _mm256_set1_ps(op->m_fill),
+        bot = _mm256_set1_ps(op->m_floor),
+        tiny = _mm256_set1_ps(MATH_TINY), zero = _mm256_setzero_ps();
+    switch (op->m_type)
+    {
+    case MATH_EXP2:
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(in1 + i), g = math_exp2_avx2(
+                _mm256_fmadd_ps(a, _mm256_min_ps(x, hi), b));
+            _mm256_storeu_ps(out + i, _mm256_blendv_ps(fill, g,
+                _mm256_cmp_ps(x, lo, _CMP_GT_OQ)));
+        }
+        break;
+    case MATH_LOG2:
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(in1 + i), g = _mm256_fmadd_ps(a,
+                math_log2_avx2(_mm256_max_ps(x, tiny)), b);
+            _mm256_storeu_ps(out + i, _mm256_blendv_ps(fill,
+                _mm256_max_ps(g, bot), _mm256_cmp_ps(x, lo, _CMP_GT_OQ)));
+        }
+        break;
+    case MATH_RSQRT:
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(in1 + i), y = _mm256_min_ps(
+                _mm256_max_ps(x, tiny), _mm256_set1_ps(MATH_HUGE)),
+                g = _mm256_rsqrt_ps(y);
+            g = _mm256_mul_ps(g, _mm256_fnmadd_ps(_mm256_mul_ps(
+                _mm256_mul_ps(_mm256_set1_ps(0.5f), y), g), g,
+                    _mm256_set1_ps(1.5f)));
+            _mm256_storeu_ps(out + i, _mm256_and_ps(
+                _mm256_cmp_ps(x, zero, _CMP_GE_OQ), g));
+        }
+        break;
+    case MATH_SQRT:
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_sqrt_ps(
+                _mm256_max_ps(_mm256_loadu_ps(in1 + i), zero)));
+        break;
+    case MATH_POW:
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(in1 + i), y = _mm256_loadu_ps(in2 + i),
+                g = math_exp2_avx2(_mm256_mul_ps(y,
+                    math_log2_avx2(_mm256_max_ps(x, tiny))));
+            _mm256_storeu_ps(out + i, _mm256_and_ps(
+                _mm256_cmp_ps(x, zero, _CMP_GT_OQ), g));
+        }
+        break;
+    case MATH_LOG:
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(in1 + i), y = _mm256_loadu_ps(in2 + i),
+                g = math_log2_avx2(_mm256_max_ps(x, tiny));
+            g = _mm256_blendv_ps(_mm256_mul_ps(g, _mm256_set1_ps(MATH_LN2)),
+                _mm256_div_ps(g, math_log2_avx2(_mm256_max_ps(y, tiny))),
+                    _mm256_cmp_ps(y, zero, _CMP_GT_OQ));
+            _mm256_storeu_ps(out + i, _mm256_blendv_ps(
+                _mm256_set1_ps(-1000.f), g, _mm256_cmp_ps(x, zero,
+                    _CMP_GT_OQ)));
+        }
+        break;
+    }
+        /* the compiler doesn't always do this before the tail call; without
+        it the C library's SSE code that follows runs many times slower */
+    _mm256_zeroupper();
+    math_kernel_c(op, in1 + i, (in2 ? in2 + i : 0), out + i, n - i);
+}
+#endif /* PD_SIMD_AVX2 */
+
+#ifdef PD_SIMD_NEON
+static float32x4_t math_exp2_neon(float32x4_t t)
+{
+    uint32x4_t valid = vcgeq_f32(t, vdupq_n_f32(-126.f));
+    float32x4_t k, p;
+    t = vminnmq_f32(vmaxnmq_f32(t, vdupq_n_f32(-126.f)),
+        vdupq_n_f32(MATH_EXP2MAX));
+    k = vrndmq_f32(t);
+    t = vsubq_f32(t, k);
+    p = vfmaq_f32(vdupq_n_f32(MATH_E4), vdupq_n_f32(MATH_E5), t);
+    p = vfmaq_f32(vdupq_n_f32(MATH_E3), p, t);
+    p = vfmaq_f32(vdupq_n_f32(MATH_E2), p, t);
+    p = vfmaq_f32(vdupq_n_f32(MATH_E1), p, t);
+    p = vfmaq_f32(vdupq_n_f32(MATH_E0), p, t);
+    p = vmulq_f32(p, vreinterpretq_f32_s32(vshlq_n_s32(
+        vaddq_s32(vcvtq_s32_f32(k), vdupq_n_s32(127)), 23)));
+    return (vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(p),
+        valid)));
+}
+
+static float32x4_t math_log2_neon(float32x4_t x)
+{
+    int32x4_t i = vreinterpretq_s32_f32(x), e;
+    uint32x4_t big;
+    float32x4_t m, s, z, p;
+    e = vsubq_s32(vshrq_n_s32(i, 23), vdupq_n_s32(127));
+    m = vreinterpretq_f32_s32(vorrq_s32(vandq_s32(i,
+        vdupq_n_s32(0x7fffff)), vdupq_n_s32(0x3f800000)));
+    big = vcgtq_f32(m, vdupq_n_f32(MATH_SQRT2));
+    m = vbslq_f32(big, vmulq_n_f32(m, 0.5f), m);
+    e = vsubq_s32(e, vreinterpretq_s32_u32(big));
+    s = vdivq_f32(vsubq_f32(m, vdupq_n_f32(1.f)),
+        vaddq_f32(m, vdupq_n_f32(1.f)));
+    z = vmulq_f32(s, s);
+    p = vfmaq_f32(vdupq_n_f32(MATH_L7), vdupq_n_f32(MATH_L9), z);
+    p = vfmaq_f32(vdupq_n_f32(MATH_L5), p, z);
+    p = vfmaq_f32(vdupq_n_f32(MATH_L3), p, z);
+    p = vfmaq_f32(vdupq_n_f32(MATH_L1), p, z);
+    return (vfmaq_f32(vcvtq_f32_s32(e), p, s));
+}
+
+static void math_kernel_neon(const t_mathop *op, const t_sample *in1,
+    const t_sample *in2, t_sample *out, int n)
+{
+    int i = 0;
+    float32x4_t lo = vdupq_n_f32(op->m_lo), hi = vdupq_n_f32(op->m_hi),
+        a = vdupq_n_f32(op->m_a), b = vdupq_n_f32(op->m_b),
+        fill = vdupq_n_f32(op->m_fill), bot = vdupq_n_f32(op->m_floor),
+        tiny = vdupq_n_f32(MATH_TINY), zero = vdupq_n_f32(0);
+    switch (op->m_type)
+    {
+    case MATH_EXP2:
+        for (; i + 4 <= n; i += 4)
+        {
+            float32x4_t x = vld1q_f32(in1 + i), g = math_exp2_neon(
+                vfmaq_f32(b, a, vminnmq_f32(x, hi)));
+            vst1q_f32(out + i, vbslq_f32(vcgtq_f32(x, lo), g, fill));
+        }
+        break;
+    case MATH_LOG2:
+        for (; i + 4 <= n; i += 4)
+        {
+            float32x4_t x = vld1q_f32(in1 + i), g = vfmaq_f32(b, a,
+                math_log2_neon(vmaxnmq_f32(x, tiny)));
+            vst1q_f32(out + i, vbslq_f32(vcgtq_f32(x, lo),
+                vmaxnmq_f32(g, bot), fill));
+        }
+        break;
+    case MATH_RSQRT:
+        for (; i + 4 <= n; i += 4)
+        {
+            float32x4_t x = vld1q_f32(in1 + i), y = vminnmq_f32(
+                vmaxnmq_f32(x, tiny), vdupq_n_f32(MATH_HUGE)),
+                g = vrsqrteq_f32(y);
+                /* the estimate is only good to 8 bits; two Newton steps */
+            g = vmulq_f32(g, vrsqrtsq_f32(vmulq_f32(y, g), g));
+            g = vmulq_f32(g, vrsqrtsq_f32(vmulq_f32(y, g), g));
+            vst1q_f32(out + i, vreinterpretq_f32_u32(vandq_u32(
+                vcgeq_f32(x, zero), vreinterpretq_u32_f32(g))));
+        }
+        break;
+    case MATH_SQRT:
+        for (; i + 4 <= n; i += 4)
+            vst1q_f32(out + i,
+                vsqrtq_f32(vmaxnmq_f32(vld1q_f32(in1 + i), zero)));
+        break;
+    case MATH_POW:
+        for (; i + 4 <= n; i += 4)
+        {
+            float32x4_t x = vld1q_f32(in1 + i), y = vld1q_f32(in2 + i),
+                g = math_exp2_neon(vmulq_f32(y,
+                    math_log2_neon(vmaxnmq_f32(x, tiny))));
+            vst1q_f32(out + i, vreinterpretq_f32_u32(vandq_u32(
+                vcgtq_f32(x, zero), vreinterpretq_u32_f32(g))));
+        }
+        break;
+    case MATH_LOG:
+        for (; i + 4 <= n; i += 4)
+        {
+            float32x4_t x = vld1q_f32(in1 + i), y = vld1q_f32(in2 + i),
+                g = math_log2_neon(vmaxnmq_f32(x, tiny));
+            g = vbslq_f32(vcgtq_f32(y, zero), vdivq_f32(g,
+                math_log2_neon(vmaxnmq_f32(y, tiny))),
+                    vmulq_n_f32(g, MATH_LN2));
+            vst1q_f32(out + i, vbslq_f32(vcgtq_f32(x, zero), g,
+                vdupq_n_f32(-1000.f)));
+        }
+        break;
+    }
+    math_kernel_c(op, in1 + i, (in2 ? in2 + i : 0), out + i, n - i);
+}
+#endif /* PD_SIMD_NEON */
+
+    /* choose a kernel for the CPU at DSP time */
+static t_mathkernel math_getkernel(void)
+{
+    int cpu = sys_getcpufeatures();
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+        return (math_kernel_avx2);
+#endif
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+        return (math_kernel_sse2);
+#endif
+#ifdef PD_SIMD_NEON
+    if (cpu & CPU_NEON)
+        return (math_kernel_neon);
+#endif
+    return (math_kernel_c);
+}
+
+static t_int *math_perform_fast(t_int *w)
+{
+    t_mathkernel kernel = (t_mathkernel)(w[1]);
+    const t_mathop *op = (const t_mathop *)(w[2]);
+    t_sample *in1 = (t_sample *)(w[3]);
+    t_sample *in2 = (t_sample *)(w[4]);
+    t_sample *out = (t_sample *)(w[5]);
+    int n = (int)(w[6]);
+    (*kernel)(op, in1, in2, out, n);
+    return (w+7);
+}
+
+static void math_dsp_fast(const t_mathop *op, t_sample *in1, t_sample *in2,
+    t_sample *out, int n)
+{
+    dsp_add(math_perform_fast, 6, math_getkernel(), op, in1, in2, out, n);
+}
+
+    /* "pd fast-math <f>"; the DSP chain is rebuilt so that the objects
+    choose their perform routines again. */
+void glob_fastmath(void *dummy, t_floatarg f)
+{
+    int dspwas = canvas_suspend_dsp();
+    sys_fastmath = (f != 0);
+    canvas_resume_dsp(dspwas);
+}
+
 /* ------------------------- clip~ -------------------------- */
 static t_class *clip_class;
 
@@ -159,7 +723,11 @@ static t_int *sigrsqrt_perform(t_int *w)
 
 static void sigrsqrt_dsp(t_sigrsqrt *x, t_signal **sp)
 {
-    dsp_add(sigrsqrt_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_fastmath)
+        math_dsp_fast(&math_rsqrt, sp[0]->s_vec, 0, sp[1]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(sigrsqrt_perform, 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void sigrsqrt_setup(void)
@@ -218,7 +786,11 @@ t_int *sigsqrt_perform(t_int *w)    /* not static; also used in d_fft.c */
 
 static void sigsqrt_dsp(t_sigsqrt *x, t_signal **sp)
 {
-    dsp_add(sigsqrt_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_fastmath)
+        math_dsp_fast(&math_sqrt, sp[0]->s_vec, 0, sp[1]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(sigsqrt_perform, 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void sigsqrt_setup(void)
@@ -314,7 +886,11 @@ static t_int *mtof_tilde_perform(t_int *w)
 
 static void mtof_tilde_dsp(t_mtof_tilde *x, t_signal **sp)
 {
-    dsp_add(mtof_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_fastmath)
+        math_dsp_fast(&math_mtof, sp[0]->s_vec, 0, sp[1]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(mtof_tilde_perform, 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void mtof_tilde_setup(void)
@@ -358,7 +934,11 @@ static t_int *ftom_tilde_perform(t_int *w)
 
 static void ftom_tilde_dsp(t_ftom_tilde *x, t_signal **sp)
 {
-    dsp_add(ftom_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_fastmath)
+        math_dsp_fast(&math_ftom, sp[0]->s_vec, 0, sp[1]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(ftom_tilde_perform, 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void ftom_tilde_setup(void)
@@ -408,7 +988,11 @@ static t_int *dbtorms_tilde_perform(t_int *w)
 
 static void dbtorms_tilde_dsp(t_dbtorms_tilde *x, t_signal **sp)
 {
-    dsp_add(dbtorms_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_fastmath)
+        math_dsp_fast(&math_dbtorms, sp[0]->s_vec, 0, sp[1]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(dbtorms_tilde_perform, 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void dbtorms_tilde_setup(void)
@@ -457,7 +1041,11 @@ static t_int *rmstodb_tilde_perform(t_int *w)
 
 static void rmstodb_tilde_dsp(t_rmstodb_tilde *x, t_signal **sp)
 {
-    dsp_add(rmstodb_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_fastmath)
+        math_dsp_fast(&math_rmstodb, sp[0]->s_vec, 0, sp[1]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(rmstodb_tilde_perform, 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void rmstodb_tilde_setup(void)
@@ -507,7 +1095,11 @@ static t_int *dbtopow_tilde_perform(t_int *w)
 
 static void dbtopow_tilde_dsp(t_dbtopow_tilde *x, t_signal **sp)
 {
-    dsp_add(dbtopow_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_fastmath)
+        math_dsp_fast(&math_dbtopow, sp[0]->s_vec, 0, sp[1]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(dbtopow_tilde_perform, 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void dbtopow_tilde_setup(void)
@@ -556,7 +1148,11 @@ static t_int *powtodb_tilde_perform(t_int *w)
 
 static void powtodb_tilde_dsp(t_powtodb_tilde *x, t_signal **sp)
 {
-    dsp_add(powtodb_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_fastmath)
+        math_dsp_fast(&math_powtodb, sp[0]->s_vec, 0, sp[1]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(powtodb_tilde_perform, 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void powtodb_tilde_setup(void)
@@ -607,7 +1203,10 @@ t_int *pow_tilde_perform(t_int *w)
 
 static void pow_tilde_dsp(t_pow_tilde *x, t_signal **sp)
 {
-    dsp_add(pow_tilde_perform, 4,
+    if (sys_fastmath)
+        math_dsp_fast(&math_pow, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(pow_tilde_perform, 4,
         sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
 }
 
@@ -648,7 +1247,9 @@ t_int *exp_tilde_perform(t_int *w)
 
 static void exp_tilde_dsp(t_exp_tilde *x, t_signal **sp)
 {
-    dsp_add(exp_tilde_perform, 3,
+    if (sys_fastmath)
+        math_dsp_fast(&math_exp, sp[0]->s_vec, 0, sp[1]->s_vec, sp[0]->s_n);
+    else dsp_add(exp_tilde_perform, 3,
         sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
@@ -700,7 +1301,10 @@ t_int *log_tilde_perform(t_int *w)
 
 static void log_tilde_dsp(t_log_tilde *x, t_signal **sp)
 {
-    dsp_add(log_tilde_perform, 4,
+    if (sys_fastmath)
+        math_dsp_fast(&math_log, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(log_tilde_perform, 4,
         sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
 }
 
@@ -757,6 +1361,212 @@ static void abs_tilde_setup(void)
         gensym("dsp"), A_CANT, 0);
 }
 
+/* ----------------------- "pd fast-math-test" ------------------------ */
+
+    /* compare the library routines and each fast kernel this CPU can run
+    against the same formulas computed in double precision, and time them
+    on 64-sample blocks.  Errors are relative, except for the logarithmic
+    outputs (ftom~, rmstodb~, powtodb~ and log~), whose errors are
+    absolute.  This holds up the scheduler for a fraction of a second. */
+
+#define MATHTEST_N 65536
+#define MATHTEST_BLOCK 64
+
+static double mathref_mtof(double x, double y)
+{
+    return (x <= -1500 ? 0 : 8.17579891564 * exp(.0577622650 *
+        (x > 1499 ? 1499 : x)));
+}
+
+static double mathref_ftom(double x, double y)
+{
+    return (x > 0 ? 17.3123405046 * log(.12231220585 * x) : -1500);
+}
+
+static double mathref_dbtorms(double x, double y)
+{
+    return (x <= 0 ? 0 : exp((LOGTEN * 0.05) * ((x > 485 ? 485 : x) - 100.)));
+}
+
+static double mathref_rmstodb(double x, double y)
+{
+    double g = 100 + 20./LOGTEN * log(x);
+    return (x <= 0 || g < 0 ? 0 : g);
+}
+
+static double mathref_dbtopow(double x, double y)
+{
+    return (x <= 0 ? 0 : exp((LOGTEN * 0.1) * ((x > 870 ? 870 : x) - 100.)));
+}
+
+static double mathref_powtodb(double x, double y)
+{
+    double g = 100 + 10./LOGTEN * log(x);
+    return (x <= 0 || g < 0 ? 0 : g);
+}
+
+static double mathref_exp(double x, double y)
+{
+    return (exp(x));
+}
+
+static double mathref_rsqrt(double x, double y)
+{
+    return (x < 0 ? 0 : 1 / sqrt(x));
+}
+
+static double mathref_sqrt(double x, double y)
+{
+    return (x < 0 ? 0 : sqrt(x));
+}
+
+static double mathref_pow(double x, double y)
+{
+    return (x > 0 ? pow(x, y) : 0);
+}
+
+static double mathref_log(double x, double y)
+{
+    return (x <= 0 ? -1000 : (y <= 0 ? log(x) : log(x) / log(y)));
+}
+
+typedef struct _mathtest
+{
+    const char *t_name;
+    const t_mathop *t_op;
+    t_perfroutine t_lib;
+    double (*t_ref)(double x, double y);
+    double t_lo, t_hi;      /* range of the first input */
+    int t_geometric;        /* spread the first input logarithmically */
+    double t_lo2, t_hi2;    /* range of the second input if there is one */
+    int t_abs;              /* measure absolute, not relative, error */
+} t_mathtest;
+
+static const t_mathtest math_tests[] =
+{
+    {"mtof~", &math_mtof, mtof_tilde_perform, mathref_mtof,
+        -20, 150, 0, 0, 0, 0},
+    {"ftom~", &math_ftom, ftom_tilde_perform, mathref_ftom,
+        1, 20000, 1, 0, 0, 1},
+    {"dbtorms~", &math_dbtorms, dbtorms_tilde_perform, mathref_dbtorms,
+        0, 130, 0, 0, 0, 0},
+    {"rmstodb~", &math_rmstodb, rmstodb_tilde_perform, mathref_rmstodb,
+        1e-5, 10, 1, 0, 0, 1},
+    {"dbtopow~", &math_dbtopow, dbtopow_tilde_perform, mathref_dbtopow,
+        0, 130, 0, 0, 0, 0},
+    {"powtodb~", &math_powtodb, powtodb_tilde_perform, mathref_powtodb,
+        1e-10, 100, 1, 0, 0, 1},
+    {"exp~", &math_exp, exp_tilde_perform, mathref_exp,
+        -20, 20, 0, 0, 0, 0},
+    {"rsqrt~", &math_rsqrt, sigrsqrt_perform, mathref_rsqrt,
+        1e-3, 1e3, 1, 0, 0, 0},
+    {"sqrt~", &math_sqrt, sigsqrt_perform, mathref_sqrt,
+        1e-3, 1e3, 1, 0, 0, 0},
+    {"pow~", &math_pow, pow_tilde_perform, mathref_pow,
+        0.01, 10, 1, -4, 4, 0},
+    {"log~", &math_log, log_tilde_perform, mathref_log,
+        1e-3, 1e3, 1, 2, 10, 1},
+};
+
+#define NMATHTEST (sizeof(math_tests)/sizeof(*math_tests))
+
+typedef struct _mathtestkernel
+{
+    const char *k_name;
+    t_mathkernel k_fn;          /* zero for the library routine */
+} t_mathtestkernel;
+
+    /* run one routine over the whole input; return ns per sample, and
+    the largest error through "errp" */
+static double math_testrun(const t_mathtest *t, t_mathkernel fn,
+    t_sample *in1, t_sample *in2, t_sample *out, double *errp)
+{
+    int i, two = (t->t_lo2 != t->t_hi2);
+    double time = sys_getrealtime(), err = 0;
+    for (i = 0; i < MATHTEST_N; i += MATHTEST_BLOCK)
+    {
+        if (fn)
+            (*fn)(t->t_op, in1 + i, (two ? in2 + i : 0), out + i,
+                MATHTEST_BLOCK);
+        else
+        {
+            t_int w[5];
+            w[1] = (t_int)(in1 + i);
+            if (two)
+                w[2] = (t_int)(in2 + i), w[3] = (t_int)(out + i),
+                    w[4] = MATHTEST_BLOCK;
+            else w[2] = (t_int)(out + i), w[3] = MATHTEST_BLOCK;
+            (*t->t_lib)(w);
+        }
+    }
+    time = (sys_getrealtime() - time) * (1e9 / MATHTEST_N);
+    for (i = 0; i < MATHTEST_N; i++)
+    {
+        double ref = (*t->t_ref)(in1[i], (two ? in2[i] : 0)),
+            diff = fabs(out[i] - ref);
+        if (!t->t_abs && ref != 0)
+            diff /= fabs(ref);
+        if (diff > err || diff != diff)
+            err = diff;
+    }
+    *errp = err;
+    return (time);
+}
+
+void glob_fastmathtest(void *dummy)
+{
+    t_mathtestkernel kernels[5];
+    int nkernels = 0, i, j, cpu = sys_getcpufeatures();
+    t_sample *in1 = (t_sample *)getbytes(3 * MATHTEST_N * sizeof(t_sample)),
+        *in2 = in1 + MATHTEST_N, *out = in2 + MATHTEST_N;
+    unsigned int seed = 1;
+    kernels[nkernels].k_name = "library", kernels[nkernels++].k_fn = 0;
+    kernels[nkernels].k_name = "C", kernels[nkernels++].k_fn = math_kernel_c;
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+        kernels[nkernels].k_name = "SSE2",
+            kernels[nkernels++].k_fn = math_kernel_sse2;
+#endif
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+        kernels[nkernels].k_name = "AVX2",
+            kernels[nkernels++].k_fn = math_kernel_avx2;
+#endif
+#ifdef PD_SIMD_NEON
+    if (cpu & CPU_NEON)
+        kernels[nkernels].k_name = "NEON",
+            kernels[nkernels++].k_fn = math_kernel_neon;
+#endif
+    post("fast math: max error and ns per sample over %d inputs:",
+        MATHTEST_N);
+    for (i = 0; i < (int)NMATHTEST; i++)
+    {
+        const t_mathtest *t = &math_tests[i];
+        for (j = 0; j < MATHTEST_N; j++)
+        {
+            double r1, r2;
+            seed = seed * 435898247 + 382842987;
+            r1 = (seed & 0x7fffffff) * (1. / 0x80000000);
+            seed = seed * 435898247 + 382842987;
+            r2 = (seed & 0x7fffffff) * (1. / 0x80000000);
+            in1[j] = (t->t_geometric ?
+                t->t_lo * pow(t->t_hi / t->t_lo, r1) :
+                    t->t_lo + (t->t_hi - t->t_lo) * r1);
+            in2[j] = t->t_lo2 + (t->t_hi2 - t->t_lo2) * r2;
+        }
+        startpost("  %-9s", t->t_name);
+        for (j = 0; j < nkernels; j++)
+        {
+            double err, ns = math_testrun(t, kernels[j].k_fn,
+                in1, in2, out, &err);
+            startpost("  %s %.1e %.2f", kernels[j].k_name, err, ns);
+        }
+        endpost();
+    }
+    post("  (errors for ftom~, rmstodb~, powtodb~ and log~ are absolute)");
+    freebytes(in1, 3 * MATHTEST_N * sizeof(t_sample));
+}
+
 /* ------------------------ global setup routine ------------------------- */
 
 void d_math_setup(void)
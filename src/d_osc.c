@@ -6,7 +6,10 @@
 */
 
 #include "m_pd.h"
+#include "s_stuff.h"
+#include "s_simd.h"
 #include "math.h"
+#include <string.h>
 
 #define UNITBIT32 1572864.  /* 3*2^19; bit 32 has place value 1 */
 
@@ -49,6 +52,323 @@ union tabfudge
     int32_t tf_i[2];
 };
 
+/* ---------------- polynomial oscillator kernels ------------------- */
+
+/* The classic phasor~, cos~ and osc~ below keep their phase in a double
+and look up a 512-point table, which is serial and gives about 70 dB
+signal-to-noise.  With "-oscprecision 1" (or "pd osc-precision 1") they
+use these kernels instead: the phase is a 32-bit integer that wraps by
+itself, whole vectors of phases are found at once by a prefix sum over
+the per-sample increments, and the cosine is an odd polynomial in the
+distance from the nearest quarter cycle, accurate to a few units in the
+last place of a float.  The classic versions remain the default so that
+old patches compute exactly what they used to. */
+
+int sys_oscprecision;
+
+    /* minimax fit of sin(2 pi b)/b in b^2 for -1/4 <= b <= 1/4 */
+#define OSC_C1 6.28318501f
+#define OSC_C3 -41.3416557f
+#define OSC_C5 81.6010056f
+#define OSC_C7 -76.5497589f
+#define OSC_C9 39.5365601f
+
+#define OSC_TWO32 4294967296.
+#define OSC_RTWO32 (1./4294967296.)
+#define OSC_RTWO24 (1./16777216.)
+
+    /* output cos(2 pi phase) if "cosine", else the phase in [0, 1) */
+typedef uint32_t (*t_oscphasekernel)(uint32_t phase, const t_sample *in,
+    t_sample *out, int n, t_sample conv, int cosine);
+    /* output cos(2 pi in) */
+typedef void (*t_osccoskernel)(const t_sample *in, t_sample *out, int n);
+
+    /* cos(2 pi u) for -1/2 <= u <= 1/2 */
+static t_sample osc_cospoly(t_sample u)
+{
+    t_sample b = 0.25f - (u < 0 ? -u : u), z = b * b;
+    return (b * (OSC_C1 + z * (OSC_C3 + z * (OSC_C5 + z * (OSC_C7 +
+        z * OSC_C9)))));
+}
+
+    /* f minus the nearest integer, in [-1/2, 1/2].  Past 2^23 there's no
+    fractional part, so that (and NaN) gives zero; the SIMD kernels mask
+    the same way. */
+static t_sample osc_frac(t_sample f)
+{
+    t_sample u;
+    if (!(f < 8388608 && f > -8388608))
+        return (0);
+    u = f - (int32_t)f;
+    if (u > 0.5f)
+        u -= 1;
+    else if (u < -0.5f)
+        u += 1;
+    return (u);
+}
+
+    /* All the phase kernels find the increment the same way, in single
+    precision: the fractional part of in * conv, in cycles, scaled to 32
+    bits.  This way a block computes the same phases whichever kernel runs
+    it, including the scalar tail of the SIMD ones. */
+static uint32_t osc_phasevec_c(uint32_t phase, const t_sample *in,
+    t_sample *out, int n, t_sample conv, int cosine)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        uint32_t inc = (uint32_t)(int64_t)(osc_frac(in[i] * conv) *
+            (t_sample)OSC_TWO32);
+        out[i] = (cosine ? osc_cospoly((int32_t)phase * OSC_RTWO32) :
+            (phase >> 8) * OSC_RTWO24);
+        phase += inc;
+    }
+    return (phase);
+}
+
+static void osc_cosvec_c(const t_sample *in, t_sample *out, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        out[i] = osc_cospoly(osc_frac(in[i]));
+}
+
+#ifdef PD_SIMD_SSE2
+static __m128 osc_cospoly_sse2(__m128 u)
+{
+    __m128 b = _mm_sub_ps(_mm_set1_ps(0.25f),
+        _mm_andnot_ps(_mm_set1_ps(-0.f), u)), z = _mm_mul_ps(b, b), r;
+    r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(OSC_C9), z), _mm_set1_ps(OSC_C7));
+    r = _mm_add_ps(_mm_mul_ps(r, z), _mm_set1_ps(OSC_C5));
+    r = _mm_add_ps(_mm_mul_ps(r, z), _mm_set1_ps(OSC_C3));
+    r = _mm_add_ps(_mm_mul_ps(r, z), _mm_set1_ps(OSC_C1));
+    return (_mm_mul_ps(r, b));
+}
+
+    /* as osc_frac() above */
+static __m128 osc_frac_sse2(__m128 f)
+{
+    __m128 u = _mm_sub_ps(f, _mm_cvtepi32_ps(_mm_cvtps_epi32(f)));
+    return (_mm_and_ps(u, _mm_cmplt_ps(_mm_andnot_ps(_mm_set1_ps(-0.f), f),
+        _mm_set1_ps(8388608.f))));
+}
+
+static uint32_t osc_phasevec_sse2(uint32_t phase, const t_sample *in,
+    t_sample *out, int n, t_sample conv, int cosine)
+{
+    int i;
+    __m128 vconv = _mm_set1_ps(conv), two32 = _mm_set1_ps(OSC_TWO32);
+    __m128i base = _mm_set1_epi32(phase);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 c = _mm_mul_ps(_mm_loadu_ps(in + i), vconv);
+        __m128i inc = _mm_cvttps_epi32(_mm_mul_ps(two32, osc_frac_sse2(c))),
+            sum, ph;
+            /* running sum of the increments within the vector */
+        sum = _mm_add_epi32(inc, _mm_slli_si128(inc, 4));
+        sum = _mm_add_epi32(sum, _mm_slli_si128(sum, 8));
+        ph = _mm_add_epi32(base, _mm_sub_epi32(sum, inc));
+        base = _mm_add_epi32(base, _mm_shuffle_epi32(sum, 0xff));
+        if (cosine)
+            _mm_storeu_ps(out + i, osc_cospoly_sse2(_mm_mul_ps(
+                _mm_cvtepi32_ps(ph), _mm_set1_ps(OSC_RTWO32))));
+        else _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(
+            _mm_srli_epi32(ph, 8)), _mm_set1_ps(OSC_RTWO24)));
+    }
+    phase = (uint32_t)_mm_cvtsi128_si32(base);
+    return (osc_phasevec_c(phase, in + i, out + i, n - i, conv, cosine));
+}
+
+static void osc_cosvec_sse2(const t_sample *in, t_sample *out, int n)
+{
+    int i;
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(out + i, osc_cospoly_sse2(osc_frac_sse2(
+            _mm_loadu_ps(in + i))));
+    }
+    osc_cosvec_c(in + i, out + i, n - i);
+}
+#endif /* PD_SIMD_SSE2 */
+
+#ifdef PD_SIMD_AVX2
+PD_SIMD_AVX2FN static __m256 osc_cospoly_avx2(__m256 u)
+{
+    __m256 b = _mm256_sub_ps(_mm256_set1_ps(0.25f),
+        _mm256_andnot_ps(_mm256_set1_ps(-0.f), u)), z = _mm256_mul_ps(b, b), r;
+    r = _mm256_fmadd_ps(_mm256_set1_ps(OSC_C9), z, _mm256_set1_ps(OSC_C7));
+    r = _mm256_fmadd_ps(r, z, _mm256_set1_ps(OSC_C5));
+    r = _mm256_fmadd_ps(r, z, _mm256_set1_ps(OSC_C3));
+    r = _mm256_fmadd_ps(r, z, _mm256_set1_ps(OSC_C1));
+    return (_mm256_mul_ps(r, b));
+}
+
+PD_SIMD_AVX2FN static __m256 osc_frac_avx2(__m256 f)
+{
+    __m256 u = _mm256_sub_ps(f, _mm256_round_ps(f,
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    return (_mm256_and_ps(u, _mm256_cmp_ps(_mm256_andnot_ps(
+        _mm256_set1_ps(-0.f), f), _mm256_set1_ps(8388608.f), _CMP_LT_OQ)));
+}
+
+PD_SIMD_AVX2FN static uint32_t osc_phasevec_avx2(uint32_t phase,
+    const t_sample *in, t_sample *out, int n, t_sample conv, int cosine)
+{
+    int i;
+    __m256 vconv = _mm256_set1_ps(conv), two32 = _mm256_set1_ps(OSC_TWO32);
+    __m256i base = _mm256_set1_epi32(phase), last = _mm256_set1_epi32(7);
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m256 c = _mm256_mul_ps(_mm256_loadu_ps(in + i), vconv);
+        __m256i inc = _mm256_cvttps_epi32(_mm256_mul_ps(two32,
+            osc_frac_avx2(c))), sum, ph;
+            /* running sum within each half, then carry the low half's
+            total into the high half */
+        sum = _mm256_add_epi32(inc, _mm256_slli_si256(inc, 4));
+        sum = _mm256_add_epi32(sum, _mm256_slli_si256(sum, 8));
+        sum = _mm256_add_epi32(sum, _mm256_permute2x128_si256(
+            _mm256_shuffle_epi32(sum, 0xff), sum, 0x08));
+        ph = _mm256_add_epi32(base, _mm256_sub_epi32(sum, inc));
+        base = _mm256_add_epi32(base, _mm256_permutevar8x32_epi32(sum, last));
+        if (cosine)
+            _mm256_storeu_ps(out + i, osc_cospoly_avx2(_mm256_mul_ps(
+                _mm256_cvtepi32_ps(ph), _mm256_set1_ps(OSC_RTWO32))));
+        else _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(
+            _mm256_srli_epi32(ph, 8)), _mm256_set1_ps(OSC_RTWO24)));
+    }
+    phase = (uint32_t)_mm256_extract_epi32(base, 0);
+    return (osc_phasevec_c(phase, in + i, out + i, n - i, conv, cosine));
+}
+
+PD_SIMD_AVX2FN static void osc_cosvec_avx2(const t_sample *in, t_sample *out,
+    int n)
+{
+    int i;
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(out + i, osc_cospoly_avx2(osc_frac_avx2(
+            _mm256_loadu_ps(in + i))));
+    }
+    osc_cosvec_c(in + i, out + i, n - i);
+}
+#endif /* PD_SIMD_AVX2 */
+
+#ifdef PD_SIMD_NEON
+static float32x4_t osc_cospoly_neon(float32x4_t u)
+{
+    float32x4_t b = vsubq_f32(vdupq_n_f32(0.25f), vabsq_f32(u)),
+        z = vmulq_f32(b, b), r;
+    r = vfmaq_f32(vdupq_n_f32(OSC_C7), vdupq_n_f32(OSC_C9), z);
+    r = vfmaq_f32(vdupq_n_f32(OSC_C5), r, z);
+    r = vfmaq_f32(vdupq_n_f32(OSC_C3), r, z);
+    r = vfmaq_f32(vdupq_n_f32(OSC_C1), r, z);
+    return (vmulq_f32(r, b));
+}
+
+static float32x4_t osc_frac_neon(float32x4_t f)
+{
+    uint32x4_t u = vreinterpretq_u32_f32(vsubq_f32(f, vrndnq_f32(f)));
+    return (vreinterpretq_f32_u32(vandq_u32(u,
+        vcltq_f32(vabsq_f32(f), vdupq_n_f32(8388608.f)))));
+}
+
+static uint32_t osc_phasevec_neon(uint32_t phase, const t_sample *in,
+    t_sample *out, int n, t_sample conv, int cosine)
+{
+    int i;
+    float32x4_t vconv = vdupq_n_f32(conv);
+    uint32x4_t base = vdupq_n_u32(phase), zero = vdupq_n_u32(0);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        float32x4_t c = osc_frac_neon(vmulq_f32(vld1q_f32(in + i), vconv));
+        uint32x4_t inc = vreinterpretq_u32_s32(vcvtq_s32_f32(vmulq_f32(c,
+            vdupq_n_f32(OSC_TWO32)))), sum, ph;
+            /* half a cycle saturates to 0x7fffffff; make it 0x80000000 as
+            the other kernels do */
+        inc = vsubq_u32(inc, vcgeq_f32(c, vdupq_n_f32(0.5f)));
+        sum = vaddq_u32(inc, vextq_u32(zero, inc, 3));
+        sum = vaddq_u32(sum, vextq_u32(zero, sum, 2));
+        ph = vaddq_u32(base, vsubq_u32(sum, inc));
+        base = vaddq_u32(base, vdupq_laneq_u32(sum, 3));
+        if (cosine)
+            vst1q_f32(out + i, osc_cospoly_neon(vmulq_f32(vcvtq_f32_s32(
+                vreinterpretq_s32_u32(ph)), vdupq_n_f32(OSC_RTWO32))));
+        else vst1q_f32(out + i, vmulq_f32(vcvtq_f32_u32(
+            vshrq_n_u32(ph, 8)), vdupq_n_f32(OSC_RTWO24)));
+    }
+    phase = vgetq_lane_u32(base, 0);
+    return (osc_phasevec_c(phase, in + i, out + i, n - i, conv, cosine));
+}
+
+static void osc_cosvec_neon(const t_sample *in, t_sample *out, int n)
+{
+    int i;
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        vst1q_f32(out + i,
+            osc_cospoly_neon(osc_frac_neon(vld1q_f32(in + i))));
+    }
+    osc_cosvec_c(in + i, out + i, n - i);
+}
+#endif /* PD_SIMD_NEON */
+
+    /* choose kernels for the CPU at DSP time */
+static t_oscphasekernel osc_getphasekernel(void)
+{
+    int cpu = sys_getcpufeatures();
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+        return (osc_phasevec_avx2);
+#endif
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+        return (osc_phasevec_sse2);
+#endif
+#ifdef PD_SIMD_NEON
+    if (cpu & CPU_NEON)
+        return (osc_phasevec_neon);
+#endif
+    return (osc_phasevec_c);
+}
+
+static t_osccoskernel osc_getcoskernel(void)
+{
+    int cpu = sys_getcpufeatures();
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+        return (osc_cosvec_avx2);
+#endif
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+        return (osc_cosvec_sse2);
+#endif
+#ifdef PD_SIMD_NEON
+    if (cpu & CPU_NEON)
+        return (osc_cosvec_neon);
+#endif
+    return (osc_cosvec_c);
+}
+
+    /* phase as a fraction of a cycle to and from the integer form */
+static uint32_t osc_tophase(double f)
+{
+    return ((uint32_t)(int64_t)((f - floor(f)) * OSC_TWO32));
+}
+
+static double osc_fromphase(uint32_t phase)
+{
+    return (phase * OSC_RTWO32);
+}
+
+    /* "pd osc-precision <f>"; the DSP chain is rebuilt so that the
+    oscillators choose their perform routines again. */
+void glob_oscprecision(void *dummy, t_floatarg f)
+{
+    int dspwas = canvas_suspend_dsp();
+    sys_oscprecision = (f > 0);
+    canvas_resume_dsp(dspwas);
+}
+
 /* -------------------------- phasor~ ------------------------------ */
 static t_class *phasor_class;
 
@@ -100,10 +420,26 @@ static t_int *phasor_perform(t_int *w)
     return (w+5);
 }
 
+static t_int *phasor_perform_poly(t_int *w)
+{
+    t_phasor *x = (t_phasor *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]);
+    t_oscphasekernel kernel = (t_oscphasekernel)(w[5]);
+    x->x_phase = osc_fromphase((*kernel)(osc_tophase(x->x_phase),
+        in, out, n, x->x_conv, 0));
+    return (w+6);
+}
+
 static void phasor_dsp(t_phasor *x, t_signal **sp)
 {
     x->x_conv = 1./sp[0]->s_sr;
-    dsp_add(phasor_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_oscprecision)
+        dsp_add(phasor_perform_poly, 5, x, sp[0]->s_vec, sp[1]->s_vec,
+            sp[0]->s_n, osc_getphasekernel());
+    else dsp_add(phasor_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec,
+        sp[0]->s_n);
 }
 
 static void phasor_ft1(t_phasor *x, t_float f)
@@ -194,9 +530,19 @@ static t_int *cos_perform(t_int *w)
     return (w+4);
 }
 
+static t_int *cos_perform_poly(t_int *w)
+{
+    t_osccoskernel kernel = (t_osccoskernel)(w[4]);
+    (*kernel)((t_sample *)(w[1]), (t_sample *)(w[2]), (int)(w[3]));
+    return (w+5);
+}
+
 static void cos_dsp(t_cos *x, t_signal **sp)
 {
-    dsp_add(cos_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_oscprecision)
+        dsp_add(cos_perform_poly, 4, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n,
+            osc_getcoskernel());
+    else dsp_add(cos_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 static void cos_maketable(void)
@@ -308,10 +654,28 @@ static t_int *osc_perform(t_int *w)
     return (w+5);
 }
 
+    /* x_phase and x_conv are in table units here too, so that the two
+    versions can be switched while running. */
+static t_int *osc_perform_poly(t_int *w)
+{
+    t_osc *x = (t_osc *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]);
+    t_oscphasekernel kernel = (t_oscphasekernel)(w[5]);
+    x->x_phase = COSTABSIZE * osc_fromphase((*kernel)(
+        osc_tophase(x->x_phase * (1./COSTABSIZE)), in, out, n,
+            x->x_conv * (1.f/COSTABSIZE), 1));
+    return (w+6);
+}
+
 static void osc_dsp(t_osc *x, t_signal **sp)
 {
     x->x_conv = COSTABSIZE/sp[0]->s_sr;
-    dsp_add(osc_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sys_oscprecision)
+        dsp_add(osc_perform_poly, 5, x, sp[0]->s_vec, sp[1]->s_vec,
+            sp[0]->s_n, osc_getphasekernel());
+    else dsp_add(osc_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 static void osc_ft1(t_osc *x, t_float f)
@@ -330,6 +694,557 @@ static void osc_setup(void)
     cos_maketable();
 }
 
+/* ------------------------- "pd osc-test" --------------------------- */
+
+    /* check and time the oscillator kernels this CPU can run, next to the
+    classic table cos~.  For cos~ each is compared to cos() in double
+    precision.  For the phase kernels (phasor~ and osc~) the phases are
+    compared bit for bit with a reference that adds up the increments the
+    way osc_phasevec_c() does, and the osc~ output to the cosine of those
+    phases.  The frequencies are random, plus some at exactly half a cycle
+    per sample and some too large to have a fractional part.  This holds up
+    the scheduler for a fraction of a second. */
+
+#define OSCTEST_N 65536
+#define OSCTEST_BLOCK 64
+#define OSCTEST_CONV (1.f/32768.f)
+
+typedef struct _osctestkernel
+{
+    const char *k_name;
+    t_oscphasekernel k_phase;   /* zero for the table versions */
+    t_osccoskernel k_cos;
+} t_osctestkernel;
+
+static double osctest_cos(t_osccoskernel fn, const t_sample *in,
+    t_sample *out, double *errp)
+{
+    int i;
+    double time = sys_getrealtime(), err = 0;
+    for (i = 0; i < OSCTEST_N; i += OSCTEST_BLOCK)
+    {
+        if (fn)
+            (*fn)(in + i, out + i, OSCTEST_BLOCK);
+        else
+        {
+            t_int w[4];
+            w[1] = (t_int)(in + i), w[2] = (t_int)(out + i),
+                w[3] = OSCTEST_BLOCK;
+            cos_perform(w);
+        }
+    }
+    time = (sys_getrealtime() - time) * (1e9 / OSCTEST_N);
+    for (i = 0; i < OSCTEST_N; i++)
+    {
+        double diff = fabs(out[i] - cos(2 * 3.14159265358979 * in[i]));
+        if (diff > err || diff != diff)
+            err = diff;
+    }
+    *errp = err;
+    return (time);
+}
+
+    /* run a phase kernel over the whole input; return ns per sample */
+static double osctest_phase(t_oscphasekernel fn, const t_sample *in,
+    t_sample *out, int cosine)
+{
+    int i;
+    uint32_t phase = 0;
+    double time = sys_getrealtime();
+    for (i = 0; i < OSCTEST_N; i += OSCTEST_BLOCK)
+        phase = (*fn)(phase, in + i, out + i, OSCTEST_BLOCK, OSCTEST_CONV,
+            cosine);
+    return ((sys_getrealtime() - time) * (1e9 / OSCTEST_N));
+}
+
+void glob_osctest(void *dummy)
+{
+    t_osctestkernel kernels[5];
+    int nkernels = 0, i, j, cpu = sys_getcpufeatures();
+    t_sample *in = (t_sample *)getbytes(2 * OSCTEST_N * sizeof(t_sample)),
+        *out = in + OSCTEST_N;
+    uint32_t *ref = (uint32_t *)getbytes(OSCTEST_N * sizeof(uint32_t)),
+        phase = 0, seed = 1;
+    kernels[nkernels].k_name = "table", kernels[nkernels].k_phase = 0,
+        kernels[nkernels++].k_cos = 0;
+    kernels[nkernels].k_name = "C", kernels[nkernels].k_phase =
+        osc_phasevec_c, kernels[nkernels++].k_cos = osc_cosvec_c;
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+        kernels[nkernels].k_name = "SSE2", kernels[nkernels].k_phase =
+            osc_phasevec_sse2, kernels[nkernels++].k_cos = osc_cosvec_sse2;
+#endif
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+        kernels[nkernels].k_name = "AVX2", kernels[nkernels].k_phase =
+            osc_phasevec_avx2, kernels[nkernels++].k_cos = osc_cosvec_avx2;
+#endif
+#ifdef PD_SIMD_NEON
+    if (cpu & CPU_NEON)
+        kernels[nkernels].k_name = "NEON", kernels[nkernels].k_phase =
+            osc_phasevec_neon, kernels[nkernels++].k_cos = osc_cosvec_neon;
+#endif
+    post("oscillators: max error and ns per sample over %d inputs:",
+        OSCTEST_N);
+
+        /* cos~, over a few cycles either side of zero */
+    for (i = 0; i < OSCTEST_N; i++)
+    {
+        seed = seed * 435898247 + 382842987;
+        in[i] = -4 + 8 * ((seed & 0x7fffffff) * (1. / 0x80000000));
+    }
+    startpost("  cos~     ");
+    for (j = 0; j < nkernels; j++)
+    {
+        double err, ns = osctest_cos(kernels[j].k_cos, in, out, &err);
+        startpost("  %s %.1e %.2f", kernels[j].k_name, err, ns);
+    }
+    endpost();
+
+        /* frequencies up to 0.6 cycles per sample either way */
+    for (i = 0; i < OSCTEST_N; i++)
+    {
+        seed = seed * 435898247 + 382842987;
+        in[i] = (i % 97 == 0 ? 16384 : (i % 97 == 1 ? -16384 :
+            (i % 97 == 2 ? 1e9 : -19661 + 39322 *
+                ((seed & 0x7fffffff) * (1. / 0x80000000)))));
+        ref[i] = phase;
+        phase += (uint32_t)(int64_t)(osc_frac(in[i] * OSCTEST_CONV) *
+            (t_sample)OSC_TWO32);
+    }
+    startpost("  osc~     ");
+    for (j = 1; j < nkernels; j++)
+    {
+        double err = 0, ns = osctest_phase(kernels[j].k_phase, in, out, 1);
+        for (i = 0; i < OSCTEST_N; i++)
+        {
+            double diff = fabs(out[i] - cos(2 * 3.14159265358979 *
+                ((int32_t)ref[i] * OSC_RTWO32)));
+            if (diff > err || diff != diff)
+                err = diff;
+        }
+        startpost("  %s %.1e %.2f", kernels[j].k_name, err, ns);
+    }
+    endpost();
+    startpost("  phasor~  ");
+    for (j = 1; j < nkernels; j++)
+    {
+        int wrong = 0;
+        double ns = osctest_phase(kernels[j].k_phase, in, out, 0);
+        for (i = 0; i < OSCTEST_N; i++)
+            if (out[i] != (t_sample)((ref[i] >> 8) * OSC_RTWO24))
+                wrong++;
+        startpost("  %s %d wrong %.2f", kernels[j].k_name, wrong, ns);
+    }
+    endpost();
+    freebytes(ref, OSCTEST_N * sizeof(uint32_t));
+    freebytes(in, 2 * OSCTEST_N * sizeof(t_sample));
+}
+
+/* ------------------ oscbank~ - a bank of sinusoids ----------------- */
+
+/* oscbank~ adds up any number of cosine partials, each with its own
+frequency and amplitude, into one output.  It's much cheaper than an
+osc~, *~ and throw~ for each partial: there's one perform routine and one
+signal for the whole bank, partials are computed 4 or 8 at a time with
+the polynomial kernels above, and groups of partials whose amplitude is
+and stays zero are skipped.  Frequencies and amplitudes come from "freq"
+and "amp" messages or, after "set", from two arrays read every block; the
+bank moves to new values by a linear ramp over one block.  A partial
+that's silent jumps to its new frequency instead. */
+
+#define OSCBANK_PAD 8       /* partials are padded to a multiple of this */
+
+typedef struct _oscbank t_oscbank;
+typedef void (*t_oscbankkernel)(t_oscbank *x, t_sample *out, int n);
+
+struct _oscbank
+{
+    t_object x_obj;
+    int x_npartials;
+    int x_npad;             /* x_npartials rounded up to OSCBANK_PAD */
+    uint32_t *x_phase;
+    int32_t *x_inc;         /* phase increment now... */
+    int32_t *x_inctarget;   /* ... where it's headed... */
+    int32_t *x_incstep;     /* ... and the per-sample change meanwhile */
+    t_sample *x_amp;        /* the same for the amplitudes */
+    t_sample *x_amptarget;
+    t_sample *x_ampstep;
+    t_sample *x_freq;       /* frequencies in Hz */
+    int x_freqdirty;        /* x_inctarget needs recomputing */
+    double x_conv;          /* phase units per sample per Hz */
+    t_sample *x_acc;        /* accumulators for the SIMD kernels */
+    int x_accsize;
+    t_symbol *x_freqname;   /* arrays for frequencies and amplitudes */
+    t_symbol *x_ampname;
+    t_float *x_freqvec;
+    int x_freqpoints;
+    int x_freqstride;
+    t_float *x_ampvec;
+    int x_amppoints;
+    int x_ampstride;
+    t_oscbankkernel x_kernel;
+};
+
+static t_class *oscbank_class;
+
+    /* is a group of "w" partials starting at "k" silent for the block? */
+static int oscbank_silent(t_oscbank *x, int k, int w)
+{
+    int i;
+    for (i = k; i < k + w; i++)
+        if (x->x_amp[i] != 0 || x->x_amptarget[i] != 0)
+            return (0);
+    return (1);
+}
+
+    /* advance the phases of a silent group as if we'd computed it */
+static void oscbank_skip(t_oscbank *x, int k, int w, int n)
+{
+    int i;
+    uint32_t tri = (uint32_t)n * (uint32_t)(n-1) / 2;
+    for (i = k; i < k + w; i++)
+        x->x_phase[i] += (uint32_t)n * (uint32_t)x->x_inc[i] +
+            tri * (uint32_t)x->x_incstep[i];
+}
+
+static void oscbank_kernel_c(t_oscbank *x, t_sample *out, int n)
+{
+    int i, k;
+    for (i = 0; i < n; i++)
+        out[i] = 0;
+    for (k = 0; k < x->x_npartials; k++)
+    {
+        uint32_t ph = x->x_phase[k], inc = x->x_inc[k],
+            step = x->x_incstep[k];
+        t_sample amp = x->x_amp[k], ampstep = x->x_ampstep[k];
+        if (oscbank_silent(x, k, 1))
+        {
+            oscbank_skip(x, k, 1, n);
+            continue;
+        }
+        for (i = 0; i < n; i++)
+        {
+            out[i] += amp * osc_cospoly((int32_t)ph * OSC_RTWO32);
+            ph += inc;
+            inc += step;
+            amp += ampstep;
+        }
+        x->x_phase[k] = ph;
+    }
+}
+
+    /* sum the "w" accumulators for each sample into the output */
+static void oscbank_sumacc(const t_sample *acc, t_sample *out, int n, int w)
+{
+    int i, j;
+    for (i = 0; i < n; i++, acc += w)
+    {
+        t_sample sum = 0;
+        for (j = 0; j < w; j++)
+            sum += acc[j];
+        out[i] = sum;
+    }
+}
+
+#ifdef PD_SIMD_SSE2
+static void oscbank_kernel_sse2(t_oscbank *x, t_sample *out, int n)
+{
+    int i, k;
+    t_sample *acc = x->x_acc;
+    memset(acc, 0, 4 * n * sizeof(t_sample));
+    for (k = 0; k < x->x_npad; k += 4)
+    {
+        __m128i ph, inc, step;
+        __m128 amp, ampstep;
+        if (oscbank_silent(x, k, 4))
+        {
+            oscbank_skip(x, k, 4, n);
+            continue;
+        }
+        ph = _mm_loadu_si128((__m128i *)(x->x_phase + k));
+        inc = _mm_loadu_si128((__m128i *)(x->x_inc + k));
+        step = _mm_loadu_si128((__m128i *)(x->x_incstep + k));
+        amp = _mm_loadu_ps(x->x_amp + k);
+        ampstep = _mm_loadu_ps(x->x_ampstep + k);
+        for (i = 0; i < n; i++)
+        {
+            __m128 c = osc_cospoly_sse2(_mm_mul_ps(_mm_cvtepi32_ps(ph),
+                _mm_set1_ps(OSC_RTWO32)));
+            _mm_storeu_ps(acc + 4*i,
+                _mm_add_ps(_mm_loadu_ps(acc + 4*i), _mm_mul_ps(amp, c)));
+            ph = _mm_add_epi32(ph, inc);
+            inc = _mm_add_epi32(inc, step);
+            amp = _mm_add_ps(amp, ampstep);
+        }
+        _mm_storeu_si128((__m128i *)(x->x_phase + k), ph);
+    }
+    oscbank_sumacc(acc, out, n, 4);
+}
+#endif /* PD_SIMD_SSE2 */
+
+#ifdef PD_SIMD_AVX2
+PD_SIMD_AVX2FN static void oscbank_kernel_avx2(t_oscbank *x, t_sample *out,
+    int n)
+{
+    int i, k;
+    t_sample *acc = x->x_acc;
+    memset(acc, 0, 8 * n * sizeof(t_sample));
+    for (k = 0; k < x->x_npad; k += 8)
+    {
+        __m256i ph, inc, step;
+        __m256 amp, ampstep;
+        if (oscbank_silent(x, k, 8))
+        {
+            oscbank_skip(x, k, 8, n);
+            continue;
+        }
+        ph = _mm256_loadu_si256((__m256i *)(x->x_phase + k));
+        inc = _mm256_loadu_si256((__m256i *)(x->x_inc + k));
+        step = _mm256_loadu_si256((__m256i *)(x->x_incstep + k));
+        amp = _mm256_loadu_ps(x->x_amp + k);
+        ampstep = _mm256_loadu_ps(x->x_ampstep + k);
+        for (i = 0; i < n; i++)
+        {
+            __m256 c = osc_cospoly_avx2(_mm256_mul_ps(_mm256_cvtepi32_ps(ph),
+                _mm256_set1_ps(OSC_RTWO32)));
+            _mm256_storeu_ps(acc + 8*i,
+                _mm256_fmadd_ps(amp, c, _mm256_loadu_ps(acc + 8*i)));
+            ph = _mm256_add_epi32(ph, inc);
+            inc = _mm256_add_epi32(inc, step);
+            amp = _mm256_add_ps(amp, ampstep);
+        }
+        _mm256_storeu_si256((__m256i *)(x->x_phase + k), ph);
+    }
+    oscbank_sumacc(acc, out, n, 8);
+}
+#endif /* PD_SIMD_AVX2 */
+
+#ifdef PD_SIMD_NEON
+static void oscbank_kernel_neon(t_oscbank *x, t_sample *out, int n)
+{
+    int i, k;
+    t_sample *acc = x->x_acc;
+    memset(acc, 0, 4 * n * sizeof(t_sample));
+    for (k = 0; k < x->x_npad; k += 4)
+    {
+        uint32x4_t ph, inc, step;
+        float32x4_t amp, ampstep;
+        if (oscbank_silent(x, k, 4))
+        {
+            oscbank_skip(x, k, 4, n);
+            continue;
+        }
+        ph = vld1q_u32(x->x_phase + k);
+        inc = vld1q_u32((uint32_t *)(x->x_inc + k));
+        step = vld1q_u32((uint32_t *)(x->x_incstep + k));
+        amp = vld1q_f32(x->x_amp + k);
+        ampstep = vld1q_f32(x->x_ampstep + k);
+        for (i = 0; i < n; i++)
+        {
+            float32x4_t c = osc_cospoly_neon(vmulq_f32(vcvtq_f32_s32(
+                vreinterpretq_s32_u32(ph)), vdupq_n_f32(OSC_RTWO32)));
+            vst1q_f32(acc + 4*i, vfmaq_f32(vld1q_f32(acc + 4*i), amp, c));
+            ph = vaddq_u32(ph, inc);
+            inc = vaddq_u32(inc, step);
+            amp = vaddq_f32(amp, ampstep);
+        }
+        vst1q_u32(x->x_phase + k, ph);
+    }
+    oscbank_sumacc(acc, out, n, 4);
+}
+#endif /* PD_SIMD_NEON */
+
+static int32_t oscbank_freqtoinc(t_oscbank *x, t_sample freq)
+{
+    return ((int32_t)(uint32_t)(int64_t)(freq * x->x_conv));
+}
+
+static t_int *oscbank_perform(t_int *w)
+{
+    t_oscbank *x = (t_oscbank *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), k, npartials = x->x_npartials;
+    t_sample rn = 1./n;
+    if (x->x_freqvec)
+    {
+        int npoints = (x->x_freqpoints < npartials ?
+            x->x_freqpoints : npartials);
+        t_float *fp = x->x_freqvec;
+        for (k = 0; k < npoints; k++, fp += x->x_freqstride)
+            if (*fp != x->x_freq[k])
+        {
+            x->x_freq[k] = *fp;
+            x->x_inctarget[k] = oscbank_freqtoinc(x, *fp);
+        }
+    }
+    if (x->x_ampvec)
+    {
+        int npoints = (x->x_amppoints < npartials ?
+            x->x_amppoints : npartials);
+        t_float *fp = x->x_ampvec;
+        for (k = 0; k < npoints; k++, fp += x->x_ampstride)
+            x->x_amptarget[k] = *fp;
+    }
+    if (x->x_freqdirty)
+    {
+        for (k = 0; k < npartials; k++)
+            x->x_inctarget[k] = oscbank_freqtoinc(x, x->x_freq[k]);
+        x->x_freqdirty = 0;
+    }
+    for (k = 0; k < npartials; k++)
+    {
+        if (x->x_inctarget[k] == x->x_inc[k])
+            x->x_incstep[k] = 0;
+        else if (x->x_amp[k] == 0)
+        {
+            x->x_inc[k] = x->x_inctarget[k];
+            x->x_incstep[k] = 0;
+        }
+        else x->x_incstep[k] = (int32_t)(((double)x->x_inctarget[k] -
+            (double)x->x_inc[k]) * rn);
+        x->x_ampstep[k] = (x->x_amptarget[k] - x->x_amp[k]) * rn;
+    }
+    (*x->x_kernel)(x, out, n);
+    memcpy(x->x_inc, x->x_inctarget, npartials * sizeof(int32_t));
+    memcpy(x->x_amp, x->x_amptarget, npartials * sizeof(t_sample));
+    return (w+4);
+}
+
+    /* look up an array; return 0 if there's none to read */
+static t_float *oscbank_getarray(t_oscbank *x, t_symbol *s, int *npoints,
+    int *stride)
+{
+    t_garray *a;
+    t_float *vec;
+    if (!s || !*s->s_name)
+        return (0);
+    if (!(a = (t_garray *)pd_findbyclass(s, garray_class)))
+    {
+        pd_error(x, "oscbank~: %s: no such array", s->s_name);
+        return (0);
+    }
+    if (!garray_getfloatvec(a, npoints, &vec, stride))
+    {
+        pd_error(x, "%s: bad template for oscbank~", s->s_name);
+        return (0);
+    }
+    garray_usedindsp(a);
+    return (vec);
+}
+
+static void oscbank_set(t_oscbank *x, t_symbol *freqname, t_symbol *ampname)
+{
+    x->x_freqname = freqname;
+    x->x_ampname = ampname;
+    x->x_freqvec = oscbank_getarray(x, freqname, &x->x_freqpoints,
+        &x->x_freqstride);
+    x->x_ampvec = oscbank_getarray(x, ampname, &x->x_amppoints,
+        &x->x_ampstride);
+}
+
+static void oscbank_freq(t_oscbank *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i;
+    for (i = 0; i < argc && i < x->x_npartials; i++)
+        x->x_freq[i] = atom_getfloat(argv + i);
+    x->x_freqdirty = 1;
+}
+
+static void oscbank_amp(t_oscbank *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i;
+    for (i = 0; i < argc && i < x->x_npartials; i++)
+        x->x_amptarget[i] = atom_getfloat(argv + i);
+}
+
+static void oscbank_dsp(t_oscbank *x, t_signal **sp)
+{
+    int n = sp[0]->s_n, cpu = sys_getcpufeatures();
+    x->x_conv = OSC_TWO32 / sp[0]->s_sr;
+    x->x_freqdirty = 1;
+    oscbank_set(x, x->x_freqname, x->x_ampname);
+    if (n * OSCBANK_PAD != x->x_accsize)
+    {
+        x->x_acc = (t_sample *)resizebytes(x->x_acc,
+            x->x_accsize * sizeof(t_sample),
+                n * OSCBANK_PAD * sizeof(t_sample));
+        x->x_accsize = n * OSCBANK_PAD;
+    }
+    x->x_kernel = oscbank_kernel_c;
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+        x->x_kernel = oscbank_kernel_sse2;
+#endif
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+        x->x_kernel = oscbank_kernel_avx2;
+#endif
+#ifdef PD_SIMD_NEON
+    if (cpu & CPU_NEON)
+        x->x_kernel = oscbank_kernel_neon;
+#endif
+    dsp_add(oscbank_perform, 3, x, sp[0]->s_vec, n);
+}
+
+static void *oscbank_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_oscbank *x = (t_oscbank *)pd_new(oscbank_class);
+    int n = atom_getfloatarg(0, argc, argv), npad;
+    if (n < 1)
+        n = 1;
+    npad = (n + OSCBANK_PAD - 1) / OSCBANK_PAD * OSCBANK_PAD;
+    x->x_npartials = n;
+    x->x_npad = npad;
+    x->x_phase = (uint32_t *)getbytes(npad * sizeof(uint32_t));
+    x->x_inc = (int32_t *)getbytes(npad * sizeof(int32_t));
+    x->x_inctarget = (int32_t *)getbytes(npad * sizeof(int32_t));
+    x->x_incstep = (int32_t *)getbytes(npad * sizeof(int32_t));
+    x->x_amp = (t_sample *)getbytes(npad * sizeof(t_sample));
+    x->x_amptarget = (t_sample *)getbytes(npad * sizeof(t_sample));
+    x->x_ampstep = (t_sample *)getbytes(npad * sizeof(t_sample));
+    x->x_freq = (t_sample *)getbytes(npad * sizeof(t_sample));
+    x->x_freqdirty = 0;
+    x->x_conv = 0;
+    x->x_acc = 0;
+    x->x_accsize = 0;
+    x->x_freqname = atom_getsymbolarg(1, argc, argv);
+    x->x_ampname = atom_getsymbolarg(2, argc, argv);
+    x->x_freqvec = x->x_ampvec = 0;
+    x->x_kernel = oscbank_kernel_c;
+    outlet_new(&x->x_obj, &s_signal);
+    return (x);
+}
+
+static void oscbank_free(t_oscbank *x)
+{
+    int npad = x->x_npad;
+    freebytes(x->x_phase, npad * sizeof(uint32_t));
+    freebytes(x->x_inc, npad * sizeof(int32_t));
+    freebytes(x->x_inctarget, npad * sizeof(int32_t));
+    freebytes(x->x_incstep, npad * sizeof(int32_t));
+    freebytes(x->x_amp, npad * sizeof(t_sample));
+    freebytes(x->x_amptarget, npad * sizeof(t_sample));
+    freebytes(x->x_ampstep, npad * sizeof(t_sample));
+    freebytes(x->x_freq, npad * sizeof(t_sample));
+    if (x->x_acc)
+        freebytes(x->x_acc, x->x_accsize * sizeof(t_sample));
+}
+
+static void oscbank_setup(void)
+{
+    oscbank_class = class_new(gensym("oscbank~"), (t_newmethod)oscbank_new,
+        (t_method)oscbank_free, sizeof(t_oscbank), 0, A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_freq,
+        gensym("freq"), A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_amp,
+        gensym("amp"), A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_set,
+        gensym("set"), A_DEFSYM, A_DEFSYM, 0);
+}
+
 /* ---- vcf~ - resonant filter with audio-rate center frequency input ----- */
 
 typedef struct vcfctl
@@ -507,6 +1422,7 @@ void d_osc_setup(void)
     phasor_setup();
     cos_setup();
     osc_setup();
+    oscbank_setup();
     sigvcf_setup();
     noise_setup();
 }
@@ -11,6 +11,9 @@ readsf~ and writesf~ are defined which confine disk operations to a separate
 thread so that they can be used in real time.  The readsf~ and writesf~
 objects use Posix-like threads.  */
 
+#ifdef __linux__
+#define _GNU_SOURCE     /* for O_DIRECT and fallocate() */
+#endif
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -23,8 +26,18 @@ objects use Posix-like threads.  */
 #include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <limits.h>
+#include <stddef.h>
+#if defined(HAVE_UNISTD_H) && !defined(_WIN32)
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define SFCACHE         /* "soundfiler read -cache" can work here */
+#endif
 
 #include "m_pd.h"
+#include "s_stuff.h"
+#include "s_simd.h"
 
 #define MAXSFCHANS 64
 
@@ -44,14 +57,16 @@ objects use Posix-like threads.  */
 
 /***************** soundfile header structures ************************/
 
+    /* a 32-bit float sample as it's stored in the file */
 typedef union _samplelong {
-  t_sample f;
-  long     l;
+  float    f;
+  uint32_t l;
 } t_sampleuint;
 
 #define FORMAT_WAVE 0
 #define FORMAT_AIFF 1
 #define FORMAT_NEXT 2
+#define FORMAT_RF64 3       /* WAVE with 64-bit sizes (EBU Tech 3306) */
 
 /* the NeXTStep sound header structure; can be big or little endian  */
 
@@ -114,6 +129,38 @@ typedef struct _wavechunk           /* ... and the last two items */
 #define WAV_INT 1
 #define WAV_FLOAT 3
 
+/* the RF64 header: a WAVE header whose 32-bit size fields are set to -1,
+    with the true sizes in a "ds64" chunk that must come first.  We split
+    the 64-bit numbers into words so that the structure isn't padded. */
+
+typedef struct _rf64
+{
+    char  r_fileid[4];              /* chunk id 'RF64'            */
+    uint32_t r_chunksize;           /* -1; see r_riffsize         */
+    char  r_waveid[4];              /* wave chunk id 'WAVE'       */
+    char  r_ds64id[4];              /* chunk id 'ds64'            */
+    uint32_t r_ds64size;            /* ds64 chunk size, 28        */
+    uint32_t r_riffsizelo;          /* file size less 8 bytes     */
+    uint32_t r_riffsizehi;
+    uint32_t r_datasizelo;          /* length of data chunk       */
+    uint32_t r_datasizehi;
+    uint32_t r_nframeslo;           /* number of sample frames    */
+    uint32_t r_nframeshi;
+    uint32_t r_tablelength;         /* no table entries follow    */
+    char  r_fmtid[4];               /* format chunk id 'fmt '     */
+    uint32_t r_fmtchunksize;        /* format chunk size          */
+    uint16_t r_fmttag;              /* format tag (WAV_INT etc)   */
+    uint16_t r_nchannels;           /* number of channels         */
+    uint32_t r_samplespersec;       /* sample rate in hz          */
+    uint32_t r_navgbytespersec;     /* average bytes per second   */
+    uint16_t r_nblockalign;         /* number of bytes per frame  */
+    uint16_t r_nbitspersample;      /* number of bits in a sample */
+    char  r_datachunkid[4];         /* data chunk id 'data'       */
+    uint32_t r_datachunksize;       /* -1; see r_datasize         */
+} t_rf64;
+
+#define RF64_DS64SIZE 28
+
 /* the AIFF header.  I'm assuming AIFC is compatible but don't really know
     that. */
 
@@ -155,7 +202,7 @@ typedef struct _aiff
 #define AIFFPLUS (AIFFHDRSIZE + 16)  /* header size including SSND chunk hdr */
 
 #define WHDR1 sizeof(t_nextstep)
-#define WHDR2 (sizeof(t_wave) > WHDR1 ? sizeof (t_wave) : WHDR1)
+#define WHDR2 (sizeof(t_rf64) > WHDR1 ? sizeof (t_rf64) : WHDR1)
 #define WRITEHDRSIZE (AIFFPLUS > WHDR2 ? AIFFPLUS : WHDR2)
 
 #define READHDRSIZE (16 > WHDR2 + 2 ? 16 : WHDR2 + 2)
@@ -209,6 +256,17 @@ static void makeaiffsamprate(double sr, unsigned char *shit)
     shit[6] = shit[7] = shit[8] = shit[9] = 0;
 }
 
+    /* ... and read one back */
+static double readaiffsamprate(const unsigned char *shit)
+{
+    int exponent = ((shit[0] & 0x7f) << 8) | shit[1];
+    uint32_t hi = ((uint32_t)shit[2] << 24) | (shit[3] << 16) |
+        (shit[4] << 8) | shit[5];
+    uint32_t lo = ((uint32_t)shit[6] << 24) | (shit[7] << 16) |
+        (shit[8] << 8) | shit[9];
+    return (ldexp(hi, exponent - 16414) + ldexp(lo, exponent - 16446));
+}
+
 /******************** soundfile access routines **********************/
 
 /* This routine opens a file, looks for either a nextstep or "wave" header,
@@ -217,15 +275,18 @@ static void makeaiffsamprate(double sr, unsigned char *shit)
 * are supported.  If "headersize" is nonzero, the
 * caller should supply the number of channels, endinanness, and bytes per
 * sample; the header is ignored.  Otherwise, the routine tries to read the
-* header and fill in the properties.
+* header and fill in the properties.  If "p_samplerate" is nonzero the file's
+* sample rate is put there, or zero if it isn't known.
 */
 
-int open_soundfile_via_fd(int fd, int headersize,
+static int soundfile_readheader(int fd, int headersize,
     int *p_bytespersamp, int *p_bigendian, int *p_nchannels, long *p_bytelimit,
-    long skipframes)
+    long skipframes, t_float *p_samplerate)
 {
-    int format, nchannels, bigendian, bytespersamp, swap, sysrtn;
+    int format, nchannels, bigendian, bytespersamp, swap, rf64 = 0;
     long bytelimit = 0x7fffffff;
+    t_float samplerate = 0;
+    off_t seekto;
     errno = 0;
     if (headersize >= 0) /* header detection overridden */
     {
@@ -253,7 +314,8 @@ int open_soundfile_via_fd(int fd, int headersize,
             format = FORMAT_NEXT, bigendian = 1;
         else if (!strncmp(buf.b_c, "dns.", 4))
             format = FORMAT_NEXT, bigendian = 0;
-        else if (!strncmp(buf.b_c, "RIFF", 4))
+        else if (!strncmp(buf.b_c, "RIFF", 4) ||
+            (rf64 = !strncmp(buf.b_c, "RF64", 4)))
         {
             if (bytesread < 12 || strncmp(buf.b_c + 8, "WAVE", 4))
                 goto badheader;
@@ -274,6 +336,7 @@ int open_soundfile_via_fd(int fd, int headersize,
             if (bytesread < (int)sizeof(t_nextstep))
                 goto badheader;
             nchannels = swap4(nsbuf->ns_nchans, swap);
+            samplerate = swap4(nsbuf->ns_sr, swap);
             format = swap4(nsbuf->ns_format, swap);
             headersize = swap4(nsbuf->ns_onset, swap);
             if (format == NS_FORMAT_LINEAR_16)
@@ -291,7 +354,10 @@ int open_soundfile_via_fd(int fd, int headersize,
                /*  This is awful.  You have to skip over chunks,
                except that if one happens to be a "fmt" chunk, you want to
                find out the format from that one.  The case where the
-               "fmt" chunk comes after the audio isn't handled. */
+               "fmt" chunk comes after the audio isn't handled.  RF64 files
+               start with a "ds64" chunk holding the real data size, which
+               replaces the data chunk's size field if that is -1. */
+            uint64_t ds64datasize = 0;
             headersize = 12;
             if (bytesread < 20)
                 goto badheader;
@@ -322,6 +388,7 @@ int open_soundfile_via_fd(int fd, int headersize,
                     if (read(fd, buf.b_c, sizeof(t_fmt)) < (int) sizeof(t_fmt))
                             goto badheader;
                     nchannels = swap2(buf.b_fmt.f_nchannels, swap);
+                    samplerate = swap4(buf.b_fmt.f_samplespersec, swap);
                     format = swap2(buf.b_fmt.f_nbitspersample, swap);
                     if (format == 16)
                         bytespersamp = 2;
@@ -331,6 +398,19 @@ int open_soundfile_via_fd(int fd, int headersize,
                         bytespersamp = 4;
                     else goto badheader;
                 }
+                else if (rf64 && !strncmp(wavechunk->wc_id, "ds64", 4))
+                {
+                    long ds64onset = headersize + 8;
+                    uint32_t sizes[4];
+                    seekout = lseek(fd, ds64onset, SEEK_SET);
+                    if (seekout != ds64onset)
+                        goto badheader;
+                    if (read(fd, (char *)sizes, sizeof(sizes)) <
+                        (int) sizeof(sizes))
+                            goto badheader;
+                    ds64datasize = swap4(sizes[2], swap) |
+                        ((uint64_t)swap4(sizes[3], swap) << 32);
+                }
                 seekout = lseek(fd, seekto, SEEK_SET);
                 if (seekout != seekto)
                     goto badheader;
@@ -345,6 +425,12 @@ int open_soundfile_via_fd(int fd, int headersize,
                 headersize = seekto;
             }
             bytelimit = swap4(wavechunk->wc_size, swap);
+            if (rf64 && bytelimit == 0xffffffff && ds64datasize)
+            {
+                    /* clip if "long" is only 32 bits */
+                bytelimit = (ds64datasize > (uint64_t)LONG_MAX ?
+                    LONG_MAX : ds64datasize);
+            }
             headersize += 8;
         }
         else
@@ -385,6 +471,7 @@ int open_soundfile_via_fd(int fd, int headersize,
                             goto badheader;
                     commchunk = &buf.b_commchunk;
                     nchannels = swap2(commchunk->c_nchannels, swap);
+                    samplerate = readaiffsamprate(commchunk->c_samprate);
                     format = swap2(commchunk->c_bitspersamp, swap);
                     if (format == 16)
                         bytespersamp = 2;
@@ -405,9 +492,8 @@ int open_soundfile_via_fd(int fd, int headersize,
         }
     }
         /* seek past header and any sample frames to skip */
-    sysrtn = lseek(fd,
-        ((off_t)nchannels) * bytespersamp * skipframes + headersize, 0);
-    if (sysrtn != nchannels * bytespersamp * skipframes + headersize)
+    seekto = ((off_t)nchannels) * bytespersamp * skipframes + headersize;
+    if (lseek(fd, seekto, 0) != seekto)
         return (-1);
      bytelimit -= nchannels * bytespersamp * skipframes;
      if (bytelimit < 0)
@@ -417,6 +503,8 @@ int open_soundfile_via_fd(int fd, int headersize,
     *p_nchannels = nchannels;
     *p_bytespersamp = bytespersamp;
     *p_bytelimit = bytelimit;
+    if (p_samplerate)
+        *p_samplerate = samplerate;
     return (fd);
 badheader:
         /* the header wasn't recognized.  We're threadable here so let's not
@@ -425,6 +513,14 @@ badheader:
     return (-1);
 }
 
+int open_soundfile_via_fd(int fd, int headersize,
+    int *p_bytespersamp, int *p_bigendian, int *p_nchannels, long *p_bytelimit,
+    long skipframes)
+{
+    return (soundfile_readheader(fd, headersize, p_bytespersamp, p_bigendian,
+        p_nchannels, p_bytelimit, skipframes, 0));
+}
+
     /* open a soundfile, using open_via_path().  This is used by readsf~ in
     a not-perfectly-threadsafe way.  LATER replace with a thread-hardened
     version of open_soundfile_via_canvas() */
@@ -457,279 +553,931 @@ int open_soundfile_via_canvas(t_canvas *canvas, const char *filename, int header
         p_bigendian, p_nchannels, p_bytelimit, skipframes));
 }
 
-static void soundfile_xferin_sample(int sfchannels, int nvecs, t_sample **vecs,
-    long itemsread, unsigned char *buf, int nitems, int bytespersamp,
-    int bigendian, int spread)
+/******************** sample format conversion ***********************/
+
+/* Samples travel between a soundfile's byte format and Pd's vectors in
+two steps.  A "codec" converts a contiguous run of samples between the
+file format and floats, and the float run is then split into (or gathered
+from) the per-channel vectors.  Each codec has a plain C version and,
+where the compiler can build them, SSE2, AVX2 and NEON versions; the best
+set the CPU supports is installed by soundfile_initcodecs().  For finite
+input all of them give bit-for-bit the results of the C versions.  The
+same goes for the inner loop of the resampler (see "sample rate
+conversion" below) except that it sums in a different order, so its
+results may differ from one instruction set to another in the last bit. */
+
+typedef void (*t_sfdecoder)(const unsigned char *sp, t_sample *fp, int n,
+    int bigendian);
+typedef void (*t_sfencoder)(const t_sample *fp, unsigned char *sp, int n,
+    t_sample gain, int bigendian);
+typedef void (*t_sfsplitter)(const t_sample *from, t_sample *left,
+    t_sample *right, int n);
+typedef void (*t_sfmerger)(const t_sample *left, const t_sample *right,
+    t_sample *to, int n);
+typedef t_sample (*t_sffir)(const t_sample *x, const t_sample *h,
+    const t_sample *dh, t_sample frac, int n);
+
+typedef struct _sfcodecs
 {
-    int i, j;
-    unsigned char *sp, *sp2;
-    t_sample *fp;
-    int nchannels = (sfchannels < nvecs ? sfchannels : nvecs);
-    int bytesperframe = bytespersamp * sfchannels;
-    for (i = 0, sp = buf; i < nchannels; i++, sp += bytespersamp)
+    const char *c_name;
+    t_sfdecoder c_decode[3];        /* indexed by bytes per sample - 2 */
+    t_sfencoder c_encode[3];
+    t_sfsplitter c_split2;          /* deinterleave stereo */
+    t_sfmerger c_merge2;            /* interleave stereo */
+    t_sffir c_fir;                  /* resampling filter */
+} t_sfcodecs;
+
+#define SFXFERCHUNK 1024    /* samples per pass through the scratch buffer */
+
+static void sfdecode16_c(const unsigned char *sp, t_sample *fp, int n,
+    int bigendian)
+{
+    if (bigendian)
     {
-        if (bytespersamp == 2)
-        {
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *fp = SCALE * ((sp2[1] << 24) | (sp2[0] << 16));
-            }
-        }
-        else if (bytespersamp == 3)
+        for (; n--; sp += 2)
+            *fp++ = SCALE * ((sp[0] << 24) | (sp[1] << 16));
+    }
+    else
+    {
+        for (; n--; sp += 2)
+            *fp++ = SCALE * ((sp[1] << 24) | (sp[0] << 16));
+    }
+}
+
+static void sfdecode24_c(const unsigned char *sp, t_sample *fp, int n,
+    int bigendian)
+{
+    if (bigendian)
+    {
+        for (; n--; sp += 3)
+            *fp++ = SCALE * ((sp[0] << 24) | (sp[1] << 16) | (sp[2] << 8));
+    }
+    else
+    {
+        for (; n--; sp += 3)
+            *fp++ = SCALE * ((sp[2] << 24) | (sp[1] << 16) | (sp[0] << 8));
+    }
+}
+
+static void sfdecode32_c(const unsigned char *sp, t_sample *fp, int n,
+    int bigendian)
+{
+    t_sampleuint f2;
+    if (bigendian)
+    {
+        for (; n--; sp += 4)
         {
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16)
-                            | (sp2[2] << 8));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *fp = SCALE * ((sp2[2] << 24) | (sp2[1] << 16)
-                            | (sp2[0] << 8));
-            }
+            f2.l = ((sp[0] << 24) | (sp[1] << 16) | (sp[2] << 8) | sp[3]);
+            *fp++ = f2.f;
         }
-        else if (bytespersamp == 4)
+    }
+    else
+    {
+        for (; n--; sp += 4)
         {
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *(long *)fp = ((sp2[0] << 24) | (sp2[1] << 16)
-                            | (sp2[2] << 8) | sp2[3]);
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *(long *)fp = ((sp2[3] << 24) | (sp2[2] << 16)
-                            | (sp2[1] << 8) | sp2[0]);
-            }
+            f2.l = ((sp[3] << 24) | (sp[2] << 16) | (sp[1] << 8) | sp[0]);
+            *fp++ = f2.f;
         }
     }
-        /* zero out other outputs */
-    for (i = sfchannels; i < nvecs; i++)
-        for (j = nitems, fp = vecs[i]; j--; )
-            *fp++ = 0;
+}
 
+static void sfencode16_c(const t_sample *fp, unsigned char *sp, int n,
+    t_sample gain, int bigendian)
+{
+    for (; n--; sp += 2)
+    {
+        int xx = 32768. + (*fp++ * gain);
+        xx -= 32768;
+        if (xx < -32767)
+            xx = -32767;
+        if (xx > 32767)
+            xx = 32767;
+        if (bigendian)
+            sp[0] = (xx >> 8), sp[1] = xx;
+        else sp[1] = (xx >> 8), sp[0] = xx;
+    }
 }
 
-static void soundfile_xferin_float(int sfchannels, int nvecs, t_float **vecs,
-    long itemsread, unsigned char *buf, int nitems, int bytespersamp,
-    int bigendian, int spread)
+static void sfencode24_c(const t_sample *fp, unsigned char *sp, int n,
+    t_sample gain, int bigendian)
 {
-    int i, j;
-    unsigned char *sp, *sp2;
-    t_float *fp;
-    int nchannels = (sfchannels < nvecs ? sfchannels : nvecs);
-    int bytesperframe = bytespersamp * sfchannels;
-    for (i = 0, sp = buf; i < nchannels; i++, sp += bytespersamp)
+    for (; n--; sp += 3)
     {
-        if (bytespersamp == 2)
-        {
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *fp = SCALE * ((sp2[1] << 24) | (sp2[0] << 16));
-            }
-        }
-        else if (bytespersamp == 3)
+        int xx = 8388608. + (*fp++ * gain);
+        xx -= 8388608;
+        if (xx < -8388607)
+            xx = -8388607;
+        if (xx > 8388607)
+            xx = 8388607;
+        if (bigendian)
+            sp[0] = (xx >> 16), sp[1] = (xx >> 8), sp[2] = xx;
+        else sp[2] = (xx >> 16), sp[1] = (xx >> 8), sp[0] = xx;
+    }
+}
+
+static void sfencode32_c(const t_sample *fp, unsigned char *sp, int n,
+    t_sample gain, int bigendian)
+{
+    t_sampleuint f2;
+    for (; n--; sp += 4)
+    {
+        f2.f = *fp++ * gain;
+        if (bigendian)
         {
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16)
-                            | (sp2[2] << 8));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *fp = SCALE * ((sp2[2] << 24) | (sp2[1] << 16)
-                            | (sp2[0] << 8));
-            }
+            sp[0] = (f2.l >> 24); sp[1] = (f2.l >> 16);
+            sp[2] = (f2.l >> 8); sp[3] = f2.l;
         }
-        else if (bytespersamp == 4)
+        else
         {
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *(long *)fp = ((sp2[0] << 24) | (sp2[1] << 16)
-                            | (sp2[2] << 8) | sp2[3]);
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + spread * itemsread;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                        *(long *)fp = ((sp2[3] << 24) | (sp2[2] << 16)
-                            | (sp2[1] << 8) | sp2[0]);
-            }
+            sp[3] = (f2.l >> 24); sp[2] = (f2.l >> 16);
+            sp[1] = (f2.l >> 8); sp[0] = f2.l;
         }
     }
-        /* zero out other outputs */
-    for (i = sfchannels; i < nvecs; i++)
-        for (j = nitems, fp = vecs[i]; j--; )
-            *fp++ = 0;
+}
 
+static void sfsplit2_c(const t_sample *from, t_sample *left,
+    t_sample *right, int n)
+{
+    for (; n--; from += 2)
+        *left++ = from[0], *right++ = from[1];
 }
 
-    /* soundfiler_write ...
- 
-    usage: write [flags] filename table ...
-    flags:
-        -nframes <frames>
-        -skip <frames>
-        -bytes <bytes per sample>
-        -normalize
-        -nextstep
-        -wave
-        -big
-        -little
-    */
+static void sfmerge2_c(const t_sample *left, const t_sample *right,
+    t_sample *to, int n)
+{
+    for (; n--; to += 2)
+        to[0] = *left++, to[1] = *right++;
+}
 
-    /* the routine which actually does the work should LATER also be called
-    from garray_write16. */
+    /* one output point of the resampler: the dot product of "n" input
+    points with a filter interpolated between two tabulated ones, "h" and
+    "h + dh", by "frac".  "n" is a multiple of 8. */
+static t_sample sffir_c(const t_sample *x, const t_sample *h,
+    const t_sample *dh, t_sample frac, int n)
+{
+    t_sample acc = 0, dacc = 0;
+    for (; n--; x++)
+        acc += *x * *h++, dacc += *x * *dh++;
+    return (acc + frac * dacc);
+}
+
+static const t_sfcodecs sfcodecs_c =
+{
+    "C",
+    {sfdecode16_c, sfdecode24_c, sfdecode32_c},
+    {sfencode16_c, sfencode24_c, sfencode32_c},
+    sfsplit2_c, sfmerge2_c, sffir_c
+};
+
+    /* The vector versions assume 32-bit floats and a little-endian CPU. */
+#if defined(PD_SIMD_NEON) && !defined(__AARCH64EB__)
+#define SF_NEON
+#endif
 
+    /* The C encoders round by truncating "offset + x" in double precision,
+    which takes negative x within half a unit in the last place of the
+    offset to 0 instead of -1.  The vector versions floor() in single
+    precision, so they first zero those values to match. */
+#define SF_TINY16 (-1. / (65536. * 65536. * 64.))   /* 32768 * 2^-53 */
+#define SF_TINY24 (-1. / (1024. * 1024. * 1024.))   /* 8388608 * 2^-53 */
 
-    /* Parse arguments for writing.  The "obj" argument is only for flagging
-    errors.  For streaming to a file the "normalize", "onset" and "nframes"
-    arguments shouldn't be set but the calling routine flags this. */
+#ifdef PD_SIMD_SSE2
 
-static int soundfiler_writeargparse(void *obj, int *p_argc, t_atom **p_argv,
-    t_symbol **p_filesym,
-    int *p_filetype, int *p_bytespersamp, int *p_swap, int *p_bigendian,
-    int *p_normalize, long *p_onset, long *p_nframes, t_float *p_rate)
+    /* SSE2 has no byte shuffle, so 24-bit samples stay with the C codecs.
+    Byte swapping is done with shifts instead. */
+static __m128i sf_swap16_sse2(__m128i v)
 {
-    int argc = *p_argc;
-    t_atom *argv = *p_argv;
-    int bytespersamp = 2, bigendian = 0,
-        endianness = -1, swap, filetype = -1, normalize = 0;
-    long onset = 0, nframes = 0x7fffffff;
-    t_symbol *filesym;
-    t_float rate = -1;
-    
-    while (argc > 0 && argv->a_type == A_SYMBOL &&
-        *argv->a_w.w_symbol->s_name == '-')
+    return (_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+}
+
+static __m128i sf_swap32_sse2(__m128i v)
+{
+    v = sf_swap16_sse2(v);
+    return (_mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16)));
+}
+
+static __m128 sf_flushtiny_sse2(__m128 x, __m128 tiny)
+{
+    return (_mm_and_ps(x, _mm_or_ps(_mm_cmplt_ps(x, tiny),
+        _mm_cmpge_ps(x, _mm_setzero_ps()))));
+}
+
+    /* floor() for values within int range; SSE2 can only truncate */
+static __m128i sf_floor_sse2(__m128 x)
+{
+    __m128i i = _mm_cvttps_epi32(x);
+    return (_mm_add_epi32(i,
+        _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(i), x))));
+}
+
+static void sfdecode16_sse2(const unsigned char *sp, t_sample *fp, int n,
+    int bigendian)
+{
+    __m128 scale = _mm_set1_ps(SCALE);
+    __m128i zero = _mm_setzero_si128();
+    for (; n >= 8; n -= 8, sp += 16, fp += 8)
     {
-        char *flag = argv->a_w.w_symbol->s_name + 1;
-        if (!strcmp(flag, "skip"))
-        {
-            if (argc < 2 || argv[1].a_type != A_FLOAT ||
-                ((onset = argv[1].a_w.w_float) < 0))
-                    goto usage;
-            argc -= 2; argv += 2;
-        }
-        else if (!strcmp(flag, "nframes"))
-        {
-            if (argc < 2 || argv[1].a_type != A_FLOAT ||
-                ((nframes = argv[1].a_w.w_float) < 0))
-                    goto usage;
-            argc -= 2; argv += 2;
-        }
-        else if (!strcmp(flag, "bytes"))
-        {
-            if (argc < 2 || argv[1].a_type != A_FLOAT ||
-                ((bytespersamp = argv[1].a_w.w_float) < 2) ||
-                    bytespersamp > 4)
-                        goto usage;
-            argc -= 2; argv += 2;
-        }
-        else if (!strcmp(flag, "normalize"))
-        {
-            normalize = 1;
-            argc -= 1; argv += 1;
-        }
-        else if (!strcmp(flag, "wave"))
-        {
-            filetype = FORMAT_WAVE;
-            argc -= 1; argv += 1;
-        }
-        else if (!strcmp(flag, "nextstep"))
-        {
-            filetype = FORMAT_NEXT;
-            argc -= 1; argv += 1;
-        }
-        else if (!strcmp(flag, "aiff"))
-        {
-            filetype = FORMAT_AIFF;
-            argc -= 1; argv += 1;
-        }
-        else if (!strcmp(flag, "big"))
-        {
-            endianness = 1;
-            argc -= 1; argv += 1;
-        }
-        else if (!strcmp(flag, "little"))
-        {
-            endianness = 0;
-            argc -= 1; argv += 1;
-        }
-        else if (!strcmp(flag, "r") || !strcmp(flag, "rate"))
-        {
-            if (argc < 2 || argv[1].a_type != A_FLOAT ||
-                ((rate = argv[1].a_w.w_float) <= 0))
-                    goto usage;
-            argc -= 2; argv += 2;
-        }
-        else goto usage;
+        __m128i v = _mm_loadu_si128((const __m128i *)sp);
+        if (bigendian)
+            v = sf_swap16_sse2(v);
+            /* put each sample in the top half of a 32-bit word */
+        _mm_storeu_ps(fp, _mm_mul_ps(scale,
+            _mm_cvtepi32_ps(_mm_unpacklo_epi16(zero, v))));
+        _mm_storeu_ps(fp + 4, _mm_mul_ps(scale,
+            _mm_cvtepi32_ps(_mm_unpackhi_epi16(zero, v))));
     }
-    if (!argc || argv->a_type != A_SYMBOL)
-        goto usage;
-    filesym = argv->a_w.w_symbol;
-    
-        /* check if format not specified and fill in */
-    if (filetype < 0) 
+    sfdecode16_c(sp, fp, n, bigendian);
+}
+
+static void sfdecode32_sse2(const unsigned char *sp, t_sample *fp, int n,
+    int bigendian)
+{
+    if (!bigendian)
     {
-        if (strlen(filesym->s_name) >= 5 &&
-                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".aif") ||
-                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".AIF")))
-                filetype = FORMAT_AIFF;
-        if (strlen(filesym->s_name) >= 6 &&
-                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 5, ".aiff") ||
-                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 5, ".AIFF")))
-                filetype = FORMAT_AIFF;
-        if (strlen(filesym->s_name) >= 5 &&
-                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".snd") ||
-                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".SND")))
-                filetype = FORMAT_NEXT;
-        if (strlen(filesym->s_name) >= 4 &&
-                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 3, ".au") ||
-                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 3, ".AU")))
-                filetype = FORMAT_NEXT;
-        if (filetype < 0)
-            filetype = FORMAT_WAVE;
+        memcpy(fp, sp, n * sizeof(t_sample));
+        return;
     }
-        /* don't handle AIFF floating point samples */
-    if (bytespersamp == 4)
+    for (; n >= 4; n -= 4, sp += 16, fp += 4)
+        _mm_storeu_si128((__m128i *)fp,
+            sf_swap32_sse2(_mm_loadu_si128((const __m128i *)sp)));
+    sfdecode32_c(sp, fp, n, bigendian);
+}
+
+static void sfencode16_sse2(const t_sample *fp, unsigned char *sp, int n,
+    t_sample gain, int bigendian)
+{
+    __m128 g = _mm_set1_ps(gain), lo = _mm_set1_ps(-32767),
+        hi = _mm_set1_ps(32767), tiny = _mm_set1_ps(SF_TINY16);
+    for (; n >= 8; n -= 8, fp += 8, sp += 16)
     {
-        if (filetype == FORMAT_AIFF)
-        {
-            pd_error(obj, "AIFF floating-point file format unavailable");
-            goto usage;
-        }
+        __m128 a = sf_flushtiny_sse2(_mm_min_ps(_mm_max_ps(
+            _mm_mul_ps(_mm_loadu_ps(fp), g), lo), hi), tiny);
+        __m128 b = sf_flushtiny_sse2(_mm_min_ps(_mm_max_ps(
+            _mm_mul_ps(_mm_loadu_ps(fp + 4), g), lo), hi), tiny);
+        __m128i v = _mm_packs_epi32(sf_floor_sse2(a), sf_floor_sse2(b));
+        if (bigendian)
+            v = sf_swap16_sse2(v);
+        _mm_storeu_si128((__m128i *)sp, v);
+    }
+    sfencode16_c(fp, sp, n, gain, bigendian);
+}
+
+static void sfencode32_sse2(const t_sample *fp, unsigned char *sp, int n,
+    t_sample gain, int bigendian)
+{
+    __m128 g = _mm_set1_ps(gain);
+    for (; n >= 4; n -= 4, fp += 4, sp += 16)
+    {
+        __m128i v = _mm_castps_si128(_mm_mul_ps(_mm_loadu_ps(fp), g));
+        if (bigendian)
+            v = sf_swap32_sse2(v);
+        _mm_storeu_si128((__m128i *)sp, v);
+    }
+    sfencode32_c(fp, sp, n, gain, bigendian);
+}
+
+static void sfsplit2_sse2(const t_sample *from, t_sample *left,
+    t_sample *right, int n)
+{
+    for (; n >= 4; n -= 4, from += 8, left += 4, right += 4)
+    {
+        __m128 a = _mm_loadu_ps(from), b = _mm_loadu_ps(from + 4);
+        _mm_storeu_ps(left, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    sfsplit2_c(from, left, right, n);
+}
+
+static void sfmerge2_sse2(const t_sample *left, const t_sample *right,
+    t_sample *to, int n)
+{
+    for (; n >= 4; n -= 4, left += 4, right += 4, to += 8)
+    {
+        __m128 a = _mm_loadu_ps(left), b = _mm_loadu_ps(right);
+        _mm_storeu_ps(to, _mm_unpacklo_ps(a, b));
+        _mm_storeu_ps(to + 4, _mm_unpackhi_ps(a, b));
+    }
+    sfmerge2_c(left, right, to, n);
+}
+
+static t_sample sffir_sse2(const t_sample *x, const t_sample *h,
+    const t_sample *dh, t_sample frac, int n)
+{
+    __m128 acc = _mm_setzero_ps(), dacc = _mm_setzero_ps();
+    float sum[4];
+    for (; n > 0; n -= 4, x += 4, h += 4, dh += 4)
+    {
+        __m128 v = _mm_loadu_ps(x);
+        acc = _mm_add_ps(acc, _mm_mul_ps(v, _mm_loadu_ps(h)));
+        dacc = _mm_add_ps(dacc, _mm_mul_ps(v, _mm_loadu_ps(dh)));
+    }
+    _mm_storeu_ps(sum, _mm_add_ps(acc, _mm_mul_ps(dacc, _mm_set1_ps(frac))));
+    return ((sum[0] + sum[1]) + (sum[2] + sum[3]));
+}
+
+static const t_sfcodecs sfcodecs_sse2 =
+{
+    "SSE2",
+    {sfdecode16_sse2, sfdecode24_c, sfdecode32_sse2},
+    {sfencode16_sse2, sfencode24_c, sfencode32_sse2},
+    sfsplit2_sse2, sfmerge2_sse2, sffir_sse2
+};
+
+#endif /* PD_SIMD_SSE2 */
+
+#ifdef PD_SIMD_AVX2
+
+PD_SIMD_AVX2NOFMAFN static __m256 sf_flushtiny_avx2(__m256 x, __m256 tiny)
+{
+    return (_mm256_and_ps(x, _mm256_or_ps(_mm256_cmp_ps(x, tiny, _CMP_LT_OQ),
+        _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GE_OQ))));
+}
+
+    /* clamp, then floor as described above SF_TINY16 */
+PD_SIMD_AVX2NOFMAFN static __m256i sf_toint_avx2(__m256 x, __m256 lo,
+    __m256 hi, __m256 tiny)
+{
+    return (_mm256_cvtps_epi32(_mm256_floor_ps(sf_flushtiny_avx2(
+        _mm256_min_ps(_mm256_max_ps(x, lo), hi), tiny))));
+}
+
+PD_SIMD_AVX2NOFMAFN static void sfdecode16_avx2(const unsigned char *sp,
+    t_sample *fp, int n, int bigendian)
+{
+    __m256 scale = _mm256_set1_ps(SCALE);
+    __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+        9, 8, 11, 10, 13, 12, 15, 14);
+    for (; n >= 8; n -= 8, sp += 16, fp += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)sp);
+        if (bigendian)
+            v = _mm_shuffle_epi8(v, swap);
+        _mm256_storeu_ps(fp, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(
+            _mm256_slli_epi32(_mm256_cvtepi16_epi32(v), 16))));
+    }
+    sfdecode16_c(sp, fp, n, bigendian);
+}
+
+    /* Four 3-byte samples are taken from each 16-byte half and shuffled
+    into the top three bytes of 32-bit words.  The second load reaches 4
+    bytes past the 8 samples in hand, hence the loop limit. */
+PD_SIMD_AVX2NOFMAFN static void sfdecode24_avx2(const unsigned char *sp,
+    t_sample *fp, int n, int bigendian)
+{
+    __m256 scale = _mm256_set1_ps(SCALE);
+    __m256i m = (bigendian ?
+        _mm256_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9,
+            -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9) :
+        _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11));
+    for (; n >= 10; n -= 8, sp += 24, fp += 8)
+    {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+            _mm_loadu_si128((const __m128i *)sp)),
+                _mm_loadu_si128((const __m128i *)(sp + 12)), 1);
+        _mm256_storeu_ps(fp, _mm256_mul_ps(scale,
+            _mm256_cvtepi32_ps(_mm256_shuffle_epi8(v, m))));
+    }
+    sfdecode24_c(sp, fp, n, bigendian);
+}
+
+PD_SIMD_AVX2NOFMAFN static void sfdecode32_avx2(const unsigned char *sp,
+    t_sample *fp, int n, int bigendian)
+{
+    __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+        11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4,
+            11, 10, 9, 8, 15, 14, 13, 12);
+    if (!bigendian)
+    {
+        memcpy(fp, sp, n * sizeof(t_sample));
+        return;
+    }
+    for (; n >= 8; n -= 8, sp += 32, fp += 8)
+        _mm256_storeu_si256((__m256i *)fp, _mm256_shuffle_epi8(
+            _mm256_loadu_si256((const __m256i *)sp), swap));
+    sfdecode32_c(sp, fp, n, bigendian);
+}
+
+PD_SIMD_AVX2NOFMAFN static void sfencode16_avx2(const t_sample *fp,
+    unsigned char *sp, int n, t_sample gain, int bigendian)
+{
+    __m256 g = _mm256_set1_ps(gain), lo = _mm256_set1_ps(-32767),
+        hi = _mm256_set1_ps(32767), tiny = _mm256_set1_ps(SF_TINY16);
+    __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+        9, 8, 11, 10, 13, 12, 15, 14);
+    for (; n >= 8; n -= 8, fp += 8, sp += 16)
+    {
+        __m256i i = sf_toint_avx2(_mm256_mul_ps(_mm256_loadu_ps(fp), g),
+            lo, hi, tiny);
+        __m128i v = _mm_packs_epi32(_mm256_castsi256_si128(i),
+            _mm256_extracti128_si256(i, 1));
+        if (bigendian)
+            v = _mm_shuffle_epi8(v, swap);
+        _mm_storeu_si128((__m128i *)sp, v);
+    }
+    sfencode16_c(fp, sp, n, gain, bigendian);
+}
+
+    /* the reverse of sfdecode24_avx2(): each store writes 4 bytes past
+    its 12, which the next store (or the C tail) overwrites. */
+PD_SIMD_AVX2NOFMAFN static void sfencode24_avx2(const t_sample *fp,
+    unsigned char *sp, int n, t_sample gain, int bigendian)
+{
+    __m256 g = _mm256_set1_ps(gain), lo = _mm256_set1_ps(-8388607),
+        hi = _mm256_set1_ps(8388607), tiny = _mm256_set1_ps(SF_TINY24);
+    __m256i m = (bigendian ?
+        _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) :
+        _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+    for (; n >= 10; n -= 8, fp += 8, sp += 24)
+    {
+        __m256i v = _mm256_shuffle_epi8(sf_toint_avx2(
+            _mm256_mul_ps(_mm256_loadu_ps(fp), g), lo, hi, tiny), m);
+        _mm_storeu_si128((__m128i *)sp, _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i *)(sp + 12),
+            _mm256_extracti128_si256(v, 1));
+    }
+    sfencode24_c(fp, sp, n, gain, bigendian);
+}
+
+PD_SIMD_AVX2NOFMAFN static void sfencode32_avx2(const t_sample *fp,
+    unsigned char *sp, int n, t_sample gain, int bigendian)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+        11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4,
+            11, 10, 9, 8, 15, 14, 13, 12);
+    for (; n >= 8; n -= 8, fp += 8, sp += 32)
+    {
+        __m256i v = _mm256_castps_si256(
+            _mm256_mul_ps(_mm256_loadu_ps(fp), g));
+        if (bigendian)
+            v = _mm256_shuffle_epi8(v, swap);
+        _mm256_storeu_si256((__m256i *)sp, v);
+    }
+    sfencode32_c(fp, sp, n, gain, bigendian);
+}
+
+PD_SIMD_AVX2FN static t_sample sffir_avx2(const t_sample *x, const t_sample *h,
+    const t_sample *dh, t_sample frac, int n)
+{
+    __m256 acc = _mm256_setzero_ps(), dacc = _mm256_setzero_ps();
+    __m128 sum;
+    for (; n > 0; n -= 8, x += 8, h += 8, dh += 8)
+    {
+        __m256 v = _mm256_loadu_ps(x);
+        acc = _mm256_fmadd_ps(v, _mm256_loadu_ps(h), acc);
+        dacc = _mm256_fmadd_ps(v, _mm256_loadu_ps(dh), dacc);
+    }
+    acc = _mm256_fmadd_ps(dacc, _mm256_set1_ps(frac), acc);
+    sum = _mm_add_ps(_mm256_castps256_ps128(acc),
+        _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return (_mm_cvtss_f32(sum));
+}
+
+static const t_sfcodecs sfcodecs_avx2 =
+{
+    "AVX2",
+    {sfdecode16_avx2, sfdecode24_avx2, sfdecode32_avx2},
+    {sfencode16_avx2, sfencode24_avx2, sfencode32_avx2},
+    sfsplit2_sse2, sfmerge2_sse2, sffir_avx2
+};
+
+#endif /* PD_SIMD_AVX2 */
+
+#ifdef SF_NEON
+
+    /* clamp, then floor as described above SF_TINY16 */
+static int32x4_t sf_toint_neon(float32x4_t x, float32x4_t lo, float32x4_t hi,
+    float32x4_t tiny)
+{
+    x = vminq_f32(vmaxq_f32(x, lo), hi);
+    x = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(x),
+        vorrq_u32(vcltq_f32(x, tiny), vcgeq_f32(x, vdupq_n_f32(0)))));
+    return (vcvtmq_s32_f32(x));
+}
+
+static void sfdecode16_neon(const unsigned char *sp, t_sample *fp, int n,
+    int bigendian)
+{
+    float32x4_t scale = vdupq_n_f32(SCALE);
+    for (; n >= 8; n -= 8, sp += 16, fp += 8)
+    {
+        uint8x16_t b = vld1q_u8(sp);
+        int16x8_t v;
+        if (bigendian)
+            b = vrev16q_u8(b);
+        v = vreinterpretq_s16_u8(b);
+        vst1q_f32(fp, vmulq_f32(scale,
+            vcvtq_f32_s32(vshll_n_s16(vget_low_s16(v), 16))));
+        vst1q_f32(fp + 4, vmulq_f32(scale,
+            vcvtq_f32_s32(vshll_n_s16(vget_high_s16(v), 16))));
+    }
+    sfdecode16_c(sp, fp, n, bigendian);
+}
+
+    /* vld3 splits 8 samples into planes of low, middle and high bytes,
+    which are zipped back together as the top three bytes of words. */
+static void sfdecode24_neon(const unsigned char *sp, t_sample *fp, int n,
+    int bigendian)
+{
+    float32x4_t scale = vdupq_n_f32(SCALE);
+    for (; n >= 8; n -= 8, sp += 24, fp += 8)
+    {
+        uint8x8x3_t b = vld3_u8(sp);
+        uint8x8_t lsb = (bigendian ? b.val[2] : b.val[0]),
+            msb = (bigendian ? b.val[0] : b.val[2]);
+        uint16x8x2_t w = vzipq_u16(vshll_n_u8(lsb, 8),
+            vorrq_u16(vmovl_u8(b.val[1]), vshll_n_u8(msb, 8)));
+        vst1q_f32(fp, vmulq_f32(scale,
+            vcvtq_f32_s32(vreinterpretq_s32_u16(w.val[0]))));
+        vst1q_f32(fp + 4, vmulq_f32(scale,
+            vcvtq_f32_s32(vreinterpretq_s32_u16(w.val[1]))));
+    }
+    sfdecode24_c(sp, fp, n, bigendian);
+}
+
+static void sfdecode32_neon(const unsigned char *sp, t_sample *fp, int n,
+    int bigendian)
+{
+    if (!bigendian)
+    {
+        memcpy(fp, sp, n * sizeof(t_sample));
+        return;
+    }
+    for (; n >= 4; n -= 4, sp += 16, fp += 4)
+        vst1q_u8((uint8_t *)fp, vrev32q_u8(vld1q_u8(sp)));
+    sfdecode32_c(sp, fp, n, bigendian);
+}
+
+static void sfencode16_neon(const t_sample *fp, unsigned char *sp, int n,
+    t_sample gain, int bigendian)
+{
+    float32x4_t g = vdupq_n_f32(gain), lo = vdupq_n_f32(-32767),
+        hi = vdupq_n_f32(32767), tiny = vdupq_n_f32(SF_TINY16);
+    for (; n >= 8; n -= 8, fp += 8, sp += 16)
+    {
+        int32x4_t a = sf_toint_neon(vmulq_f32(vld1q_f32(fp), g),
+            lo, hi, tiny);
+        int32x4_t b = sf_toint_neon(vmulq_f32(vld1q_f32(fp + 4), g),
+            lo, hi, tiny);
+        uint8x16_t v = vreinterpretq_u8_s16(vcombine_s16(
+            vmovn_s32(a), vmovn_s32(b)));
+        if (bigendian)
+            v = vrev16q_u8(v);
+        vst1q_u8(sp, v);
+    }
+    sfencode16_c(fp, sp, n, gain, bigendian);
+}
+
+static void sfencode24_neon(const t_sample *fp, unsigned char *sp, int n,
+    t_sample gain, int bigendian)
+{
+    float32x4_t g = vdupq_n_f32(gain), lo = vdupq_n_f32(-8388607),
+        hi = vdupq_n_f32(8388607), tiny = vdupq_n_f32(SF_TINY24);
+    for (; n >= 8; n -= 8, fp += 8, sp += 24)
+    {
+        uint32x4_t a = vreinterpretq_u32_s32(sf_toint_neon(
+            vmulq_f32(vld1q_f32(fp), g), lo, hi, tiny));
+        uint32x4_t b = vreinterpretq_u32_s32(sf_toint_neon(
+            vmulq_f32(vld1q_f32(fp + 4), g), lo, hi, tiny));
+        uint16x8_t low = vcombine_u16(vmovn_u32(a), vmovn_u32(b));
+        uint8x8_t msb = vmovn_u16(vcombine_u16(
+            vshrn_n_u32(a, 16), vshrn_n_u32(b, 16)));
+        uint8x8x3_t o;
+        o.val[0] = (bigendian ? msb : vmovn_u16(low));
+        o.val[1] = vshrn_n_u16(low, 8);
+        o.val[2] = (bigendian ? vmovn_u16(low) : msb);
+        vst3_u8(sp, o);
+    }
+    sfencode24_c(fp, sp, n, gain, bigendian);
+}
+
+static void sfencode32_neon(const t_sample *fp, unsigned char *sp, int n,
+    t_sample gain, int bigendian)
+{
+    float32x4_t g = vdupq_n_f32(gain);
+    for (; n >= 4; n -= 4, fp += 4, sp += 16)
+    {
+        uint8x16_t v = vreinterpretq_u8_f32(vmulq_f32(vld1q_f32(fp), g));
+        if (bigendian)
+            v = vrev32q_u8(v);
+        vst1q_u8(sp, v);
+    }
+    sfencode32_c(fp, sp, n, gain, bigendian);
+}
+
+static void sfsplit2_neon(const t_sample *from, t_sample *left,
+    t_sample *right, int n)
+{
+    for (; n >= 4; n -= 4, from += 8, left += 4, right += 4)
+    {
+        float32x4x2_t v = vld2q_f32(from);
+        vst1q_f32(left, v.val[0]);
+        vst1q_f32(right, v.val[1]);
+    }
+    sfsplit2_c(from, left, right, n);
+}
+
+static void sfmerge2_neon(const t_sample *left, const t_sample *right,
+    t_sample *to, int n)
+{
+    for (; n >= 4; n -= 4, left += 4, right += 4, to += 8)
+    {
+        float32x4x2_t v;
+        v.val[0] = vld1q_f32(left);
+        v.val[1] = vld1q_f32(right);
+        vst2q_f32(to, v);
+    }
+    sfmerge2_c(left, right, to, n);
+}
+
+static t_sample sffir_neon(const t_sample *x, const t_sample *h,
+    const t_sample *dh, t_sample frac, int n)
+{
+    float32x4_t acc = vdupq_n_f32(0), dacc = vdupq_n_f32(0);
+    for (; n > 0; n -= 4, x += 4, h += 4, dh += 4)
+    {
+        float32x4_t v = vld1q_f32(x);
+        acc = vfmaq_f32(acc, v, vld1q_f32(h));
+        dacc = vfmaq_f32(dacc, v, vld1q_f32(dh));
+    }
+    return (vaddvq_f32(vfmaq_n_f32(acc, dacc, frac)));
+}
+
+static const t_sfcodecs sfcodecs_neon =
+{
+    "NEON",
+    {sfdecode16_neon, sfdecode24_neon, sfdecode32_neon},
+    {sfencode16_neon, sfencode24_neon, sfencode32_neon},
+    sfsplit2_neon, sfmerge2_neon, sffir_neon
+};
+
+#endif /* SF_NEON */
+
+static t_sfcodecs sf_codecs;
+static int sf_codecsinit;
+
+    /* pick the codecs once, from the main thread, before any object can
+    start a disk thread (which is why we don't do it in the setup routine:
+    the "-nosimd" flag isn't parsed yet then.) */
+static void soundfile_initcodecs(void)
+{
+    int cpu;
+    if (sf_codecsinit)
+        return;
+    cpu = sys_getcpufeatures();
+    sf_codecs = sfcodecs_c;
+#ifdef PD_SIMD_SSE2
+    if (cpu & CPU_SSE2)
+        sf_codecs = sfcodecs_sse2;
+#endif
+#ifdef PD_SIMD_AVX2
+    if (cpu & CPU_AVX2)
+        sf_codecs = sfcodecs_avx2;
+#endif
+#ifdef SF_NEON
+    if (cpu & CPU_NEON)
+        sf_codecs = sfcodecs_neon;
+#endif
+    verbose(1, "soundfile sample conversion: %s", sf_codecs.c_name);
+    sf_codecsinit = 1;
+}
+
+    /* convert "nitems" frames of "sfchannels" channels from "buf" into the
+    vectors, starting at frame "itemsread" and stepping by "spread" points.
+    Vectors beyond the file's channels are zeroed. */
+static void soundfile_xferin_sample(int sfchannels, int nvecs, t_sample **vecs,
+    long itemsread, unsigned char *buf, int nitems, int bytespersamp,
+    int bigendian, int spread)
+{
+    t_sample scratch[SFXFERCHUNK], *fp;
+    int i, j, k, nchannels = (sfchannels < nvecs ? sfchannels : nvecs);
+    int bytesperframe = bytespersamp * sfchannels;
+    int chunkframes = SFXFERCHUNK / sfchannels;
+    long onset = spread * itemsread;
+    t_sfdecoder decode;
+    if (bytespersamp < 2 || bytespersamp > 4)
+        return;
+    decode = sf_codecs.c_decode[bytespersamp - 2];
+    if (sfchannels == 1 && spread == 1)
+        (*decode)(buf, vecs[0] + onset, nitems, bigendian);
+    else for (j = 0; j < nitems; j += chunkframes)
+    {
+        int nframes = (nitems - j < chunkframes ? nitems - j : chunkframes);
+        (*decode)(buf + j * bytesperframe, scratch, nframes * sfchannels,
+            bigendian);
+        if (sfchannels == 2 && nchannels == 2 && spread == 1)
+            (*sf_codecs.c_split2)(scratch, vecs[0] + onset + j,
+                vecs[1] + onset + j, nframes);
+        else for (i = 0; i < nchannels; i++)
+        {
+            t_sample *sp = scratch + i;
+            for (k = 0, fp = vecs[i] + onset + j * spread; k < nframes;
+                k++, sp += sfchannels, fp += spread)
+                    *fp = *sp;
+        }
+    }
+        /* zero out other outputs */
+    for (i = sfchannels; i < nvecs; i++)
+        for (j = nitems, fp = vecs[i] + onset; j--; fp += spread)
+            *fp = 0;
+}
+
+    /* t_float and t_sample are the same type */
+static void soundfile_xferin_float(int sfchannels, int nvecs, t_float **vecs,
+    long itemsread, unsigned char *buf, int nitems, int bytespersamp,
+    int bigendian, int spread)
+{
+    soundfile_xferin_sample(sfchannels, nvecs, (t_sample **)vecs,
+        itemsread, buf, nitems, bytespersamp, bigendian, spread);
+}
+
+    /* soundfiler_write ...
+ 
+    usage: write [flags] filename table ...
+    flags:
+        -nframes <frames>
+        -skip <frames>
+        -bytes <bytes per sample>
+        -normalize
+        -nextstep
+        -wave
+        -rf64
+        -big
+        -little
+    */
+
+    /* the routine which actually does the work should LATER also be called
+    from garray_write16. */
+
+
+    /* how writesf~ streams its file to disk; set by "open" flags */
+typedef struct _sfwritepolicy
+{
+    t_float wp_prealloc;    /* megabytes to allocate ahead, or 0 */
+    t_float wp_sync;        /* seconds between fdatasync() calls, or 0 */
+    int wp_direct;          /* write around the page cache (O_DIRECT) */
+} t_sfwritepolicy;
+
+    /* Parse arguments for writing.  The "obj" argument is only for flagging
+    errors.  For streaming to a file the "normalize", "onset" and "nframes"
+    arguments shouldn't be set but the calling routine flags this.  The
+    "-async" flag is only accepted if "p_async" is nonzero, and the
+    "-prealloc", "-sync" and "-direct" flags only if "p_policy" is. */
+
+static int soundfiler_writeargparse(void *obj, int *p_argc, t_atom **p_argv,
+    t_symbol **p_filesym,
+    int *p_filetype, int *p_bytespersamp, int *p_swap, int *p_bigendian,
+    int *p_normalize, long *p_onset, long *p_nframes, t_float *p_rate,
+    int *p_async, t_sfwritepolicy *p_policy)
+{
+    int argc = *p_argc;
+    t_atom *argv = *p_argv;
+    int bytespersamp = 2, bigendian = 0,
+        endianness = -1, swap, filetype = -1, normalize = 0, async = 0;
+    long onset = 0, nframes = 0x7fffffff;
+    t_symbol *filesym;
+    t_float rate = -1;
+    
+    while (argc > 0 && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        char *flag = argv->a_w.w_symbol->s_name + 1;
+        if (!strcmp(flag, "skip"))
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                ((onset = argv[1].a_w.w_float) < 0))
+                    goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(flag, "nframes"))
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                ((nframes = argv[1].a_w.w_float) < 0))
+                    goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(flag, "bytes"))
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                ((bytespersamp = argv[1].a_w.w_float) < 2) ||
+                    bytespersamp > 4)
+                        goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(flag, "normalize"))
+        {
+            normalize = 1;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "wave"))
+        {
+            filetype = FORMAT_WAVE;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "nextstep"))
+        {
+            filetype = FORMAT_NEXT;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "aiff"))
+        {
+            filetype = FORMAT_AIFF;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "rf64"))
+        {
+            filetype = FORMAT_RF64;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "big"))
+        {
+            endianness = 1;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "little"))
+        {
+            endianness = 0;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "r") || !strcmp(flag, "rate"))
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                ((rate = argv[1].a_w.w_float) <= 0))
+                    goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(flag, "async") && p_async)
+        {
+            async = 1;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "prealloc") && p_policy)
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                ((p_policy->wp_prealloc = argv[1].a_w.w_float) < 0))
+                    goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(flag, "sync") && p_policy)
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                ((p_policy->wp_sync = argv[1].a_w.w_float) < 0))
+                    goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(flag, "direct") && p_policy)
+        {
+            p_policy->wp_direct = 1;
+            argc -= 1; argv += 1;
+        }
+        else goto usage;
+    }
+    if (!argc || argv->a_type != A_SYMBOL)
+        goto usage;
+    filesym = argv->a_w.w_symbol;
+    
+        /* check if format not specified and fill in */
+    if (filetype < 0) 
+    {
+        if (strlen(filesym->s_name) >= 5 &&
+                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".aif") ||
+                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".AIF")))
+                filetype = FORMAT_AIFF;
+        if (strlen(filesym->s_name) >= 6 &&
+                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 5, ".aiff") ||
+                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 5, ".AIFF")))
+                filetype = FORMAT_AIFF;
+        if (strlen(filesym->s_name) >= 5 &&
+                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".snd") ||
+                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".SND")))
+                filetype = FORMAT_NEXT;
+        if (strlen(filesym->s_name) >= 4 &&
+                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 3, ".au") ||
+                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 3, ".AU")))
+                filetype = FORMAT_NEXT;
+        if (strlen(filesym->s_name) >= 6 &&
+                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 5, ".rf64") ||
+                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 5, ".RF64")))
+                filetype = FORMAT_RF64;
+        if (filetype < 0)
+            filetype = FORMAT_WAVE;
+    }
+        /* don't handle AIFF floating point samples */
+    if (bytespersamp == 4)
+    {
+        if (filetype == FORMAT_AIFF)
+        {
+            pd_error(obj, "AIFF floating-point file format unavailable");
+            goto usage;
+        }
     }
         /* for WAVE force little endian; for nextstep use machine native */
-    if (filetype == FORMAT_WAVE)
+    if (filetype == FORMAT_WAVE || filetype == FORMAT_RF64)
     {
         bigendian = 0;
         if (endianness == 1)
@@ -761,29 +1509,71 @@ static int soundfiler_writeargparse(void *obj, int *p_argc, t_atom **p_argv,
     *p_nframes = nframes;
     *p_bigendian = bigendian;
     *p_rate = rate;
+    if (p_async)
+        *p_async = async;
     return (0);
 usage:
     return (-1);
 }
 
+    /* the full path of the file create_soundfile() writes, with the
+    extension added for the file type if it's missing */
+static void soundfile_writepath(t_canvas *canvas, const char *filename,
+    int filetype, char *buf)
+{
+    char filenamebuf[MAXPDSTRING];
+    int n;
+    strncpy(filenamebuf, filename, MAXPDSTRING-10);
+    filenamebuf[MAXPDSTRING-10] = 0;
+    n = strlen(filenamebuf);
+    if (filetype == FORMAT_NEXT)
+    {
+        if (strcmp(filenamebuf + n-4, ".snd"))
+            strcat(filenamebuf, ".snd");
+    }
+    else if (filetype == FORMAT_AIFF)
+    {
+        if (strcmp(filenamebuf + n-4, ".aif") &&
+            strcmp(filenamebuf + n-5, ".aiff"))
+                strcat(filenamebuf, ".aif");
+    }
+    else if (filetype == FORMAT_RF64)
+    {
+        if (strcmp(filenamebuf + n-4, ".wav") &&
+            strcmp(filenamebuf + n-5, ".rf64"))
+                strcat(filenamebuf, ".wav");
+    }
+    else if (strcmp(filenamebuf + n-4, ".wav"))
+        strcat(filenamebuf, ".wav");
+    canvas_makefilename(canvas, filenamebuf, buf, MAXPDSTRING);
+}
+
+    /* tables that "read -map" mapped from a file we're about to write
+    would see it change under them, so copy them into memory first.  This
+    has to be done in Pd's thread, before anyone asks the tables for their
+    sample vectors. */
+static void soundfile_unmapforwrite(t_canvas *canvas, const char *filename,
+    int filetype)
+{
+    char buf[MAXPDSTRING];
+    soundfile_writepath(canvas, filename, filetype, buf);
+    garray_unmapfile(buf);
+}
+
 static int create_soundfile(t_canvas *canvas, const char *filename,
     int filetype, int nframes, int bytespersamp,
     int bigendian, int nchannels, int swap, t_float samplerate)
 {
-    char filenamebuf[MAXPDSTRING], buf2[MAXPDSTRING];
+    char buf2[MAXPDSTRING];
     char headerbuf[WRITEHDRSIZE];
     t_wave *wavehdr = (t_wave *)headerbuf;
     t_nextstep *nexthdr = (t_nextstep *)headerbuf;
     t_aiff *aiffhdr = (t_aiff *)headerbuf;
+    t_rf64 *rf64hdr = (t_rf64 *)headerbuf;
     int fd, headersize = 0;
-    
-    strncpy(filenamebuf, filename, MAXPDSTRING-10);
-    filenamebuf[MAXPDSTRING-10] = 0;
 
     if (filetype == FORMAT_NEXT)
     {
-        if (strcmp(filenamebuf + strlen(filenamebuf)-4, ".snd"))
-            strcat(filenamebuf, ".snd");
         if (bigendian)
             strncpy(nexthdr->ns_fileid, ".snd", 4);
         else strncpy(nexthdr->ns_fileid, "dns.", 4);
@@ -801,9 +1591,6 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
     {
         long datasize = nframes * nchannels * bytespersamp;
         long longtmp;
-        if (strcmp(filenamebuf + strlen(filenamebuf)-4, ".aif") &&
-            strcmp(filenamebuf + strlen(filenamebuf)-5, ".aiff"))
-                strcat(filenamebuf, ".aif");
         strncpy(aiffhdr->a_fileid, "FORM", 4);
         aiffhdr->a_chunksize = swap4(datasize + sizeof(*aiffhdr) + 4, swap);
         strncpy(aiffhdr->a_aiffid, "AIFF", 4);
@@ -820,11 +1607,39 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
         memset(((char *)(&aiffhdr->a_samprate))+18, 0, 8);
         headersize = AIFFPLUS;
     }
+    else if (filetype == FORMAT_RF64)
+    {
+        uint64_t datasize = (uint64_t)nframes * nchannels * bytespersamp,
+            riffsize = datasize + sizeof(*rf64hdr) - 8;
+        memcpy(rf64hdr->r_fileid, "RF64", 4);
+        rf64hdr->r_chunksize = 0xffffffff;
+        memcpy(rf64hdr->r_waveid, "WAVE", 4);
+        memcpy(rf64hdr->r_ds64id, "ds64", 4);
+        rf64hdr->r_ds64size = swap4(RF64_DS64SIZE, swap);
+        rf64hdr->r_riffsizelo = swap4((uint32_t)riffsize, swap);
+        rf64hdr->r_riffsizehi = swap4((uint32_t)(riffsize >> 32), swap);
+        rf64hdr->r_datasizelo = swap4((uint32_t)datasize, swap);
+        rf64hdr->r_datasizehi = swap4((uint32_t)(datasize >> 32), swap);
+        rf64hdr->r_nframeslo = swap4(nframes, swap);
+        rf64hdr->r_nframeshi = 0;
+        rf64hdr->r_tablelength = 0;
+        memcpy(rf64hdr->r_fmtid, "fmt ", 4);
+        rf64hdr->r_fmtchunksize = swap4(16, swap);
+        rf64hdr->r_fmttag =
+            swap2((bytespersamp == 4 ? WAV_FLOAT : WAV_INT), swap);
+        rf64hdr->r_nchannels = swap2(nchannels, swap);
+        rf64hdr->r_samplespersec = swap4(samplerate, swap);
+        rf64hdr->r_navgbytespersec =
+            swap4((int)(samplerate * nchannels * bytespersamp), swap);
+        rf64hdr->r_nblockalign = swap2(nchannels * bytespersamp, swap);
+        rf64hdr->r_nbitspersample = swap2(8 * bytespersamp, swap);
+        memcpy(rf64hdr->r_datachunkid, "data", 4);
+        rf64hdr->r_datachunksize = 0xffffffff;
+        headersize = sizeof(t_rf64);
+    }
     else    /* WAVE format */
     {
         long datasize = nframes * nchannels * bytespersamp;
-        if (strcmp(filenamebuf + strlen(filenamebuf)-4, ".wav"))
-            strcat(filenamebuf, ".wav");
         strncpy(wavehdr->w_fileid, "RIFF", 4);
         wavehdr->w_chunksize = swap4(datasize + sizeof(*wavehdr) - 8, swap);
         strncpy(wavehdr->w_waveid, "WAVE", 4);
@@ -843,7 +1658,7 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
         headersize = sizeof(t_wave);
     }
 
-    canvas_makefilename(canvas, filenamebuf, buf2, MAXPDSTRING);
+    soundfile_writepath(canvas, filename, filetype, buf2);
     if ((fd = sys_open(buf2, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
         return (-1);
 
@@ -855,336 +1670,982 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
     return (fd);
 }
 
+    /* write a 32-bit header field at a given place in the file */
+static int soundfile_putheaderword(int fd, long where, uint32_t value)
+{
+    if (lseek(fd, where, SEEK_SET) != where ||
+        write(fd, (char *)&value, 4) < 4)
+            return (-1);
+    return (0);
+}
+
+    /* Rewrite the size fields in the header of a file being written, to
+    say that it has "nframes" sample frames.  This leaves the file pointer
+    somewhere in the header.  Sizes that don't fit in the 32-bit fields
+    of WAVE and AIFF files are clipped; NeXT files are just marked as
+    having unknown size.  Returns 0 on success, or -1 with errno set. */
+static int soundfile_updateheader(int fd, int filetype, int64_t nframes,
+    int bytesperframe, int swap)
+{
+    uint64_t datasize = (uint64_t)nframes * bytesperframe;
+    if (filetype == FORMAT_WAVE)
+    {
+        uint64_t riffsize = datasize + sizeof(t_wave) - 8;
+        if (soundfile_putheaderword(fd, offsetof(t_wave, w_chunksize),
+            swap4(riffsize > 0xffffffff ? 0xffffffff : riffsize, swap)) ||
+            soundfile_putheaderword(fd, offsetof(t_wave, w_datachunksize),
+                swap4(datasize > 0xffffffff ? 0xffffffff : datasize, swap)))
+                    return (-1);
+    }
+    else if (filetype == FORMAT_RF64)
+    {
+        uint64_t riffsize = datasize + sizeof(t_rf64) - 8;
+        uint32_t words[6];
+        words[0] = swap4((uint32_t)riffsize, swap);
+        words[1] = swap4((uint32_t)(riffsize >> 32), swap);
+        words[2] = swap4((uint32_t)datasize, swap);
+        words[3] = swap4((uint32_t)(datasize >> 32), swap);
+        words[4] = swap4((uint32_t)nframes, swap);
+        words[5] = swap4((uint32_t)((uint64_t)nframes >> 32), swap);
+            /* all three sizes in one write so they can't disagree */
+        if (lseek(fd, offsetof(t_rf64, r_riffsizelo), SEEK_SET) !=
+            (off_t)offsetof(t_rf64, r_riffsizelo) ||
+                write(fd, (char *)words, sizeof(words)) < (int)sizeof(words))
+                    return (-1);
+    }
+    else if (filetype == FORMAT_AIFF)
+    {
+        uint64_t formsize = datasize + AIFFHDRSIZE;
+        if (nframes > 0xffffffff)
+            nframes = 0xffffffff;
+        if (soundfile_putheaderword(fd, offsetof(t_aiff, a_nframeshi),
+            swap4(nframes, swap)) ||
+            soundfile_putheaderword(fd, offsetof(t_aiff, a_chunksize),
+                swap4(formsize > 0xffffffff ? 0xffffffff : formsize, swap)) ||
+            soundfile_putheaderword(fd, AIFFHDRSIZE+4,
+                swap4(datasize > 0xffffffff ? 0xffffffff : datasize, swap)))
+                    return (-1);
+    }
+    else if (filetype == FORMAT_NEXT)
+    {
+            /* do it the lazy way: just set the size field to 'unknown size'*/
+        if (soundfile_putheaderword(fd, 8, 0xffffffff))
+            return (-1);
+    }
+    return (0);
+}
+
 static void soundfile_finishwrite(void *obj, char *filename, int fd,
-    int filetype, long nframes, long itemswritten, int bytesperframe, int swap)
+    int filetype, long nframes, int64_t itemswritten, int bytesperframe,
+    int swap)
 {
     if (itemswritten < nframes) 
     {
         if (nframes < 0x7fffffff)
             pd_error(obj, "soundfiler_write: %ld out of %ld bytes written",
-                itemswritten, nframes);
+                (long)itemswritten, nframes);
             /* try to fix size fields in header */
-        if (filetype == FORMAT_WAVE)
-        {
-            long datasize = itemswritten * bytesperframe, mofo;
-            
-            if (lseek(fd,
-                ((char *)(&((t_wave *)0)->w_chunksize)) - (char *)0,
-                    SEEK_SET) == 0)
-                        goto baddonewrite;
-            mofo = swap4(datasize + sizeof(t_wave) - 8, swap);
-            if (write(fd, (char *)(&mofo), 4) < 4)
-                goto baddonewrite;
-            if (lseek(fd,
-                ((char *)(&((t_wave *)0)->w_datachunksize)) - (char *)0,
-                    SEEK_SET) == 0)
-                        goto baddonewrite;
-            mofo = swap4(datasize, swap);
-            if (write(fd, (char *)(&mofo), 4) < 4)
-                goto baddonewrite;
-        }
-        if (filetype == FORMAT_AIFF)
-        {
-            long mofo;
-            if (lseek(fd,
-                ((char *)(&((t_aiff *)0)->a_nframeshi)) - (char *)0,
-                    SEEK_SET) == 0)
-                        goto baddonewrite;
-            mofo = swap4(itemswritten, swap);
-            if (write(fd, (char *)(&mofo), 4) < 4)
-                goto baddonewrite;
-            if (lseek(fd,
-                ((char *)(&((t_aiff *)0)->a_chunksize)) - (char *)0,
-                    SEEK_SET) == 0)
-                        goto baddonewrite;
-            mofo = swap4(itemswritten*bytesperframe+AIFFHDRSIZE, swap);
-            if (write(fd, (char *)(&mofo), 4) < 4)
-                goto baddonewrite;
-            if (lseek(fd, (AIFFHDRSIZE+4), SEEK_SET) == 0)
-                goto baddonewrite;
-            mofo = swap4(itemswritten*bytesperframe, swap);
-            if (write(fd, (char *)(&mofo), 4) < 4)
-                goto baddonewrite;
-        }
-        if (filetype == FORMAT_NEXT)
+        if (soundfile_updateheader(fd, filetype, itemswritten,
+            bytesperframe, swap))
+                post("%s: %s", filename, strerror(errno));
+    }
+}
+
+    /* the reverse of soundfile_xferin_sample(), with the samples scaled
+    by "normalfactor" on the way. */
+static void soundfile_xferout_sample(int nchannels, t_sample **vecs,
+    unsigned char *buf, int nitems, long onset, int bytespersamp,
+    int bigendian, t_sample normalfactor, int spread)
+{
+    t_sample scratch[SFXFERCHUNK], gain, *fp;
+    int i, j, k, bytesperframe = bytespersamp * nchannels;
+    int chunkframes = SFXFERCHUNK / nchannels;
+    t_sfencoder encode;
+    if (bytespersamp < 2 || bytespersamp > 4)
+        return;
+    encode = sf_codecs.c_encode[bytespersamp - 2];
+    if (bytespersamp == 2)
+        gain = normalfactor * 32768.;
+    else if (bytespersamp == 3)
+        gain = normalfactor * 8388608.;
+    else gain = normalfactor;
+    onset *= spread;
+    if (nchannels == 1 && spread == 1)
+        (*encode)(vecs[0] + onset, buf, nitems, gain, bigendian);
+    else for (j = 0; j < nitems; j += chunkframes)
+    {
+        int nframes = (nitems - j < chunkframes ? nitems - j : chunkframes);
+        if (nchannels == 2 && spread == 1)
+            (*sf_codecs.c_merge2)(vecs[0] + onset + j, vecs[1] + onset + j,
+                scratch, nframes);
+        else for (i = 0; i < nchannels; i++)
         {
-            /* do it the lazy way: just set the size field to 'unknown size'*/
-            uint32_t nextsize = 0xffffffff;
-            if (lseek(fd, 8, SEEK_SET) == 0)
-            {
-                goto baddonewrite;
-            }
-            if (write(fd, &nextsize, 4) < 4)
-            {
-                goto baddonewrite;
-            }
+            t_sample *sp = scratch + i;
+            for (k = 0, fp = vecs[i] + onset + j * spread; k < nframes;
+                k++, sp += nchannels, fp += spread)
+                    *sp = *fp;
         }
+        (*encode)(scratch, buf + j * bytesperframe, nframes * nchannels,
+            gain, bigendian);
     }
-    return;
-baddonewrite:
-    post("%s: %s", filename, strerror(errno));
 }
 
-static void soundfile_xferout_sample(int nchannels, t_sample **vecs,
+static void soundfile_xferout_float(int nchannels, t_float **vecs,
     unsigned char *buf, int nitems, long onset, int bytespersamp,
     int bigendian, t_sample normalfactor, int spread)
 {
-    int i, j;
-    unsigned char *sp, *sp2;
-    t_sample *fp;
-    int bytesperframe = bytespersamp * nchannels;
-    for (i = 0, sp = buf; i < nchannels; i++, sp += bytespersamp)
+    soundfile_xferout_sample(nchannels, (t_sample **)vecs, buf, nitems,
+        onset, bytespersamp, bigendian, normalfactor, spread);
+}
+
+/* ------- soundfiler - reads and writes soundfiles to/from "garrays" ---- */
+#define DEFMAXSIZE 4000000      /* default maximum 16 MB per channel */
+#define SAMPBUFSIZE 65536
+
+/******************** sample rate conversion ***********************/
+
+/* "soundfiler read -resample" converts a file to Pd's sample rate as it is
+loaded.  Each output point is the input around it weighted by a
+Kaiser-windowed sinc centered on the output point's position in the input.
+The filter is tabulated at a number of fractional positions ("phases")
+and interpolated linearly between neighboring ones, so any ratio of rates
+works.  When going down in rate the cutoff goes down with it so nothing
+folds over.  The whole file is decoded first; then the channels are
+converted in parallel by helper threads.  The quality setting trades the
+filter length and table resolution against speed: */
+
+typedef struct _sfquality
+{
+    int q_zeros;            /* zero crossings of the sinc on each side */
+    int q_nphases;          /* fractional positions tabulated */
+    double q_beta;          /* Kaiser window shape */
+    double q_rolloff;       /* cutoff as a fraction of the lower Nyquist */
+} t_sfquality;
+
+static const t_sfquality sfresample_quality[] =
+{
+    {8, 128, 6, 0.85},      /* 0: fast, about 60 dB down */
+    {16, 256, 8, 0.90},     /* 1: about 80 dB */
+    {32, 512, 10, 0.94},    /* 2: about 100 dB; the default */
+    {64, 1024, 12, 0.97},   /* 3: best */
+};
+
+#define SFRESAMPLE_DEFQUALITY 2
+#define SFRESAMPLE_MAXQUALITY 3
+#define SFRESAMPLE_MAXTHREADS 8
+
+typedef struct _sfresampler
+{
+    double r_step;          /* input frames per output frame */
+    int r_ntaps;            /* filter length, a multiple of 8 */
+    int r_nphases;
+    t_sample *r_coefs;      /* (nphases + 1) rows of ntaps coefficients */
+    t_sample *r_dcoefs;     /* difference from each row to the next */
+} t_sfresampler;
+
+    /* modified Bessel function of order zero, for the Kaiser window */
+static double sf_besseli0(double x)
+{
+    double sum = 1, term = 1, y = x * x * 0.25;
+    int k;
+    for (k = 1; k < 100 && term > sum * 1e-12; k++)
+    {
+        term *= y / ((double)k * k);
+        sum += term;
+    }
+    return (sum);
+}
+
+static void sfresampler_free(t_sfresampler *r)
+{
+    int size = (r->r_nphases + 1) * r->r_ntaps * sizeof(t_sample);
+    if (r->r_coefs)
+        freebytes(r->r_coefs, size);
+    if (r->r_dcoefs)
+        freebytes(r->r_dcoefs, size);
+    freebytes(r, sizeof(*r));
+}
+
+    /* make a converter from rate "insr" to rate "outsr" */
+static t_sfresampler *sfresampler_new(double insr, double outsr,
+    int quality)
+{
+    const t_sfquality *q = &sfresample_quality[quality];
+    t_sfresampler *r = (t_sfresampler *)getbytes(sizeof(*r));
+    double fc = (outsr < insr ? outsr / insr : 1) * q->q_rolloff,
+        i0beta = sf_besseli0(q->q_beta), *row;
+    int half = ceil(q->q_zeros / fc), p, k;
+    half = (half + 3) & ~3;
+    r->r_step = insr / outsr;
+    r->r_ntaps = 2 * half;
+    r->r_nphases = q->q_nphases;
+    r->r_coefs = (t_sample *)getbytes((r->r_nphases + 1) * r->r_ntaps *
+        sizeof(t_sample));
+    r->r_dcoefs = (t_sample *)getbytes((r->r_nphases + 1) * r->r_ntaps *
+        sizeof(t_sample));
+    row = (double *)getbytes(r->r_ntaps * sizeof(double));
+    if (!r->r_coefs || !r->r_dcoefs || !row)
     {
-        if (bytespersamp == 2)
+        if (row)
+            freebytes(row, r->r_ntaps * sizeof(double));
+        sfresampler_free(r);
+        return (0);
+    }
+        /* row p is the filter for an output point p/nphases of the way
+        from input point "half - 1" to input point "half". */
+    for (p = 0; p <= r->r_nphases; p++)
+    {
+        double sum = 0;
+        for (k = 0; k < r->r_ntaps; k++)
         {
-            t_sample ff = normalfactor * 32768.;
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    int xx = 32768. + (*fp * ff);
-                    xx -= 32768;
-                    if (xx < -32767)
-                        xx = -32767;
-                    if (xx > 32767)
-                        xx = 32767;
-                    sp2[0] = (xx >> 8);
-                    sp2[1] = xx;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    int xx = 32768. + (*fp * ff);
-                    xx -= 32768;
-                    if (xx < -32767)
-                        xx = -32767;
-                    if (xx > 32767)
-                        xx = 32767;
-                    sp2[1] = (xx >> 8);
-                    sp2[0] = xx;
-                }
-            }
+            double d = (k - half + 1) - (double)p / r->r_nphases,
+                w = 1 - (d * d) / ((double)half * half);
+            row[k] = (w > 0 ? sf_besseli0(q->q_beta * sqrt(w)) / i0beta : 0) *
+                (d == 0 ? fc : sin(3.14159265358979 * fc * d) /
+                    (3.14159265358979 * d));
+            sum += row[k];
         }
-        else if (bytespersamp == 3)
+            /* normalize for unit gain at DC */
+        for (k = 0; k < r->r_ntaps; k++)
+            r->r_coefs[p * r->r_ntaps + k] = row[k] / sum;
+    }
+    for (p = 0; p < r->r_nphases; p++)
+        for (k = 0; k < r->r_ntaps; k++)
+            r->r_dcoefs[p * r->r_ntaps + k] =
+                r->r_coefs[(p + 1) * r->r_ntaps + k] -
+                    r->r_coefs[p * r->r_ntaps + k];
+    freebytes(row, r->r_ntaps * sizeof(double));
+    return (r);
+}
+
+    /* how many output frames "ninframes" input frames make */
+static long sfresampler_outframes(const t_sfresampler *r, long ninframes)
+{
+    return ((long)(ninframes / r->r_step + 0.5));
+}
+
+    /* how many input frames we need (of "navail") for "noutframes" output */
+static long sfresampler_inframes(const t_sfresampler *r, long noutframes,
+    long navail)
+{
+    double need = noutframes * r->r_step + r->r_ntaps / 2 + 2;
+    return (need < navail ? (long)need : navail);
+}
+
+    /* convert one channel.  The input must be readable (and zero) for
+    ntaps/2 points before its start and ntaps/2 + 1 points after its end. */
+static void sfresampler_run(const t_sfresampler *r, const t_sample *in,
+    t_float *out, int stride, long nout)
+{
+    int ntaps = r->r_ntaps, nphases = r->r_nphases;
+    t_sffir fir = sf_codecs.c_fir;
+    long n;
+    in -= ntaps / 2 - 1;
+    for (n = 0; n < nout; n++, out += stride)
+    {
+        double t = n * r->r_step, pf;
+        long i = (long)t;
+        int p;
+        pf = (t - i) * nphases;
+        p = (int)pf;
+        *out = (*fir)(in + i, r->r_coefs + p * ntaps,
+            r->r_dcoefs + p * ntaps, (t_sample)(pf - p), ntaps);
+    }
+}
+
+typedef struct _sfresamplethread
+{
+    const t_sfresampler *t_resampler;
+    t_sample **t_in;
+    t_float **t_out;
+    int t_stride;
+    long t_nout;
+    int t_first;            /* first channel this thread does, */
+    int t_hop;              /* ... then every "hop"th one */
+    int t_nchannels;
+    int t_started;
+    pthread_t t_thread;
+} t_sfresamplethread;
+
+static void *sfresampler_threadmain(void *z)
+{
+    t_sfresamplethread *t = (t_sfresamplethread *)z;
+    int i;
+    for (i = t->t_first; i < t->t_nchannels; i += t->t_hop)
+        sfresampler_run(t->t_resampler, t->t_in[i], t->t_out[i],
+            t->t_stride, t->t_nout);
+    return (0);
+}
+
+    /* read "ninframes" frames from a soundfile, convert them, and put
+    up to "noutframes" of the result in the vectors.  Return the number of
+    frames output; if reading failed "*p_errno" is set. */
+static long soundfile_readresampled(const t_sfresampler *r, int fd,
+    int channels, int bytespersamp, int bigendian, long ninframes,
+    int nvecs, t_float **vecs, int stride, long noutframes, int *p_errno)
+{
+    int nconv = (channels < nvecs ? channels : nvecs), half = r->r_ntaps / 2,
+        bytesperframe = channels * bytespersamp,
+        bufframes = SAMPBUFSIZE / bytesperframe, nthreads = nconv, i;
+    long inbufsize = ninframes + 2 * half + 1, ngot = 0, nout;
+    t_sample *in[MAXSFCHANS];
+    t_sfresamplethread threads[SFRESAMPLE_MAXTHREADS];
+    unsigned char *buf = (unsigned char *)getbytes(SAMPBUFSIZE);
+    *p_errno = 0;
+    for (i = 0; i < nconv; i++)
+    {
+        if (!(in[i] = (t_sample *)getbytes(inbufsize * sizeof(t_sample))))
         {
-            t_sample ff = normalfactor * 8388608.;
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    int xx = 8388608. + (*fp * ff);
-                    xx -= 8388608;
-                    if (xx < -8388607)
-                        xx = -8388607;
-                    if (xx > 8388607)
-                        xx = 8388607;
-                    sp2[0] = (xx >> 16);
-                    sp2[1] = (xx >> 8);
-                    sp2[2] = xx;
-                }
-            }
-            else
+            *p_errno = ENOMEM;
+            nconv = i;
+            ninframes = 0;
+            break;
+        }
+        in[i] += half;
+    }
+    while (ngot < ninframes)
+    {
+        long nbytes = (ninframes - ngot < bufframes ?
+            ninframes - ngot : bufframes) * bytesperframe, got, rtn = 0;
+        for (got = 0; got < nbytes; got += rtn)
+            if ((rtn = read(fd, buf + got, nbytes - got)) <= 0)
+                break;
+        if (got < nbytes && rtn < 0)
+            *p_errno = errno;
+        if (got / bytesperframe > 0)
+            soundfile_xferin_sample(channels, nconv, in, ngot, buf,
+                got / bytesperframe, bytespersamp, bigendian, 1);
+        ngot += got / bytesperframe;
+        if (got < nbytes)
+            break;
+    }
+    nout = sfresampler_outframes(r, ngot);
+    if (nout > noutframes)
+        nout = noutframes;
+#ifdef _SC_NPROCESSORS_ONLN
+    {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpu > 0 && nthreads > ncpu)
+            nthreads = ncpu;
+    }
+#endif
+    if (nthreads > SFRESAMPLE_MAXTHREADS)
+        nthreads = SFRESAMPLE_MAXTHREADS;
+    for (i = 0; i < nthreads; i++)
+    {
+        threads[i].t_resampler = r;
+        threads[i].t_in = in;
+        threads[i].t_out = vecs;
+        threads[i].t_stride = stride;
+        threads[i].t_nout = nout;
+        threads[i].t_first = i;
+        threads[i].t_hop = nthreads;
+        threads[i].t_nchannels = nconv;
+    }
+        /* the calling thread takes the first share itself; if a helper
+        thread can't be started we do its share as well. */
+    for (i = 1; i < nthreads; i++)
+        if (!(threads[i].t_started = !pthread_create(&threads[i].t_thread,
+            0, sfresampler_threadmain, &threads[i])))
+                sfresampler_threadmain(&threads[i]);
+    sfresampler_threadmain(&threads[0]);
+    for (i = 1; i < nthreads; i++)
+        if (threads[i].t_started)
+            pthread_join(threads[i].t_thread, 0);
+    for (i = 0; i < nconv; i++)
+        freebytes(in[i] - half, inbufsize * sizeof(t_sample));
+    freebytes(buf, SAMPBUFSIZE);
+    return (nout);
+}
+
+
+
+static t_class *soundfiler_class;
+
+    /* With the "-async" flag, reading and writing are done by a helper
+    thread so that the scheduler doesn't stall on disk access.  For reading,
+    the thread fills freshly allocated vectors which are swapped into the
+    tables all at once, at a clock tick, after the whole file is in.  For
+    writing, the samples are copied out of the tables first so the tables
+    can go on changing while the file is written.  In either case the frame
+    count goes out the outlet when the job is done.  Each soundfiler can
+    have one such job outstanding at a time. */
+
+#define ASYNCBUFSIZE 65536
+#define ASYNCPOLL 5         /* msec between checks for completion */
+
+typedef struct _sfjob
+{
+    int j_write;            /* nonzero for writing, zero for reading */
+    int j_fd;
+    int j_channels;         /* number of channels in file */
+    int j_nvecs;            /* number of tables */
+    int j_bytespersamp;
+    int j_bigendian;
+    int j_stride;           /* point k of a vector is at j_vecs[i][k*stride] */
+    long j_nframes;         /* size of each vector */
+    long j_ntransfer;       /* number of frames to read or write */
+    t_symbol *j_names[MAXSFCHANS];
+    t_float *j_vecs[MAXSFCHANS];
+    unsigned char *j_buf;   /* ASYNCBUFSIZE bytes for the helper thread */
+    int j_resize;           /* reading: clear tables' save-in-patch flag */
+    t_sfresampler *j_resampler; /* reading: converter if resampling, */
+    long j_ninframes;       /* ... and how many input frames to convert */
+    t_sample j_normfactor;  /* writing: scale factor, */
+    int j_filetype;         /* ... and what we need to finish the header */
+    int j_swap;
+    t_symbol *j_filesym;
+    pthread_t j_thread;
+    pthread_mutex_t j_mutex;    /* protects the following: */
+    int j_done;             /* set by helper thread when finished */
+    int j_cancel;           /* set by us to ask helper thread to quit */
+    long j_ndone;           /* frames actually transferred */
+    int j_errno;            /* errno if the transfer failed */
+} t_sfjob;
+
+typedef struct _soundfiler
+{
+    t_object x_obj;
+    t_canvas *x_canvas;
+    t_sfjob *x_job;         /* "-async" job in progress, if any */
+    t_clock *x_clock;       /* polls for job completion */
+} t_soundfiler;
+
+static void soundfiler_tick(t_soundfiler *x);
+
+static t_soundfiler *soundfiler_new(void)
+{
+    t_soundfiler *x = (t_soundfiler *)pd_new(soundfiler_class);
+    soundfile_initcodecs();
+    x->x_canvas = canvas_getcurrent();
+    x->x_job = 0;
+    x->x_clock = clock_new(x, (t_method)soundfiler_tick);
+    outlet_new(&x->x_obj, &s_float);
+    return (x);
+}
+
+static t_sfjob *sfjob_new(int write, int fd, int nvecs)
+{
+    t_sfjob *j = (t_sfjob *)getbytes(sizeof(*j));
+    j->j_write = write;
+    j->j_fd = fd;
+    j->j_nvecs = nvecs;
+    j->j_buf = (unsigned char *)getbytes(ASYNCBUFSIZE);
+    pthread_mutex_init(&j->j_mutex, 0);
+    return (j);
+}
+
+static void sfjob_free(t_sfjob *j)
+{
+    int i;
+    for (i = 0; i < j->j_nvecs; i++)
+        if (j->j_vecs[i])
+            freebytes(j->j_vecs[i],
+                j->j_nframes * j->j_stride * sizeof(t_float));
+    if (j->j_fd >= 0)
+        close(j->j_fd);
+    if (j->j_resampler)
+        sfresampler_free(j->j_resampler);
+    freebytes(j->j_buf, ASYNCBUFSIZE);
+    pthread_mutex_destroy(&j->j_mutex);
+    freebytes(j, sizeof(*j));
+}
+
+    /* the helper thread.  It touches nothing but the job structure. */
+static void *sfjob_main(void *z)
+{
+    t_sfjob *j = (t_sfjob *)z;
+    int bytesperframe = j->j_channels * j->j_bytespersamp,
+        bufframes = ASYNCBUFSIZE / bytesperframe, cancel = 0, err = 0;
+    long ndone = 0;
+    if (j->j_resampler)
+    {
+        ndone = soundfile_readresampled(j->j_resampler, j->j_fd,
+            j->j_channels, j->j_bytespersamp, j->j_bigendian,
+                j->j_ninframes, j->j_nvecs, j->j_vecs, j->j_stride,
+                    j->j_ntransfer, &err);
+    }
+    else while (ndone < j->j_ntransfer && !cancel)
+    {
+        long thisxfer = j->j_ntransfer - ndone, nbytes, got;
+        if (thisxfer > bufframes)
+            thisxfer = bufframes;
+        nbytes = thisxfer * bytesperframe;
+        if (j->j_write)
+        {
+            soundfile_xferout_float(j->j_channels, j->j_vecs, j->j_buf,
+                thisxfer, ndone, j->j_bytespersamp, j->j_bigendian,
+                    j->j_normfactor, j->j_stride);
+            if ((got = write(j->j_fd, j->j_buf, nbytes)) < nbytes)
             {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    int xx = 8388608. + (*fp * ff);
-                    xx -= 8388608;
-                    if (xx < -8388607)
-                        xx = -8388607;
-                    if (xx > 8388607)
-                        xx = 8388607;
-                    sp2[2] = (xx >> 16);
-                    sp2[1] = (xx >> 8);
-                    sp2[0] = xx;
-                }
+                err = (got < 0 ? errno : ENOSPC);
+                if (got > 0)
+                    ndone += got / bytesperframe;
+                break;
             }
         }
-        else if (bytespersamp == 4)
+        else
         {
-            if (bigendian)
+            for (got = 0; got < nbytes; )
             {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    t_sampleuint f2;
-                    f2.f = *fp * normalfactor;
-                    sp2[0] = (f2.l >> 24); sp2[1] = (f2.l >> 16);
-                    sp2[2] = (f2.l >> 8); sp2[3] = f2.l;
-                }
+                long r = read(j->j_fd, j->j_buf + got, nbytes - got);
+                if (r < 0)
+                    err = errno;
+                if (r <= 0)
+                    break;
+                got += r;
             }
-            else
+            if ((thisxfer = got / bytesperframe) > 0)
+                soundfile_xferin_float(j->j_channels, j->j_nvecs, j->j_vecs,
+                    ndone, j->j_buf, thisxfer, j->j_bytespersamp,
+                        j->j_bigendian, j->j_stride);
+            if (got < nbytes)
             {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    t_sampleuint f2;
-                    f2.f = *fp * normalfactor;
-                    sp2[3] = (f2.l >> 24); sp2[2] = (f2.l >> 16);
-                    sp2[1] = (f2.l >> 8); sp2[0] = f2.l;
-                }
+                ndone += thisxfer;
+                break;
             }
         }
+        ndone += thisxfer;
+        pthread_mutex_lock(&j->j_mutex);
+        cancel = j->j_cancel;
+        pthread_mutex_unlock(&j->j_mutex);
     }
+    pthread_mutex_lock(&j->j_mutex);
+    j->j_ndone = ndone;
+    j->j_errno = err;
+    j->j_done = 1;
+    pthread_mutex_unlock(&j->j_mutex);
+    return (0);
 }
-static void soundfile_xferout_float(int nchannels, t_float **vecs,
-    unsigned char *buf, int nitems, long onset, int bytespersamp,
-    int bigendian, t_sample normalfactor, int spread)
+
+    /* hand a filled-in job to a new helper thread.  On failure the job
+    is freed and we return 0. */
+static int soundfiler_startjob(t_soundfiler *x, t_sfjob *j)
 {
-    int i, j;
-    unsigned char *sp, *sp2;
-    t_float *fp;
-    int bytesperframe = bytespersamp * nchannels;
-    for (i = 0, sp = buf; i < nchannels; i++, sp += bytespersamp)
+    if (pthread_create(&j->j_thread, 0, sfjob_main, j))
+    {
+        pd_error(x, "soundfiler: couldn't start helper thread");
+        sfjob_free(j);
+        return (0);
+    }
+    x->x_job = j;
+    clock_delay(x->x_clock, ASYNCPOLL);
+    return (1);
+}
+
+    /* at a clock tick, see if the helper thread is done and if so put the
+    results in place and report the frame count */
+static void soundfiler_tick(t_soundfiler *x)
+{
+    t_sfjob *j = x->x_job;
+    int done, i;
+    if (!j)
+        return;
+    pthread_mutex_lock(&j->j_mutex);
+    done = j->j_done;
+    pthread_mutex_unlock(&j->j_mutex);
+    if (!done)
     {
-        if (bytespersamp == 2)
+        clock_delay(x->x_clock, ASYNCPOLL);
+        return;
+    }
+    pthread_join(j->j_thread, 0);
+    x->x_job = 0;
+    if (j->j_errno)
+        pd_error(x, "soundfiler: %s: %s", j->j_filesym->s_name,
+            strerror(j->j_errno));
+    if (j->j_write)
+        soundfile_finishwrite(x, j->j_filesym->s_name, j->j_fd,
+            j->j_filetype, j->j_ntransfer, j->j_ndone,
+                j->j_channels * j->j_bytespersamp, j->j_swap);
+    else for (i = 0; i < j->j_nvecs; i++)
+    {
+        t_garray *a = (t_garray *)pd_findbyclass(j->j_names[i],
+            garray_class);
+        if (!a)
+            pd_error(x, "%s: no such table", j->j_names[i]->s_name);
+        else if (!garray_adoptvec(a, j->j_vecs[i], j->j_nframes,
+            j->j_stride))
+                pd_error(x, "%s: table changed while reading",
+                    j->j_names[i]->s_name);
+        else
         {
-            t_sample ff = normalfactor * 32768.;
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    int xx = 32768. + (*fp * ff);
-                    xx -= 32768;
-                    if (xx < -32767)
-                        xx = -32767;
-                    if (xx > 32767)
-                        xx = 32767;
-                    sp2[0] = (xx >> 8);
-                    sp2[1] = xx;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    int xx = 32768. + (*fp * ff);
-                    xx -= 32768;
-                    if (xx < -32767)
-                        xx = -32767;
-                    if (xx > 32767)
-                        xx = 32767;
-                    sp2[1] = (xx >> 8);
-                    sp2[0] = xx;
-                }
-            }
+            j->j_vecs[i] = 0;
+            if (j->j_resize)
+                garray_setsaveit(a, 0);
+            garray_redraw(a);
         }
-        else if (bytespersamp == 3)
+    }
+    outlet_float(x->x_obj.ob_outlet, (t_float)j->j_ndone);
+    sfjob_free(j);
+}
+
+static void soundfiler_free(t_soundfiler *x)
+{
+    t_sfjob *j = x->x_job;
+    if (j)
+    {
+        pthread_mutex_lock(&j->j_mutex);
+        j->j_cancel = 1;
+        pthread_mutex_unlock(&j->j_mutex);
+        pthread_join(j->j_thread, 0);
+        sfjob_free(j);
+    }
+    clock_free(x->x_clock);
+}
+
+    /* soundfiler_read ...
+    
+    usage: read [flags] filename table ...
+    flags:
+        -skip <frames> ... frames to skip in file
+        -onset <frames> ... onset in table to read into (NOT DONE YET)
+        -raw <headersize channels bytes endian>
+        -resize
+        -maxsize <max-size>
+        -map ... map 32-bit float files into the tables instead of copying
+        -async ... read in the background; output frame count when done
+        -resample [quality] ... convert to Pd's sample rate
+        -cache ... share decoded samples with other tables reading the file
+    */
+
+    /* resize tables in excess of the number of channels and zero them */
+static void soundfiler_zeroextra(t_garray **garrays, int narrays,
+    long nframes)
+{
+    int i, j;
+    for (i = 0; i < narrays; i++)
+    {
+        int vecsize, stride;
+        t_float *vec;
+        garray_resize_long(garrays[i], nframes);
+        if (garray_getfloatvec(garrays[i], &vecsize, &vec, &stride))
+            for (j = 0; j < vecsize; j++)
+                vec[j * stride] = 0;
+    }
+}
+
+    /* try to satisfy "read -map" by mapping the file's samples straight
+    into the arrays, which then share the OS's page cache and are paged in
+    lazily.  This only works for 32-bit float files in our own byte order;
+    otherwise (or if mapping fails) return -1 so the caller reads the file
+    the usual way.  On success return the number of frames mapped. */
+static long soundfiler_map(t_garray **garrays, int narrays, int fd,
+    int channels, int bytespersamp, int bigendian, long bytelimit,
+    long maxsize)
+{
+    long onset, eofis, nframes;
+    int i;
+    if (bytespersamp != 4 || bigendian != garray_ambigendian())
+        return (-1);
+    onset = lseek(fd, 0, SEEK_CUR);
+    eofis = lseek(fd, 0, SEEK_END);
+    if (onset < 0 || lseek(fd, onset, SEEK_SET) != onset || eofis < onset)
+        return (-1);
+    if (eofis - onset > bytelimit)
+        eofis = onset + bytelimit;
+    nframes = (eofis - onset) / (channels * bytespersamp);
+    if (nframes > maxsize)
+        nframes = maxsize;
+    if (nframes < 1)
+        return (-1);
+    for (i = 0; i < narrays && i < channels; i++)
+        if (!garray_mapfile(garrays[i], fd, onset + i * bytespersamp,
+            nframes, channels * bytespersamp))
+                return (-1);
+    soundfiler_zeroextra(garrays + i, narrays - i, nframes);
+    return (nframes);
+}
+
+    /* "read -cache" keeps decoded files in a process-wide cache so that
+    tables loading the same file share one copy of its samples.  An entry
+    holds the channels one after another, as native floats, in an anonymous
+    memory file which tables map copy-on-write with garray_mapfile(): a
+    table that gets written to copies only the pages written, and the
+    cached samples never change.  Entries are looked up by full path, by
+    the file's identity and modification time, and by whatever else
+    changes the samples (-skip, -raw and -resample).  Evicting an entry
+    just closes its memory file; tables mapping it keep their samples until
+    they are freed or resized. */
+
+#ifdef SFCACHE
+
+typedef struct _sfcache
+{
+    struct _sfcache *c_next;
+    t_symbol *c_path;           /* full path of the file */
+    dev_t c_dev;                /* which file, and which version of it */
+    ino_t c_ino;
+    off_t c_size;
+    time_t c_mtime;
+    time_t c_ctime;
+    long c_skip;                /* how it was read */
+    int c_headersize;
+    int c_channels;
+    int c_bytespersamp;
+    int c_bigendian;
+    t_float c_samplerate;       /* rate converted to, or zero */
+    int c_quality;
+    int c_fd;                   /* memory file holding the samples */
+    long c_nframes;
+    int c_complete;             /* nonzero if all of the file is here */
+    size_t c_chanbytes;         /* bytes per channel, rounded to pages */
+    int c_nreads;               /* how many reads it has served */
+} t_sfcache;
+
+static t_sfcache *sfcache_list;
+
+static void sfcache_free(t_sfcache *c)
+{
+    close(c->c_fd);
+    freebytes(c, sizeof(*c));
+}
+
+    /* remove entries for "path", or all entries if "path" is zero; if
+    "st" is nonzero, only those made from some other version of the file */
+static int sfcache_evict(t_symbol *path, struct stat *st)
+{
+    t_sfcache **cp = &sfcache_list, *c;
+    int n = 0;
+    while ((c = *cp))
+    {
+        if ((!path || c->c_path == path) && (!st ||
+            c->c_dev != st->st_dev || c->c_ino != st->st_ino ||
+            c->c_size != st->st_size || c->c_mtime != st->st_mtime ||
+            c->c_ctime != st->st_ctime))
         {
-            t_sample ff = normalfactor * 8388608.;
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    int xx = 8388608. + (*fp * ff);
-                    xx -= 8388608;
-                    if (xx < -8388607)
-                        xx = -8388607;
-                    if (xx > 8388607)
-                        xx = 8388607;
-                    sp2[0] = (xx >> 16);
-                    sp2[1] = (xx >> 8);
-                    sp2[2] = xx;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    int xx = 8388608. + (*fp * ff);
-                    xx -= 8388608;
-                    if (xx < -8388607)
-                        xx = -8388607;
-                    if (xx > 8388607)
-                        xx = 8388607;
-                    sp2[2] = (xx >> 16);
-                    sp2[1] = (xx >> 8);
-                    sp2[0] = xx;
-                }
-            }
+            *cp = c->c_next;
+            sfcache_free(c);
+            n++;
         }
-        else if (bytespersamp == 4)
+        else cp = &c->c_next;
+    }
+    return (n);
+}
+
+    /* make a file for the samples that lives only in memory (or at least
+    has no name) */
+static int sfcache_memfile(void)
+{
+    char name[] = "/tmp/pd-samplecacheXXXXXX";
+    int fd;
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    if ((fd = memfd_create("pd-samplecache", MFD_CLOEXEC)) >= 0)
+        return (fd);
+#endif
+    if ((fd = mkstemp(name)) >= 0)
+        unlink(name);
+    return (fd);
+}
+
+    /* decode the rest of an open soundfile into a new cache entry.  Up to
+    "maxframes" frames are kept. */
+static t_sfcache *sfcache_load(int fd, int channels, int bytespersamp,
+    int bigendian, long bytelimit, long maxframes,
+    const t_sfresampler *resampler)
+{
+    long pagesize = sysconf(_SC_PAGESIZE), poswas, eofis, ninframes,
+        nframes, itemsread = 0;
+    int bytesperframe = channels * bytespersamp, memfd, i, err = 0,
+        complete;
+    size_t chanbytes;
+    char *mem;
+    t_float *vecs[MAXSFCHANS];
+    t_sfcache *c;
+    poswas = lseek(fd, 0, SEEK_CUR);
+    eofis = lseek(fd, 0, SEEK_END);
+    if (pagesize <= 0 || poswas < 0 || eofis < poswas ||
+        lseek(fd, poswas, SEEK_SET) != poswas)
+            return (0);
+    ninframes = (eofis - poswas) / bytesperframe;
+    if (ninframes > bytelimit / bytesperframe)
+        ninframes = bytelimit / bytesperframe;
+    nframes = (resampler ?
+        sfresampler_outframes(resampler, ninframes) : ninframes);
+    if ((complete = (nframes <= maxframes)) == 0)
+        nframes = maxframes;
+    if (nframes < 1)
+        return (0);
+    chanbytes = nframes * sizeof(t_float);
+    chanbytes = ((chanbytes + pagesize - 1) / pagesize) * pagesize;
+    if ((memfd = sfcache_memfile()) < 0)
+        return (0);
+    if (ftruncate(memfd, chanbytes * channels) < 0 ||
+        (mem = (char *)mmap(0, chanbytes * channels, PROT_READ | PROT_WRITE,
+            MAP_SHARED, memfd, 0)) == MAP_FAILED)
+    {
+        close(memfd);
+        return (0);
+    }
+    for (i = 0; i < channels; i++)
+        vecs[i] = (t_float *)(mem + i * chanbytes);
+    if (resampler)
+        itemsread = soundfile_readresampled(resampler, fd, channels,
+            bytespersamp, bigendian,
+                sfresampler_inframes(resampler, nframes, ninframes),
+                    channels, vecs, 1, nframes, &err);
+    else
+    {
+        unsigned char *buf = (unsigned char *)getbytes(SAMPBUFSIZE);
+        long bufframes = SAMPBUFSIZE / bytesperframe;
+        while (itemsread < nframes)
         {
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    t_sampleuint f2;
-                    f2.f = *fp * normalfactor;
-                    sp2[0] = (f2.l >> 24); sp2[1] = (f2.l >> 16);
-                    sp2[2] = (f2.l >> 8); sp2[3] = f2.l;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
-                    j < nitems; j++, sp2 += bytesperframe, fp += spread)
-                {
-                    t_sampleuint f2;
-                    f2.f = *fp * normalfactor;
-                    sp2[3] = (f2.l >> 24); sp2[2] = (f2.l >> 16);
-                    sp2[1] = (f2.l >> 8); sp2[0] = f2.l;
-                }
-            }
+            long nbytes = (nframes - itemsread < bufframes ?
+                nframes - itemsread : bufframes) * bytesperframe, got, rtn = 0;
+            for (got = 0; got < nbytes; got += rtn)
+                if ((rtn = read(fd, buf + got, nbytes - got)) <= 0)
+                    break;
+            if (got / bytesperframe > 0)
+                soundfile_xferin_float(channels, channels, vecs, itemsread,
+                    buf, got / bytesperframe, bytespersamp, bigendian, 1);
+            itemsread += got / bytesperframe;
+            if (got < nbytes)
+                break;
         }
+        freebytes(buf, SAMPBUFSIZE);
+    }
+    munmap(mem, chanbytes * channels);
+    if (itemsread < 1 || err)
+    {
+        close(memfd);
+        return (0);
     }
+    c = (t_sfcache *)getbytes(sizeof(*c));
+    c->c_fd = memfd;
+    c->c_nframes = itemsread;
+    c->c_complete = (complete || itemsread < nframes);
+    c->c_chanbytes = chanbytes;
+    c->c_channels = channels;
+    return (c);
 }
 
-/* ------- soundfiler - reads and writes soundfiles to/from "garrays" ---- */
-#define DEFMAXSIZE 4000000      /* default maximum 16 MB per channel */
-#define SAMPBUFSIZE 1024
-
+    /* try to satisfy "read -cache" from the cache, loading the file into
+    it first if need be.  As with soundfiler_map() return the number of
+    frames put in the tables, or -1 if the caller should read the file the
+    usual way. */
+static long soundfiler_cacheread(t_garray **garrays, int narrays, int fd,
+    t_symbol *path, long skip, int headersize, int channels,
+    int bytespersamp, int bigendian, long bytelimit, long maxsize,
+    const t_sfresampler *resampler, int quality)
+{
+    struct stat st;
+    t_sfcache **cp, *c;
+    t_float samplerate = (resampler ? sys_getsr() : 0);
+    long nframes;
+    int i;
+    if (fstat(fd, &st) < 0)
+        return (-1);
+    sfcache_evict(path, &st);   /* the file changed since we cached it */
+    for (cp = &sfcache_list; (c = *cp); cp = &c->c_next)
+        if (c->c_path == path && c->c_skip == skip &&
+            c->c_headersize == headersize && c->c_channels == channels &&
+            c->c_bytespersamp == bytespersamp &&
+            c->c_bigendian == bigendian &&
+            c->c_samplerate == samplerate &&
+            (!resampler || c->c_quality == quality))
+                break;
+    if (c && !c->c_complete && c->c_nframes < maxsize)
+    {
+            /* we cached less of the file than is wanted now */
+        *cp = c->c_next;
+        sfcache_free(c);
+        c = 0;
+    }
+    if (!c)
+    {
+        if (!(c = sfcache_load(fd, channels, bytespersamp, bigendian,
+            bytelimit, maxsize, resampler)))
+                return (-1);
+        c->c_path = path;
+        c->c_dev = st.st_dev;
+        c->c_ino = st.st_ino;
+        c->c_size = st.st_size;
+        c->c_mtime = st.st_mtime;
+        c->c_ctime = st.st_ctime;
+        c->c_skip = skip;
+        c->c_headersize = headersize;
+        c->c_bytespersamp = bytespersamp;
+        c->c_bigendian = bigendian;
+        c->c_samplerate = samplerate;
+        c->c_quality = quality;
+        c->c_next = sfcache_list;
+        sfcache_list = c;
+    }
+    nframes = (c->c_nframes < maxsize ? c->c_nframes : maxsize);
+    for (i = 0; i < narrays && i < channels; i++)
+        if (!garray_mapfile(garrays[i], c->c_fd, i * c->c_chanbytes,
+            nframes, sizeof(t_float)))
+                return (-1);
+    soundfiler_zeroextra(garrays + i, narrays - i, nframes);
+    c->c_nreads++;
+    return (nframes);
+}
 
-static t_class *soundfiler_class;
+#endif /* SFCACHE */
 
-typedef struct _soundfiler
+    /* "cache-info": list what's in the sample cache */
+static void soundfiler_cacheinfo(t_soundfiler *x)
 {
-    t_object x_obj;
-    t_canvas *x_canvas;
-} t_soundfiler;
+#ifdef SFCACHE
+    t_sfcache *c;
+    double total = 0;
+    int n = 0;
+    for (c = sfcache_list; c; c = c->c_next, n++)
+    {
+        double size = (double)c->c_chanbytes * c->c_channels;
+        post("%s: %ld frames, %d channel(s)%s, %.1f MB, read %d time(s)",
+            c->c_path->s_name, c->c_nframes, c->c_channels,
+                (c->c_samplerate > 0 ? " resampled" : ""),
+                    size / 1048576., c->c_nreads);
+        total += size;
+    }
+    post("sample cache: %d file(s), %.1f MB", n, total / 1048576.);
+#else
+    post("sample cache: not available on this platform");
+#endif
+}
 
-static t_soundfiler *soundfiler_new(void)
+    /* "cache-clear [filename]": forget one file or all of them */
+static void soundfiler_cacheclear(t_soundfiler *x, t_symbol *s)
 {
-    t_soundfiler *x = (t_soundfiler *)pd_new(soundfiler_class);
-    x->x_canvas = canvas_getcurrent();
-    outlet_new(&x->x_obj, &s_float);
-    return (x);
+#ifdef SFCACHE
+    if (*s->s_name)
+    {
+        char pathbuf[MAXPDSTRING], *pathptr;
+        int fd = canvas_open(x->x_canvas, s->s_name, "", pathbuf, &pathptr,
+            MAXPDSTRING, 1), n;
+        if (fd >= 0)
+        {
+            char fullpath[2 * MAXPDSTRING];
+            close(fd);
+            snprintf(fullpath, 2 * MAXPDSTRING, "%s/%s", pathbuf, pathptr);
+            n = sfcache_evict(gensym(fullpath), 0);
+        }
+        else n = sfcache_evict(s, 0);
+        if (!n)
+            post("soundfiler: %s: not in cache", s->s_name);
+    }
+    else sfcache_evict(0, 0);
+#endif
 }
 
-    /* soundfiler_read ...
-    
-    usage: read [flags] filename table ...
-    flags:
-        -skip <frames> ... frames to skip in file
-        -onset <frames> ... onset in table to read into (NOT DONE YET)
-        -raw <headersize channels bytes endian>
-        -resize
-        -maxsize <max-size>
-    */
-
 static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     int argc, t_atom *argv)
 {
     int headersize = -1, channels = 0, bytespersamp = 0, bigendian = 0,
-        resize = 0, i, j;
+        resize = 0, map = 0, gotmaxsize = 0, async = 0, started = 0, i, j,
+        resample = 0, quality = SFRESAMPLE_DEFQUALITY, cache = 0;
     long skipframes = 0, finalsize = 0, itemsleft,
-        maxsize = DEFMAXSIZE, itemsread = 0, bytelimit  = 0x7fffffff;
+        maxsize = DEFMAXSIZE, itemsread = 0, bytelimit  = 0x7fffffff,
+        ninframes = 0;
     int fd = -1;
-    char endianness, *filename;
+    char endianness, *filename, pathbuf[MAXPDSTRING], *pathptr;
+    t_float filesr = 0;
+    t_sfresampler *resampler = 0;
     t_garray *garrays[MAXSFCHANS];
-    t_word *vecs[MAXSFCHANS];
+    t_float *vecs[MAXSFCHANS];
     char sampbuf[SAMPBUFSIZE];
-    int bufframes, nitems;
+    int bufframes, nitems, stride = 1;   /* same for all arrays */
     FILE *fp;
     while (argc > 0 && argv->a_type == A_SYMBOL &&
         *argv->a_w.w_symbol->s_name == '-')
@@ -1231,12 +2692,47 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
                 ((maxsize = argv[1].a_w.w_float) < 0))
                     goto usage;
             resize = 1;     /* maxsize implies resize. */
+            gotmaxsize = 1;
             argc -= 2; argv += 2;
         }
+        else if (!strcmp(flag, "map"))
+        {
+            map = 1;
+            resize = 1;     /* ... and so does map, if we have to copy */
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "async"))
+        {
+            async = 1;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "cache"))
+        {
+            cache = 1;
+            resize = 1;     /* like "-map" */
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "resample"))
+        {
+            resample = 1;
+            if (argc > 1 && argv[1].a_type == A_FLOAT)
+            {
+                if ((quality = argv[1].a_w.w_float) < 0 ||
+                    quality > SFRESAMPLE_MAXQUALITY)
+                        goto usage;
+                argc--; argv++;
+            }
+            argc -= 1; argv += 1;
+        }
         else goto usage;
     }
     if (argc < 2 || argc > MAXSFCHANS + 1 || argv[0].a_type != A_SYMBOL)
         goto usage;
+    if (async && x->x_job)
+    {
+        pd_error(x, "soundfiler: previous -async request not finished");
+        goto done;
+    }
     filename = argv[0].a_w.w_symbol->s_name;
     argc--; argv++;
     
@@ -1251,8 +2747,8 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             pd_error(x, "%s: no such table", argv[i].a_w.w_symbol->s_name);
             goto done;
         }
-        else if (!garray_getfloatwords(garrays[i], &vecsize, 
-                &vecs[i]))
+        else if (!garray_getfloatvec(garrays[i], &vecsize, 
+                &vecs[i], &stride))
             error("%s: bad template for tabwrite",
                 argv[i].a_w.w_symbol->s_name);
         if (finalsize && finalsize != vecsize && !resize)
@@ -1262,16 +2758,148 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
         }
         finalsize = vecsize;
     }
-    fd = open_soundfile_via_canvas(x->x_canvas, filename,
-        headersize, &bytespersamp, &bigendian, &channels, &bytelimit,
-            skipframes);
-    
+    if ((fd = canvas_open(x->x_canvas, filename, "", pathbuf, &pathptr,
+        MAXPDSTRING, 1)) >= 0 && soundfile_readheader(fd, headersize,
+            &bytespersamp, &bigendian, &channels, &bytelimit, skipframes,
+                &filesr) < 0)
+    {
+        int err = errno;
+        close(fd);
+        fd = -1;
+        errno = err;
+    }
     if (fd < 0)
     {
         pd_error(x, "soundfiler_read: %s: %s", filename, (errno == EIO ?
             "unknown or bad header format" : strerror(errno)));
         goto done;
     }
+        /* if asked to, and if the file says what its rate is, make a
+        converter to ours.  Below, sizes are then in output frames except
+        for "ninframes", the number of frames to read from the file. */
+    if (resample && filesr > 0 && filesr != sys_getsr())
+    {
+        if (!(resampler = sfresampler_new(filesr, sys_getsr(), quality)))
+        {
+            pd_error(x, "soundfiler_read: out of memory");
+            goto done;
+        }
+        verbose(1, "soundfiler_read: %s: resampling from %g to %g",
+            filename, filesr, sys_getsr());
+        map = 0;
+    }
+#ifdef SFCACHE
+    if (cache)
+    {
+        char fullpath[2 * MAXPDSTRING];
+        snprintf(fullpath, 2 * MAXPDSTRING, "%s/%s", pathbuf, pathptr);
+        if ((itemsread = soundfiler_cacheread(garrays, argc, fd,
+            gensym(fullpath), skipframes, headersize, channels,
+                bytespersamp, bigendian, bytelimit,
+                    (gotmaxsize ? maxsize : 0x7fffffff), resampler,
+                        quality)) >= 0)
+        {
+            for (i = 0; i < argc; i++)
+            {
+                garray_setsaveit(garrays[i], 0);
+                garray_redraw(garrays[i]);
+            }
+            goto done;
+        }
+        verbose(1, "soundfiler_read: %s: can't cache; copying instead",
+            filename);
+        if (lseek(fd, 0, SEEK_SET) < 0 || soundfile_readheader(fd,
+            headersize, &bytespersamp, &bigendian, &channels, &bytelimit,
+                skipframes, 0) < 0)
+        {
+            pd_error(x, "soundfiler_read: %s: can't reread", filename);
+            goto done;
+        }
+        itemsread = 0;
+    }
+#endif
+        /* mapping copies nothing, so the default size limit doesn't apply */
+    if (map)
+    {
+        if ((itemsread = soundfiler_map(garrays, argc, fd, channels,
+            bytespersamp, bigendian, bytelimit,
+                (gotmaxsize ? maxsize : 0x7fffffff))) >= 0)
+        {
+            for (i = 0; i < argc; i++)
+            {
+                garray_setsaveit(garrays[i], 0);
+                garray_redraw(garrays[i]);
+            }
+            goto done;
+        }
+        verbose(1, "soundfiler_read: %s: can't map; copying instead",
+            filename);
+        itemsread = 0;
+    }
+    if (async)
+    {
+        long poswas, eofis, framesinfile, nframes;
+        t_sfjob *j;
+        poswas = lseek(fd, 0, SEEK_CUR);
+        eofis = lseek(fd, 0, SEEK_END);
+        if (poswas < 0 || eofis < poswas ||
+            lseek(fd, poswas, SEEK_SET) != poswas)
+        {
+            pd_error(x, "soundfiler_read: lseek failed");
+            goto done;
+        }
+        framesinfile = (eofis - poswas) / (channels * bytespersamp);
+        if (framesinfile > bytelimit / (channels * bytespersamp))
+            framesinfile = bytelimit / (channels * bytespersamp);
+        if (resampler)
+        {
+            ninframes = framesinfile;
+            framesinfile = sfresampler_outframes(resampler, framesinfile);
+        }
+        if (resize)
+        {
+            if (framesinfile > maxsize)
+            {
+                pd_error(x, "soundfiler_read: truncated to %ld elements",
+                    maxsize);
+                framesinfile = maxsize;
+            }
+            nframes = framesinfile;
+        }
+        else nframes = finalsize;
+        if (nframes < 1)
+            nframes = 1;
+        j = sfjob_new(0, fd, argc);
+        fd = -1;
+        for (i = 0; i < argc; i++)
+        {
+            j->j_names[i] = argv[i].a_w.w_symbol;
+            if (!(j->j_vecs[i] = garray_allocvec(garrays[i], nframes,
+                &j->j_stride)))
+            {
+                pd_error(x, "%s: bad template for soundfiler",
+                    argv[i].a_w.w_symbol->s_name);
+                sfjob_free(j);
+                goto done;
+            }
+        }
+        j->j_channels = channels;
+        j->j_bytespersamp = bytespersamp;
+        j->j_bigendian = bigendian;
+        j->j_nframes = nframes;
+        j->j_ntransfer = (framesinfile < nframes ? framesinfile : nframes);
+        j->j_resize = resize;
+        if (resampler)
+        {
+            j->j_ninframes = sfresampler_inframes(resampler, j->j_ntransfer,
+                ninframes);
+            j->j_resampler = resampler;
+            resampler = 0;
+        }
+        j->j_filesym = gensym(filename);
+        started = soundfiler_startjob(x, j);
+        goto done;
+    }
 
     if (resize)
     {
@@ -1287,13 +2915,15 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
         }
         lseek(fd, poswas, SEEK_SET);
         framesinfile = (eofis - poswas) / (channels * bytespersamp);
+        if (framesinfile > bytelimit / (channels * bytespersamp))
+            framesinfile = bytelimit / (channels * bytespersamp);
+        if (resampler)
+            framesinfile = sfresampler_outframes(resampler, framesinfile);
         if (framesinfile > maxsize)
         {
             pd_error(x, "soundfiler_read: truncated to %ld elements", maxsize);
             framesinfile = maxsize;
         }
-        if (framesinfile > bytelimit / (channels * bytespersamp))
-            framesinfile = bytelimit / (channels * bytespersamp);
         finalsize = framesinfile;
         for (i = 0; i < argc; i++)
         {
@@ -1302,8 +2932,8 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             garray_resize_long(garrays[i], finalsize);
                 /* for sanity's sake let's clear the save-in-patch flag here */
             garray_setsaveit(garrays[i], 0);
-            garray_getfloatwords(garrays[i], &vecsize, 
-                &vecs[i]);
+            garray_getfloatvec(garrays[i], &vecsize, 
+                &vecs[i], &stride);
                 /* if the resize failed, garray_resize reported the error */
             if (vecsize != framesinfile)
             {
@@ -1313,84 +2943,126 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
         }
     }
     if (!finalsize) finalsize = 0x7fffffff;
-    if (finalsize > bytelimit / (channels * bytespersamp))
-        finalsize = bytelimit / (channels * bytespersamp);
-    fp = fdopen(fd, "rb");
-    bufframes = SAMPBUFSIZE / (channels * bytespersamp);
-
-    for (itemsread = 0; itemsread < finalsize; )
-    {
-        int thisread = finalsize - itemsread;
-        thisread = (thisread > bufframes ? bufframes : thisread);
-        nitems = fread(sampbuf, channels * bytespersamp, thisread, fp);
-        if (nitems <= 0) break;
-        soundfile_xferin_float(channels, argc, (t_float **)vecs, itemsread,
-            (unsigned char *)sampbuf, nitems, bytespersamp, bigendian,
-                sizeof(t_word)/sizeof(t_sample));
-        itemsread += nitems;
+    if (resampler)
+    {
+        long poswas = lseek(fd, 0, SEEK_CUR), eofis = lseek(fd, 0, SEEK_END);
+        int err;
+        if (poswas < 0 || eofis < poswas ||
+            lseek(fd, poswas, SEEK_SET) != poswas)
+        {
+            pd_error(x, "soundfiler_read: lseek failed");
+            goto done;
+        }
+        ninframes = (eofis - poswas) / (channels * bytespersamp);
+        if (ninframes > bytelimit / (channels * bytespersamp))
+            ninframes = bytelimit / (channels * bytespersamp);
+        if (finalsize > sfresampler_outframes(resampler, ninframes))
+            finalsize = sfresampler_outframes(resampler, ninframes);
+        itemsread = soundfile_readresampled(resampler, fd, channels,
+            bytespersamp, bigendian,
+                sfresampler_inframes(resampler, finalsize, ninframes),
+                    argc, vecs, stride, finalsize, &err);
+        if (err)
+            pd_error(x, "soundfiler_read: %s: %s", filename, strerror(err));
+        fp = 0;
+    }
+    else
+    {
+        if (finalsize > bytelimit / (channels * bytespersamp))
+            finalsize = bytelimit / (channels * bytespersamp);
+        fp = fdopen(fd, "rb");
+        bufframes = SAMPBUFSIZE / (channels * bytespersamp);
+
+        for (itemsread = 0; itemsread < finalsize; )
+        {
+            int thisread = finalsize - itemsread;
+            thisread = (thisread > bufframes ? bufframes : thisread);
+            nitems = fread(sampbuf, channels * bytespersamp, thisread, fp);
+            if (nitems <= 0) break;
+            soundfile_xferin_float(channels, argc, vecs, itemsread,
+                (unsigned char *)sampbuf, nitems, bytespersamp, bigendian,
+                    stride);
+            itemsread += nitems;
+        }
     }
         /* zero out remaining elements of vectors */
         
     for (i = 0; i < argc; i++)
     {
         int nzero, vecsize;
-        garray_getfloatwords(garrays[i], &vecsize, &vecs[i]);
+        garray_getfloatvec(garrays[i], &vecsize, &vecs[i], &stride);
         for (j = itemsread; j < vecsize; j++)
-            vecs[i][j].w_float = 0;
+            vecs[i][j * stride] = 0;
     }
         /* zero out vectors in excess of number of channels */
     for (i = channels; i < argc; i++)
     {
         int vecsize;
-        t_word *foo;
-        garray_getfloatwords(garrays[i], &vecsize, &foo);
+        t_float *foo;
+        garray_getfloatvec(garrays[i], &vecsize, &foo, &stride);
         for (j = 0; j < vecsize; j++)
-            foo[j].w_float = 0;
+            foo[j * stride] = 0;
     }
         /* do all graphics updates */
     for (i = 0; i < argc; i++)
         garray_redraw(garrays[i]);
-    fclose(fp);
-    fd = -1;
+    if (fp)
+    {
+        fclose(fp);
+        fd = -1;
+    }
     goto done;
 usage:
     pd_error(x, "usage: read [flags] filename tablename...");
-    post("flags: -skip <n> -resize -maxsize <n> ...");
+    post("flags: -skip <n> -resize -maxsize <n> -map -async ...");
+    post("-resample [quality 0-3] -cache ...");
     post("-raw <headerbytes> <channels> <bytespersamp> <endian (b, l, or n)>.");
 done:
     if (fd >= 0)
         close (fd);
-    outlet_float(x->x_obj.ob_outlet, (t_float)itemsread); 
+    if (resampler)
+        sfresampler_free(resampler);
+    if (!started)   /* else the frame count is output when the job is done */
+        outlet_float(x->x_obj.ob_outlet, (t_float)itemsread); 
 }
 
     /* this is broken out from soundfiler_write below so garray_write can
-    call it too... not done yet though. */
+    call it too... not done yet though.  If "sf" is nonzero the "-async"
+    flag is allowed; if it's given, the writing is handed to a helper
+    thread and *p_started is set if that worked. */
 
-long soundfiler_dowrite(void *obj, t_canvas *canvas,
-    int argc, t_atom *argv)
+static long soundfiler_dodowrite(void *obj, t_canvas *canvas,
+    int argc, t_atom *argv, t_soundfiler *sf, int *p_started)
 {
     int headersize, bytespersamp, bigendian,
         endianness, swap, filetype, normalize, i, j, nchannels;
     long onset, nframes, itemsleft,
         maxsize = DEFMAXSIZE, itemswritten = 0;
     t_garray *garrays[MAXSFCHANS];
-    t_word *vecs[MAXSFCHANS];
+    t_float *vecs[MAXSFCHANS];
     char sampbuf[SAMPBUFSIZE];
-    int bufframes, nitems;
+    int bufframes, nitems, stride = 1;
     int fd = -1;
     t_sample normfactor, biggest = 0;
     t_float samplerate;
     t_symbol *filesym;
+    int async = 0;
 
     if (soundfiler_writeargparse(obj, &argc, &argv, &filesym, &filetype,
         &bytespersamp, &swap, &bigendian, &normalize, &onset, &nframes,
-            &samplerate))
+            &samplerate, (sf ? &async : 0), 0))
                 goto usage;
+    if (async && sf->x_job)
+    {
+        pd_error(obj, "soundfiler: previous -async request not finished");
+        goto fail;
+    }
     nchannels = argc;
     if (nchannels < 1 || nchannels > MAXSFCHANS)
         goto usage;
     if (samplerate < 0)
         samplerate = sys_getsr();
+    soundfile_unmapforwrite(canvas, filesym->s_name, filetype);
     for (i = 0; i < nchannels; i++)
     {
         int vecsize;
@@ -1402,18 +3074,22 @@ long soundfiler_dowrite(void *obj, t_canvas *canvas,
             pd_error(obj, "%s: no such table", argv[i].a_w.w_symbol->s_name);
             goto fail;
         }
-        else if (!garray_getfloatwords(garrays[i], &vecsize, &vecs[i]))
+        else if (!garray_getfloatvec(garrays[i], &vecsize, &vecs[i],
+            &stride))
+        {
             error("%s: bad template for tabwrite",
                 argv[i].a_w.w_symbol->s_name);
+            goto fail;
+        }
         if (nframes > vecsize - onset)
             nframes = vecsize - onset;
         
         for (j = 0; j < vecsize; j++)
         {
-            if (vecs[i][j].w_float > biggest)
-                biggest = vecs[i][j].w_float;
-            else if (-vecs[i][j].w_float > biggest)
-                biggest = -vecs[i][j].w_float;
+            if (vecs[i][j * stride] > biggest)
+                biggest = vecs[i][j * stride];
+            else if (-vecs[i][j * stride] > biggest)
+                biggest = -vecs[i][j * stride];
         }
     }
     if (nframes <= 0)
@@ -1442,15 +3118,41 @@ long soundfiler_dowrite(void *obj, t_canvas *canvas,
         normfactor = (biggest > 0 ? 32767./(32768. * biggest) : 1);
     else normfactor = 1;
 
+    if (async)
+    {
+            /* copy the samples out now; the tables might change later */
+        t_sfjob *job = sfjob_new(1, fd, nchannels);
+        fd = -1;
+        job->j_channels = nchannels;
+        job->j_bytespersamp = bytespersamp;
+        job->j_bigendian = bigendian;
+        job->j_stride = 1;
+        job->j_nframes = job->j_ntransfer = nframes;
+        job->j_normfactor = normfactor;
+        job->j_filetype = filetype;
+        job->j_swap = swap;
+        job->j_filesym = filesym;
+        for (i = 0; i < nchannels; i++)
+        {
+            t_float *fp = job->j_vecs[i] =
+                (t_float *)getbytes(nframes * sizeof(t_float)),
+                    *from = vecs[i] + onset * stride;
+            job->j_names[i] = argv[i].a_w.w_symbol;
+            for (j = 0; j < nframes; j++, from += stride)
+                fp[j] = *from;
+        }
+        *p_started = soundfiler_startjob(sf, job);
+        return (0);
+    }
+
     bufframes = SAMPBUFSIZE / (nchannels * bytespersamp);
 
     for (itemswritten = 0; itemswritten < nframes; )
     {
         int thiswrite = nframes - itemswritten, nitems, nbytes;
         thiswrite = (thiswrite > bufframes ? bufframes : thiswrite);
-        soundfile_xferout_float(argc, (t_float **)vecs, (unsigned char *)sampbuf,
-            thiswrite, onset, bytespersamp, bigendian, normfactor,
-                 sizeof(t_word)/sizeof(t_sample));
+        soundfile_xferout_float(argc, vecs, (unsigned char *)sampbuf,
+            thiswrite, onset, bytespersamp, bigendian, normfactor, stride);
         nbytes = write(fd, sampbuf, nchannels * bytespersamp * thiswrite);
         if (nbytes < nchannels * bytespersamp * thiswrite)
         {
@@ -1460,7 +3162,7 @@ long soundfiler_dowrite(void *obj, t_canvas *canvas,
             break;
         }
         itemswritten += thiswrite;
-        onset += thiswrite * (sizeof(t_word)/sizeof(float));
+        onset += thiswrite;
     }
     if (fd >= 0)
     {
@@ -1471,8 +3173,8 @@ long soundfiler_dowrite(void *obj, t_canvas *canvas,
     return ((float)itemswritten); 
 usage:
     pd_error(obj, "usage: write [flags] filename tablename...");
-    post("flags: -skip <n> -nframes <n> -bytes <n> -wave -aiff -nextstep ...");
-    post("-big -little -normalize");
+    post("flags: -skip <n> -nframes <n> -bytes <n> -wave -rf64 -aiff -nextstep ...");
+    post("-big -little -normalize -async");
     post("(defaults to a 16-bit wave file).");
 fail:
     if (fd >= 0)
@@ -1480,22 +3182,34 @@ fail:
     return (0); 
 }
 
+long soundfiler_dowrite(void *obj, t_canvas *canvas,
+    int argc, t_atom *argv)
+{
+    return (soundfiler_dodowrite(obj, canvas, argc, argv, 0, 0));
+}
+
 static void soundfiler_write(t_soundfiler *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    long bozo = soundfiler_dowrite(x, x->x_canvas,
-        argc, argv);
-    outlet_float(x->x_obj.ob_outlet, (t_float)bozo); 
+    int started = 0;
+    long bozo = soundfiler_dodowrite(x, x->x_canvas,
+        argc, argv, x, &started);
+    if (!started)   /* else the frame count is output when the job is done */
+        outlet_float(x->x_obj.ob_outlet, (t_float)bozo); 
 }
 
 static void soundfiler_setup(void)
 {
     soundfiler_class = class_new(gensym("soundfiler"), (t_newmethod)soundfiler_new, 
-        0, sizeof(t_soundfiler), 0, 0);
+        (t_method)soundfiler_free, sizeof(t_soundfiler), 0, 0);
     class_addmethod(soundfiler_class, (t_method)soundfiler_read, gensym("read"), 
         A_GIMME, 0);
     class_addmethod(soundfiler_class, (t_method)soundfiler_write,
         gensym("write"), A_GIMME, 0);
+    class_addmethod(soundfiler_class, (t_method)soundfiler_cacheinfo,
+        gensym("cache-info"), 0);
+    class_addmethod(soundfiler_class, (t_method)soundfiler_cacheclear,
+        gensym("cache-clear"), A_DEFSYM, 0);
 }
 
 
@@ -1504,21 +3218,44 @@ static void soundfiler_setup(void)
 /* READSF uses the Posix threads package; for the moment we're Linux
 only although this should be portable to the other platforms.
 
-Each instance of readsf~ owns a "child" thread for doing the unix (MSW?) file
-reading.  The parent thread signals the child each time:
+All readsf~ and writesf~ instances share a small pool of "disk" threads
+(two unless the "-diskthreads" flag says otherwise) instead of each owning
+one.  The parent thread signals the pool each time:
     (1) a file wants opening or closing;
-    (2) we've eaten another 1/16 of the shared buffer (so that the
-        child thread should check if it's time to read some more.)
-The child signals the parent whenever a read has completed.  Signalling
-is done by setting "conditions" and putting data in mutex-controlled common
-areas.
+    (2) we've eaten (or, for writesf~, filled) another 1/16 of an
+        object's buffer, so that it might be time to read or write more.
+A disk thread that wakes up looks at all the objects and serves the one
+whose buffer will run dry (or full) first, reading or writing as much of
+it as fits in one contiguous transfer; then it looks again.  A stream is
+only ever served by one thread at a time.
+
+One mutex protects the state of all the objects, but the DSP routines
+never take it, since that would let the disk hold up the audio thread.
+Each object's buffer is a single-producer, single-consumer ring: the
+producer (the disk thread for readsf~, the perform routine for writesf~)
+owns the head and the consumer owns the tail, and each side publishes its
+own index with a release store after touching the data, and reads the
+other's with an acquire load.  When the data isn't there in time, readsf~
+outputs silence and writesf~ drops its input; either way they count an
+"underrun" and carry on.  The perform routines wake the disk threads
+with a non-blocking write to an eventfd (elsewhere, a condition variable
+the threads also poll), so they never wait on the disk threads; the
+methods that open and close files still do that, via "sfio_answercondition".
+
+All that is only for real-time scheduling.  When no audio device is open
+(as under "pd -batch", which never opens one) nothing is lost by waiting,
+and DSP may run much faster than the disk; so then the perform routines
+wait on "sfio_answercondition" for the disk threads, and the output is the
+same however fast the disk is.
 */
 
 #define MAXBYTESPERSAMPLE 4
 #define MAXVECSIZE 128
 
-#define READSIZE 65536
-#define WRITESIZE 65536
+#define READSIZE 65536          /* smallest read worth waking up for */
+#define WRITESIZE 65536         /* smallest write ditto */
+#define MAXXFERSIZE 1048576     /* largest single read or write */
+#define XFERALIGN 4096          /* keep file offsets aligned to this */
 #define DEFBUFPERCHAN 262144
 #define MINBUFSIZE (4 * READSIZE)
 #define MAXBUFSIZE 16777216     /* arbitrary; just don't want to hang malloc */
@@ -1533,6 +3270,20 @@ areas.
 #define STATE_STARTUP 1
 #define STATE_STREAM 2
 
+#define SFIO_MAXTHREADS 16
+#define HEADERUPDATESECS 2      /* writesf~ rewrites the header this often */
+
+    /* atomic access to the fifo indices and the eof flag */
+#if defined(__GNUC__)
+#define SFIO_LOAD(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define SFIO_STORE(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#else   /* MSVC gives volatile accesses acquire and release semantics */
+#define SFIO_LOAD(p) (*(volatile int *)&(p))
+#define SFIO_STORE(p, v) (*(volatile int *)&(p) = (v))
+#endif
+
+int sys_diskthreads = 2;
+
 static t_class *readsf_class;
 
 typedef struct _readsf
@@ -1548,7 +3299,7 @@ typedef struct _readsf
     t_outlet *x_bangout;                    /* bang-on-done outlet */
     int x_state;                            /* opened, running, or idle */
     t_float x_insamplerate;   /* sample rate of input signal if known */
-        /* parameters to communicate with subthread */
+        /* parameters to communicate with the disk threads */
     int x_requestcode;      /* pending request from parent to I/O thread */
     char *x_filename;       /* file to open (string is permanently allocated) */
     int x_fileerror;        /* slot for "errno" return */
@@ -1560,6 +3311,7 @@ typedef struct _readsf
     long x_onsetframes;     /* number of sample frames to skip */
     long x_bytelimit;       /* max number of data bytes to read */
     int x_fd;               /* filedesc */
+    off_t x_filepos;        /* file offset of the next transfer */
     int x_fifosize;         /* buffer size appropriately rounded down */            
     int x_fifohead;         /* index of next byte to get from file */
     int x_fifotail;         /* index of next byte the ugen will read */
@@ -1567,17 +3319,97 @@ typedef struct _readsf
     int x_sigcountdown;     /* counter for signalling child for more data */
     int x_sigperiod;        /* number of ticks per signal */
     int x_filetype;         /* writesf~ only; type of file to create */
-    int x_itemswritten;     /* writesf~ only; items writen */
+    int64_t x_byteswritten; /* writesf~ only; data bytes written */
+    int64_t x_nextheader;   /* writesf~ only; when to update header next */
+    int64_t x_headerperiod; /* writesf~ only; bytes between updates */
+    int64_t x_nextsync;     /* writesf~ only; when to fdatasync() next */
+    int64_t x_syncperiod;   /* writesf~ only; bytes between syncs, or 0 */
+    off_t x_prealloc;       /* writesf~ only; bytes to allocate ahead */
+    off_t x_allocend;       /* writesf~ only; end of space allocated */
+    int x_direct;           /* writesf~ only; try O_DIRECT writes */
+    char *x_directbuf;      /* writesf~ only; aligned buffer for those */
     int x_swap;             /* writesf~ only; true if byte swapping */
     t_float x_f;              /* writesf~ only; scalar for signal inlet */
-    pthread_mutex_t x_mutex;
-    pthread_cond_t x_requestcondition;
-    pthread_cond_t x_answercondition;
-    pthread_t x_childthread;
+    int x_writer;           /* true for writesf~ */
+    int x_busy;             /* true while a disk thread is serving us */
+    int x_underruns;        /* DSP ticks the disk didn't keep up with */
+    int x_primed;           /* readsf~ only; true once data has come out */
+    struct _readsf *x_next; /* next in list of all readsf~ and writesf~ */
 } t_readsf;
 
+/************** the disk threads which perform file I/O ***********/
+
+static pthread_mutex_t sfio_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sfio_answercondition = PTHREAD_COND_INITIALIZER;
+static t_readsf *sfio_list;      /* all readsf~ and writesf~ objects */
+static int sfio_nthreads;
+
+    /* Wake a disk thread up.  This never blocks and so can be called from
+    the DSP routines, without the mutex.  sfio_sleep() is called by a disk
+    thread, with the mutex locked, when it finds nothing to do. */
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <stdint.h>
+
+static int sfio_eventfd = -1;
+
+static int sfio_initwakeup(void)
+{
+    return ((sfio_eventfd = eventfd(0, EFD_CLOEXEC)) >= 0);
+}
+
+static void sfio_wakeup(void)
+{
+    uint64_t one = 1;
+    if (write(sfio_eventfd, &one, sizeof(one)) < 0)
+        return;     /* can only fail if the counter overflows */
+}
+
+static void sfio_sleep(void)
+{
+    uint64_t count;
+    pthread_mutex_unlock(&sfio_mutex);
+    if (read(sfio_eventfd, &count, sizeof(count)) < 0)
+        sched_yield();
+    pthread_mutex_lock(&sfio_mutex);
+}
+
+#else /* __linux__ */
+#include <sys/time.h>
+
+    /* Signalling without holding the mutex can be missed by a thread that
+    is just about to wait, so the threads look again every 10 msec. */
+static pthread_cond_t sfio_requestcondition = PTHREAD_COND_INITIALIZER;
+
+static int sfio_initwakeup(void)
+{
+    return (1);
+}
+
+static void sfio_wakeup(void)
+{
+    pthread_cond_signal(&sfio_requestcondition);
+}
+
+static void sfio_sleep(void)
+{
+    struct timeval now;
+    struct timespec until;
+    gettimeofday(&now, 0);
+    until.tv_sec = now.tv_sec;
+    until.tv_nsec = now.tv_usec * 1000 + 10000000;
+    if (until.tv_nsec >= 1000000000)
+        until.tv_sec++, until.tv_nsec -= 1000000000;
+    pthread_cond_timedwait(&sfio_requestcondition, &sfio_mutex, &until);
+}
+#endif /* __linux__ */
 
-/************** the child thread which performs file I/O ***********/
+    /* true if the perform routines should wait for the disk threads rather
+    than lose data; see above. */
+static int sfio_mustwait(void)
+{
+    return (!audio_isopen());
+}
 
 #if 0
 static void pute(char *s)   /* debug routine */
@@ -1589,7 +3421,6 @@ static void pute(char *s)   /* debug routine */
 
 #if 1
 #define sfread_cond_wait pthread_cond_wait
-#define sfread_cond_signal pthread_cond_signal
 #else
 #include <sys/time.h>    /* debugging version... */
 #include <sys/types.h>
@@ -1603,295 +3434,558 @@ static void readsf_fakewait(pthread_mutex_t *b)
     pthread_mutex_lock(b);
 }
 
-#define sfread_cond_wait(a,b) readsf_fakewait(b)
-#define sfread_cond_signal(a) 
+#define sfread_cond_wait(a,b) readsf_fakewait(b)
+#endif
+
+    /* shorten a transfer so that it ends on an aligned file offset, if
+    that leaves anything to transfer. */
+static int sfio_align(off_t filepos, int nbytes)
+{
+    int over = (filepos + nbytes) % XFERALIGN;
+    return (nbytes > over ? nbytes - over : nbytes);
+}
+
+    /* number of bytes readsf~ can read in one go right now, or 0 if it
+    isn't worth doing yet.  Called with the mutex locked.  If the tail is
+    at zero we hold back READSIZE bytes so the fifo never fills up (you
+    couldn't tell full from empty); otherwise we read up to the end of the
+    fifo and wrap around. */
+static int readsf_wantbytes(t_readsf *x)
+{
+    int wantbytes, fifotail = SFIO_LOAD(x->x_fifotail);
+    if (x->x_fifohead >= fifotail && fifotail)
+        wantbytes = x->x_fifosize - x->x_fifohead;
+    else
+    {
+        if (x->x_fifohead >= fifotail)
+            wantbytes = x->x_fifosize - x->x_fifohead - READSIZE;
+        else wantbytes = fifotail - x->x_fifohead - 1;
+        if (wantbytes < READSIZE)
+            return (0);
+    }
+    if (wantbytes > MAXXFERSIZE)
+        wantbytes = MAXXFERSIZE;
+    if (wantbytes > XFERALIGN)
+        wantbytes = sfio_align(x->x_filepos, wantbytes);
+    if (wantbytes > x->x_bytelimit)
+        wantbytes = x->x_bytelimit;
+    return (wantbytes > 0 ? wantbytes : 0);
+}
+
+    /* same for writesf~: how much can be written in one go.  We hold off
+    until there are WRITESIZE bytes unless the file is being closed. */
+static int writesf_wantbytes(t_readsf *x)
+{
+    int wantbytes, fifohead = SFIO_LOAD(x->x_fifohead);
+    if (fifohead < x->x_fifotail)
+        wantbytes = x->x_fifosize - x->x_fifotail;
+    else if ((wantbytes = fifohead - x->x_fifotail) < WRITESIZE &&
+        x->x_requestcode != REQUEST_CLOSE)
+            return (0);
+    if (wantbytes > MAXXFERSIZE)
+        wantbytes = MAXXFERSIZE;
+    if (wantbytes > XFERALIGN)
+        wantbytes = sfio_align(x->x_filepos, wantbytes);
+    return (wantbytes);
+}
+
+    /* Decide whether an object needs a disk thread's attention.  Returns
+    -1 if not; otherwise the number of sample frames before its buffer runs
+    dry (or full, for writesf~), which is how urgent the work is.  Opening
+    and closing files come first of all. */
+static double sfio_urgency(t_readsf *x)
+{
+    int bytesperframe = x->x_bytespersample * x->x_sfchannels, inbuf;
+    if (x->x_busy || x->x_requestcode == REQUEST_NOTHING)
+        return (-1);
+    if (x->x_requestcode != REQUEST_BUSY &&
+        !(x->x_writer && x->x_requestcode == REQUEST_CLOSE &&
+            x->x_fd >= 0 &&
+                SFIO_LOAD(x->x_fifohead) != SFIO_LOAD(x->x_fifotail)))
+                    return (0);
+    if (x->x_fifosize <= 0)
+        return (0);
+    inbuf = SFIO_LOAD(x->x_fifohead) - SFIO_LOAD(x->x_fifotail);
+    if (inbuf < 0)
+        inbuf += x->x_fifosize;
+    if (x->x_writer)
+        return (writesf_wantbytes(x) ?
+            (double)(x->x_fifosize - inbuf) / bytesperframe + 1 : -1);
+    else if (x->x_eof || x->x_fileerror || x->x_bytelimit <= 0)
+        return (0);     /* nothing more to read; go close the file */
+    else return (readsf_wantbytes(x) ?
+        (double)inbuf / bytesperframe + 1 : -1);
+}
+
+    /* close the file of a readsf~.  Called, and returns, with the mutex
+    locked. */
+static void readsf_closefile(t_readsf *x)
+{
+    if (x->x_fd >= 0)
+    {
+        int fd = x->x_fd;
+        x->x_fd = -1;
+        pthread_mutex_unlock(&sfio_mutex);
+        close (fd);
+        pthread_mutex_lock(&sfio_mutex);
+    }
+}
+
+    /* do the next piece of work for a readsf~: open a file, read one
+    chunk, or close the file. */
+static void readsf_iostep(t_readsf *x)
+{
+    int fd;
+    if (x->x_requestcode == REQUEST_OPEN)
+    {
+            /* copy file stuff out of the data structure so we can
+            relinquish the mutex while we're in open_soundfile(). */
+        long onsetframes = x->x_onsetframes;
+        long bytelimit = 0x7fffffff;
+        int skipheaderbytes = x->x_skipheaderbytes;
+        int bytespersample = x->x_bytespersample;
+        int sfchannels = x->x_sfchannels;
+        int bigendian = x->x_bigendian;
+        char *filename = x->x_filename;
+        char *dirname = canvas_getdir(x->x_canvas)->s_name;
+            /* alter the request code so that an ensuing "open" will get
+            noticed. */
+        x->x_requestcode = REQUEST_BUSY;
+        x->x_fileerror = 0;
+
+            /* if there's already a file open, close it */
+        readsf_closefile(x);
+        if (x->x_requestcode != REQUEST_BUSY)
+            return;
+            /* open the soundfile with the mutex unlocked */
+        pthread_mutex_unlock(&sfio_mutex);
+        fd = open_soundfile(dirname, filename,
+            skipheaderbytes, &bytespersample, &bigendian,
+            &sfchannels, &bytelimit, onsetframes);
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (fd >= 0)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        pthread_mutex_lock(&sfio_mutex);
+
+            /* copy back into the instance structure. */
+        x->x_bytespersample = bytespersample;
+        x->x_sfchannels = sfchannels;
+        x->x_bigendian = bigendian;
+        x->x_fd = fd;
+        x->x_bytelimit = bytelimit;
+        if (fd < 0)
+        {
+            x->x_fileerror = errno;
+            SFIO_STORE(x->x_eof, 1);
+#ifdef DEBUG_SOUNDFILE
+            pute("open failed\n");
+            pute(filename);
+            pute(dirname);
+#endif
+            if (x->x_requestcode == REQUEST_BUSY)
+                x->x_requestcode = REQUEST_NOTHING;
+            return;
+        }
+            /* if another request has been made, we'll field it next time */
+        if (x->x_requestcode != REQUEST_BUSY)
+            return;
+        x->x_filepos = lseek(fd, 0, SEEK_CUR);
+        SFIO_STORE(x->x_fifohead, 0);
+                /* set fifosize from bufsize.  fifosize must be a
+                multiple of the number of bytes eaten for each DSP
+                tick.  We pessimistically assume MAXVECSIZE samples
+                per tick since that could change.  There could be a
+                problem here if the vector size increases while a
+                soundfile is being played...  */
+        x->x_fifosize = x->x_bufsize - (x->x_bufsize %
+            (x->x_bytespersample * x->x_sfchannels * MAXVECSIZE));
+                /* arrange for the disk threads to be woken 16 times per
+                buffer.  The perform routine picks this up once the first
+                data arrives. */
+        x->x_sigperiod =
+            (x->x_fifosize /
+                (16 * x->x_bytespersample * x->x_sfchannels *
+                    x->x_vecsize));
+    }
+    else if (x->x_requestcode == REQUEST_BUSY)
+    {
+        int wantbytes, fifohead, sysrtn;
+        char *buf;
+        if (x->x_eof || x->x_fileerror || !(wantbytes = readsf_wantbytes(x)))
+        {
+                /* fell out of read loop: close file.  The parent sees
+                EOF and drains what's left in the fifo. */
+            SFIO_STORE(x->x_eof, 1);
+            x->x_requestcode = REQUEST_NOTHING;
+            readsf_closefile(x);
+            return;
+        }
+        fd = x->x_fd;
+        buf = x->x_buf;
+        fifohead = x->x_fifohead;
+        pthread_mutex_unlock(&sfio_mutex);
+        sysrtn = read(fd, buf + fifohead, wantbytes);
+        pthread_mutex_lock(&sfio_mutex);
+        if (x->x_requestcode != REQUEST_BUSY)
+            return;
+        if (sysrtn < 0)
+        {
+            x->x_fileerror = errno;
+            SFIO_STORE(x->x_eof, 1);
+        }
+        else if (sysrtn == 0)
+            SFIO_STORE(x->x_eof, 1);
+        else
+        {
+                /* publish the new data to the perform routine */
+            x->x_filepos += sysrtn;
+            x->x_bytelimit -= sysrtn;
+            if ((fifohead += sysrtn) == x->x_fifosize)
+                fifohead = 0;
+            SFIO_STORE(x->x_fifohead, fifohead);
+            if (x->x_bytelimit <= 0)
+                SFIO_STORE(x->x_eof, 1);
+        }
+#ifdef DEBUG_SOUNDFILE
+        {
+            char boo[80];
+            sprintf(boo, "after: head %d, tail %d\n",
+                x->x_fifohead, x->x_fifotail);
+            pute(boo);
+        }
+#endif
+    }
+    else if (x->x_requestcode == REQUEST_CLOSE ||
+        x->x_requestcode == REQUEST_QUIT)
+    {
+        int code = x->x_requestcode;
+        readsf_closefile(x);
+        if (x->x_requestcode == code)
+            x->x_requestcode = REQUEST_NOTHING;
+    }
+}
+
+    /* flush a file's data, if not necessarily all its metadata, to disk */
+static int sfio_datasync(int fd)
+{
+#if defined(_WIN32)
+    return (_commit(fd));
+#elif defined(__linux__)
+    return (fdatasync(fd));
+#else
+    return (fsync(fd));
+#endif
+}
+
+    /* reserve disk space for a file without changing its size, so that
+    growing it later doesn't have to wait for the file system to find
+    room.  Only Linux can do this; elsewhere it does nothing. */
+static void sfio_preallocate(int fd, off_t onset, off_t nbytes)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, onset, nbytes) < 0)
+        return;     /* not supported here; no harm done */
 #endif
+}
 
-static void *readsf_child_main(void *zz)
+    /* Write a chunk of a writesf~ object's fifo at the current file
+    position.  If "-direct" was asked for and the transfer is aligned, it
+    is copied to an aligned buffer and written around the page cache;
+    headers and odd-sized pieces always go through the cache.  Called by
+    the disk thread with the mutex unlocked. */
+static int writesf_write(t_readsf *x, int fd, char *buf, int nbytes,
+    off_t filepos)
 {
-    t_readsf *x = zz;
-#ifdef DEBUG_SOUNDFILE
-    pute("1\n");
-#endif
-    pthread_mutex_lock(&x->x_mutex);
-    while (1)
+        /* keep the space allocated ahead of us */
+    while (x->x_prealloc && filepos + nbytes + x->x_prealloc / 2 >
+        x->x_allocend)
     {
-        int fd, fifohead;
-        char *buf;
-#ifdef DEBUG_SOUNDFILE
-        pute("0\n");
-#endif
-        if (x->x_requestcode == REQUEST_NOTHING)
+        sfio_preallocate(fd, x->x_allocend, x->x_prealloc);
+        x->x_allocend += x->x_prealloc;
+    }
+#ifdef O_DIRECT
+    if (x->x_direct && x->x_directbuf &&
+        !(filepos % XFERALIGN) && !(nbytes % XFERALIGN))
+    {
+        int flags = fcntl(fd, F_GETFL), rtn;
+        if (flags >= 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) >= 0)
         {
-#ifdef DEBUG_SOUNDFILE
-            pute("wait 2\n");
-#endif
-            sfread_cond_signal(&x->x_answercondition);
-            sfread_cond_wait(&x->x_requestcondition, &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-            pute("3\n");
-#endif
+            memcpy(x->x_directbuf, buf, nbytes);
+            rtn = write(fd, x->x_directbuf, nbytes);
+            fcntl(fd, F_SETFL, flags);
+            if (rtn >= 0 || errno != EINVAL)
+                return (rtn);
         }
-        else if (x->x_requestcode == REQUEST_OPEN)
-        {
-            char boo[80];
-            int sysrtn, wantbytes;
-            
-                /* copy file stuff out of the data structure so we can
-                relinquish the mutex while we're in open_soundfile(). */
-            long onsetframes = x->x_onsetframes;
-            long bytelimit = 0x7fffffff;
-            int skipheaderbytes = x->x_skipheaderbytes;
-            int bytespersample = x->x_bytespersample;
-            int sfchannels = x->x_sfchannels;
-            int bigendian = x->x_bigendian;
-            char *filename = x->x_filename;
-            char *dirname = canvas_getdir(x->x_canvas)->s_name;
-                /* alter the request code so that an ensuing "open" will get
-                noticed. */
-#ifdef DEBUG_SOUNDFILE
-            pute("4\n");
+            /* the file system can't do it; stop trying */
+        x->x_direct = 0;
+    }
 #endif
-            x->x_requestcode = REQUEST_BUSY;
-            x->x_fileerror = 0;
-
-                /* if there's already a file open, close it */
-            if (x->x_fd >= 0)
-            {
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                close (fd);
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-                if (x->x_requestcode != REQUEST_BUSY)
-                    goto lost;
-            }
-                /* open the soundfile with the mutex unlocked */
-            pthread_mutex_unlock(&x->x_mutex);
-            fd = open_soundfile(dirname, filename,
-                skipheaderbytes, &bytespersample, &bigendian,
-                &sfchannels, &bytelimit, onsetframes);      
-            pthread_mutex_lock(&x->x_mutex);
+    return (write(fd, buf, nbytes));
+}
 
-#ifdef DEBUG_SOUNDFILE
-            pute("5\n");
-#endif
-                /* copy back into the instance structure. */
-            x->x_bytespersample = bytespersample;
-            x->x_sfchannels = sfchannels;
-            x->x_bigendian = bigendian;
-            x->x_fd = fd;
-            x->x_bytelimit = bytelimit;
-            if (fd < 0)
-            {
-                x->x_fileerror = errno;
-                x->x_eof = 1;
-#ifdef DEBUG_SOUNDFILE
-                pute("open failed\n");
-                pute(filename);
-                pute(dirname);
-#endif
-                goto lost;
-            }
-                /* check if another request has been made; if so, field it */
-            if (x->x_requestcode != REQUEST_BUSY)
-                goto lost;
-#ifdef DEBUG_SOUNDFILE
-            pute("6\n");
-#endif
-            x->x_fifohead = 0;
-                    /* set fifosize from bufsize.  fifosize must be a
-                    multiple of the number of bytes eaten for each DSP
-                    tick.  We pessimistically assume MAXVECSIZE samples
-                    per tick since that could change.  There could be a
-                    problem here if the vector size increases while a
-                    soundfile is being played...  */
-            x->x_fifosize = x->x_bufsize - (x->x_bufsize %
-                (x->x_bytespersample * x->x_sfchannels * MAXVECSIZE));
-                    /* arrange for the "request" condition to be signalled 16
-                    times per buffer */
-#ifdef DEBUG_SOUNDFILE
-            sprintf(boo, "fifosize %d\n", 
-                x->x_fifosize);
-            pute(boo);
+    /* update the header of, and close, the file of a writesf~.  Called,
+    and returns, with the mutex locked. */
+static void writesf_closefile(t_readsf *x)
+{
+    if (x->x_fd >= 0)
+    {
+        int bytesperframe = x->x_bytespersample * x->x_sfchannels;
+        char *filename = x->x_filename;
+        int fd = x->x_fd;
+        int filetype = x->x_filetype;
+        int64_t itemswritten = x->x_byteswritten / bytesperframe;
+        int swap = x->x_swap, sync = (x->x_syncperiod > 0);
+        off_t filepos = x->x_filepos, allocend = x->x_allocend;
+        x->x_fd = -1;
+        pthread_mutex_unlock(&sfio_mutex);
+
+        if (soundfile_updateheader(fd, filetype, itemswritten,
+            bytesperframe, swap))
+                post("%s: %s", filename, strerror(errno));
+#ifdef __linux__
+            /* give back any space allocated past the end */
+        if (allocend > filepos && ftruncate(fd, filepos) < 0)
+            post("%s: %s", filename, strerror(errno));
 #endif
-            x->x_sigcountdown = x->x_sigperiod =
-                (x->x_fifosize /
-                    (16 * x->x_bytespersample * x->x_sfchannels *
-                        x->x_vecsize));
-                /* in a loop, wait for the fifo to get hungry and feed it */
+        if (sync)
+            sfio_datasync(fd);
+        close (fd);
 
-            while (x->x_requestcode == REQUEST_BUSY)
-            {
-                int fifosize = x->x_fifosize;
-#ifdef DEBUG_SOUNDFILE
-                pute("77\n");
-#endif
-                if (x->x_eof)
-                    break;
-                if (x->x_fifohead >= x->x_fifotail)
-                {
-                        /* if the head is >= the tail, we can immediately read
-                        to the end of the fifo.  Unless, that is, we would
-                        read all the way to the end of the buffer and the 
-                        "tail" is zero; this would fill the buffer completely
-                        which isn't allowed because you can't tell a completely
-                        full buffer from an empty one. */
-                    if (x->x_fifotail || (fifosize - x->x_fifohead > READSIZE))
-                    {
-                        wantbytes = fifosize - x->x_fifohead;
-                        if (wantbytes > READSIZE)
-                            wantbytes = READSIZE;
-                        if (wantbytes > x->x_bytelimit)
-                            wantbytes = x->x_bytelimit;
-#ifdef DEBUG_SOUNDFILE
-                        sprintf(boo, "head %d, tail %d, size %d\n", 
-                            x->x_fifohead, x->x_fifotail, wantbytes);
-                        pute(boo);
-#endif
-                    }
-                    else
-                    {
-#ifdef DEBUG_SOUNDFILE
-                        pute("wait 7a ...\n");
-#endif
-                        sfread_cond_signal(&x->x_answercondition);
-#ifdef DEBUG_SOUNDFILE
-                        pute("signalled\n");
-#endif
-                        sfread_cond_wait(&x->x_requestcondition,
-                            &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-                        pute("7a done\n");
-#endif
-                        continue;
-                    }
-                }
-                else
-                {
-                        /* otherwise check if there are at least READSIZE
-                        bytes to read.  If not, wait and loop back. */
-                    wantbytes =  x->x_fifotail - x->x_fifohead - 1;
-                    if (wantbytes < READSIZE)
-                    {
-#ifdef DEBUG_SOUNDFILE
-                        pute("wait 7...\n");
-#endif
-                        sfread_cond_signal(&x->x_answercondition);
-                        sfread_cond_wait(&x->x_requestcondition,
-                            &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-                        pute("7 done\n");
-#endif
-                        continue;
-                    }
-                    else wantbytes = READSIZE;
-                    if (wantbytes > x->x_bytelimit)
-                        wantbytes = x->x_bytelimit;
-                }
-#ifdef DEBUG_SOUNDFILE
-                pute("8\n");
-#endif
-                fd = x->x_fd;
-                buf = x->x_buf;
-                fifohead = x->x_fifohead;
-                pthread_mutex_unlock(&x->x_mutex);
-                sysrtn = read(fd, buf + fifohead, wantbytes);
-                pthread_mutex_lock(&x->x_mutex);
-                if (x->x_requestcode != REQUEST_BUSY)
-                    break;
-                if (sysrtn < 0)
-                {
-#ifdef DEBUG_SOUNDFILE
-                    pute("fileerror\n");
-#endif
-                    x->x_fileerror = errno;
-                    break;
-                }
-                else if (sysrtn == 0)
-                {
-                    x->x_eof = 1;
-                    break;
-                }
-                else
-                {
-                    x->x_fifohead += sysrtn;
-                    x->x_bytelimit -= sysrtn;
-                    if (x->x_fifohead == fifosize)
-                        x->x_fifohead = 0;
-                    if (x->x_bytelimit <= 0)
-                    {
-                        x->x_eof = 1;
-                        break;
-                    }
-                }
+        pthread_mutex_lock(&sfio_mutex);
+    }
+}
+
+    /* do the next piece of work for a writesf~: create a file, write one
+    chunk, or finish the file. */
+static void writesf_iostep(t_readsf *x)
+{
+    int fd;
+    if (x->x_requestcode == REQUEST_OPEN)
+    {
+            /* copy file stuff out of the data structure so we can
+            relinquish the mutex while we're in create_soundfile(). */
+        int bytespersample = x->x_bytespersample;
+        int sfchannels = x->x_sfchannels;
+        int bigendian = x->x_bigendian;
+        int filetype = x->x_filetype;
+        char *filename = x->x_filename;
+        t_canvas *canvas = x->x_canvas;
+        t_float samplerate = x->x_samplerate;
+
+            /* alter the request code so that an ensuing "open" will get
+            noticed. */
+        x->x_requestcode = REQUEST_BUSY;
+        x->x_fileerror = 0;
+
+            /* if there's already a file open, close it.  This
+            should never happen since writesf_open() calls stop if
+            needed and then waits until we're idle. */
+        writesf_closefile(x);
+        if (x->x_requestcode != REQUEST_BUSY)
+            return;
+            /* open the soundfile with the mutex unlocked */
+        pthread_mutex_unlock(&sfio_mutex);
+        fd = create_soundfile(canvas, filename, filetype, 0,
+                bytespersample, bigendian, sfchannels, 
+                    garray_ambigendian() != bigendian, samplerate);
+        pthread_mutex_lock(&sfio_mutex);
+
+        if (fd < 0)
+        {
+            x->x_fd = -1;
+            x->x_fileerror = errno;
+            SFIO_STORE(x->x_eof, 1);
 #ifdef DEBUG_SOUNDFILE
-                sprintf(boo, "after: head %d, tail %d\n", 
-                    x->x_fifohead, x->x_fifotail);
-                pute(boo);
+            pute("open failed\n");
+            pute(filename);
 #endif
-                    /* signal parent in case it's waiting for data */
-                sfread_cond_signal(&x->x_answercondition);
-            }
-        lost:
-
             if (x->x_requestcode == REQUEST_BUSY)
                 x->x_requestcode = REQUEST_NOTHING;
-                /* fell out of read loop: close file if necessary,
-                set EOF and signal once more */
-            if (x->x_fd >= 0)
-            {
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                close (fd);
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-            }
-            sfread_cond_signal(&x->x_answercondition);
-
+            return;
         }
-        else if (x->x_requestcode == REQUEST_CLOSE)
+        x->x_fd = fd;
+        x->x_filepos = x->x_allocend = lseek(fd, 0, SEEK_CUR);
+        x->x_byteswritten = 0;
+        x->x_swap = garray_ambigendian() != bigendian;      
+#ifdef O_DIRECT
+        if (x->x_direct && !x->x_directbuf)
         {
-            if (x->x_fd >= 0)
-            {
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                close (fd);
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-            }
-            if (x->x_requestcode == REQUEST_CLOSE)
-                x->x_requestcode = REQUEST_NOTHING;
-            sfread_cond_signal(&x->x_answercondition);
+            void *mem;
+            if (!posix_memalign(&mem, XFERALIGN, MAXXFERSIZE))
+                x->x_directbuf = mem;
         }
-        else if (x->x_requestcode == REQUEST_QUIT)
+#endif
+    }
+    else if (x->x_requestcode == REQUEST_BUSY ||
+        (x->x_requestcode == REQUEST_CLOSE && x->x_fd >= 0 &&
+            SFIO_LOAD(x->x_fifohead) != x->x_fifotail))
+    {
+            /* write what's in the fifo to disk.  On "close" we flush
+            whatever is left before closing the file. */
+        int writebytes = writesf_wantbytes(x), fifotail, sysrtn,
+            bytesperframe = x->x_bytespersample * x->x_sfchannels,
+            filetype = x->x_filetype, swap = x->x_swap, update, sync;
+        int64_t byteswritten = x->x_byteswritten;
+        off_t filepos = x->x_filepos;
+        char *buf = x->x_buf;
+        if (!writebytes)
+            return;
+        fifotail = x->x_fifotail;
+        fd = x->x_fd;
+        sync = (x->x_syncperiod > 0 &&
+            byteswritten + writebytes >= x->x_nextsync);
+        update = (sync || byteswritten + writebytes >= x->x_nextheader);
+        pthread_mutex_unlock(&sfio_mutex);
+        sysrtn = writesf_write(x, fd, buf + fifotail, writebytes, filepos);
+            /* with "-sync", get the data onto the disk before the header
+            that describes it, then the header too. */
+        if (sysrtn == writebytes && sync && sfio_datasync(fd) < 0)
+            sysrtn = -1;
+        if (sysrtn == writebytes && update)
         {
-            if (x->x_fd >= 0)
-            {
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                close (fd);
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-            }
-            x->x_requestcode = REQUEST_NOTHING;
-            sfread_cond_signal(&x->x_answercondition);
-            break;
+                /* now and then bring the header up to date, so that if
+                we crash the file is still good up to about here. */
+            if (soundfile_updateheader(fd, filetype,
+                (byteswritten + sysrtn) / bytesperframe, bytesperframe,
+                    swap) || lseek(fd, filepos + sysrtn, SEEK_SET) !=
+                        filepos + sysrtn)
+                            sysrtn = -1;
         }
-        else
+        if (sysrtn == writebytes && sync && sfio_datasync(fd) < 0)
+            sysrtn = -1;
+        pthread_mutex_lock(&sfio_mutex);
+        if (x->x_requestcode != REQUEST_BUSY &&
+            x->x_requestcode != REQUEST_CLOSE)
+                return;
+        if (sysrtn < writebytes)
         {
 #ifdef DEBUG_SOUNDFILE
-            pute("13\n");
+            pute("fileerror\n");
 #endif
+            x->x_fileerror = errno;
+            SFIO_STORE(x->x_eof, 1);
+                /* give up on the rest and leave a valid file */
+            if (sysrtn > 0)
+                x->x_byteswritten += sysrtn;
+            SFIO_STORE(x->x_fifotail, SFIO_LOAD(x->x_fifohead));
+            writesf_closefile(x);
+            if (x->x_requestcode == REQUEST_BUSY)
+                x->x_requestcode = REQUEST_NOTHING;
+        }
+        else
+        {
+                /* hand the space back to the perform routine */
+            x->x_filepos += sysrtn;
+            x->x_byteswritten += sysrtn;
+            if (update)
+                x->x_nextheader = x->x_byteswritten + x->x_headerperiod;
+            if (sync)
+                x->x_nextsync = x->x_byteswritten + x->x_syncperiod;
+            if ((fifotail += sysrtn) == x->x_fifosize)
+                fifotail = 0;
+            SFIO_STORE(x->x_fifotail, fifotail);
         }
-    }
 #ifdef DEBUG_SOUNDFILE
-    pute("thread exit\n");
+        {
+            char boo[80];
+            sprintf(boo, "after: head %d, tail %d written %ld\n",
+                x->x_fifohead, x->x_fifotail, (long)x->x_byteswritten);
+            pute(boo);
+        }
 #endif
-    pthread_mutex_unlock(&x->x_mutex);
+    }
+    else if (x->x_requestcode == REQUEST_CLOSE ||
+        x->x_requestcode == REQUEST_QUIT)
+    {
+        int code = x->x_requestcode;
+        writesf_closefile(x);
+        if (x->x_requestcode == code)
+            x->x_requestcode = REQUEST_NOTHING;
+    }
+}
+
+static void *sfio_main(void *dummy)
+{
+    pthread_mutex_lock(&sfio_mutex);
+    while (1)
+    {
+        t_readsf *x, *best = 0;
+        double urgency, bestu = 0;
+        for (x = sfio_list; x; x = x->x_next)
+            if ((urgency = sfio_urgency(x)) >= 0 &&
+                (!best || urgency < bestu))
+                    best = x, bestu = urgency;
+        if (!best)
+        {
+            sfio_sleep();
+            continue;
+        }
+        best->x_busy = 1;
+            /* let another thread look for more work meanwhile */
+        sfio_wakeup();
+        if (best->x_writer)
+            writesf_iostep(best);
+        else readsf_iostep(best);
+        best->x_busy = 0;
+            /* signal parent in case it's waiting */
+        pthread_cond_broadcast(&sfio_answercondition);
+    }
+    pthread_mutex_unlock(&sfio_mutex);
     return (0);
 }
 
+    /* add an object to the list the disk threads serve, starting the
+    threads the first time. */
+static void sfio_add(t_readsf *x)
+{
+    pthread_mutex_lock(&sfio_mutex);
+    x->x_next = sfio_list;
+    sfio_list = x;
+    if (!sfio_nthreads && !sfio_initwakeup())
+        bug("readsf~/writesf~: couldn't create wakeup");
+    else if (!sfio_nthreads)
+    {
+        int n = (sys_diskthreads < 1 ? 1 :
+            (sys_diskthreads > SFIO_MAXTHREADS ?
+                SFIO_MAXTHREADS : sys_diskthreads));
+        while (sfio_nthreads < n)
+        {
+            pthread_t thread;
+            if (pthread_create(&thread, 0, sfio_main, 0))
+                break;
+            pthread_detach(thread);
+            sfio_nthreads++;
+        }
+        if (!sfio_nthreads)
+            bug("readsf~/writesf~: couldn't start disk thread");
+    }
+    pthread_mutex_unlock(&sfio_mutex);
+}
+
+    /* ask the disk threads to close the object's file and forget it, and
+    wait until they have. */
+static void sfio_remove(t_readsf *x)
+{
+    t_readsf *y;
+    pthread_mutex_lock(&sfio_mutex);
+    x->x_requestcode = REQUEST_QUIT;
+    while (x->x_requestcode != REQUEST_NOTHING || x->x_busy)
+    {
+        sfio_wakeup();
+        sfread_cond_wait(&sfio_answercondition, &sfio_mutex);
+    }
+    if (sfio_list == x)
+        sfio_list = x->x_next;
+    else for (y = sfio_list; y; y = y->x_next)
+        if (y->x_next == x)
+    {
+        y->x_next = x->x_next;
+        break;
+    }
+    pthread_mutex_unlock(&sfio_mutex);
+}
+
 /******** the object proper runs in the calling (parent) thread ****/
 
 static void readsf_tick(t_readsf *x);
@@ -1915,14 +4009,12 @@ static void *readsf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     if (!buf) return (0);
     
     x = (t_readsf *)pd_new(readsf_class);
+    soundfile_initcodecs();
     
     for (i = 0; i < nchannels; i++)
         outlet_new(&x->x_obj, gensym("signal"));
     x->x_noutlets = nchannels;
     x->x_bangout = outlet_new(&x->x_obj, &s_bang);
-    pthread_mutex_init(&x->x_mutex, 0);
-    pthread_cond_init(&x->x_requestcondition, 0);
-    pthread_cond_init(&x->x_answercondition, 0);
     x->x_vecsize = MAXVECSIZE;
     x->x_state = STATE_IDLE;
     x->x_clock = clock_new(x, (t_method)readsf_tick);
@@ -1933,7 +4025,9 @@ static void *readsf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_buf = buf;
     x->x_bufsize = bufsize;
     x->x_fifosize = x->x_fifohead = x->x_fifotail = x->x_requestcode = 0;
-    pthread_create(&x->x_childthread, 0, readsf_child_main, x);
+    x->x_writer = x->x_busy = x->x_underruns = x->x_primed = 0;
+    x->x_sigcountdown = x->x_sigperiod = 0;
+    sfio_add(x);
     return (x);
 }
 
@@ -1942,41 +4036,50 @@ static void readsf_tick(t_readsf *x)
     outlet_bang(x->x_bangout);
 }
 
+    /* wait until there's a block of data to read or the file has ended.
+    Called from the perform routine when not running in real time. */
+static void readsf_wait(t_readsf *x)
+{
+    int wantbytes = x->x_sfchannels * x->x_vecsize * x->x_bytespersample,
+        fifohead, fifotail;
+    pthread_mutex_lock(&sfio_mutex);
+    while (!x->x_eof && (fifohead = x->x_fifohead) >=
+        (fifotail = x->x_fifotail) && fifohead - fifotail < wantbytes)
+    {
+        sfio_wakeup();
+        sfread_cond_wait(&sfio_answercondition, &sfio_mutex);
+            /* the disk thread sets these when it opens the file */
+        wantbytes = x->x_sfchannels * x->x_vecsize * x->x_bytespersample;
+    }
+    pthread_mutex_unlock(&sfio_mutex);
+}
+
 static t_int *readsf_perform(t_int *w)
 {
     t_readsf *x = (t_readsf *)(w[1]);
-    int vecsize = x->x_vecsize, noutlets = x->x_noutlets, i, j,
-        bytespersample = x->x_bytespersample,
-        bigendian = x->x_bigendian;
+    int vecsize = x->x_vecsize, noutlets = x->x_noutlets, i, j;
     t_sample *fp;
     if (x->x_state == STATE_STREAM)
     {
-        int wantbytes, nchannels, sfchannels = x->x_sfchannels;
-        pthread_mutex_lock(&x->x_mutex);
+        int wantbytes, sfchannels, bytespersample, bigendian,
+            fifotail, eof, fifohead;
+        if (sfio_mustwait())
+            readsf_wait(x);
+        fifotail = x->x_fifotail;
+        eof = SFIO_LOAD(x->x_eof);
+        fifohead = SFIO_LOAD(x->x_fifohead);
+        if (fifohead == fifotail && !eof)
+            goto underrun;
+            /* the disk thread set these before publishing any data */
+        sfchannels = x->x_sfchannels;
+        bytespersample = x->x_bytespersample;
+        bigendian = x->x_bigendian;
         wantbytes = sfchannels * vecsize * bytespersample;
-        while (
-            !x->x_eof && x->x_fifohead >= x->x_fifotail &&
-                x->x_fifohead < x->x_fifotail + wantbytes-1)
-        {
-#ifdef DEBUG_SOUNDFILE
-            pute("wait...\n");
-#endif
-            sfread_cond_signal(&x->x_requestcondition);
-            sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
-                /* resync local cariables -- bug fix thanks to Shahrokh */
-            vecsize = x->x_vecsize;
-            bytespersample = x->x_bytespersample;
-            sfchannels = x->x_sfchannels;
-            wantbytes = sfchannels * vecsize * bytespersample;
-            bigendian = x->x_bigendian;
-#ifdef DEBUG_SOUNDFILE
-            pute("done\n");
-#endif
-        }
-        if (x->x_eof && x->x_fifohead >= x->x_fifotail &&
-            x->x_fifohead < x->x_fifotail + wantbytes-1)
+        if (fifohead >= fifotail && fifohead - fifotail < wantbytes)
         {
             int xfersize;
+            if (!eof)
+                goto underrun;
             if (x->x_fileerror)
             {
                 pd_error(x, "dsp: %s: %s", x->x_filename,
@@ -1988,12 +4091,12 @@ static t_int *readsf_perform(t_int *w)
             x->x_state = STATE_IDLE;
 
                 /* if there's a partial buffer left, copy it out. */
-            xfersize = (x->x_fifohead - x->x_fifotail + 1) /
+            xfersize = (fifohead - fifotail) /
                 (sfchannels * bytespersample);
             if (xfersize)
             {
                 soundfile_xferin_sample(sfchannels, noutlets, x->x_outvec, 0,
-                    (unsigned char *)(x->x_buf + x->x_fifotail), xfersize,
+                    (unsigned char *)(x->x_buf + fifotail), xfersize,
                         bytespersample, bigendian, 1);
                 vecsize -= xfersize;
             }
@@ -2001,32 +4104,34 @@ static t_int *readsf_perform(t_int *w)
             for (i = 0; i < noutlets; i++)
                 for (j = vecsize, fp = x->x_outvec[i] + xfersize; j--; )
                     *fp++ = 0;
-
-            sfread_cond_signal(&x->x_requestcondition);
-            pthread_mutex_unlock(&x->x_mutex);
             return (w+2); 
         }
 
         soundfile_xferin_sample(sfchannels, noutlets, x->x_outvec, 0,
-            (unsigned char *)(x->x_buf + x->x_fifotail), vecsize,
+            (unsigned char *)(x->x_buf + fifotail), vecsize,
                 bytespersample, bigendian, 1);
-        
-        x->x_fifotail += wantbytes;
-        if (x->x_fifotail >= x->x_fifosize)
-            x->x_fifotail = 0;
+
+            /* hand the space back to the disk thread */
+        if ((fifotail += wantbytes) >= x->x_fifosize)
+            fifotail = 0;
+        SFIO_STORE(x->x_fifotail, fifotail);
+        x->x_primed = 1;
         if ((--x->x_sigcountdown) <= 0)
         {
-            sfread_cond_signal(&x->x_requestcondition);
+            sfio_wakeup();
             x->x_sigcountdown = x->x_sigperiod;
         }
-        pthread_mutex_unlock(&x->x_mutex);
-    }
-    else
-    {
-        for (i = 0; i < noutlets; i++)
-            for (j = vecsize, fp = x->x_outvec[i]; j--; )
-                *fp++ = 0;
+        return (w+2);
+    underrun:
+            /* the disk hasn't kept up (or the file is still being
+            opened); output silence this time rather than wait. */
+        if (x->x_primed)
+            x->x_underruns++;
+        sfio_wakeup();
     }
+    for (i = 0; i < noutlets; i++)
+        for (j = vecsize, fp = x->x_outvec[i]; j--; )
+            *fp++ = 0;
     return (w+2);
 }
 
@@ -2042,11 +4147,11 @@ static void readsf_start(t_readsf *x)
 static void readsf_stop(t_readsf *x)
 {
         /* LATER rethink whether you need the mutex just to set a variable? */
-    pthread_mutex_lock(&x->x_mutex);
+    pthread_mutex_lock(&sfio_mutex);
     x->x_state = STATE_IDLE;
     x->x_requestcode = REQUEST_CLOSE;
-    sfread_cond_signal(&x->x_requestcondition);
-    pthread_mutex_unlock(&x->x_mutex);
+    sfio_wakeup();
+    pthread_mutex_unlock(&sfio_mutex);
 }
 
 static void readsf_float(t_readsf *x, t_floatarg f)
@@ -2072,7 +4177,7 @@ static void readsf_open(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
     t_symbol *endian = atom_getsymbolarg(5, argc, argv);
     if (!*filesym->s_name)
         return;
-    pthread_mutex_lock(&x->x_mutex);
+    pthread_mutex_lock(&sfio_mutex);
     x->x_requestcode = REQUEST_OPEN;
     x->x_filename = filesym->s_name;
     x->x_fifotail = 0;
@@ -2091,22 +4196,23 @@ static void readsf_open(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
     x->x_bytespersample = (bytespersamp > 2 ? bytespersamp : 2);
     x->x_eof = 0;
     x->x_fileerror = 0;
+    x->x_underruns = x->x_primed = x->x_sigcountdown = 0;
     x->x_state = STATE_STARTUP;
-    sfread_cond_signal(&x->x_requestcondition);
-    pthread_mutex_unlock(&x->x_mutex);
+    sfio_wakeup();
+    pthread_mutex_unlock(&sfio_mutex);
 }
 
 static void readsf_dsp(t_readsf *x, t_signal **sp)
 {
     int i, noutlets = x->x_noutlets;
-    pthread_mutex_lock(&x->x_mutex);
+    pthread_mutex_lock(&sfio_mutex);
     x->x_vecsize = sp[0]->s_n;
     
     x->x_sigperiod = (x->x_fifosize /
         (x->x_bytespersample * x->x_sfchannels * x->x_vecsize));
     for (i = 0; i < noutlets; i++)
         x->x_outvec[i] = sp[i]->s_vec;
-    pthread_mutex_unlock(&x->x_mutex);
+    pthread_mutex_unlock(&sfio_mutex);
     dsp_add(readsf_perform, 1, x);
 }
 
@@ -2118,27 +4224,12 @@ static void readsf_print(t_readsf *x)
     post("fifo size %d", x->x_fifosize);
     post("fd %d", x->x_fd);
     post("eof %d", x->x_eof);
+    post("underruns %d", x->x_underruns);
 }
 
 static void readsf_free(t_readsf *x)
 {
-        /* request QUIT and wait for acknowledge */
-    void *threadrtn;
-    pthread_mutex_lock(&x->x_mutex);
-    x->x_requestcode = REQUEST_QUIT;
-    sfread_cond_signal(&x->x_requestcondition);
-    while (x->x_requestcode != REQUEST_NOTHING)
-    {
-        sfread_cond_signal(&x->x_requestcondition);
-        sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
-    }
-    pthread_mutex_unlock(&x->x_mutex);
-    if (pthread_join(x->x_childthread, &threadrtn))
-        error("readsf_free: join failed");
-    
-    pthread_cond_destroy(&x->x_requestcondition);
-    pthread_cond_destroy(&x->x_answercondition);
-    pthread_mutex_destroy(&x->x_mutex);
+    sfio_remove(x);
     freebytes(x->x_buf, x->x_bufsize);
     clock_free(x->x_clock);
 }
@@ -2163,243 +4254,8 @@ static t_class *writesf_class;
 
 #define t_writesf t_readsf      /* just re-use the structure */
 
-/************** the child thread which performs file I/O ***********/
-
-static void *writesf_child_main(void *zz)
-{
-    t_writesf *x = zz;
-#ifdef DEBUG_SOUNDFILE
-    pute("1\n");
-#endif
-    pthread_mutex_lock(&x->x_mutex);
-    while (1)
-    {
-#ifdef DEBUG_SOUNDFILE
-        pute("0\n");
-#endif
-        if (x->x_requestcode == REQUEST_NOTHING)
-        {
-#ifdef DEBUG_SOUNDFILE
-            pute("wait 2\n");
-#endif
-            sfread_cond_signal(&x->x_answercondition);
-            sfread_cond_wait(&x->x_requestcondition, &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-            pute("3\n");
-#endif
-        }
-        else if (x->x_requestcode == REQUEST_OPEN)
-        {
-            char boo[80];
-            int fd, sysrtn, writebytes;
-            
-                /* copy file stuff out of the data structure so we can
-                relinquish the mutex while we're in open_soundfile(). */
-            long onsetframes = x->x_onsetframes;
-            long bytelimit = 0x7fffffff;
-            int skipheaderbytes = x->x_skipheaderbytes;
-            int bytespersample = x->x_bytespersample;
-            int sfchannels = x->x_sfchannels;
-            int bigendian = x->x_bigendian;
-            int filetype = x->x_filetype;
-            char *filename = x->x_filename;
-            t_canvas *canvas = x->x_canvas;
-            t_float samplerate = x->x_samplerate;
-
-                /* alter the request code so that an ensuing "open" will get
-                noticed. */
-#ifdef DEBUG_SOUNDFILE
-            pute("4\n");
-#endif
-            x->x_requestcode = REQUEST_BUSY;
-            x->x_fileerror = 0;
-
-                /* if there's already a file open, close it.  This
-                should never happen since writesf_open() calls stop if
-                needed and then waits until we're idle. */
-            if (x->x_fd >= 0)
-            {
-                int bytesperframe = x->x_bytespersample * x->x_sfchannels;
-                int bigendian = x->x_bigendian;
-                char *filename = x->x_filename;
-                int fd = x->x_fd;
-                int filetype = x->x_filetype;
-                int itemswritten = x->x_itemswritten;
-                int swap = x->x_swap;
-                pthread_mutex_unlock(&x->x_mutex);
-                
-                soundfile_finishwrite(x, filename, fd,
-                    filetype, 0x7fffffff, itemswritten,
-                    bytesperframe, swap);
-                close (fd);
-
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-#ifdef DEBUG_SOUNDFILE
-                {
-                    char s[1000];
-                    sprintf(s, "bug??? ditched %d\n", itemswritten);
-                    pute(s);
-                }
-#endif  
-                if (x->x_requestcode != REQUEST_BUSY)
-                    continue;
-            }
-                /* open the soundfile with the mutex unlocked */
-            pthread_mutex_unlock(&x->x_mutex);
-            fd = create_soundfile(canvas, filename, filetype, 0,
-                    bytespersample, bigendian, sfchannels, 
-                        garray_ambigendian() != bigendian, samplerate);
-            pthread_mutex_lock(&x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-            pute("5\n");
-#endif
-
-            if (fd < 0)
-            {
-                x->x_fd = -1;
-                x->x_eof = 1;
-                x->x_fileerror = errno;
-#ifdef DEBUG_SOUNDFILE
-                pute("open failed\n");
-                pute(filename);
-#endif
-                x->x_requestcode = REQUEST_NOTHING;
-                continue;
-            }
-            /* check if another request has been made; if so, field it */
-            if (x->x_requestcode != REQUEST_BUSY)
-                continue;
-#ifdef DEBUG_SOUNDFILE
-            pute("6\n");
-#endif
-            x->x_fd = fd;
-            x->x_fifotail = 0;
-            x->x_itemswritten = 0;
-            x->x_swap = garray_ambigendian() != bigendian;      
-                /* in a loop, wait for the fifo to have data and write it
-                    to disk */
-            while (x->x_requestcode == REQUEST_BUSY ||
-                (x->x_requestcode == REQUEST_CLOSE &&
-                    x->x_fifohead != x->x_fifotail))
-            {
-                int fifosize = x->x_fifosize, fifotail;
-                char *buf = x->x_buf;
-#ifdef DEBUG_SOUNDFILE
-                pute("77\n");
-#endif
-                    /* if the head is < the tail, we can immediately write
-                    from tail to end of fifo to disk; otherwise we hold off
-                    writing until there are at least WRITESIZE bytes in the
-                    buffer */
-                if (x->x_fifohead < x->x_fifotail ||
-                    x->x_fifohead >= x->x_fifotail + WRITESIZE
-                    || (x->x_requestcode == REQUEST_CLOSE &&
-                        x->x_fifohead != x->x_fifotail))
-                {
-                    writebytes = (x->x_fifohead < x->x_fifotail ?
-                        fifosize : x->x_fifohead) - x->x_fifotail;
-                    if (writebytes > READSIZE)
-                        writebytes = READSIZE;
-                }
-                else
-                {
-#ifdef DEBUG_SOUNDFILE
-                    pute("wait 7a ...\n");
-#endif
-                    sfread_cond_signal(&x->x_answercondition);
-#ifdef DEBUG_SOUNDFILE
-                    pute("signalled\n");
-#endif
-                    sfread_cond_wait(&x->x_requestcondition,
-                        &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-                    pute("7a done\n");
-#endif
-                    continue;
-                }
-#ifdef DEBUG_SOUNDFILE
-                pute("8\n");
-#endif
-                fifotail = x->x_fifotail;
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                sysrtn = write(fd, buf + fifotail, writebytes);
-                pthread_mutex_lock(&x->x_mutex);
-                if (x->x_requestcode != REQUEST_BUSY &&
-                    x->x_requestcode != REQUEST_CLOSE)
-                        break;
-                if (sysrtn < writebytes)
-                {
-#ifdef DEBUG_SOUNDFILE
-                    pute("fileerror\n");
-#endif
-                    x->x_fileerror = errno;
-                    break;
-                }
-                else
-                {
-                    x->x_fifotail += sysrtn;
-                    if (x->x_fifotail == fifosize)
-                        x->x_fifotail = 0;
-                }
-                x->x_itemswritten +=
-                    sysrtn / (x->x_bytespersample * x->x_sfchannels);
-#ifdef DEBUG_SOUNDFILE
-                sprintf(boo, "after: head %d, tail %d written %d\n", 
-                    x->x_fifohead, x->x_fifotail, x->x_itemswritten);
-                pute(boo);
-#endif
-                    /* signal parent in case it's waiting for data */
-                sfread_cond_signal(&x->x_answercondition);
-            }
-        }
-        else if (x->x_requestcode == REQUEST_CLOSE ||
-            x->x_requestcode == REQUEST_QUIT)
-        {
-            int quit = (x->x_requestcode == REQUEST_QUIT);
-            if (x->x_fd >= 0)
-            {
-                int bytesperframe = x->x_bytespersample * x->x_sfchannels;
-                int bigendian = x->x_bigendian;
-                char *filename = x->x_filename;
-                int fd = x->x_fd;
-                int filetype = x->x_filetype;
-                int itemswritten = x->x_itemswritten;
-                int swap = x->x_swap;
-                pthread_mutex_unlock(&x->x_mutex);
-
-                soundfile_finishwrite(x, filename, fd,
-                    filetype, 0x7fffffff, itemswritten,
-                    bytesperframe, swap);
-                close (fd);
-
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-            }
-            x->x_requestcode = REQUEST_NOTHING;
-            sfread_cond_signal(&x->x_answercondition);
-            if (quit)
-                break;
-        }
-        else
-        {
-#ifdef DEBUG_SOUNDFILE
-            pute("13\n");
-#endif
-        }
-    }
-#ifdef DEBUG_SOUNDFILE
-    pute("thread exit\n");
-#endif
-    pthread_mutex_unlock(&x->x_mutex);
-    return (0);
-}
-
 /******** the object proper runs in the calling (parent) thread ****/
 
-static void writesf_tick(t_writesf *x);
-
 static void *writesf_new(t_floatarg fnchannels, t_floatarg fbufsize)
 {
     t_writesf *x;
@@ -2419,15 +4275,13 @@ static void *writesf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     if (!buf) return (0);
     
     x = (t_writesf *)pd_new(writesf_class);
+    soundfile_initcodecs();
     
     for (i = 1; i < nchannels; i++)
         inlet_new(&x->x_obj,  &x->x_obj.ob_pd, &s_signal, &s_signal);
 
     x->x_f = 0;
     x->x_sfchannels = nchannels;
-    pthread_mutex_init(&x->x_mutex, 0);
-    pthread_cond_init(&x->x_requestcondition, 0);
-    pthread_cond_init(&x->x_answercondition, 0);
     x->x_vecsize = MAXVECSIZE;
     x->x_insamplerate = x->x_samplerate = 0;
     x->x_state = STATE_IDLE;
@@ -2438,54 +4292,79 @@ static void *writesf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_buf = buf;
     x->x_bufsize = bufsize;
     x->x_fifosize = x->x_fifohead = x->x_fifotail = x->x_requestcode = 0;
-    pthread_create(&x->x_childthread, 0, writesf_child_main, x);
+    x->x_busy = x->x_underruns = 0;
+    x->x_nextsync = x->x_syncperiod = x->x_prealloc = x->x_allocend = 0;
+    x->x_direct = 0;
+    x->x_directbuf = 0;
+    x->x_writer = 1;
+    sfio_add(x);
     return (x);
 }
 
+    /* wait until there's room for a block in the fifo, or writing has
+    failed.  Called from the perform routine when not running in real
+    time. */
+static void writesf_wait(t_writesf *x, int wantbytes)
+{
+    int roominfifo;
+    pthread_mutex_lock(&sfio_mutex);
+    while (!x->x_eof)
+    {
+        if ((roominfifo = x->x_fifotail - x->x_fifohead) <= 0)
+            roominfifo += x->x_fifosize;
+        if (roominfifo >= wantbytes + 1)
+            break;
+        sfio_wakeup();
+        sfread_cond_wait(&sfio_answercondition, &sfio_mutex);
+    }
+    pthread_mutex_unlock(&sfio_mutex);
+}
+
 static t_int *writesf_perform(t_int *w)
 {
     t_writesf *x = (t_writesf *)(w[1]);
-    int vecsize = x->x_vecsize, sfchannels = x->x_sfchannels, i, j,
+    int vecsize = x->x_vecsize, sfchannels = x->x_sfchannels,
         bytespersample = x->x_bytespersample,
         bigendian = x->x_bigendian;
-    t_sample *fp;
-    if (x->x_state == STATE_STREAM)
+        /* if the file couldn't be created or written, drop the output */
+    if (x->x_state == STATE_STREAM && !SFIO_LOAD(x->x_eof))
     {
-        int wantbytes, roominfifo;
-        pthread_mutex_lock(&x->x_mutex);
-        wantbytes = sfchannels * vecsize * bytespersample;
-        roominfifo = x->x_fifotail - x->x_fifohead;
+        int wantbytes = sfchannels * vecsize * bytespersample,
+            fifohead = x->x_fifohead, roominfifo;
+        if (sfio_mustwait())
+        {
+            writesf_wait(x, wantbytes);
+            if (SFIO_LOAD(x->x_eof))
+                return (w+2);
+        }
+        roominfifo = SFIO_LOAD(x->x_fifotail) - fifohead;
         if (roominfifo <= 0)
             roominfifo += x->x_fifosize;
-        while (roominfifo < wantbytes + 1)
+        if (roominfifo < wantbytes + 1)
         {
-            fprintf(stderr, "writesf waiting for disk write..\n");
-            fprintf(stderr, "(head %d, tail %d, room %d, want %d)\n",
-                x->x_fifohead, x->x_fifotail, roominfifo, wantbytes);
-            sfread_cond_signal(&x->x_requestcondition);
-            sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
-            fprintf(stderr, "... done waiting.\n");
-            roominfifo = x->x_fifotail - x->x_fifohead;
-            if (roominfifo <= 0)
-                roominfifo += x->x_fifosize;
+                /* the disk hasn't kept up; lose this block rather than
+                wait for it. */
+            x->x_underruns++;
+            sfio_wakeup();
+            return (w+2);
         }
 
         soundfile_xferout_sample(sfchannels, x->x_outvec,
-            (unsigned char *)(x->x_buf + x->x_fifohead), vecsize, 0,
+            (unsigned char *)(x->x_buf + fifohead), vecsize, 0,
                 bytespersample, bigendian, 1., 1);
-        
-        x->x_fifohead += wantbytes;
-        if (x->x_fifohead >= x->x_fifosize)
-            x->x_fifohead = 0;
+
+            /* publish the new data to the disk thread */
+        if ((fifohead += wantbytes) >= x->x_fifosize)
+            fifohead = 0;
+        SFIO_STORE(x->x_fifohead, fifohead);
         if ((--x->x_sigcountdown) <= 0)
         {
 #ifdef DEBUG_SOUNDFILE
             pute("signal 1\n");
 #endif
-            sfread_cond_signal(&x->x_requestcondition);
+            sfio_wakeup();
             x->x_sigcountdown = x->x_sigperiod;
         }
-        pthread_mutex_unlock(&x->x_mutex);
     }
     return (w+2);
 }
@@ -2503,14 +4382,22 @@ static void writesf_start(t_writesf *x)
 static void writesf_stop(t_writesf *x)
 {
         /* LATER rethink whether you need the mutex just to set a Svariable? */
-    pthread_mutex_lock(&x->x_mutex);
+    pthread_mutex_lock(&sfio_mutex);
     x->x_state = STATE_IDLE;
     x->x_requestcode = REQUEST_CLOSE;
 #ifdef DEBUG_SOUNDFILE
     pute("signal 2\n");
 #endif
-    sfread_cond_signal(&x->x_requestcondition);
-    pthread_mutex_unlock(&x->x_mutex);
+    sfio_wakeup();
+        /* if not in real time, also wait for the file to be finished, so
+        that a batch run can quit right after "stop" */
+    while (sfio_mustwait() &&
+        (x->x_requestcode == REQUEST_CLOSE || x->x_busy))
+    {
+        sfio_wakeup();
+        sfread_cond_wait(&sfio_answercondition, &sfio_mutex);
+    }
+    pthread_mutex_unlock(&sfio_mutex);
 }
 
 
@@ -2524,40 +4411,46 @@ static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
     int filetype, bytespersamp, swap, bigendian, normalize;
     long onset, nframes;
     t_float samplerate;
+    t_sfwritepolicy policy;
+    policy.wp_prealloc = policy.wp_sync = 0;
+    policy.wp_direct = 0;
     if (x->x_state != STATE_IDLE)
     {
         writesf_stop(x);
     }
     if (soundfiler_writeargparse(x, &argc,
         &argv, &filesym, &filetype, &bytespersamp, &swap, &bigendian,
-        &normalize, &onset, &nframes, &samplerate))
+        &normalize, &onset, &nframes, &samplerate, 0, &policy))
     {
         pd_error(x,
-            "writesf~: usage: open [-bytes [234]] [-wave,-nextstep,-aiff] ...");
-        post("... [-big,-little] [-rate ####] filename");
+            "writesf~: usage: open [-bytes [234]] [-wave,-rf64,-nextstep,-aiff] ...");
+        post("... [-big,-little] [-rate ####] [-prealloc <MB>] [-sync <sec>]");
+        post("... [-direct] filename");
         return;
     }
     if (normalize || onset || (nframes != 0x7fffffff))
         pd_error(x, "normalize/onset/nframes argument to writesf~: ignored");
     if (argc)
         pd_error(x, "extra argument(s) to writesf~: ignored");
-    pthread_mutex_lock(&x->x_mutex);
+    soundfile_unmapforwrite(x->x_canvas, filesym->s_name, filetype);
+    pthread_mutex_lock(&sfio_mutex);
     while (x->x_requestcode != REQUEST_NOTHING)
     {
-        sfread_cond_signal(&x->x_requestcondition);
-        sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
+        sfio_wakeup();
+        sfread_cond_wait(&sfio_answercondition, &sfio_mutex);
     }
     x->x_bytespersample = bytespersamp;
     x->x_swap = swap;
     x->x_bigendian = bigendian;
     x->x_filename = filesym->s_name;
     x->x_filetype = filetype;
-    x->x_itemswritten = 0;
+    x->x_byteswritten = 0;
     x->x_requestcode = REQUEST_OPEN;
     x->x_fifotail = 0;
     x->x_fifohead = 0;
     x->x_eof = 0;
     x->x_fileerror = 0;
+    x->x_underruns = 0;
     x->x_state = STATE_STARTUP;
     x->x_bytespersample = (bytespersamp > 2 ? bytespersamp : 2);
     if (samplerate > 0)
@@ -2565,6 +4458,13 @@ static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
     else if (x->x_insamplerate > 0)
         x->x_samplerate = x->x_insamplerate;
     else x->x_samplerate = sys_getsr();
+    x->x_nextheader = x->x_headerperiod = (int64_t)x->x_samplerate *
+        x->x_bytespersample * x->x_sfchannels * HEADERUPDATESECS;
+    x->x_nextsync = x->x_syncperiod = (int64_t)(x->x_samplerate *
+        x->x_bytespersample * x->x_sfchannels * policy.wp_sync);
+    x->x_prealloc = (off_t)(policy.wp_prealloc * 1048576);
+    x->x_prealloc -= x->x_prealloc % XFERALIGN;
+    x->x_direct = policy.wp_direct;
         /* set fifosize from bufsize.  fifosize must be a
         multiple of the number of bytes eaten for each DSP
         tick.  */
@@ -2574,21 +4474,21 @@ static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
             times per buffer */
     x->x_sigcountdown = x->x_sigperiod = (x->x_fifosize /
             (16 * x->x_bytespersample * x->x_sfchannels * x->x_vecsize));
-    sfread_cond_signal(&x->x_requestcondition);
-    pthread_mutex_unlock(&x->x_mutex);
+    sfio_wakeup();
+    pthread_mutex_unlock(&sfio_mutex);
 }
 
 static void writesf_dsp(t_writesf *x, t_signal **sp)
 {
     int i, ninlets = x->x_sfchannels;
-    pthread_mutex_lock(&x->x_mutex);
+    pthread_mutex_lock(&sfio_mutex);
     x->x_vecsize = sp[0]->s_n;
     x->x_sigperiod = (x->x_fifosize /
             (16 * x->x_bytespersample * x->x_sfchannels * x->x_vecsize));
     for (i = 0; i < ninlets; i++)
         x->x_outvec[i] = sp[i]->s_vec;
     x->x_insamplerate = sp[0]->s_sr;
-    pthread_mutex_unlock(&x->x_mutex);
+    pthread_mutex_unlock(&sfio_mutex);
     dsp_add(writesf_perform, 1, x);
 }
 
@@ -2600,31 +4500,18 @@ static void writesf_print(t_writesf *x)
     post("fifo size %d", x->x_fifosize);
     post("fd %d", x->x_fd);
     post("eof %d", x->x_eof);
+    post("overruns %d", x->x_underruns);
+    post("prealloc %ld bytes, sync every %ld bytes%s",
+        (long)x->x_prealloc, (long)x->x_syncperiod,
+            (x->x_direct ? ", direct" : ""));
 }
 
 static void writesf_free(t_writesf *x)
 {
-        /* request QUIT and wait for acknowledge */
-    void *threadrtn;
-    pthread_mutex_lock(&x->x_mutex);
-    x->x_requestcode = REQUEST_QUIT;
-    /* post("stopping writesf thread..."); */
-    sfread_cond_signal(&x->x_requestcondition);
-    while (x->x_requestcode != REQUEST_NOTHING)
-    {
-        /* post("signalling..."); */
-        sfread_cond_signal(&x->x_requestcondition);
-        sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
-    }
-    pthread_mutex_unlock(&x->x_mutex);
-    if (pthread_join(x->x_childthread, &threadrtn))
-        error("writesf_free: join failed");
-    /* post("... done."); */
-    
-    pthread_cond_destroy(&x->x_requestcondition);
-    pthread_cond_destroy(&x->x_answercondition);
-    pthread_mutex_destroy(&x->x_mutex);
+    sfio_remove(x);
     freebytes(x->x_buf, x->x_bufsize);
+    if (x->x_directbuf)
+        free(x->x_directbuf);
 }
 
 static void writesf_setup(void)
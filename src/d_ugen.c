@@ -13,8 +13,10 @@
 
 #include "m_pd.h"
 #include "m_imp.h"
+#include "s_stuff.h"
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 extern t_class *vinlet_class, *voutlet_class, *canvas_class;
 t_float *obj_findsignalscalar(t_object *x, int m);
@@ -62,7 +64,10 @@ t_int *zero_perf8(t_int *w)
 
 void dsp_add_zero(t_sample *out, int n)
 {
-    if (n&7)
+    t_veckernel kernel = sys_getveckernel(VEC_ZERO);
+    if (kernel)
+        dsp_add(vec_perform, 5, kernel, 0, 0, out, n);
+    else if (n&7)
         dsp_add(zero_perform, 2, out, n);
     else        
         dsp_add(zero_perf8, 2, out, n);
@@ -325,11 +330,14 @@ void dsp_addv(t_perfroutine f, int n, t_int *vec)
     pd_this->pd_dspchainsize = newsize;
 }
 
+static void dsp_denormals(void);
+
 void dsp_tick(void)
 {
     if (pd_this->pd_dspchain)
     {
         t_int *ip;
+        dsp_denormals();
         for (ip = pd_this->pd_dspchain; ip; ) ip = (*(t_perfroutine)(*ip))(ip);
         dsp_phase++;
     }
@@ -1149,6 +1157,139 @@ t_signal *ugen_getiosig(int index, int inout)
     return (ugen_currentcontext->dc_iosigs[index]);
 }
 
+/* ------------------------ CPU features -------------------------- */
+
+/* Routines that have vectorized versions ask here which instruction sets
+they may use.  The answer is found once and cached.  "-nosimd" makes us
+report none, so that the plain C code runs everywhere; that's useful for
+checking results and timing the difference. */
+
+int sys_nosimd;
+int sys_avx512;     /* use AVX-512 where there's a choice ("-avx512") */
+static int cpu_features = -1;
+
+int sys_getcpufeatures(void)
+{
+    if (cpu_features < 0)
+    {
+        int f = 0;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))
+            f |= CPU_SSE2;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            f |= CPU_AVX2;
+        if (__builtin_cpu_supports("avx512f"))
+            f |= CPU_AVX512;
+#elif defined(_M_X64)
+        f |= CPU_SSE2;
+#endif
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+        f |= CPU_NEON;
+#endif
+        cpu_features = (sys_nosimd ? 0 : f);
+    }
+    return (cpu_features);
+}
+
+/* ------------------------ denormals ----------------------------- */
+
+/* With "-flushdenormals" or "pd flush-denormals 1", the thread computing
+DSP is put in flush-to-zero mode, so that the hardware rounds numbers too
+small to matter ("denormals") to zero instead of slowly computing with them.
+Tilde objects can then ask sys_denormalsflushed() at DSP time and choose
+perform routines that skip testing every sample with PD_BIGORSMALL.  Those
+tests also caught infinities and NaNs; the alternative routines for
+recursive filters still check their state once per block so that they can
+recover from them, and the ones that pass signals on to be fed back
+(delwrite~, send~ and throw~) test each block with sys_infornan().  The
+mode is only available where floating point is computed in SSE or NEON
+registers; otherwise the flag is ignored. */
+
+int sys_flushdenormals;
+
+#if defined(__SSE2_MATH__) || defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FTZ_GET() _mm_getcsr()
+#define FTZ_SET(m) _mm_setcsr(m)
+#if defined(__x86_64__) || defined(_M_X64)
+#define FTZ_BITS 0x8040         /* FTZ and DAZ */
+#else
+#define FTZ_BITS 0x8000         /* FTZ only; early SSE2 CPUs lack DAZ */
+#endif
+#elif defined(__aarch64__) && defined(__GNUC__)
+static unsigned long ftz_getfpcr(void)
+{
+    unsigned long r;
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (r));
+    return (r);
+}
+static void ftz_setfpcr(unsigned long r)
+{
+    __asm__ __volatile__ ("msr fpcr, %0" : : "r" (r));
+}
+#define FTZ_GET() ftz_getfpcr()
+#define FTZ_SET(m) ftz_setfpcr(m)
+#define FTZ_BITS (1ul << 24)    /* FZ */
+#endif
+
+    /* may perform routines count on denormals being flushed? */
+int sys_denormalsflushed(void)
+{
+#ifdef FTZ_BITS
+    return (sys_flushdenormals);
+#else
+    return (0);
+#endif
+}
+
+    /* test a block for infinities and NaNs, for routines that skip the
+    per-sample test but whose output can feed back into itself.  This only
+    masks and ORs the bits (which survive -ffast-math and vectorize),
+    setting the top bit if any exponent is all ones. */
+int sys_infornan(const t_sample *vec, int n)
+{
+#if PD_FLOATSIZE == 32
+    const uint32_t *ip = (const uint32_t *)vec;
+    uint32_t bits = 0;
+    while (n--)
+        bits |= (*ip++ & 0x7f800000) + 0x00800000;
+    return ((bits & 0x80000000) != 0);
+#else
+    const uint64_t *ip = (const uint64_t *)vec;
+    uint64_t bits = 0;
+    while (n--)
+        bits |= (*ip++ & 0x7ff0000000000000ull) + 0x0010000000000000ull;
+    return ((bits & 0x8000000000000000ull) != 0);
+#endif
+}
+
+    /* called from dsp_tick() since some audio APIs call us from a thread
+    of their own, and the mode belongs to the thread. */
+static void dsp_denormals(void)
+{
+#ifdef FTZ_BITS
+    static int wasset;
+    if (sys_flushdenormals || wasset)
+    {
+        unsigned long mode = FTZ_GET(), want = (sys_flushdenormals ?
+            (mode | FTZ_BITS) : (mode & ~FTZ_BITS));
+        if (want != mode)
+            FTZ_SET(want);
+        wasset = sys_flushdenormals;
+    }
+#endif
+}
+
+    /* "pd flush-denormals <f>"; the DSP chain is rebuilt so that objects
+    can choose their perform routines again. */
+void glob_flushdenormals(void *dummy, t_floatarg f)
+{
+    int dspwas = canvas_suspend_dsp();
+    sys_flushdenormals = (f != 0);
+    canvas_resume_dsp(dspwas);
+}
+
 /* ------------------------ samplerate~~ -------------------------- */
 
 static t_class *samplerate_tilde_class;
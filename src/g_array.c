@@ -8,6 +8,12 @@
 #include "m_pd.h"
 #include "g_canvas.h"
 #include <math.h>
+#if defined(HAVE_UNISTD_H) && !defined(_WIN32)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define GARRAY_MMAP
+#endif
 
 /* jsarlo { */
 #define ARRAYPAGESIZE 1000  /* this should match the page size in u_main.tk */
@@ -27,8 +33,10 @@ t_array *array_new(t_symbol *templatesym, t_gpointer *parent)
     template = template_findbyname(templatesym);
     x->a_templatesym = templatesym;
     x->a_n = 1;
-    x->a_elemsize = sizeof(t_word) * template->t_n;
+    x->a_elemsize = template_elemsize(template);
     x->a_vec = (char *)getbytes(x->a_elemsize);
+    x->a_map = 0;
+    x->a_mapsize = 0;
         /* note here we blithely copy a gpointer instead of "setting" a
         new one; this gpointer isn't accounted for and needn't be since
         we'll be deleted before the thing pointed to gets deleted anyway;
@@ -50,12 +58,18 @@ void array_resize(t_array *x, int n)
     t_template *template = template_findbyname(x->a_templatesym);
     if (n < 1)
         n = 1;
+    array_unmap(x);
     oldn = x->a_n;
-    elemsize = sizeof(t_word) * template->t_n;
+    elemsize = x->a_elemsize;
 
     x->a_vec = (char *)resizebytes(x->a_vec, oldn * elemsize, n * elemsize);
     x->a_n = n;
-    if (n > oldn)
+    if (n > oldn && elemsize < (int)sizeof(t_word))
+    {
+            /* packed floats (see template_elemsize()); just zero them */
+        memset(x->a_vec + elemsize * oldn, 0, elemsize * (n - oldn));
+    }
+    else if (n > oldn)
     {
         char *cp = x->a_vec + elemsize * oldn;
         int i = n - oldn;
@@ -83,20 +97,86 @@ void array_resize_and_redraw(t_array *array, t_glist *glist, int n)
 
 void word_free(t_word *wp, t_template *template);
 
-void array_free(t_array *x)
+#ifdef GARRAY_MMAP
+    /* arrays mapped from files, so that garray_unmapfile() can find them
+    again by file */
+typedef struct _arraymap
+{
+    struct _arraymap *m_next;
+    t_array *m_array;
+    t_garray *m_garray;
+    dev_t m_dev;
+    ino_t m_ino;
+} t_arraymap;
+
+static t_arraymap *array_maplist;
+
+static void array_forgetmap(t_array *x)
+{
+    t_arraymap **mp, *m;
+    for (mp = &array_maplist; (m = *mp); mp = &m->m_next)
+        if (m->m_array == x)
+    {
+        *mp = m->m_next;
+        freebytes(m, sizeof(*m));
+        return;
+    }
+}
+#endif
+
+    /* free the elements; mapped arrays only hold floats so there's nothing
+    to free in them but the mapping itself */
+static void array_freevec(t_array *x)
 {
     int i;
     t_template *scalartemplate = template_findbyname(x->a_templatesym);
-    gstub_cutoff(x->a_stub);
+#ifdef GARRAY_MMAP
+    if (x->a_map)
+    {
+        array_forgetmap(x);
+        munmap(x->a_map, x->a_mapsize);
+        x->a_map = 0;
+        x->a_mapsize = 0;
+        return;
+    }
+#endif
     for (i = 0; i < x->a_n; i++)
     {
         t_word *wp = (t_word *)(x->a_vec + x->a_elemsize * i);
         word_free(wp, scalartemplate);
     }
     freebytes(x->a_vec, x->a_elemsize * x->a_n);
+}
+
+void array_free(t_array *x)
+{
+    gstub_cutoff(x->a_stub);
+    array_freevec(x);
     freebytes(x, sizeof *x);
 }
 
+    /* copy a file-mapped array into ordinary memory before anything tries
+    to resize it or change its template.  Until then, writes to the array
+    land in private copy-on-write pages and never reach the file. */
+void array_unmap(t_array *x)
+{
+    t_template *template;
+    int i, elemsize;
+    char *vec;
+    if (!x->a_map)
+        return;
+    template = template_findbyname(x->a_templatesym);
+    elemsize = template_elemsize(template);
+    vec = (char *)getbytes(x->a_n * elemsize);
+    for (i = 0; i < x->a_n; i++)
+        *(t_float *)(vec + elemsize * i) =
+            *(t_float *)(x->a_vec + x->a_elemsize * i);
+    array_freevec(x);
+    x->a_vec = vec;
+    x->a_elemsize = elemsize;
+    x->a_valid = ++glist_valid;
+}
+
 /* --------------------- graphical arrays (garrays) ------------------- */
 
 t_class *garray_class;
@@ -638,6 +718,7 @@ static void array_getrect(t_array *array, t_glist *glist,
         &elemtemplate, &elemsize, 0, 0, 0, &xonset, &yonset, &wonset))
     {
         int incr;
+        elemsize = array->a_elemsize;
             /* if it has more than 2000 points, just check 300 of them. */
         if (array->a_n < 2000)
             incr = 1;
@@ -728,7 +809,8 @@ void garray_savecontentsto(t_garray *x, t_binbuf *b)
                 chunk = ARRAYWRITECHUNKSIZE;
             binbuf_addv(b, "si", gensym("#A"), n2);
             for (i = 0; i < chunk; i++)
-                binbuf_addv(b, "f", ((t_word *)(array->a_vec))[n2+i].w_float);
+                binbuf_addv(b, "f", *(t_float *)(array->a_vec +
+                    array->a_elemsize * (n2+i)));
             binbuf_addv(b, ";");
             n2 += chunk;
         }
@@ -845,6 +927,13 @@ int garray_getfloatwords(t_garray *x, int *size, t_word **vec)
         error("%s: needs floating-point 'y' field", x->x_realname->s_name);
         return (0);
     }
+    else if (elemsize != sizeof(t_word) &&
+        (elemsize == sizeof(t_float) || a->a_map))
+    {
+        error("%s: packed or mapped array not supported here",
+            x->x_realname->s_name);
+        return (0);
+    }
     else if (elemsize != sizeof(t_word))
     {
         error("%s: has more than one field", x->x_realname->s_name);
@@ -854,13 +943,46 @@ int garray_getfloatwords(t_garray *x, int *size, t_word **vec)
     *vec =  (t_word *)garray_vec(x);
     return (1);
 }
-    /* older, non-64-bit safe version, supplied for older externs */
+
+    /* same, but also accepting packed arrays (see template_elemsize()) and
+    file-mapped ones (garray_mapfile()).  Point n is found at
+    (*vec)[n * *stride]; the stride is 1 for packed arrays, the number of
+    channels for mapped ones, and sizeof(t_word)/sizeof(t_float) otherwise. */
+
+int garray_getfloatvec(t_garray *x, int *size, t_float **vec, int *stride)
+{
+    int yonset, elemsize;
+    t_array *a = garray_getarray_floatonly(x, &yonset, &elemsize);
+    if (!a)
+    {
+        error("%s: needs floating-point 'y' field", x->x_realname->s_name);
+        return (0);
+    }
+    else if (elemsize != sizeof(t_word) && elemsize != sizeof(t_float) &&
+        !a->a_map)
+    {
+        error("%s: has more than one field", x->x_realname->s_name);
+        return (0);
+    }
+    *size = garray_npoints(x);
+    *vec = (t_float *)garray_vec(x);
+    *stride = elemsize / sizeof(t_float);
+    return (1);
+}
+
+    /* older, non-64-bit safe version, supplied for older externs.  This
+    works again when arrays are packed. */
 
 int garray_getfloatarray(t_garray *x, int *size, t_float **vec)
 {
+    int stride;
     if (sizeof(t_word) != sizeof(t_float))
     {
         t_symbol *patchname;
+        if (!garray_getfloatvec(x, size, vec, &stride))
+            return (0);
+        else if (stride == 1)
+            return (1);
         if (x->x_glist->gl_owner)
             patchname = x->x_glist->gl_owner->gl_name;
         else
@@ -1150,7 +1272,7 @@ static void garray_write(t_garray *x, t_symbol *filename)
     for (i = 0; i < array->a_n; i++)
     {
         if (fprintf(fd, "%g\n",
-            *(t_float *)(((array->a_vec + sizeof(t_word) * i)) + yonset)) < 1)
+            *(t_float *)(((array->a_vec + elemsize * i)) + yonset)) < 1)
         {
             post("%s: write error", filename->s_name);
             break;
@@ -1188,6 +1310,163 @@ void garray_resize(t_garray *x, t_floatarg f)
     garray_resize_long(x, f);
 }
 
+    /* replace the array's contents with "n" floats mapped from a file,
+    starting at byte "onset" and "stride" bytes apart, so that large sample
+    files can share the OS's page cache instead of being copied into the
+    heap.  The floats must be in native byte order.  This is used by
+    soundfiler's "read -map"; it returns 0 if the array can't be mapped, in
+    which case the caller should read the file the usual way. */
+int garray_mapfile(t_garray *x, int fd, long onset, long n, int stride)
+{
+#ifdef GARRAY_MMAP
+    t_array *array = garray_getarray(x);
+    t_template *template = template_findbyname(array->a_templatesym);
+    long pagesize = sysconf(_SC_PAGESIZE), mapbase;
+    size_t mapsize;
+    char *map;
+    int vis;
+    struct stat statbuf;
+    if (sizeof(t_float) != 4 || !template || template->t_n != 1 ||
+        template->t_vec[0].ds_type != DT_FLOAT || n < 1 || n > 0x7fffffff
+            || (onset & 3) || (stride & 3) || stride < 4 || pagesize <= 0)
+                return (0);
+    mapbase = onset - onset % pagesize;
+    mapsize = (onset - mapbase) + (size_t)(n - 1) * stride + sizeof(t_float);
+    if ((map = (char *)mmap(0, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+        fd, mapbase)) == MAP_FAILED)
+            return (0);
+    garray_fittograph(x, n, template_getfloat(
+        template_findbyname(x->x_scalar->sc_template),
+            gensym("style"), x->x_scalar->sc_vec, 1));
+    if ((vis = glist_isvisible(x->x_glist)))
+        gobj_vis(&x->x_scalar->sc_gobj, x->x_glist, 0);
+    array_freevec(array);
+    array->a_map = map;
+    array->a_mapsize = mapsize;
+    array->a_vec = map + (onset - mapbase);
+    array->a_n = n;
+    array->a_elemsize = stride;
+    array->a_valid = ++glist_valid;
+    if (!fstat(fd, &statbuf))
+    {
+        t_arraymap *m = (t_arraymap *)getbytes(sizeof(*m));
+        m->m_array = array;
+        m->m_garray = x;
+        m->m_dev = statbuf.st_dev;
+        m->m_ino = statbuf.st_ino;
+        m->m_next = array_maplist;
+        array_maplist = m;
+    }
+    if (vis)
+        gobj_vis(&x->x_scalar->sc_gobj, x->x_glist, 1);
+    if (x->x_usedindsp)
+        canvas_update_dsp();
+    return (1);
+#else
+    return (0);
+#endif
+}
+
+    /* copy every array mapped from the file "path" into ordinary memory.
+    The mappings are private, but pages not yet touched still come from the
+    file, so rewriting it would change the arrays behind our back and
+    shortening it would make reading them a bus error.  Everything in Pd
+    that writes a soundfile calls this before opening it; writers outside
+    Pd are still unsafe. */
+void garray_unmapfile(const char *path)
+{
+#ifdef GARRAY_MMAP
+    struct stat statbuf;
+    t_arraymap *m;
+    int usedindsp = 0;
+    if (!array_maplist || stat(path, &statbuf) < 0)
+        return;
+again:
+    for (m = array_maplist; m; m = m->m_next)
+        if (m->m_dev == statbuf.st_dev && m->m_ino == statbuf.st_ino)
+    {
+        usedindsp |= m->m_garray->x_usedindsp;
+        array_unmap(m->m_array);    /* this takes it off the list */
+        goto again;
+    }
+    if (usedindsp)
+        canvas_update_dsp();
+#endif
+}
+
+    /* allocate (zeroed) storage for "n" points laid out the way this array
+    wants them, so that another thread can fill it in and garray_adoptvec()
+    can later swap it in without copying.  As with garray_getfloatvec(),
+    point k goes at vec[k * *stride].  Returns 0 if the array isn't a plain
+    float array.  Free unused vectors with freebytes(vec,
+    n * *stride * sizeof(t_float)). */
+t_float *garray_allocvec(t_garray *x, long n, int *stride)
+{
+    t_array *array = garray_getarray(x);
+    t_template *template = template_findbyname(array->a_templatesym);
+    int elemsize;
+    if (!template || template->t_n != 1 ||
+        template->t_vec[0].ds_type != DT_FLOAT || n < 1 || n > 0x7fffffff)
+            return (0);
+    elemsize = template_elemsize(template);
+    *stride = elemsize / sizeof(t_float);
+    return ((t_float *)getbytes(n * elemsize));
+}
+
+    /* replace the array's contents with a vector from garray_allocvec(),
+    which the array then owns.  If the array's layout changed in the
+    meantime, return 0 and leave the vector to the caller. */
+int garray_adoptvec(t_garray *x, t_float *vec, long n, int stride)
+{
+    t_array *array = garray_getarray(x);
+    t_template *template = template_findbyname(array->a_templatesym);
+    int vis;
+    if (!template || template->t_n != 1 ||
+        template_elemsize(template) != stride * (int)sizeof(t_float))
+            return (0);
+    garray_fittograph(x, n, template_getfloat(
+        template_findbyname(x->x_scalar->sc_template),
+            gensym("style"), x->x_scalar->sc_vec, 1));
+    if ((vis = glist_isvisible(x->x_glist)))
+        gobj_vis(&x->x_scalar->sc_gobj, x->x_glist, 0);
+    array_freevec(array);
+    array->a_vec = (char *)vec;
+    array->a_n = n;
+    array->a_elemsize = stride * sizeof(t_float);
+    array->a_valid = ++glist_valid;
+    if (vis)
+        gobj_vis(&x->x_scalar->sc_gobj, x->x_glist, 1);
+    if (x->x_usedindsp)
+        canvas_update_dsp();
+    return (1);
+}
+
+    /* "prefetch <onset> <npoints>": hint that part of a mapped array will
+    be played soon so the OS can page it in ahead of the DSP thread.  With
+    no arguments, the whole array.  Does nothing to ordinary arrays. */
+static void garray_prefetch(t_garray *x, t_floatarg fonset, t_floatarg fn)
+{
+#ifdef GARRAY_MMAP
+    t_array *array = garray_getarray(x);
+    long pagesize = sysconf(_SC_PAGESIZE), onset = fonset, n = fn;
+    char *start, *end;
+    if (!array->a_map || pagesize <= 0)
+        return;
+    if (onset < 0)
+        onset = 0;
+    if (onset >= array->a_n)
+        return;
+    if (n <= 0 || n > array->a_n - onset)
+        n = array->a_n - onset;
+    start = array->a_vec + (size_t)onset * array->a_elemsize;
+    end = array->a_vec + (size_t)(onset + n - 1) * array->a_elemsize
+        + sizeof(t_float);
+    start = array->a_map + ((start - array->a_map) / pagesize) * pagesize;
+    if (madvise(start, end - start, MADV_WILLNEED) < 0)
+        post("%s: prefetch failed", x->x_realname->s_name);
+#endif
+}
+
 static void garray_print(t_garray *x)
 {
     t_array *array = garray_getarray(x);
@@ -1223,6 +1502,8 @@ void g_array_setup(void)
         A_FLOAT, A_NULL);
     class_addmethod(garray_class, (t_method)garray_print, gensym("print"),
         A_NULL);
+    class_addmethod(garray_class, (t_method)garray_prefetch,
+        gensym("prefetch"), A_DEFFLOAT, A_DEFFLOAT, A_NULL);
     class_addmethod(garray_class, (t_method)garray_sinesum, gensym("sinesum"),
         A_GIMME, 0);
     class_addmethod(garray_class, (t_method)garray_cosinesum,
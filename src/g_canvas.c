@@ -1085,8 +1085,10 @@ static void canvas_start_dsp(void)
     else sys_gui("pdtk_pd_dsp ON\n");
     ugen_start();
     
+    sys_profile_begin("dsp", "DSP sort");
     for (x = pd_getcanvaslist(); x; x = x->gl_next)
         canvas_dodsp(x, 1, 0);
+    sys_profile_end();
     
     canvas_dspstate = pd_this->pd_dspstate = 1;
 }
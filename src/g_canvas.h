@@ -225,6 +225,8 @@ struct _array
     int a_valid;        /* protection against stale pointers into array */
     t_gpointer a_gp;    /* pointer to scalar or array element we're in */
     t_gstub *a_stub;    /* stub for pointing into this array */
+    char *a_map;        /* if nonzero, a_vec points into this file mapping */
+    size_t a_mapsize;   /* ... of this many bytes (see garray_mapfile()) */
 };
 
     /* structure for traversing all the connections in a glist */
@@ -536,6 +538,7 @@ EXTERN t_garray *graph_array(t_glist *gl, t_symbol *s, t_symbol *tmpl,
 EXTERN t_array *array_new(t_symbol *templatesym, t_gpointer *parent);
 EXTERN void array_resize(t_array *x, int n);
 EXTERN void array_free(t_array *x);
+EXTERN void array_unmap(t_array *x);
 EXTERN void array_redraw(t_array *a, t_glist *glist);
 EXTERN void array_resize_and_redraw(t_array *array, t_glist *glist, int n);
 
@@ -578,6 +581,7 @@ EXTERN void template_free(t_template *x);
 EXTERN int template_match(t_template *x1, t_template *x2);
 EXTERN int template_find_field(t_template *x, t_symbol *name, int *p_onset,
     int *p_type, t_symbol **p_arraytype);
+EXTERN int template_elemsize(t_template *x);
 EXTERN t_float template_getfloat(t_template *x, t_symbol *fieldname, t_word *wp,
     int loud);
 EXTERN void template_setfloat(t_template *x, t_symbol *fieldname, t_word *wp,
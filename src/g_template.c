@@ -136,6 +136,22 @@ int template_find_field(t_template *x, t_symbol *name, int *p_onset,
     return (0);
 }
 
+int sys_packedarrays;   /* set by "-packedarrays" flag before anything loads */
+
+    /* size in bytes of an element of an array of this template.  Normally
+    each field takes a t_word, but if the "-packedarrays" flag was given,
+    arrays whose elements are a single float are stored as a plain vector
+    of t_float, which halves their memory footprint on 64-bit machines.  Any
+    code walking through an array must step by this (or a_elemsize), never
+    by sizeof(t_word).  Fields are still found at the onsets reported by
+    template_find_field() since a lone float field has onset zero. */
+int template_elemsize(t_template *x)
+{
+    if (sys_packedarrays && x->t_n == 1 && x->t_vec[0].ds_type == DT_FLOAT)
+        return (sizeof(t_float));
+    else return (x->t_n * sizeof(t_word));
+}
+
 t_float template_getfloat(t_template *x, t_symbol *fieldname, t_word *wp,
     int loud)
 {
@@ -328,29 +344,39 @@ static void template_conformarray(t_template *tfrom, t_template *tto,
     if (a->a_templatesym == tfrom->t_sym)
     {
         /* the array elements must all be conformed */
-        int oldelemsize = sizeof(t_word) * tfrom->t_n,
-            newelemsize = sizeof(t_word) * tto->t_n;
-        char *newarray = getbytes(newelemsize * a->a_n);
-        char *oldarray = a->a_vec;
+        int oldelemsize = template_elemsize(tfrom),
+            newelemsize = template_elemsize(tto);
+        char *newarray, *oldarray;
+        t_word *wfrom, *wto;
+        array_unmap(a);
+        newarray = getbytes(newelemsize * a->a_n);
+        oldarray = a->a_vec;
+            /* elements are swapped through full-sized scratch words since
+            either array might be packed (see template_elemsize()) */
+        wfrom = (t_word *)getbytes(sizeof(t_word) * tfrom->t_n);
+        wto = (t_word *)getbytes(sizeof(t_word) * tto->t_n);
         if (a->a_elemsize != oldelemsize)
             bug("template_conformarray");
         for (i = 0; i < a->a_n; i++)
         {
-            t_word *wp = (t_word *)(newarray + newelemsize * i);
-            word_init(wp, tto, &a->a_gp);
-            template_conformwords(tfrom, tto, conformaction,
-                (t_word *)(oldarray + oldelemsize * i), wp);
-            word_free((t_word *)(oldarray + oldelemsize * i), tfrom);
+            memcpy(wfrom, oldarray + oldelemsize * i, oldelemsize);
+            word_init(wto, tto, &a->a_gp);
+            template_conformwords(tfrom, tto, conformaction, wfrom, wto);
+            word_free(wfrom, tfrom);
+            memcpy(newarray + newelemsize * i, wto, newelemsize);
         }
+        freebytes(wfrom, sizeof(t_word) * tfrom->t_n);
+        freebytes(wto, sizeof(t_word) * tto->t_n);
         scalartemplate = tto;
         a->a_vec = newarray;
+        a->a_elemsize = newelemsize;
         freebytes(oldarray, oldelemsize * a->a_n);
     }
     else scalartemplate = template_findbyname(a->a_templatesym);
         /* convert all arrays and sublist fields in each element of the array */
     for (i = 0; i < a->a_n; i++)
     {
-        t_word *wp = (t_word *)(a->a_vec + sizeof(t_word) * a->a_n * i);
+        t_word *wp = (t_word *)(a->a_vec + a->a_elemsize * i);
         for (j = 0; j < scalartemplate->t_n; j++)
         {
             t_dataslot *ds = scalartemplate->t_vec + j;
@@ -1495,7 +1521,7 @@ int array_getfields(t_symbol *elemtemplatesym,
         error("plot: %s: no canvas for this template", elemtemplatesym->s_name);
         return (-1);
     }
-    elemsize = elemtemplate->t_n * sizeof(t_word);
+    elemsize = template_elemsize(elemtemplate);
     if (yfielddesc && yfielddesc->fd_var)
         varname = yfielddesc->fd_un.fd_varsym;
     else varname = gensym("y");
@@ -1558,6 +1584,7 @@ static void plot_getrect(t_gobj *z, t_glist *glist,
     {
             /* if it has more than 2000 points, just check 1000 of them. */
         int incr = (array->a_n <= 2000 ? 1 : array->a_n / 1000);
+        elemsize = array->a_elemsize;   /* might be file-mapped */
         for (i = 0, xsum = 0; i < array->a_n; i += incr)
         {
             t_float usexloc, useyloc;
@@ -1673,6 +1700,7 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                     return;
     nelem = array->a_n;
     elem = (char *)array->a_vec;
+    elemsize = array->a_elemsize;
 
     if (tovis)
     {
@@ -2040,6 +2068,7 @@ static int array_doclick_element(t_array *array, t_glist *glist,
         &elemtemplate, &elemsize, xfield, yfield, wfield,
             &xonset, &yonset, &wonset))
                 return (0);
+    elemsize = array->a_elemsize;
         /* if it has more than 2000 points, just check 300 of them. */
     if (array->a_n < 2000)
         incr = 1;
@@ -2081,6 +2110,7 @@ static int array_doclick(t_array *array, t_glist *glist, t_scalar *sc,
         t_float best = 100;
             /* if it has more than 2000 points, just check 1000 of them. */
         int incr = (array->a_n <= 2000 ? 1 : array->a_n / 1000);
+        elemsize = array->a_elemsize;
         array_motion_elemsize = elemsize;
         array_motion_glist = glist;
         array_motion_scalar = sc;
@@ -2093,7 +2123,7 @@ static int array_doclick(t_array *array, t_glist *glist, t_scalar *sc,
             call "motion" later. */
         if (glist->gl_list && pd_class(&glist->gl_list->g_pd) == garray_class
             && !glist->gl_list->g_next &&
-                elemsize == sizeof(t_word))
+                elemtemplate->t_n == 1)
         {
             int xval = glist_pixelstox(glist, xpix);
             if (xval < 0)
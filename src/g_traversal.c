@@ -827,9 +827,8 @@ static void elem_float(t_elem *x, t_float f)
         return;
     }
 
-    elemsize = elemtemplate->t_n * sizeof(t_word);
-
     array = *(t_array **)(((char *)w) + onset);
+    elemsize = array->a_elemsize;
 
     nitems = array->a_n;
     if (indx < 0) indx = 0;
@@ -1024,9 +1023,10 @@ static void setsize_float(t_setsize *x, t_float f)
         return;
     }
 
-    elemsize = elemtemplate->t_n * sizeof(t_word);
+    elemsize = template_elemsize(elemtemplate);
 
     array = *(t_array **)(((char *)w) + onset);
+    array_unmap(array);
 
     if (elemsize != array->a_elemsize) bug("setsize_gpointer");
 
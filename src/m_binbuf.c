@@ -5,6 +5,7 @@
 
 #include <stdlib.h>
 #include "m_pd.h"
+#include "m_imp.h"
 #include "s_stuff.h"
 #include <stdio.h>
 #include <errno.h>
@@ -17,23 +18,46 @@
 #include <fcntl.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(HAVE_UNISTD_H) && !defined(_WIN32)
+#include <sys/mman.h>
+#define BINBUF_MMAP
+#endif
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#endif
+#ifdef _MSC_VER
+#define snprintf sprintf_s
+#endif
+
+struct _dollcache;
 
 struct _binbuf
 {
     int b_n;
     t_atom *b_vec;
+    int b_neval;                    /* number of times evaluated */
+    struct _dollcache *b_dollcache; /* cache of expanded dollar symbols */
 };
 
+static void binbuf_freedollcache(t_binbuf *x);
+
 t_binbuf *binbuf_new(void)
 {
     t_binbuf *x = (t_binbuf *)t_getbytes(sizeof(*x));
     x->b_n = 0;
     x->b_vec = t_getbytes(0);
+    x->b_neval = 0;
+    x->b_dollcache = 0;
     return (x);
 }
 
 void binbuf_free(t_binbuf *x)
 {
+    binbuf_freedollcache(x);
     t_freebytes(x->b_vec, x->b_n * sizeof(*x->b_vec));
     t_freebytes(x,  sizeof(*x));
 }
@@ -41,6 +65,8 @@ void binbuf_free(t_binbuf *x)
 t_binbuf *binbuf_duplicate(t_binbuf *y)
 {
     t_binbuf *x = (t_binbuf *)t_getbytes(sizeof(*x));
+    x->b_neval = 0;
+    x->b_dollcache = 0;
     x->b_n = y->b_n;
     x->b_vec = t_getbytes(x->b_n * sizeof(*x->b_vec));
     memcpy(x->b_vec, y->b_vec, x->b_n * sizeof(*x->b_vec));
@@ -53,131 +79,327 @@ void binbuf_clear(t_binbuf *x)
     x->b_n = 0;
 }
 
+    /* parse one atom (other than a comma or semicolon) the slow way,
+    character by character, handling backslashes and atoms too long for
+    the buffer.  Returns the new text pointer. */
+static const char *binbuf_textatom(t_atom *ap, const char *textp,
+    const char *etext)
+{
+    char buf[MAXPDSTRING+1], *bufp, *ebuf = buf+MAXPDSTRING;
+    char c;
+    int floatstate = 0, slash = 0, lastslash = 0, dollar = 0;
+    bufp = buf;
+    do
+    {
+        c = *bufp = *textp++;
+        lastslash = slash;
+        slash = (c == '\\');
+
+        if (floatstate >= 0)
+        {
+            int digit = (c >= '0' && c <= '9'),
+                dot = (c == '.'), minus = (c == '-'),
+                plusminus = (minus || (c == '+')),
+                expon = (c == 'e' || c == 'E');
+            if (floatstate == 0)    /* beginning */
+            {
+                if (minus) floatstate = 1;
+                else if (digit) floatstate = 2;
+                else if (dot) floatstate = 3;
+                else floatstate = -1;
+            }
+            else if (floatstate == 1)   /* got minus */
+            {
+                if (digit) floatstate = 2;
+                else if (dot) floatstate = 3;
+                else floatstate = -1;
+            }
+            else if (floatstate == 2)   /* got digits */
+            {
+                if (dot) floatstate = 4;
+                else if (expon) floatstate = 6;
+                else if (!digit) floatstate = -1;
+            }
+            else if (floatstate == 3)   /* got '.' without digits */
+            {
+                if (digit) floatstate = 5;
+                else floatstate = -1;
+            }
+            else if (floatstate == 4)   /* got '.' after digits */
+            {
+                if (digit) floatstate = 5;
+                else if (expon) floatstate = 6;
+                else floatstate = -1;
+            }
+            else if (floatstate == 5)   /* got digits after . */
+            {
+                if (expon) floatstate = 6;
+                else if (!digit) floatstate = -1;
+            }
+            else if (floatstate == 6)   /* got 'e' */
+            {
+                if (plusminus) floatstate = 7;
+                else if (digit) floatstate = 8;
+                else floatstate = -1;
+            }
+            else if (floatstate == 7)   /* got plus or minus */
+            {
+                if (digit) floatstate = 8;
+                else floatstate = -1;
+            }
+            else if (floatstate == 8)   /* got digits */
+            {
+                if (!digit) floatstate = -1;
+            }
+        }
+        if (!lastslash && c == '$' && (textp != etext && 
+            textp[0] >= '0' && textp[0] <= '9'))
+                dollar = 1;
+        if (!slash) bufp++;
+        else if (lastslash)
+        {
+            bufp++;
+            slash = 0;
+        }
+    }
+    while (textp != etext && bufp != ebuf && 
+        (slash || (*textp != ' ' && *textp != '\n' && *textp != '\r'
+            && *textp != '\t' &&*textp != ',' && *textp != ';')));
+    *bufp = 0;
+#if 0
+    post("binbuf_text: buf %s", buf);
+#endif
+    if (floatstate == 2 || floatstate == 4 || floatstate == 5 ||
+        floatstate == 8)
+            SETFLOAT(ap, atof(buf));
+        /* LATER try to figure out how to mix "$" and "\$" correctly;
+        here, the backslashes were already stripped so we assume all
+        "$" chars are real dollars.  In fact, we only know at least one
+        was. */
+    else if (dollar)
+    {
+        if (buf[0] != '$') 
+            dollar = 0;
+        for (bufp = buf+1; *bufp; bufp++)
+            if (*bufp < '0' || *bufp > '9')
+                dollar = 0;
+        if (dollar)
+            SETDOLLAR(ap, atoi(buf+1));
+        else SETDOLLSYM(ap, gensym(buf));
+    }
+    else SETSYMBOL(ap, gensym(buf));
+    return (textp);
+}
+
+/* The tokenizer proper handles the common case of atoms without backslashes
+in a single pass over the text.  A table gives each character's class,
+which both ends the atom and drives the same float-recognizing state
+machine as binbuf_textatom() above.  Integers and plain decimals are
+converted directly (exactly as atof() would: a mantissa below 2^53 divided
+by an exact power of ten is correctly rounded); other floats go through
+atof().  Symbols are looked up first in a small cache that lasts one call,
+which catches the many repeats of "#X", "obj", "connect" and so on, and
+otherwise passed to gensym_hashed() with the hash computed while scanning.
+Anything unusual is handed back to binbuf_textatom(). */
+
+    /* character classes */
+#define TC_OTHER 0
+#define TC_DIGIT 1
+#define TC_DOT 2
+#define TC_MINUS 3
+#define TC_PLUS 4
+#define TC_EXPON 5
+#define TC_DOLLAR 6      /* classes below this can appear in atoms */
+#define TC_SLOW 7       /* backslash or null: use the slow path */
+#define TC_WHITE 8
+#define TC_SEMI 9
+#define TC_COMMA 10
+
+#define TS_FAIL 9       /* failed state of the float parser */
+
+static unsigned char binbuf_ctype[256];
+    /* float parser transitions, by state (as above) and class */
+static const signed char binbuf_fstate[10][TC_DOLLAR+1] = {
+/*        other    digit    dot      minus    plus     expon    dollar */
+/* 0 */ {TS_FAIL, 2,       3,       1,       TS_FAIL, TS_FAIL, TS_FAIL},
+/* 1 */ {TS_FAIL, 2,       3,       TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL},
+/* 2 */ {TS_FAIL, 2,       4,       TS_FAIL, TS_FAIL, 6,       TS_FAIL},
+/* 3 */ {TS_FAIL, 5,       TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL},
+/* 4 */ {TS_FAIL, 5,       TS_FAIL, TS_FAIL, TS_FAIL, 6,       TS_FAIL},
+/* 5 */ {TS_FAIL, 5,       TS_FAIL, TS_FAIL, TS_FAIL, 6,       TS_FAIL},
+/* 6 */ {TS_FAIL, 8,       TS_FAIL, 7,       7,       TS_FAIL, TS_FAIL},
+/* 7 */ {TS_FAIL, 8,       TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL},
+/* 8 */ {TS_FAIL, 8,       TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL},
+/* F */ {TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL, TS_FAIL},
+};
+#define TS_ISFLOAT(s) ((s) == 2 || (s) == 4 || (s) == 5 || (s) == 8)
+
+static const double binbuf_pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+    1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+    1e19, 1e20, 1e21, 1e22};
+
+static void binbuf_textinit(void)
+{
+    int i;
+    for (i = '0'; i <= '9'; i++)
+        binbuf_ctype[i] = TC_DIGIT;
+    binbuf_ctype['.'] = TC_DOT;
+    binbuf_ctype['-'] = TC_MINUS;
+    binbuf_ctype['+'] = TC_PLUS;
+    binbuf_ctype['e'] = binbuf_ctype['E'] = TC_EXPON;
+    binbuf_ctype['$'] = TC_DOLLAR;
+    binbuf_ctype['\\'] = binbuf_ctype[0] = TC_SLOW;
+    binbuf_ctype[' '] = binbuf_ctype['\n'] = binbuf_ctype['\r'] =
+        binbuf_ctype['\t'] = TC_WHITE;
+    binbuf_ctype[';'] = TC_SEMI;
+    binbuf_ctype[','] = TC_COMMA;
+}
+
+#define TEXTCACHESIZE 256
+#define TEXTGUESSMAX 65536  /* most atoms to allocate before we see them */
+
+    /* the symbol cache.  It's good for one call; rather than clearing it
+    each time, each call gets a new generation number and entries from
+    older generations are ignored. */
+typedef struct _textcache
+{
+    t_symbol *tc_sym;
+    unsigned int tc_hash;
+    int tc_length;
+    unsigned int tc_gen;
+} t_textcache;
+
+static t_textcache binbuf_textcache[TEXTCACHESIZE];
+static unsigned int binbuf_textgen;
+
     /* convert text to a binbuf */
 void binbuf_text(t_binbuf *x, char *text, size_t size)
 {
-    char buf[MAXPDSTRING+1], *bufp, *ebuf = buf+MAXPDSTRING;
-    const char *textp = text, *etext = text+size;
+    char buf[MAXPDSTRING+1];
+    const unsigned char *textp = (const unsigned char *)text,
+        *etext = textp + size;
     t_atom *ap;
-    int nalloc = 16, natom = 0;
+    int nalloc, natom = 0;
+    unsigned int gen;
+    static int initted;
+    if (!initted)
+        binbuf_textinit(), initted = 1;
+    if (!(gen = ++binbuf_textgen))     /* wrapped around: really clear it */
+    {
+        memset(binbuf_textcache, 0, sizeof(binbuf_textcache));
+        gen = binbuf_textgen = 1;
+    }
+        /* guess one atom per 6 characters, which is about right for
+        patches, up to TEXTGUESSMAX; past that the vector doubles as
+        needed.  It gets trimmed at the end. */
+    nalloc = (size < 6 * (size_t)TEXTGUESSMAX ? size / 6 : TEXTGUESSMAX)
+        + 16;
     t_freebytes(x->b_vec, x->b_n * sizeof(*x->b_vec));
     x->b_vec = t_getbytes(nalloc * sizeof(*x->b_vec));
     ap = x->b_vec;
     x->b_n = 0;
     while (1)
     {
-        int type;
             /* skip leading space */
-        while ((textp != etext) && (*textp == ' ' || *textp == '\n'
-            || *textp == '\r' || *textp == '\t')) textp++;
+        while (textp != etext && binbuf_ctype[*textp] == TC_WHITE)
+            textp++;
         if (textp == etext) break;
         if (*textp == ';') SETSEMI(ap), textp++;
         else if (*textp == ',') SETCOMMA(ap), textp++;
         else
         {
                 /* it's an atom other than a comma or semi */
-            char c;
-            int floatstate = 0, slash = 0, lastslash = 0, dollar = 0;
-            bufp = buf;
-            do
+            const unsigned char *start = textp;
+            unsigned int hash = 5381;
+            int state = 0, dollar = 0, cls, length;
+            while (textp != etext &&
+                (cls = binbuf_ctype[*textp]) <= TC_DOLLAR)
             {
-                c = *bufp = *textp++;
-                lastslash = slash;
-                slash = (c == '\\');
-
-                if (floatstate >= 0)
+                state = binbuf_fstate[state][cls];
+                    /* same hash as dogensym() (including sign extension
+                    of chars on platforms where char is signed) */
+                hash = ((hash << 5) + hash) + (char)*textp;
+                if (cls == TC_DOLLAR && textp + 1 != etext &&
+                    binbuf_ctype[textp[1]] == TC_DIGIT)
+                        dollar = 1;
+                textp++;
+            }
+            length = textp - start;
+            if ((textp != etext && cls == TC_SLOW) || length >= MAXPDSTRING)
+                textp = (const unsigned char *)binbuf_textatom(ap,
+                    (const char *)start, (const char *)etext);
+            else if (TS_ISFLOAT(state))
+            {
+                    /* fast path for integers and plain decimals */
+                const unsigned char *sp = start;
+                int neg = 0, ndigits = 0, nfrac = 0, infrac = 0;
+                double mantissa = 0;
+                if (*sp == '-')
+                    neg = 1, sp++;
+                for (; sp < textp; sp++)
                 {
-                    int digit = (c >= '0' && c <= '9'),
-                        dot = (c == '.'), minus = (c == '-'),
-                        plusminus = (minus || (c == '+')),
-                        expon = (c == 'e' || c == 'E');
-                    if (floatstate == 0)    /* beginning */
-                    {
-                        if (minus) floatstate = 1;
-                        else if (digit) floatstate = 2;
-                        else if (dot) floatstate = 3;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 1)   /* got minus */
-                    {
-                        if (digit) floatstate = 2;
-                        else if (dot) floatstate = 3;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 2)   /* got digits */
-                    {
-                        if (dot) floatstate = 4;
-                        else if (expon) floatstate = 6;
-                        else if (!digit) floatstate = -1;
-                    }
-                    else if (floatstate == 3)   /* got '.' without digits */
-                    {
-                        if (digit) floatstate = 5;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 4)   /* got '.' after digits */
-                    {
-                        if (digit) floatstate = 5;
-                        else if (expon) floatstate = 6;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 5)   /* got digits after . */
-                    {
-                        if (expon) floatstate = 6;
-                        else if (!digit) floatstate = -1;
-                    }
-                    else if (floatstate == 6)   /* got 'e' */
-                    {
-                        if (plusminus) floatstate = 7;
-                        else if (digit) floatstate = 8;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 7)   /* got plus or minus */
-                    {
-                        if (digit) floatstate = 8;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 8)   /* got digits */
+                    if (*sp == '.')
+                        infrac = 1;
+                    else if (binbuf_ctype[*sp] != TC_DIGIT)
+                        break;
+                    else
                     {
-                        if (!digit) floatstate = -1;
+                        mantissa = mantissa * 10 + (*sp - '0');
+                        nfrac += infrac;
+                        if (mantissa && ++ndigits > 15)
+                            break;
                     }
                 }
-                if (!lastslash && c == '$' && (textp != etext && 
-                    textp[0] >= '0' && textp[0] <= '9'))
-                        dollar = 1;
-                if (!slash) bufp++;
-                else if (lastslash)
+                if (sp == textp && nfrac <= 22)
                 {
-                    bufp++;
-                    slash = 0;
+                    mantissa /= binbuf_pow10[nfrac];
+                    SETFLOAT(ap, (neg ? -mantissa : mantissa));
                 }
-            }
-            while (textp != etext && bufp != ebuf && 
-                (slash || (*textp != ' ' && *textp != '\n' && *textp != '\r'
-                    && *textp != '\t' &&*textp != ',' && *textp != ';')));
-            *bufp = 0;
-#if 0
-            post("binbuf_text: buf %s", buf);
-#endif
-            if (floatstate == 2 || floatstate == 4 || floatstate == 5 ||
-                floatstate == 8)
+                else
+                {
+                    memcpy(buf, start, length);
+                    buf[length] = 0;
                     SETFLOAT(ap, atof(buf));
-                /* LATER try to figure out how to mix "$" and "\$" correctly;
-                here, the backslashes were already stripped so we assume all
-                "$" chars are real dollars.  In fact, we only know at least one
-                was. */
-            else if (dollar)
+                }
+            }
+            else
             {
-                if (buf[0] != '$') 
-                    dollar = 0;
-                for (bufp = buf+1; *bufp; bufp++)
-                    if (*bufp < '0' || *bufp > '9')
-                        dollar = 0;
+                t_textcache *tc =
+                    binbuf_textcache + (hash & (TEXTCACHESIZE-1));
+                t_symbol *sym;
+                memcpy(buf, start, length);
+                buf[length] = 0;
                 if (dollar)
+                {
+                    int i;
+                        /* "$" and digits only is a dollar, else a dollsym */
+                    if (buf[0] != '$')
+                        dollar = 2;
+                    for (i = 1; i < length; i++)
+                        if (buf[i] < '0' || buf[i] > '9')
+                            dollar = 2;
+                }
+                if (dollar == 1)
                     SETDOLLAR(ap, atoi(buf+1));
-                else SETDOLLSYM(ap, gensym(buf));
+                else
+                {
+                    if (tc->tc_gen == gen && tc->tc_hash == hash &&
+                        tc->tc_length == length &&
+                            !memcmp(tc->tc_sym->s_name, buf, length))
+                                sym = tc->tc_sym;
+                    else
+                    {
+                        sym = gensym_hashed(buf, length, hash);
+                        tc->tc_sym = sym;
+                        tc->tc_hash = hash;
+                        tc->tc_length = length;
+                        tc->tc_gen = gen;
+                    }
+                    if (dollar)
+                        SETDOLLSYM(ap, sym);
+                    else SETSYMBOL(ap, sym);
+                }
             }
-            else SETSYMBOL(ap, gensym(buf));
         }
         ap++;
         natom++;
@@ -564,6 +786,111 @@ done:
     return (gensym(buf2));
 }
 
+/* Binbufs that get evaluated repeatedly (message boxes, for instance) keep
+a small cache of the symbols their A_DOLLSYM atoms expanded to, so that
+"$1-foo" needn't be re-expanded and re-gensym'ed on every evaluation.  An
+entry is keyed on the unexpanded symbol, on the "tonew" flag and on the
+values of just those arguments (and $0) which the symbol refers to.  The
+cache is made on a binbuf's second evaluation, so that object boxes,
+which are usually evaluated only once, don't pay for it.  It holds no
+atom indices, so changes to the binbuf's contents can't make it stale. */
+
+#define DOLLCACHESIZE 8     /* entries per binbuf; power of 2 */
+#define DOLLCACHENARG 4     /* max number of $n in a cacheable symbol */
+
+typedef struct _dollcache
+{
+    t_symbol *dc_sym;       /* the unexpanded symbol, or 0 if unused */
+    t_symbol *dc_result;    /* what it expanded to */
+    int dc_tonew;
+    int dc_nargs;           /* number of $n referred to */
+    int dc_argno[DOLLCACHENARG];
+    t_atom dc_arg[DOLLCACHENARG];   /* their values (A_NULL if missing) */
+} t_dollcache;
+
+static void binbuf_freedollcache(t_binbuf *x)
+{
+    if (x->b_dollcache)
+        t_freebytes(x->b_dollcache, DOLLCACHESIZE * sizeof(t_dollcache));
+    x->b_dollcache = 0;
+}
+
+    /* find the value argument "argno" has in this evaluation */
+static void binbuf_dollarg(int argno, int ac, t_atom *av, t_atom *a)
+{
+    if (argno == 0)
+        SETFLOAT(a, canvas_getdollarzero());
+    else if (argno > 0 && argno <= ac)
+        *a = av[argno-1];
+    else a->a_type = A_NULL, a->a_w.w_index = 0;
+}
+
+    /* true if two atoms would expand to the same string */
+static int binbuf_sameatom(t_atom *a1, t_atom *a2)
+{
+    if (a1->a_type != a2->a_type)
+        return (0);
+    switch (a1->a_type)
+    {
+    case A_FLOAT:   /* compare bits, so that 0 and -0 differ */
+        return (!memcmp(&a1->a_w.w_float, &a2->a_w.w_float,
+            sizeof(t_float)));
+    case A_SYMBOL:
+    case A_DOLLSYM:
+        return (a1->a_w.w_symbol == a2->a_w.w_symbol);
+    case A_DOLLAR:
+        return (a1->a_w.w_index == a2->a_w.w_index);
+    default:        /* pointers etc. are printed without their value */
+        return (1);
+    }
+}
+
+static t_symbol *binbuf_realizedollsym_cached(t_binbuf *x, t_symbol *s,
+    int ac, t_atom *av, int tonew)
+{
+    t_dollcache *dc;
+    t_symbol *ret;
+    char *sp;
+    int i;
+    if (!x->b_dollcache)
+        return (binbuf_realizedollsym(s, ac, av, tonew));
+    dc = x->b_dollcache + ((((size_t)s) * 2654435761u >> 16) &
+        (DOLLCACHESIZE-1));
+    if (dc->dc_sym == s && dc->dc_tonew == tonew)
+    {
+        t_atom a;
+        for (i = 0; i < dc->dc_nargs; i++)
+        {
+            binbuf_dollarg(dc->dc_argno[i], ac, av, &a);
+            if (!binbuf_sameatom(&a, &dc->dc_arg[i]))
+                break;
+        }
+        if (i == dc->dc_nargs)
+            return (dc->dc_result);
+    }
+    if (!(ret = binbuf_realizedollsym(s, ac, av, tonew)))
+        return (0);
+        /* refill the entry, if the symbol doesn't refer to too many args */
+    dc->dc_sym = 0;
+    dc->dc_nargs = 0;
+    for (sp = s->s_name; (sp = strchr(sp, '$')); )
+    {
+        sp++;
+        if (*sp < '0' || *sp > '9')
+            continue;
+        if (dc->dc_nargs == DOLLCACHENARG)
+            return (ret);
+        dc->dc_argno[dc->dc_nargs] = atoi(sp);
+        binbuf_dollarg(dc->dc_argno[dc->dc_nargs], ac, av,
+            &dc->dc_arg[dc->dc_nargs]);
+        dc->dc_nargs++;
+    }
+    dc->dc_sym = s;
+    dc->dc_result = ret;
+    dc->dc_tonew = tonew;
+    return (ret);
+}
+
 #define SMALLMSG 5
 #define HUGEMSG 1000
 
@@ -596,6 +923,9 @@ void binbuf_eval(t_binbuf *x, t_pd *target, int argc, t_atom *argv)
     t_atom *at = x->b_vec;
     int ac = x->b_n;
     int nargs, maxnargs = 0;
+    if (x->b_neval < 2 && ++x->b_neval == 2)
+        x->b_dollcache = (t_dollcache *)t_getbytes(
+            DOLLCACHESIZE * sizeof(t_dollcache));
     if (ac <= SMALLMSG)
         mstack = smallstack;
     else
@@ -665,7 +995,7 @@ void binbuf_eval(t_binbuf *x, t_pd *target, int argc, t_atom *argv)
             }
             else if (at->a_type == A_DOLLSYM)
             {
-                if (!(s = binbuf_realizedollsym(at->a_w.w_symbol,
+                if (!(s = binbuf_realizedollsym_cached(x, at->a_w.w_symbol,
                     argc, argv, 0)))
                 {
                     error("$%s: not enough arguments supplied",
@@ -740,8 +1070,8 @@ void binbuf_eval(t_binbuf *x, t_pd *target, int argc, t_atom *argv)
                 }
                 break;
             case A_DOLLSYM:
-                s9 = binbuf_realizedollsym(at->a_w.w_symbol, argc, argv,
-                    target == &pd_objectmaker);
+                s9 = binbuf_realizedollsym_cached(x, at->a_w.w_symbol,
+                    argc, argv, target == &pd_objectmaker);
                 if (!s9)
                 {
                     error("%s: argument number out of range", at->a_w.w_symbol->s_name);
@@ -1445,6 +1775,336 @@ static t_binbuf *binbuf_convert(t_binbuf *oldb, int maxtopd)
     return (newb);
 }
 
+/* ------------- binary "precompiled" binbufs for fast loading ------------- */
+
+/* A binbuf can be saved in a compact binary form: a table of the distinct
+symbols it uses, followed by the atom types (one byte each) and their
+values (a t_float, or a 32-bit symbol or dollar index, each in a t_float
+sized slot).  Reading it back needs no tokenizing or float conversion and
+only one gensym() per distinct symbol.  The file records the size and
+modification time of the text file it was made from, so that a stale
+file can be detected, and the float size and byte order, since the
+format is only meant to be read back by the same build on the same
+machine.
+
+If Pd is started with "-patchcache <dir>", binbuf_evalfile() keeps such a
+file in that directory for each patch or abstraction it reads, and uses it
+instead of the text file as long as the text file hasn't changed. */
+
+#define BINBUF_MAGIC "PdBB"
+#define BINBUF_VERSION 1
+#define BINBUF_BYTEORDER 0x01020304
+#define BINBUF_ALIGN(n) (((n) + 7) & ~7)
+
+typedef struct _binbufheader
+{
+    char bh_magic[4];
+    unsigned int bh_version;
+    unsigned int bh_floatsize;
+    unsigned int bh_byteorder;
+    double bh_srcsize;          /* size and mtime of the source text file */
+    double bh_srcmtime;
+    unsigned int bh_nsym;       /* number of symbols in table */
+    unsigned int bh_strsize;    /* bytes of null-terminated symbol names */
+    unsigned int bh_natom;
+    unsigned int bh_pad;
+} t_binbufheader;
+
+typedef union _binbufvalue
+{
+    t_float bv_float;
+    int bv_int;
+} t_binbufvalue;
+
+t_symbol *sys_patchcachedir;
+
+    /* simple open hash table mapping symbols to their index in the file */
+typedef struct _binbufsymtab
+{
+    t_symbol **st_sym;
+    int *st_index;
+    int st_size;
+} t_binbufsymtab;
+
+static int binbuf_symtabindex(t_binbufsymtab *st, t_symbol *s, int *np)
+{
+    unsigned int h = (unsigned int)(((size_t)s) >> 3) & (st->st_size - 1);
+    while (st->st_sym[h] && st->st_sym[h] != s)
+        h = (h + 1) & (st->st_size - 1);
+    if (!st->st_sym[h])
+    {
+        st->st_sym[h] = s;
+        st->st_index[h] = (*np)++;
+    }
+    return (st->st_index[h]);
+}
+
+    /* write a binbuf in binary form.  "srcsize" and "srcmtime" identify
+    the text file it came from, if any. */
+int binbuf_write_binary(t_binbuf *x, const char *filename,
+    double srcsize, double srcmtime)
+{
+    t_binbufheader head;
+    t_binbufsymtab st;
+    t_symbol **symvec;
+    unsigned char *types;
+    t_binbufvalue *values;
+    int i, nsym = 0, ret = 1;
+    size_t strsize = 0, typesize = BINBUF_ALIGN(x->b_n);
+    FILE *f;
+
+    for (st.st_size = 64; st.st_size < 2 * x->b_n; st.st_size *= 2)
+        ;
+    st.st_sym = (t_symbol **)getbytes(st.st_size * sizeof(t_symbol *));
+    st.st_index = (int *)getbytes(st.st_size * sizeof(int));
+    types = (unsigned char *)getbytes(typesize);
+    values = (t_binbufvalue *)getbytes(x->b_n * sizeof(*values));
+    for (i = 0; i < x->b_n; i++)
+    {
+        t_atom *ap = x->b_vec + i;
+        types[i] = ap->a_type;
+        switch (ap->a_type)
+        {
+        case A_FLOAT:
+            values[i].bv_float = ap->a_w.w_float;
+            break;
+        case A_SYMBOL:
+        case A_DOLLSYM:
+            values[i].bv_int =
+                binbuf_symtabindex(&st, ap->a_w.w_symbol, &nsym);
+            break;
+        case A_DOLLAR:
+            values[i].bv_int = ap->a_w.w_index;
+            break;
+        case A_SEMI:
+        case A_COMMA:
+            break;
+        default:
+                /* pointers etc. can't be saved */
+            goto done;
+        }
+    }
+        /* put the symbols in index order */
+    symvec = (t_symbol **)getbytes((nsym ? nsym : 1) * sizeof(t_symbol *));
+    for (i = 0; i < st.st_size; i++)
+        if (st.st_sym[i])
+    {
+        symvec[st.st_index[i]] = st.st_sym[i];
+        strsize += strlen(st.st_sym[i]->s_name) + 1;
+    }
+    memset(&head, 0, sizeof(head));
+    memcpy(head.bh_magic, BINBUF_MAGIC, 4);
+    head.bh_version = BINBUF_VERSION;
+    head.bh_floatsize = sizeof(t_float);
+    head.bh_byteorder = BINBUF_BYTEORDER;
+    head.bh_srcsize = srcsize;
+    head.bh_srcmtime = srcmtime;
+    head.bh_nsym = nsym;
+    head.bh_strsize = BINBUF_ALIGN(strsize);
+    head.bh_natom = x->b_n;
+    if (!(f = sys_fopen(filename, "wb")))
+        goto freesyms;
+    if (fwrite(&head, sizeof(head), 1, f) < 1)
+        goto closeit;
+    for (i = 0; i < nsym; i++)
+        if (fwrite(symvec[i]->s_name, strlen(symvec[i]->s_name) + 1,
+            1, f) < 1)
+                goto closeit;
+    for (; strsize < head.bh_strsize; strsize++)
+        putc(0, f);
+    if ((typesize && fwrite(types, typesize, 1, f) < 1) ||
+        (x->b_n && fwrite(values, x->b_n * sizeof(*values), 1, f) < 1))
+            goto closeit;
+    ret = 0;
+closeit:
+    if (fclose(f) != 0)
+        ret = 1;
+freesyms:
+    freebytes(symvec, (nsym ? nsym : 1) * sizeof(t_symbol *));
+done:
+    freebytes(values, x->b_n * sizeof(*values));
+    freebytes(types, typesize);
+    freebytes(st.st_index, st.st_size * sizeof(int));
+    freebytes(st.st_sym, st.st_size * sizeof(t_symbol *));
+    return (ret);
+}
+
+    /* read a binary binbuf written by binbuf_write_binary().  If "srcsize"
+    is nonnegative, fail unless the file was made from a text file of the
+    given size and modification time.  Returns 0 on success. */
+int binbuf_read_binary(t_binbuf *x, const char *filename,
+    double srcsize, double srcmtime)
+{
+    int fd, i, ret = 1;
+    long length;
+    char *buf, *sp, *ep;
+    t_binbufheader head;
+    t_symbol **symvec = 0;
+    unsigned char *types;
+    t_binbufvalue *values;
+    t_atom *vec;
+#ifdef BINBUF_MMAP
+    int mapped = 0;
+#endif
+
+    if ((fd = sys_open(filename, 0)) < 0)
+        return (1);
+    if ((length = lseek(fd, 0, SEEK_END)) < (long)sizeof(head) ||
+        lseek(fd, 0, SEEK_SET) < 0)
+    {
+        close(fd);
+        return (1);
+    }
+#ifdef BINBUF_MMAP
+    if ((buf = (char *)mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0))
+        != MAP_FAILED)
+            mapped = 1;
+    else
+#endif
+    {
+        if (!(buf = t_getbytes(length)))
+        {
+            close(fd);
+            return (1);
+        }
+        if (read(fd, buf, length) < length)
+            goto fail;
+    }
+    memcpy(&head, buf, sizeof(head));
+    if (memcmp(head.bh_magic, BINBUF_MAGIC, 4) ||
+        head.bh_version != BINBUF_VERSION ||
+        head.bh_floatsize != sizeof(t_float) ||
+        head.bh_byteorder != BINBUF_BYTEORDER ||
+        (srcsize >= 0 && (head.bh_srcsize != srcsize ||
+            head.bh_srcmtime != srcmtime)) ||
+        (double)sizeof(head) + head.bh_strsize +
+            (double)BINBUF_ALIGN((size_t)head.bh_natom) +
+                (double)head.bh_natom * sizeof(*values) != length)
+                    goto fail;
+    sp = buf + sizeof(head);
+    ep = sp + head.bh_strsize;
+    types = (unsigned char *)ep;
+    values = (t_binbufvalue *)(types + BINBUF_ALIGN(head.bh_natom));
+    symvec = (t_symbol **)getbytes((head.bh_nsym ? head.bh_nsym : 1) *
+        sizeof(t_symbol *));
+    for (i = 0; i < (int)head.bh_nsym; i++)
+    {
+        char *s2 = memchr(sp, 0, ep - sp);
+        if (!s2)
+            goto fail;
+        symvec[i] = gensym(sp);
+        sp = s2 + 1;
+    }
+    vec = (t_atom *)t_getbytes(head.bh_natom * sizeof(t_atom));
+    for (i = 0; i < (int)head.bh_natom; i++)
+    {
+        t_binbufvalue v;
+        memcpy(&v, values + i, sizeof(v));
+        switch (types[i])
+        {
+        case A_FLOAT: SETFLOAT(vec+i, v.bv_float); break;
+        case A_SEMI: SETSEMI(vec+i); break;
+        case A_COMMA: SETCOMMA(vec+i); break;
+        case A_DOLLAR: SETDOLLAR(vec+i, v.bv_int); break;
+        case A_SYMBOL:
+        case A_DOLLSYM:
+            if (v.bv_int < 0 || v.bv_int >= (int)head.bh_nsym)
+            {
+                t_freebytes(vec, head.bh_natom * sizeof(t_atom));
+                goto fail;
+            }
+            if (types[i] == A_SYMBOL)
+                SETSYMBOL(vec+i, symvec[v.bv_int]);
+            else SETDOLLSYM(vec+i, symvec[v.bv_int]);
+            break;
+        default:
+            t_freebytes(vec, head.bh_natom * sizeof(t_atom));
+            goto fail;
+        }
+    }
+    t_freebytes(x->b_vec, x->b_n * sizeof(*x->b_vec));
+    x->b_vec = vec;
+    x->b_n = head.bh_natom;
+    ret = 0;
+fail:
+    if (symvec)
+        freebytes(symvec, (head.bh_nsym ? head.bh_nsym : 1) *
+            sizeof(t_symbol *));
+#ifdef BINBUF_MMAP
+    if (mapped)
+        munmap(buf, length);
+    else
+#endif
+    t_freebytes(buf, length);
+    close(fd);
+    return (ret);
+}
+
+    /* name of the cached binary version of a patch file, made from its
+    name and a hash of its full path so that files of the same name in
+    different directories don't collide.  Returns 0 if the name didn't
+    fit in the buffer. */
+static int binbuf_cachename(const char *filename, const char *dirname,
+    char *buf, int bufsize)
+{
+    unsigned int hash = 5381;
+    const char *sp, *base = strrchr(filename, '/');
+    base = (base ? base + 1 : filename);
+    for (sp = dirname; *sp; sp++)
+        hash = hash * 33 + (unsigned char)*sp;
+    hash = hash * 33 + '/';
+    for (sp = filename; *sp; sp++)
+        hash = hash * 33 + (unsigned char)*sp;
+    return (snprintf(buf, bufsize, "%s/%s-%08x.pdc",
+        sys_patchcachedir->s_name, base, hash) < bufsize);
+}
+
+    /* read a patch file, using (and refreshing) the binary cache if there
+    is one */
+static int binbuf_read_cached(t_binbuf *b, char *filename, char *dirname)
+{
+    char namebuf[MAXPDSTRING], cachebuf[MAXPDSTRING],
+        tmpbuf[MAXPDSTRING + 16];   /* cachebuf plus ".<pid>" */
+    struct stat statbuf;
+    if (!sys_patchcachedir)
+        return (binbuf_read(b, filename, dirname, 0));
+    snprintf(namebuf, MAXPDSTRING-1, "%s%s%s", dirname, (*dirname ? "/" : ""),
+        filename);
+    namebuf[MAXPDSTRING-1] = 0;
+    sys_bashfilename(namebuf, tmpbuf);
+    if (stat(tmpbuf, &statbuf) < 0)
+        return (binbuf_read(b, filename, dirname, 0));
+    if (!binbuf_cachename(filename, dirname, cachebuf, MAXPDSTRING))
+        return (binbuf_read(b, filename, dirname, 0));
+    if (!binbuf_read_binary(b, cachebuf, (double)statbuf.st_size,
+        (double)statbuf.st_mtime))
+    {
+        if (sys_verbose)
+            post("%s: read from %s", namebuf, cachebuf);
+        return (0);
+    }
+    if (binbuf_read(b, filename, dirname, 0))
+        return (1);
+        /* don't cache a file that might still be changing within the
+        resolution of its time stamp.  Write to a temporary file and rename
+        it so that another Pd never sees a half-written cache file. */
+    if (statbuf.st_mtime < time(0) - 1)
+    {
+        snprintf(tmpbuf, sizeof(tmpbuf), "%s.%d", cachebuf, (int)getpid());
+        if (binbuf_write_binary(b, tmpbuf, (double)statbuf.st_size,
+            (double)statbuf.st_mtime) || rename(tmpbuf, cachebuf) < 0)
+        {
+            static int warned;
+            if (!warned)
+                error("%s: couldn't write patch cache", cachebuf), warned = 1;
+            remove(tmpbuf);
+        }
+        else if (sys_verbose)
+            post("%s: cached in %s", namebuf, cachebuf);
+    }
+    return (0);
+}
+
 void pd_doloadbang(void);
 
 /* LATER make this evaluate the file on-the-fly. */
@@ -1457,8 +2117,9 @@ void binbuf_evalfile(t_symbol *name, t_symbol *dir)
     int dspstate = canvas_suspend_dsp();
         /* set filename so that new canvases can pick them up */
     glob_setfilename(0, name, dir);
-    if (binbuf_read(b, name->s_name, dir->s_name, 0))
-        error("%s: read failed; %s", name->s_name, strerror(errno));
+    if ((import ? binbuf_read(b, name->s_name, dir->s_name, 0) :
+        binbuf_read_cached(b, name->s_name, dir->s_name)))
+            error("%s: read failed; %s", name->s_name, strerror(errno));
     else
     {
             /* save bindings of symbols #N, #A (and restore afterward) */
@@ -487,18 +487,10 @@ t_propertiesfn class_getpropertiesfn(t_class *c)
 
 static t_symbol *symhash[HASHSIZE];
 
-t_symbol *dogensym(const char *s, t_symbol *oldsym)
+static t_symbol *dogensym_hashed(const char *s, int length,
+    unsigned int hash, t_symbol *oldsym)
 {
     t_symbol **sym1, *sym2;
-    unsigned int hash = 5381;
-    int length = 0;
-    const char *s2 = s;
-    while (*s2) /* djb2 hash algo */
-    {
-        hash = ((hash << 5) + hash) + *s2;
-        length++;
-        s2++;
-    }
     sym1 = symhash + (hash & (HASHSIZE-1));
     while (sym2 = *sym1)
     {
@@ -518,6 +510,27 @@ t_symbol *dogensym(const char *s, t_symbol *oldsym)
     return (sym2);
 }
 
+t_symbol *dogensym(const char *s, t_symbol *oldsym)
+{
+    unsigned int hash = 5381;
+    int length = 0;
+    const char *s2 = s;
+    while (*s2) /* djb2 hash algo */
+    {
+        hash = ((hash << 5) + hash) + *s2;
+        length++;
+        s2++;
+    }
+    return (dogensym_hashed(s, length, hash, oldsym));
+}
+
+    /* gensym() for callers such as binbuf_text() which have already found
+    the string's length and computed its hash as in dogensym() above */
+t_symbol *gensym_hashed(const char *s, int length, unsigned int hash)
+{
+    return (dogensym_hashed(s, length, hash, 0));
+}
+
 t_symbol *gensym(const char *s)
 {
     return(dogensym(s, 0));
@@ -576,7 +589,9 @@ void new_anything(void *dummy, t_symbol *s, int argc, t_atom *argv)
         {
             t_pd *was = s__X.s_thing;
             canvas_setargs(argc, argv);
+            sys_profile_begin("abstraction", s->s_name);
             binbuf_evalfile(gensym(nameptr), gensym(dirbuf));
+            sys_profile_end();
             if (s__X.s_thing && was != s__X.s_thing)
                 canvas_popabstraction((t_canvas *)(s__X.s_thing));
             else s__X.s_thing = was;
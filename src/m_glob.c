@@ -30,12 +30,20 @@ void glob_midi_dialog(t_pd *dummy, t_symbol *s, int argc, t_atom *argv);
 void glob_midi_setapi(t_pd *dummy, t_floatarg f);
 void glob_start_path_dialog(t_pd *dummy, t_floatarg flongform);
 void glob_path_dialog(t_pd *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_rescanpaths(t_pd *dummy);
 void glob_start_startup_dialog(t_pd *dummy, t_floatarg flongform);
 void glob_startup_dialog(t_pd *dummy, t_symbol *s, int argc, t_atom *argv);
 void glob_ping(t_pd *dummy);
 void glob_plugindispatch(t_pd *dummy, t_symbol *s, int argc, t_atom *argv);
 void glob_watchdog(t_pd *dummy);
 void glob_savepreferences(t_pd *dummy);
+void glob_flushdenormals(void *dummy, t_floatarg f);
+void glob_oscprecision(void *dummy, t_floatarg f);
+void glob_osctest(void *dummy);
+void glob_fastmath(void *dummy, t_floatarg f);
+void glob_cpufeatures(void *dummy);
+void glob_fastmathtest(void *dummy);
+void glob_ffttest(void *dummy);
 
 static void glob_helpintro(t_pd *dummy)
 {
@@ -159,6 +167,8 @@ void glob_init(void)
         gensym("start-path-dialog"), 0);
     class_addmethod(glob_pdobject, (t_method)glob_path_dialog,
         gensym("path-dialog"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_rescanpaths,
+        gensym("rescan-paths"), 0);
     class_addmethod(glob_pdobject, (t_method)glob_start_startup_dialog,
         gensym("start-startup-dialog"), 0);
     class_addmethod(glob_pdobject, (t_method)glob_startup_dialog,
@@ -172,6 +182,20 @@ void glob_init(void)
         gensym("perf"), A_FLOAT, 0);
     class_addmethod(glob_pdobject, (t_method)glob_compatibility,
         gensym("compatibility"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_flushdenormals,
+        gensym("flush-denormals"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_oscprecision,
+        gensym("osc-precision"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_osctest,
+        gensym("osc-test"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_fastmath,
+        gensym("fast-math"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_cpufeatures,
+        gensym("cpu-features"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_fastmathtest,
+        gensym("fast-math-test"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_ffttest,
+        gensym("fft-test"), 0);
     class_addmethod(glob_pdobject, (t_method)glob_plugindispatch,
         gensym("plugin-dispatch"), A_GIMME, 0);
     class_addmethod(glob_pdobject, (t_method)glob_helpintro,
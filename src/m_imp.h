@@ -79,6 +79,7 @@ extern t_pdinstance *pd_this;
 
 /* m_class.c */
 EXTERN void pd_emptylist(t_pd *x);
+EXTERN t_symbol *gensym_hashed(const char *s, int length, unsigned int hash);
 
 /* m_obj.c */
 EXTERN int obj_noutlets(t_object *x);
@@ -99,6 +100,12 @@ EXTERN int obj_nsigoutlets(t_object *x);
 EXTERN int obj_siginletindex(t_object *x, int m);
 EXTERN int obj_sigoutletindex(t_object *x, int m);
 
+/* m_binbuf.c */
+EXTERN int binbuf_write_binary(t_binbuf *x, const char *filename,
+    double srcsize, double srcmtime);
+EXTERN int binbuf_read_binary(t_binbuf *x, const char *filename,
+    double srcsize, double srcmtime);
+
 /* misc */
 EXTERN t_pd *glob_evalfile(t_pd *ignore, t_symbol *name, t_symbol *dir);
 EXTERN void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv);
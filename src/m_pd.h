@@ -610,6 +610,10 @@ EXTERN void mayer_fft(int n, t_sample *real, t_sample *imag);
 EXTERN void mayer_ifft(int n, t_sample *real, t_sample *imag);
 EXTERN void mayer_realfft(int n, t_sample *real);
 EXTERN void mayer_realifft(int n, t_sample *real);
+EXTERN void mayer_multirealfft(int n, int nchans, t_sample **in,
+    t_sample **re, t_sample **im);
+EXTERN void mayer_multirealifft(int n, int nchans, t_sample **re,
+    t_sample **im, t_sample **out);
 
 EXTERN float *cos_table;
 #define LOGCOSTABSIZE 9
@@ -668,6 +672,8 @@ EXTERN_STRUCT _garray;
 EXTERN t_class *garray_class;
 EXTERN int garray_getfloatarray(t_garray *x, int *size, t_float **vec);
 EXTERN int garray_getfloatwords(t_garray *x, int *size, t_word **vec);
+EXTERN int garray_getfloatvec(t_garray *x, int *size, t_float **vec,
+    int *stride);
 EXTERN void garray_redraw(t_garray *x);
 EXTERN int garray_npoints(t_garray *x);
 EXTERN char *garray_vec(t_garray *x);
@@ -675,6 +681,11 @@ EXTERN void garray_resize(t_garray *x, t_floatarg f);  /* avoid; use this: */
 EXTERN void garray_resize_long(t_garray *x, long n);   /* better version */
 EXTERN void garray_usedindsp(t_garray *x);
 EXTERN void garray_setsaveit(t_garray *x, int saveit);
+EXTERN int garray_mapfile(t_garray *x, int fd, long onset, long n,
+    int stride);
+EXTERN void garray_unmapfile(const char *path);
+EXTERN t_float *garray_allocvec(t_garray *x, long n, int *stride);
+EXTERN int garray_adoptvec(t_garray *x, t_float *vec, long n, int stride);
 EXTERN t_glist *garray_getglist(t_garray *x);
 EXTERN t_array *garray_getarray(t_garray *x);
 EXTERN t_class *scalar_class;
@@ -10,6 +10,7 @@
 # clean: clean everything
 # depend: c header dependencies
 # tags: tags file
+# neon-check: compile the NEON code paths with an ARM64 cross compiler
 # install: install to /usr/local (or elsewhere by setting "prefix" variable)
 #
 # You can get jack support ($ make -f makfile.gnu JACK=TRUE) or compile in
@@ -135,7 +136,7 @@ endif
 #  ------------------ targets ------------------------------------
 #
 
-.PHONY: pd externs all depend
+.PHONY: pd externs all depend neon-check
 
 all: pd $(BIN_DIR)/pd-watchdog $(BIN_DIR)/pdsend $(BIN_DIR)/pdreceive externs \
     makefile.dependencies
@@ -241,6 +242,20 @@ distclean: clean
 
 tags: $(SRC) $(GSRC); ctags *.[ch]
 
+# The NEON kernels are only compiled on ARM64 machines, so check them from
+# elsewhere with a cross compiler, e.g.:
+#   $ make -f makefile.gnu neon-check NEONCC=aarch64-linux-gnu-gcc
+NEONCC = aarch64-linux-gnu-gcc
+NEONSRC = d_arithmetic.c d_ctl.c d_filter.c d_fft_fftsg.c d_math.c d_osc.c \
+    d_soundfile.c d_ugen.c
+
+neon-check:
+	for i in $(NEONSRC); do \
+	    $(NEONCC) $(CPPFLAGS) $(CODECFLAGS) \
+	        -Werror=implicit-function-declaration -c -o /dev/null $$i \
+	        || exit 1; \
+	done
+
 depend: makefile.dependencies
 
 $(OBJ_DIR):
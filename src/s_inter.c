@@ -1316,6 +1316,7 @@ void sys_bail(int n)
 
 void glob_quit(void *dummy)
 {
+    sys_profile_finish();   /* in case we're asked to quit during startup */
     sys_close_audio();
     sys_close_midi();
     if (!sys_nogui)
@@ -277,8 +277,10 @@ int sys_load_lib(t_canvas *canvas, char *classname)
     int dspstate = canvas_suspend_dsp();
     int ok = 0;
     loader_queue_t *q;
+    sys_profile_begin("load", classname);
     for(q = &loaders; q; q = q->next)
         if (ok = q->loader(canvas, classname)) break;
+    sys_profile_end();
     canvas_resume_dsp(dspstate);
     return ok;
 }
@@ -179,6 +179,198 @@ int sys_fontheight(int fontsize)
 int sys_defaultfont;
 #define DEFAULTFONT 10
 
+/* ------------------------- startup profiling ---------------------------- */
+
+/* With "-startup-profile" (or "-startup-trace <file>") we time the phases of
+startup, every library load and every abstraction instantiation until
+audio and MIDI are open and the scheduler is about to start.  Intervals
+nest; for each one we record both the total ("inclusive") time and the
+time not spent in nested intervals ("self").  At the end we either print a
+report sorted by self time, or write a Chrome trace-event file which can be
+loaded into chrome://tracing or similar viewers.  With a GUI, the "-open"
+and "-send" arguments are only dealt with once the GUI has connected,
+which is after the scheduler has started; so run with -nogui to time
+those. */
+
+int sys_startupprofile;
+static char *sys_startuptrace;
+
+#define PROFILE_MAXDEPTH 64
+#define PROFILE_REPORTLINES 40
+
+typedef struct _profevent
+{
+    char *pe_name;
+    const char *pe_category;
+    double pe_start;            /* seconds since profiling started */
+    double pe_dur;              /* inclusive duration */
+    double pe_self;             /* duration minus nested events */
+    int pe_depth;
+} t_profevent;
+
+static t_profevent *profile_vec;
+static int profile_n, profile_alloc;
+static int profile_stack[PROFILE_MAXDEPTH];
+static int profile_depth;
+static double profile_starttime;
+
+void sys_profile_begin(const char *category, const char *name)
+{
+    t_profevent *pe;
+    if (!sys_startupprofile)
+        return;
+    if (!profile_alloc)
+        profile_starttime = sys_getrealtime();
+    if (profile_depth >= PROFILE_MAXDEPTH)
+    {
+        profile_depth++;    /* too deep; just keep track for sys_profile_end */
+        return;
+    }
+    if (profile_n == profile_alloc)
+    {
+        int newalloc = (profile_alloc ? 2 * profile_alloc : 256);
+        profile_vec = (t_profevent *)resizebytes(profile_vec,
+            profile_alloc * sizeof(*profile_vec),
+                newalloc * sizeof(*profile_vec));
+        profile_alloc = newalloc;
+    }
+    pe = profile_vec + profile_n;
+    pe->pe_name = (char *)getbytes(strlen(name) + 1);
+    strcpy(pe->pe_name, name);
+    pe->pe_category = category;
+    pe->pe_depth = profile_depth;
+    pe->pe_dur = pe->pe_self = 0;
+    profile_stack[profile_depth++] = profile_n++;
+    pe->pe_start = sys_getrealtime() - profile_starttime;
+}
+
+void sys_profile_end(void)
+{
+    t_profevent *pe;
+    if (!sys_startupprofile || !profile_depth)
+        return;
+    if (--profile_depth >= PROFILE_MAXDEPTH)
+        return;
+    pe = profile_vec + profile_stack[profile_depth];
+    pe->pe_dur = sys_getrealtime() - profile_starttime - pe->pe_start;
+    pe->pe_self += pe->pe_dur;
+    if (profile_depth)
+        profile_vec[profile_stack[profile_depth-1]].pe_self -= pe->pe_dur;
+}
+
+    /* events summed by name and category, for the report */
+typedef struct _profsum
+{
+    const char *ps_name;
+    const char *ps_category;
+    int ps_count;
+    double ps_dur;
+    double ps_self;
+} t_profsum;
+
+static int profile_sumcompare(const void *a, const void *b)
+{
+    double d = ((t_profsum *)b)->ps_self - ((t_profsum *)a)->ps_self;
+    return (d > 0 ? 1 : (d < 0 ? -1 : 0));
+}
+
+static void profile_report(void)
+{
+    t_profsum *sums = (t_profsum *)getbytes(profile_n * sizeof(*sums));
+    int i, j, nsums = 0;
+    double total = 0;
+    for (i = 0; i < profile_n; i++)
+    {
+        t_profevent *pe = profile_vec + i;
+        if (!pe->pe_depth)
+            total += pe->pe_dur;
+            /* linear search, but this only happens once */
+        for (j = 0; j < nsums; j++)
+            if (sums[j].ps_category == pe->pe_category &&
+                !strcmp(sums[j].ps_name, pe->pe_name))
+                    break;
+        if (j == nsums)
+        {
+            sums[j].ps_name = pe->pe_name;
+            sums[j].ps_category = pe->pe_category;
+            nsums++;
+        }
+        sums[j].ps_count++;
+        sums[j].ps_dur += pe->pe_dur;
+        sums[j].ps_self += pe->pe_self;
+    }
+    qsort(sums, nsums, sizeof(*sums), profile_sumcompare);
+    post("startup profile: %.1f msec in %d events", 1000. * total, profile_n);
+    post("    self ms   total ms  count  category     name");
+    for (i = 0; i < nsums && i < PROFILE_REPORTLINES; i++)
+        post("%11.2f %10.2f %6d  %-12s %s", 1000. * sums[i].ps_self,
+            1000. * sums[i].ps_dur, sums[i].ps_count, sums[i].ps_category,
+                sums[i].ps_name);
+    if (nsums > PROFILE_REPORTLINES)
+        post("... %d more", nsums - PROFILE_REPORTLINES);
+    freebytes(sums, profile_n * sizeof(*sums));
+}
+
+    /* write a string as a JSON string literal */
+static void profile_writestring(FILE *fd, const char *s)
+{
+    putc('"', fd);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(fd, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(fd, "\\u%04x", (unsigned char)*s);
+        else putc(*s, fd);
+    }
+    putc('"', fd);
+}
+
+static void profile_writetrace(const char *filename)
+{
+    int i;
+    FILE *fd = sys_fopen(filename, "w");
+    if (!fd)
+    {
+        error("%s: can't write startup trace", filename);
+        return;
+    }
+    fprintf(fd, "{\"traceEvents\":[\n");
+    for (i = 0; i < profile_n; i++)
+    {
+        t_profevent *pe = profile_vec + i;
+        fprintf(fd, "{\"name\":");
+        profile_writestring(fd, pe->pe_name);
+        fprintf(fd, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,"
+            "\"pid\":1,\"tid\":1}%s\n", pe->pe_category, 1e6 * pe->pe_start,
+                1e6 * pe->pe_dur, (i < profile_n - 1 ? "," : ""));
+    }
+    fprintf(fd, "],\"displayTimeUnit\":\"ms\"}\n");
+    if (fclose(fd) != 0)
+        error("%s: error writing startup trace", filename);
+    else post("startup trace written to %s", filename);
+}
+
+    /* called once startup is done: report and stop profiling */
+void sys_profile_finish(void)
+{
+    int i;
+    if (!sys_startupprofile)
+        return;
+    while (profile_depth)       /* close anything still open */
+        sys_profile_end();
+    sys_startupprofile = 0;     /* so that nothing more gets recorded */
+    if (sys_startuptrace)
+        profile_writetrace(sys_startuptrace);
+    else profile_report();
+    for (i = 0; i < profile_n; i++)
+        freebytes(profile_vec[i].pe_name, strlen(profile_vec[i].pe_name) + 1);
+    freebytes(profile_vec, profile_alloc * sizeof(*profile_vec));
+    profile_vec = 0;
+    profile_n = profile_alloc = 0;
+    sys_startupprofile = 0;
+}
+
 static void openit(const char *dirname, const char *filename)
 {
     char dirbuf[MAXPDSTRING], *nameptr;
@@ -187,7 +379,9 @@ static void openit(const char *dirname, const char *filename)
     if (fd >= 0)
     {
         close (fd);
+        sys_profile_begin("open", filename);
         glob_evalfile(0, gensym(nameptr), gensym(dirbuf));
+        sys_profile_end();
     }
     else
         error("%s: can't open", filename);
@@ -238,15 +432,20 @@ void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv)
             sys_fontlist[i].fi_height);
 #endif
         /* load dynamic libraries specified with "-lib" args */
+    sys_profile_begin("phase", "load -lib libraries");
     for  (nl = sys_externlist; nl; nl = nl->nl_next)
         if (!sys_load_lib(0, nl->nl_string))
             post("%s: can't load library", nl->nl_string);
+    sys_profile_end();
         /* open patches specifies with "-open" args */
+    sys_profile_begin("phase", "open patches");
     for  (nl = sys_openlist; nl; nl = nl->nl_next)
         openit(cwd, nl->nl_string);
+    sys_profile_end();
     namelist_free(sys_openlist);
     sys_openlist = 0;
         /* send messages specified with "-send" args */
+    sys_profile_begin("phase", "-send messages");
     for  (nl = sys_messagelist; nl; nl = nl->nl_next)
     {
         t_binbuf *b = binbuf_new();
@@ -254,6 +453,7 @@ void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv)
         binbuf_eval(b, 0, 0, 0);
         binbuf_free(b);
     }
+    sys_profile_end();
     namelist_free(sys_messagelist);
     sys_messagelist = 0;
 }
@@ -284,35 +484,71 @@ int sys_main(int argc, char **argv)
     pd_init();                                  /* start the message system */
     sys_findprogdir(argv[0]);                   /* set sys_progname, guipath */
     for (i = noprefs = 0; i < argc; i++)        /* prescan args for noprefs */
+    {
         if (!strcmp(argv[i], "-noprefs"))
             noprefs = 1;
+        else if (!strcmp(argv[i], "-startup-profile") ||
+            !strcmp(argv[i], "-startup-trace"))    /* and for profiling */
+                sys_startupprofile = 1;
+    }
+    sys_profile_begin("phase", "startup");
     if (!noprefs)
+    {
+        sys_profile_begin("phase", "load preferences");
         sys_loadpreferences();                  /* load default settings */
+        sys_profile_end();
+    }
 #ifndef _WIN32
     if (!noprefs)
+    {
+        sys_profile_begin("phase", "sys_rcfile");
         sys_rcfile();                           /* parse the startup file */
+        sys_profile_end();
+    }
 #endif
+    sys_profile_begin("phase", "parse arguments");
     if (sys_argparse(argc-1, argv+1))           /* parse cmd line */
         return (1);
     sys_afterargparse();                    /* post-argparse settings */
+    sys_profile_end();
     if (sys_verbose || sys_version) fprintf(stderr, "%s compiled %s %s\n",
         pd_version, pd_compiletime, pd_compiledate);
     if (sys_version)    /* if we were just asked our version, exit here. */
         return (0);
     sys_setsignalhandlers();
+        /* with -nogui, sys_startgui() only calls glob_initfromgui() to load
+        libraries and open patches, which are timed as phases of their own */
+    if (!sys_nogui)
+        sys_profile_begin("phase", "sys_startgui");
     if (sys_startgui(sys_libdir->s_name))       /* start the gui */
         return (1);
+    if (!sys_nogui)
+        sys_profile_end();
     if (sys_externalschedlib)
+    {
+        sys_profile_finish();
         return (sys_run_scheduler(sys_externalschedlibname,
             sys_extraflagsstring));
+    }
     else if (sys_batch)
+    {
+        sys_profile_finish();
         return (m_batchmain());
+    }
     else
     {
             /* open audio and MIDI */
+        sys_profile_begin("phase", "open MIDI");
         sys_reopen_midi();
+        sys_profile_end();
         if (audio_shouldkeepopen())
+        {
+            sys_profile_begin("phase", "open audio");
             sys_reopen_audio();
+            sys_profile_end();
+        }
+        sys_profile_end();      /* end of "startup" */
+        sys_profile_finish();
             /* run scheduler until it quits */
         return (m_mainloop());
     }
@@ -433,6 +669,16 @@ static char *(usagemessage[]) = {
 "-autopatch       -- enable auto-connecting new from selected objects (true by default)\n",
 "-noautopatch     -- defeat auto-patching new from selected objects\n",
 "-compatibility <f> -- set back-compatibility to version <f>\n",
+"-startup-profile -- time startup phases and print a report\n",
+"-startup-trace <file> -- same, but write a Chrome trace-event file\n",
+"-patchcache <dir> -- keep precompiled copies of patches in <dir>\n",
+"-packedarrays    -- store arrays of plain floats without per-point padding\n",
+"-nosimd          -- don't use vector instructions even if the CPU has them\n",
+"-avx512          -- use AVX-512 instructions where the CPU has them\n",
+"-flushdenormals  -- have the CPU flush tiny numbers to zero during DSP\n",
+"-oscprecision <n> -- 1 for precise polynomial phasor~, cos~ and osc~\n",
+"-fastmath        -- vectorized approximate mtof~, exp~, log~, pow~, etc.\n",
+"-diskthreads <n> -- number of threads serving readsf~ and writesf~\n",
 };
 
 static void sys_parsedevlist(int *np, int *vecp, int max, char *str)
@@ -1087,6 +1333,53 @@ int sys_argparse(int argc, char **argv)
         }
         else if (!strcmp(*argv, "-noprefs")) /* did this earlier */
             argc--, argv++;
+        else if (!strcmp(*argv, "-startup-profile")) /* this too */
+            argc--, argv++;
+        else if (!strcmp(*argv, "-patchcache") && argc > 1)
+        {
+            sys_patchcachedir = gensym(argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-packedarrays"))
+        {
+            sys_packedarrays = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-nosimd"))
+        {
+            sys_nosimd = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-avx512"))
+        {
+            sys_avx512 = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-flushdenormals"))
+        {
+            sys_flushdenormals = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-oscprecision") && argc > 1)
+        {
+            sys_oscprecision = atoi(argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-fastmath"))
+        {
+            sys_fastmath = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-diskthreads") && argc > 1)
+        {
+            sys_diskthreads = atoi(argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-startup-trace") && argc > 1)
+        {
+            sys_startuptrace = gensym(argv[1])->s_name;
+            argc -= 2; argv += 2;
+        }
         else
         {
             unsigned int i;
@@ -261,6 +261,232 @@ void sys_setextrapath(const char *p)
     sys_staticpath = namelist_append(sys_staticpath, p, 0);
 }
 
+/* ------------------- directory index for path searches ------------------ */
+
+/* Looking up an unknown class tries to open() every combination of search
+directory and filename extension, and nearly all of those attempts fail.
+To avoid the system calls we keep an index of the contents of each directory
+searched, read lazily the first time a directory is visited.  A name absent
+from the index is reported missing without touching the file system (so the
+index also serves as a negative lookup cache); names that are present still
+go through open() as before.  Names are compared case-insensitively and names
+with non-ASCII characters bypass the index, so that case-insensitive or
+Unicode-normalizing file systems can't cause a false miss.
+
+Each index is checked against its directory's modification time at most
+every PATHINDEX_RECHECK seconds.  All indices are rechecked at the next
+lookup whenever Pd itself creates a file, and are thrown away when the
+search path changes or when Pd gets the "rescan-paths" message. */
+
+#ifndef _WIN32
+#define PATHINDEX
+#endif
+
+#ifdef PATHINDEX
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+
+#define PATHINDEX_NHASH 64
+#define PATHINDEX_RECHECK 1.
+
+typedef struct _pathindex
+{
+    struct _pathindex *pi_next;
+    char *pi_dir;               /* directory, as passed to opendir() */
+    int pi_exists;              /* false if directory couldn't be read */
+    time_t pi_mtime;            /* directory's mtime when scanned */
+    time_t pi_scantime;         /* wall clock time when scanned */
+    double pi_checktime;        /* sys_getrealtime() of last mtime check */
+    int pi_nentries;
+    char **pi_entries;          /* sorted, compared case-insensitively */
+} t_pathindex;
+
+static t_pathindex *pathindex_hash[PATHINDEX_NHASH];
+static int pathindex_recheckall;
+    /* readsf~ opens files via the path from its own thread */
+static pthread_mutex_t pathindex_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int pathindex_compare(const void *a, const void *b)
+{
+    return (strcasecmp(*(char **)a, *(char **)b));
+}
+
+static void pathindex_clear(t_pathindex *pi)
+{
+    int i;
+    for (i = 0; i < pi->pi_nentries; i++)
+        freebytes(pi->pi_entries[i], strlen(pi->pi_entries[i]) + 1);
+    if (pi->pi_entries)
+        freebytes(pi->pi_entries, pi->pi_nentries * sizeof(char *));
+    pi->pi_entries = 0;
+    pi->pi_nentries = 0;
+}
+
+static void pathindex_scan(t_pathindex *pi)
+{
+    DIR *dir;
+    struct dirent *de;
+    struct stat statbuf;
+    int nalloc = 0;
+    pathindex_clear(pi);
+    pi->pi_scantime = time(0);
+    pi->pi_checktime = sys_getrealtime();
+    if (stat(pi->pi_dir, &statbuf) < 0 || !(dir = opendir(pi->pi_dir)))
+    {
+        pi->pi_exists = 0;
+        return;
+    }
+    pi->pi_exists = 1;
+    pi->pi_mtime = statbuf.st_mtime;
+    while ((de = readdir(dir)))
+    {
+        if (pi->pi_nentries == nalloc)
+        {
+            int newalloc = (nalloc ? 2 * nalloc : 64);
+            pi->pi_entries = (char **)resizebytes(pi->pi_entries,
+                nalloc * sizeof(char *), newalloc * sizeof(char *));
+            nalloc = newalloc;
+        }
+        pi->pi_entries[pi->pi_nentries] =
+            (char *)getbytes(strlen(de->d_name) + 1);
+        strcpy(pi->pi_entries[pi->pi_nentries], de->d_name);
+        pi->pi_nentries++;
+    }
+    closedir(dir);
+    if (nalloc > pi->pi_nentries)
+        pi->pi_entries = (char **)resizebytes(pi->pi_entries,
+            nalloc * sizeof(char *), pi->pi_nentries * sizeof(char *));
+    qsort(pi->pi_entries, pi->pi_nentries, sizeof(char *), pathindex_compare);
+    if (sys_verbose)
+        post("indexed %s (%d entries)", pi->pi_dir, pi->pi_nentries);
+}
+
+    /* find (or create) the index for a directory and bring it up to date */
+static t_pathindex *pathindex_get(const char *dirname)
+{
+    unsigned int hash = 5381;
+    const char *sp;
+    t_pathindex *pi;
+    double now;
+    for (sp = dirname; *sp; sp++)
+        hash = hash * 33 + (unsigned char)*sp;
+    hash %= PATHINDEX_NHASH;
+    for (pi = pathindex_hash[hash]; pi; pi = pi->pi_next)
+        if (!strcmp(pi->pi_dir, dirname))
+            break;
+    if (!pi)
+    {
+        pi = (t_pathindex *)getbytes(sizeof(*pi));
+        pi->pi_dir = (char *)getbytes(strlen(dirname) + 1);
+        strcpy(pi->pi_dir, dirname);
+        pi->pi_next = pathindex_hash[hash];
+        pathindex_hash[hash] = pi;
+        pathindex_scan(pi);
+        return (pi);
+    }
+    now = sys_getrealtime();
+    if (pathindex_recheckall ||
+        now - pi->pi_checktime > PATHINDEX_RECHECK || now < pi->pi_checktime)
+    {
+        struct stat statbuf;
+        int exists = (stat(dirname, &statbuf) >= 0);
+        pi->pi_checktime = now;
+            /* an mtime no older than the scan might hide a later change
+            within the same second, so rescan in that case too */
+        if (exists != pi->pi_exists || (exists &&
+            (statbuf.st_mtime != pi->pi_mtime ||
+                statbuf.st_mtime >= pi->pi_scantime)))
+                    pathindex_scan(pi);
+    }
+    return (pi);
+}
+
+    /* return false if "name" (which may include subdirectories) is known
+    not to exist in directory "dir" */
+static int pathindex_mayexist(const char *dir, const char *name)
+{
+    char first[MAXPDSTRING], *key = first;
+    const char *sp;
+    int i, found;
+    t_pathindex *pi;
+    for (i = 0, sp = name; *sp && *sp != '/' && i < MAXPDSTRING-1; i++, sp++)
+    {
+        if (*sp & 0x80)
+            return (1);
+        first[i] = *sp;
+    }
+    first[i] = 0;
+    if (!i || i == MAXPDSTRING-1 || !strcmp(first, ".") ||
+        !strcmp(first, ".."))
+            return (1);
+    pthread_mutex_lock(&pathindex_mutex);
+    if (pathindex_recheckall)
+    {
+        for (i = 0; i < PATHINDEX_NHASH; i++)
+            for (pi = pathindex_hash[i]; pi; pi = pi->pi_next)
+                pi->pi_checktime = -1e9;
+        pathindex_recheckall = 0;
+    }
+    pi = pathindex_get(*dir ? dir : ".");
+    found = (pi->pi_exists && pi->pi_nentries &&
+        bsearch(&key, pi->pi_entries, pi->pi_nentries, sizeof(char *),
+            pathindex_compare));
+    pthread_mutex_unlock(&pathindex_mutex);
+    return (found);
+}
+
+    /* called when Pd creates a file: recheck directories on next lookup */
+static void pathindex_touch(void)
+{
+    pathindex_recheckall = 1;
+}
+
+    /* forget all directory indices; they're rebuilt as needed */
+void sys_rescanpaths(void)
+{
+    int i;
+    t_pathindex *pi, *next;
+    pthread_mutex_lock(&pathindex_mutex);
+    for (i = 0; i < PATHINDEX_NHASH; i++)
+    {
+        for (pi = pathindex_hash[i]; pi; pi = next)
+        {
+            next = pi->pi_next;
+            pathindex_clear(pi);
+            freebytes(pi->pi_dir, strlen(pi->pi_dir) + 1);
+            freebytes(pi, sizeof(*pi));
+        }
+        pathindex_hash[i] = 0;
+    }
+    pathindex_recheckall = 0;
+    pthread_mutex_unlock(&pathindex_mutex);
+}
+
+#else /* PATHINDEX */
+
+static int pathindex_mayexist(const char *dir, const char *name)
+{
+    return (1);
+}
+
+static void pathindex_touch(void)
+{
+}
+
+void sys_rescanpaths(void)
+{
+}
+
+#endif /* PATHINDEX */
+
+void glob_rescanpaths(t_pd *dummy)
+{
+    sys_rescanpaths();
+    if (sys_verbose)
+        post("rescanning search paths");
+}
+
     /* try to open a file in the directory "dir", named "name""ext",
     for reading.  "Name" may have slashes.  The directory is copied to
     "dirresult" which must be at least "size" bytes.  "nameresult" is set
@@ -272,8 +498,9 @@ int sys_trytoopenone(const char *dir, const char *name, const char* ext,
     char *dirresult, char **nameresult, unsigned int size, int bin)
 {
     int fd;
-    char buf[MAXPDSTRING];
-    if (strlen(dir) + strlen(name) + strlen(ext) + 4 > size)
+    char buf[MAXPDSTRING], buf2[MAXPDSTRING];
+    if (strlen(dir) + strlen(name) + strlen(ext) + 4 > size ||
+        strlen(name) + strlen(ext) >= MAXPDSTRING)
         return (-1);
     sys_expandpath(dir, buf, MAXPDSTRING);
     strcpy(dirresult, buf);
@@ -283,6 +510,14 @@ int sys_trytoopenone(const char *dir, const char *name, const char* ext,
     strcat(dirresult, ext);
 
     DEBUG(post("looking for %s",dirresult));
+        /* skip the open() if the directory index says it would fail */
+    strcpy(buf2, name);
+    strcat(buf2, ext);
+    if (!pathindex_mayexist(buf, buf2))
+    {
+        if (sys_verbose) post("tried %s and failed (indexed)", dirresult);
+        return (-1);
+    }
         /* see if we can open the file for reading */
     if ((fd=sys_open(dirresult, O_RDONLY)) >= 0)
     {
@@ -455,6 +690,7 @@ int sys_open(const char *path, int oflag, ...)
         mode = (mode_t)imode;
         va_end(ap);
         fd = open(pathbuf, oflag, mode);
+        pathindex_touch();
     }
     else
         fd = open(pathbuf, oflag);
@@ -465,6 +701,8 @@ FILE *sys_fopen(const char *filename, const char *mode)
 {
   char namebuf[MAXPDSTRING];
   sys_bashfilename(filename, namebuf);
+  if (*mode != 'r')
+      pathindex_touch();
   return fopen(namebuf, mode);
 }
 #endif /* _WIN32 */
@@ -725,6 +963,7 @@ void glob_path_dialog(t_pd *dummy, t_symbol *s, int argc, t_atom *argv)
     int i;
     namelist_free(sys_searchpath);
     sys_searchpath = 0;
+    sys_rescanpaths();
     sys_usestdpath = atom_getintarg(0, argc, argv);
     sys_verbose = atom_getintarg(1, argc, argv);
     for (i = 0; i < argc-2; i++)
@@ -0,0 +1,46 @@
+/* Copyright (c) 1997-1999 Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* Which instruction sets the vector DSP kernels can be compiled for.  The
+kernels work on 32-bit floats, so with PD_FLOATSIZE 64 none is defined and
+only the C versions are built.  Compiling a kernel doesn't mean the CPU
+running it has the instructions: AVX2 and AVX-512 kernels are compiled
+with per-function target attributes (PD_SIMD_AVX2FN etc.) and are only
+chosen at run time if sys_getcpufeatures() says so.  SSE2 and NEON are
+part of the x86-64 and ARM64 baselines.
+
+PD_SIMD_AVX2FN also enables FMA, which lets the compiler fuse a multiply
+and an add into one rounding.  Kernels that have to round exactly like the
+C code they replace use PD_SIMD_AVX2NOFMAFN instead. */
+
+#ifndef S_SIMD_H
+#define S_SIMD_H
+
+#include "m_pd.h"
+
+#if PD_FLOATSIZE == 32
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PD_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(PD_SIMD_SSE2) && defined(__GNUC__)
+#define PD_SIMD_AVX2
+#define PD_SIMD_AVX2FN __attribute__((target("avx2,fma")))
+#define PD_SIMD_AVX2NOFMAFN __attribute__((target("avx2")))
+#define PD_SIMD_AVX512
+#define PD_SIMD_AVX512FN __attribute__((target("avx512f")))
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#define PD_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#endif /* PD_FLOATSIZE == 32 */
+
+#endif /* S_SIMD_H */
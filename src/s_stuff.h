@@ -29,6 +29,7 @@ int sys_open_absolute(const char *name, const char* ext,
 int sys_trytoopenone(const char *dir, const char *name, const char* ext,
     char *dirresult, char **nameresult, unsigned int size, int bin);
 t_symbol *sys_decodedialog(t_symbol *s);
+void sys_rescanpaths(void);
 
 /* s_file.c */
 
@@ -43,6 +44,58 @@ extern int sys_verbose;
 extern int sys_noloadbang;
 extern int sys_nogui;
 extern char *sys_guicmd;
+extern int sys_startupprofile;
+void sys_profile_begin(const char *category, const char *name);
+void sys_profile_end(void);
+void sys_profile_finish(void);
+
+/* m_binbuf.c */
+extern t_symbol *sys_patchcachedir;
+
+/* g_template.c */
+extern int sys_packedarrays;
+
+/* d_ugen.c */
+#define CPU_SSE2 1
+#define CPU_AVX2 2      /* AVX2 and FMA together */
+#define CPU_NEON 4
+#define CPU_AVX512 8    /* AVX-512F */
+extern int sys_nosimd;
+extern int sys_avx512;
+int sys_getcpufeatures(void);
+extern int sys_flushdenormals;
+int sys_denormalsflushed(void);
+int sys_infornan(const t_sample *vec, int n);
+
+/* d_soundfile.c */
+extern int sys_diskthreads;
+
+/* d_osc.c */
+extern int sys_oscprecision;
+
+/* d_math.c */
+extern int sys_fastmath;
+
+/* d_arithmetic.c */
+#define VEC_PLUS 0      /* out = in1 + in2 */
+#define VEC_MINUS 1     /* out = in1 - in2 */
+#define VEC_TIMES 2     /* out = in1 * in2 */
+#define VEC_OVER 3      /* out = in1 / in2, or 0 where in2 is 0 */
+#define VEC_MAX 4       /* out = max(in1, in2) */
+#define VEC_MIN 5       /* out = min(in1, in2) */
+#define VEC_COPY 6      /* out = in1 */
+#define VEC_ZERO 7      /* out = 0 */
+#define VEC_CATCH 8     /* out = in1, then in1 = 0 */
+#define VEC_THROW 9     /* out = in2 + in1, taking PD_BIGORSMALL in1 as 0 */
+#define VEC_NKERNELS 10
+typedef void (*t_veckernel)(t_sample *in1, t_sample *in2, t_sample *out,
+    int n);
+t_veckernel sys_getveckernel(int which);
+t_int *vec_perform(t_int *w);
+
+/* d_global.c */
+t_perfroutine sys_getcatchthrowperform(int which, t_sample *in,
+    t_sample *out, int n, t_int *w);
 
 EXTERN int sys_nearestfontsize(int fontsize);
 EXTERN int sys_hostfontsize(int fontsize);